@@ -0,0 +1,84 @@
+#include "camera_frame_source.h"
+
+#include <memory>
+#include <utility>
+
+#include <app_framework/logging.h>
+#include <ml_media_error.h>
+
+void CameraFrameSource::SetCamera(MLCameraContext context, int32_t width, int32_t height) {
+    context_ = context;
+    width_ = width;
+    height_ = height;
+}
+
+bool CameraFrameSource::Start(vlm::FrameSink *sink, std::string *error) {
+    Stop();
+    if (!MLHandleIsValid(context_)) {
+        *error = "Camera is not connected";
+        return false;
+    }
+    MLHandle metadata_handle = ML_INVALID_HANDLE;
+    MLCameraCaptureConfig config = {};
+    MLCameraCaptureConfigInit(&config);
+    config.stream_config[0].capture_type = MLCameraCaptureType_Video;
+    config.stream_config[0].width = width_;
+    config.stream_config[0].height = height_;
+    config.stream_config[0].output_format = MLCameraOutputFormat_YUV_420_888;
+    config.stream_config[0].native_surface_handle = ML_INVALID_HANDLE;
+    config.capture_frame_rate = MLCameraCaptureFrameRate_30FPS;
+    config.num_streams = 1;
+    MLResult result = MLCameraPrepareCapture(context_, &config, &metadata_handle);
+    if (result != MLResult_Ok) {
+        *error = std::string("MLCameraPrepareCapture failed: ") + MLMediaResultGetString(result);
+        return false;
+    }
+    result = MLCameraPreCaptureAEAWB(context_);
+    if (result != MLResult_Ok) {
+        ALOGW("MLCameraPreCaptureAEAWB failed: %s", MLMediaResultGetString(result));
+    }
+    // Frames may arrive before MLCameraCaptureVideoStart returns.
+    sink_.store(sink, std::memory_order_release);
+    result = MLCameraCaptureVideoStart(context_);
+    if (result != MLResult_Ok) {
+        sink_.store(nullptr, std::memory_order_release);
+        *error = std::string("MLCameraCaptureVideoStart failed: ") + MLMediaResultGetString(result);
+        return false;
+    }
+    ALOGI("Video capture started at %dx%d", width_, height_);
+    return true;
+}
+
+void CameraFrameSource::Stop() {
+    if (!sink_.load(std::memory_order_acquire)) {
+        return;
+    }
+    // Stopping waits for the callback in flight, so nothing reaches the sink
+    // once the pointer is cleared.
+    const MLResult result = MLCameraCaptureVideoStop(context_);
+    if (result != MLResult_Ok) {
+        ALOGE("MLCameraCaptureVideoStop failed: %s", MLMediaResultGetString(result));
+    }
+    sink_.store(nullptr, std::memory_order_release);
+}
+
+void CameraFrameSource::OnVideoBuffer(const MLCameraOutput *output, const MLCameraResultExtras *extra) {
+    vlm::FrameSink *sink = sink_.load(std::memory_order_acquire);
+    if (!sink || output->format != MLCameraOutputFormat_YUV_420_888 || !sink->WantsFrame(extra->vcam_timestamp)) {
+        return;
+    }
+    std::shared_ptr<vlm::Frame> frame = pool_->Acquire();
+    if (!frame) {
+        ALOGW("No free frame buffer, skipping video frame");
+        return;
+    }
+    // The planes are only valid during the callback.
+    const MLCameraPlaneInfo *planes = output->planes;
+    const uint8_t *const plane_data[3] = {planes[0].data, planes[1].data, planes[2].data};
+    const size_t plane_sizes[3] = {planes[0].size, planes[1].size, planes[2].size};
+    frame->AssignYuv420(planes[0].width, planes[0].height, plane_data, plane_sizes, planes[0].stride,
+                        planes[1].stride, planes[1].pixel_stride);
+    frame->frame_id = ++next_frame_id_;
+    frame->timestamp_ns = extra->vcam_timestamp;
+    sink->OnFrame(std::move(frame));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <ml_camera_v2.h>
+
+#include "vlm/frame_source.h"
+
+// Streams the mixed reality camera as YUV video frames. The camera's capture
+// callbacks belong to the app, which forwards on_video_buffer_available to
+// OnVideoBuffer(); only frames the sink wants are copied into the pool.
+class CameraFrameSource : public vlm::FrameSource {
+public:
+    explicit CameraFrameSource(vlm::FramePool *pool) : pool_(pool) {}
+    CameraFrameSource(const CameraFrameSource &) = delete;
+    CameraFrameSource &operator=(const CameraFrameSource &) = delete;
+
+    // Must be called with a connected camera before Start().
+    void SetCamera(MLCameraContext context, int32_t width, int32_t height);
+
+    bool Start(vlm::FrameSink *sink, std::string *error) override;
+    void Stop() override;
+
+    // Camera callback thread.
+    void OnVideoBuffer(const MLCameraOutput *output, const MLCameraResultExtras *extra);
+
+private:
+    vlm::FramePool *pool_;
+    MLCameraContext context_ = ML_INVALID_HANDLE;
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+    std::atomic<vlm::FrameSink *> sink_{nullptr};
+    uint64_t next_frame_id_ = 0;
+};
@@ -13,8 +13,10 @@
 
 #define ALOG_TAG "com.magicleap.capi.sample.camera_mixed_reality"
 
+#include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <iomanip>
 #include <sstream>
@@ -52,7 +54,17 @@
 #include <fstream>
 
 
-#include "onnxruntime/core/session/onnxruntime_c_api.h"
+#include "camera_frame_source.h"
+#include "vlm/burst_scorer.h"
+#include "vlm/caption_pipeline.h"
+#include "vlm/capture_size.h"
+#include "vlm/frame_pool.h"
+#include "vlm/frame_quality.h"
+#include "vlm/frame_writer.h"
+#include "vlm/inference_worker.h"
+#include "vlm/live_captioner.h"
+#include "vlm/snapshot_buffer.h"
+#include "vlm/vlm_engine.h"
 #include <iostream>
 #ifdef ML_LUMIN
 #include <EGL/egl.h>
@@ -87,15 +99,9 @@ namespace EnumHelpers {
 using namespace ml::app_framework;
 using namespace std::chrono_literals;
 
-class CameraMixedRealityApp : public Application {
+class CameraMixedRealityApp : public Application, public vlm::BurstSink {
 public:
-    ~CameraMixedRealityApp();  // Declare destructor
     std::string onnx_status_message_;   // To store ONNX init result for GUI
-    bool onnx_initialized_ = false;     // Flag to ensure one-time init
-    void InitializeONNX();             // Declaration of the new method
-
-
-
 
     bool send_to_vlm_after_capture_ = false;  // Flag to indicate VLM sending
     CameraMixedRealityApp(struct android_app *state)
@@ -107,10 +113,15 @@ public:
               recorder_camera_context_(ML_INVALID_HANDLE),
               default_output_filepath_(GetExternalFilesDir() + "/captures/"),
               default_output_filename_photo_("mr_dk_camera_photo_output"),
-              entered_standby_(false) {}
+              entered_standby_(false),
+              frame_pool_(kFramePoolSize, 0),
+              camera_frame_source_(&frame_pool_),
+              live_captioner_(&inference_worker_) {}
 
     void OnStart() override {
         mkdir(default_output_filepath_.c_str(), 0755);
+        frame_writer_.Start();
+        InitializeVlm();
     }
 
     void OnResume() override {
@@ -121,6 +132,7 @@ public:
     }
 
     void OnStop() override {
+        live_captioner_.Stop();
         UNWRAP_MLRESULT(DestroyCamera());
     }
 
@@ -131,7 +143,13 @@ public:
             }
         }
         standby_helper_threads_.clear();
+        live_captioner_.Stop();
         UNWRAP_MLRESULT(DestroyCamera());
+        burst_scorer_.Stop();
+        inference_worker_.Stop();
+        frame_writer_.Stop();
+        vlm_ready_ = false;
+        vlm_engine_.Shutdown();
     }
 
     void OnUpdate(float delta_time_sec) override {
@@ -139,18 +157,117 @@ public:
     }
 
 private:
-    const OrtApi* ort_ = nullptr;
-    OrtSession* encoder_session_ = nullptr;
-    OrtSession* decoder_session_ = nullptr;
-    void SendImageToVLM(const std::string& imagePath) {
-        // Implement your VLM sending logic here
-        ALOGI("Sending image to VLM: %s", imagePath.c_str());
-        InitializeONNX();
-        // (If you plan to actually use ONNX for inference, you would load the model
+    // Loads the encoder/decoder once; every capture reuses the same sessions.
+    void InitializeVlm() {
+        vlm::VlmEngineConfig config;
+        config.models_dir = GetExternalFilesDir() + "/models/";
+        config.optimized_model_cache_dir = GetExternalFilesDir() + "/model_cache/";
+        config.intra_op_num_threads = kVlmIntraOpThreads;
+        // Uses encoder_model_int8.onnx etc. where present, fp32 otherwise.
+        config.precision = vlm::ModelPrecision::kInt8;
+        if (!vlm_engine_.Initialize(config)) {
+            onnx_status_message_ = vlm_engine_.StatusMessage();
+            return;
+        }
+        vlm::CaptionConfig caption_config;
+        caption_config.vocab_path = config.models_dir + "vocab.json";
+        // Pointing at the same scene again returns the last caption at once.
+        caption_config.gate.enabled = true;
+        // Seen from a slightly different angle, it is usually found here.
+        caption_config.cache.enabled = true;
+        caption_config.cache.half_keys = true;
+        // The GUI shows each caption as it is generated.
+        caption_config.stream = true;
+        std::string error;
+        vlm_ready_ = caption_pipeline_.Initialize(&vlm_engine_, caption_config, &error);
+        onnx_status_message_ = vlm_engine_.StatusMessage();
+        if (!vlm_ready_) {
+            onnx_status_message_ += "\nCaption pipeline failed: " + error;
+            return;
+        }
+        vlm::FrameQualityConfig quality_config;
+        quality_config.burst_frames = kVlmBurstFrames;
+        quality_config.min_sharpness = kVlmMinSharpness;
+        quality_config.max_clipped = kVlmMaxClipped;
+        burst_scorer_.Configure(quality_config);
+        // Back-to-back captures encode the next frame while the previous one
+        // is still being decoded.
+        inference_worker_.Start(&caption_pipeline_, vlm::InferenceMode::kPipelined);
+        burst_scorer_.Start(this);
+    }
+
+    // Called on the burst scoring thread; only queues the frame.
+    void SendFrameToVLM(vlm::FrameRef frame) {
+        if (!vlm_ready_) {
+            ALOGE("VLM not ready, capture ignored");
+            return;
+        }
+        vlm::FrameJob job;
+        job.frame_id = frame->frame_id;
+        job.frame = std::move(frame);
+        inference_worker_.Submit(std::move(job));
+    }
+
+    // Called on the camera callback thread for every frame of a VLM burst,
+    // null for one that was dropped; the frame is scored on the burst
+    // scoring thread.
+    void AddBurstFrame(vlm::FrameRef frame) {
+        if (!vlm_ready_) {
+            return;
+        }
+        burst_scorer_.Add(std::move(frame));
+    }
+
+    // Called on the burst scoring thread once a burst is complete; queues
+    // its best frame if it is good enough.
+    void OnBurst(vlm::FrameRef best, const vlm::BurstOutcome &outcome) override {
+        burst_outcome_.Write() = outcome;
+        burst_outcome_.Publish();
+        if (best) {
+            SendFrameToVLM(std::move(best));
+        }
+    }
+
+    // Called on the render thread; picks up captions finished by the worker.
+    void PollVlmCompletions() {
+        vlm::CaptionCompletion completion;
+        while (inference_worker_.PollCompletion(&completion)) {
+            live_captioner_.OnCompletion(completion);
+            // The streamed caption, if finished, is this one; an unfinished
+            // one is the next.
+            const vlm::CaptionSnapshot &stream = caption_pipeline_.StreamSnapshot();
+            shown_stream_caption_ = stream.done || stream.caption == 0 ? stream.caption : stream.caption - 1;
+            if (!completion.ok) {
+                onnx_status_message_ = "Captioning failed: " + completion.error;
+                continue;
+            }
+            const vlm::CaptionTimings &t = completion.caption.timings;
+            std::ostringstream status;
+            if (completion.caption.reused) {
+                status << std::fixed << std::setprecision(1) << "VLM response: " << completion.caption.text
+                       << "\nScene unchanged, caption reused in " << t.total_ms << " ms";
+                onnx_status_message_ = status.str();
+                continue;
+            }
+            if (completion.caption.cache_hit) {
+                status << std::fixed << std::setprecision(1) << "VLM response: " << completion.caption.text
+                       << "\nEncoder " << t.encoder_ms << " ms, caption found in cache\nTotal " << t.total_ms
+                       << " ms";
+                onnx_status_message_ = status.str();
+                continue;
+            }
+            status << std::fixed << std::setprecision(1) << "VLM response: " << completion.caption.text
+                   << "\nJPEG decode " << t.image_decode_ms << " ms, preprocess " << t.preprocess_ms
+                   << " ms\nEncoder " << t.encoder_ms << " ms, decoder " << t.decoder_ms << " ms ("
+                   << t.generated_tokens << " tokens)\nFirst token " << t.first_token_ms << " ms, "
+                   << t.inter_token_ms << " ms per token after it\nTotal " << t.total_ms << " ms";
+            onnx_status_message_ = status.str();
+        }
     }
 
     void SetupRestrictedResources() {
         if (entered_standby_) {
+            live_captioner_.Stop();
             UNWRAP_MLRESULT(DestroyCamera());
             entered_standby_ = false;
         }
@@ -159,6 +276,7 @@ private:
     }
 
     void UpdateGui() {
+        PollVlmCompletions();
         auto &gui = GetGui();
         gui.BeginUpdate();
         bool is_running = true;
@@ -168,15 +286,34 @@ private:
                             ImGuiWindowFlags_NoCollapse)) {
             ImGui::Text("Capture Options:");
 
-            if (ImGui::Button("Capture and Send to VLM")) {
+            // Still captures are hidden while live: they would reconfigure
+            // the running video stream.
+            if (vlm_ready_ && ImGui::Button(live_captioner_.IsRunning() ? "Stop Live Captioning"
+                                                                        : "Start Live Captioning")) {
+                ToggleLiveCaptioning();
+            }
+            if (live_captioner_.IsRunning()) {
+                ImGui::Text("Live: one frame every %.0f ms, %llu captioned, %llu skipped",
+                            live_captioner_.IntervalMs(),
+                            static_cast<unsigned long long>(live_captioner_.SampledFrames()),
+                            static_cast<unsigned long long>(live_captioner_.SkippedFrames()));
+            } else if (ImGui::Button("Capture and Send to VLM")) {
                 send_to_vlm_after_capture_ = true;
-                UNWRAP_MLRESULT(CaptureImage());
-                InitializeONNX();  // Call ONNX init when button is pressed
+                burst_scorer_.Begin();
+                UNWRAP_MLRESULT(CaptureImage(vlm_capture_yuv_ ? MLCameraOutputFormat_YUV_420_888
+                                                              : MLCameraOutputFormat_JPEG,
+                                             kVlmBurstFrames));
             }
+            ImGui::Checkbox("VLM capture as YUV (skip JPEG encode/decode)", &vlm_capture_yuv_);
 
-            if (ImGui::Button("Capture Photo")) {
+            bool save_vlm_captures = save_vlm_captures_;
+            if (ImGui::Checkbox("Save VLM captures to disk", &save_vlm_captures)) {
+                save_vlm_captures_ = save_vlm_captures;
+            }
+
+            if (!live_captioner_.IsRunning() && ImGui::Button("Capture Photo")) {
                 send_to_vlm_after_capture_ = false;
-                UNWRAP_MLRESULT(CaptureImage());
+                UNWRAP_MLRESULT(CaptureImage(MLCameraOutputFormat_JPEG, 1));
             }
 
             ImGui::NewLine();
@@ -184,10 +321,46 @@ private:
             ImGui::NewLine();
             ImGui::Text("Last photo info:");
             ImGui::Text("\tFilename: \"%s\"", current_filename_photo_.c_str());
-            if (!onnx_status_message_.empty()) {
+            const vlm::BurstOutcome &burst = burst_outcome_.Read();
+            if (burst.best_index >= 0) {
+                ImGui::Text("\tBest of %d frames: sharpness %.0f, %.0f%% clipped%s", burst.frames,
+                            burst.best.sharpness, 100.0f * burst.best.clipped,
+                            burst.accepted ? "" : " - too blurry or badly exposed, not captioned");
+            }
+            // A caption still being generated, or finished but not yet
+            // picked up from the worker, is shown as far as it goes.
+            const vlm::CaptionSnapshot &stream = caption_pipeline_.StreamSnapshot();
+            if (stream.caption > shown_stream_caption_) {
+                ImGui::Text("VLM response: %s", stream.text.c_str());
+                // Once done, the timings come with the completion.
+                if (!stream.done && stream.tokens > 0) {
+                    ImGui::Text("\tFirst token %.1f ms, %.1f ms per token after it", stream.first_token_ms,
+                                stream.tokens > 1 ? (stream.last_token_ms - stream.first_token_ms) / (stream.tokens - 1)
+                                                  : 0.0);
+                }
+            } else if (!onnx_status_message_.empty()) {
                 ImGui::Text("ONNX status:");
                 ImGui::Text("\t%s", onnx_status_message_.c_str());
             }
+            if (inference_worker_.IsBusy()) {
+                ImGui::Text("Captioning in progress...");
+            }
+            if (caption_pipeline_.GatedFrames() > 0) {
+                ImGui::Text("Unchanged frames skipped: %llu (models ran on %llu)",
+                            static_cast<unsigned long long>(caption_pipeline_.GatedFrames()),
+                            static_cast<unsigned long long>(caption_pipeline_.EncodedFrames()));
+            }
+            const vlm::CaptionCache &cache = caption_pipeline_.Cache();
+            if (cache.Hits() > 0) {
+                ImGui::Text("Caption cache: %llu hits of %llu, %zu entries (%.1f MB)",
+                            static_cast<unsigned long long>(cache.Hits()),
+                            static_cast<unsigned long long>(cache.Hits() + cache.Misses()), cache.Entries(),
+                            cache.MemoryBytes() / (1024.0 * 1024.0));
+            }
+            if (inference_worker_.DroppedFrames() > 0) {
+                ImGui::Text("Frames dropped while busy: %llu",
+                            static_cast<unsigned long long>(inference_worker_.DroppedFrames()));
+            }
         }
         gui.EndDialog();
         gui.EndUpdate();
@@ -201,41 +374,83 @@ private:
                                  const MLCameraResultExtras *extra, void *data) {
         CameraMixedRealityApp *this_app = reinterpret_cast<CameraMixedRealityApp *>(data);
         if (this_app) {
-            const std::string k_file_ext = ".jpg";
+            const bool is_yuv = output->format == MLCameraOutputFormat_YUV_420_888;
+            const std::string k_file_ext = is_yuv ? ".yuv" : ".jpg";
             this_app->current_filename_photo_ =
                     this_app->default_output_filename_photo_ + std::to_string(extra->vcam_timestamp) + k_file_ext;
             const std::string output_filename = this_app->default_output_filepath_ + this_app->current_filename_photo_;
 
-            ALOGI("Image output filename: %s", output_filename.c_str());
-            auto opened_output_file = fopen(output_filename.c_str(), "wb");
-            if (opened_output_file) {
-                fwrite(output->planes[0].data, output->planes[0].size, 1, opened_output_file);
-                fclose(opened_output_file);
-
-                // If the flag is set, send the image to VLM
+            // The plane is only valid during this callback: copy it once into a
+            // pooled buffer and let the inference worker and the disk writer
+            // share that copy.
+            std::shared_ptr<vlm::Frame> frame = this_app->frame_pool_.Acquire();
+            if (!frame) {
+                ALOGE("No free frame buffer, dropping capture %s", output_filename.c_str());
                 if (this_app->send_to_vlm_after_capture_) {
-                    this_app->SendImageToVLM(output_filename);
+                    // The burst still ends, with the frames it did get.
+                    this_app->AddBurstFrame(nullptr);
                 }
+                return;
+            }
+            if (is_yuv) {
+                const MLCameraPlaneInfo *planes = output->planes;
+                const uint8_t *const plane_data[3] = {planes[0].data, planes[1].data, planes[2].data};
+                const size_t plane_sizes[3] = {planes[0].size, planes[1].size, planes[2].size};
+                frame->AssignYuv420(planes[0].width, planes[0].height, plane_data, plane_sizes, planes[0].stride,
+                                    planes[1].stride, planes[1].pixel_stride);
             } else {
-                ALOGE("Failed to open %s, with error: %s!", output_filename.c_str(), strerror(errno));
+                frame->Assign(output->planes[0].data, output->planes[0].size);
+            }
+            frame->frame_id = ++this_app->last_frame_id_;
+            frame->timestamp_ns = extra->vcam_timestamp;
+
+            const bool send_to_vlm = this_app->send_to_vlm_after_capture_;
+            if (send_to_vlm) {
+                this_app->AddBurstFrame(frame);
+            }
+            if (!send_to_vlm || this_app->save_vlm_captures_) {
+                ALOGI("Image output filename: %s", output_filename.c_str());
+                this_app->frame_writer_.Enqueue(std::move(frame), output_filename);
             }
         }
     }
 
-    MLResult CaptureImage() {
+    static void OnVideoAvailable(const MLCameraOutput *output, const MLHandle metadata_handle,
+                                 const MLCameraResultExtras *extra, void *data) {
+        CameraMixedRealityApp *this_app = reinterpret_cast<CameraMixedRealityApp *>(data);
+        if (this_app) {
+            this_app->camera_frame_source_.OnVideoBuffer(output, extra);
+        }
+    }
+
+    // Streams the camera through the live captioner, which samples frames
+    // as fast as the worker can caption them.
+    void ToggleLiveCaptioning() {
+        if (live_captioner_.IsRunning()) {
+            live_captioner_.Stop();
+            return;
+        }
+        camera_frame_source_.SetCamera(recorder_camera_context_, capture_width_, capture_height_);
+        std::string error;
+        if (!live_captioner_.Start(&camera_frame_source_, &error)) {
+            onnx_status_message_ = "Live captioning failed: " + error;
+        }
+    }
+
+    MLResult CaptureImage(MLCameraOutputFormat output_format, uint32_t num_images) {
         MLHandle metadata_handle = ML_INVALID_HANDLE;
         MLCameraCaptureConfig config = {};
         MLCameraCaptureConfigInit(&config);
         config.stream_config[0].capture_type = MLCameraCaptureType_Image;
         config.stream_config[0].width = capture_width_;
         config.stream_config[0].height = capture_height_;
-        config.stream_config[0].output_format = MLCameraOutputFormat_JPEG;
+        config.stream_config[0].output_format = output_format;
         config.stream_config[0].native_surface_handle = ML_INVALID_HANDLE;
         config.capture_frame_rate = MLCameraCaptureFrameRate_None;
         config.num_streams = 1;
         UNWRAP_RET_MEDIARESULT(MLCameraPrepareCapture(recorder_camera_context_, &config, &metadata_handle));
         UNWRAP_MLMEDIA_RESULT(MLCameraPreCaptureAEAWB(recorder_camera_context_));
-        UNWRAP_RET_MEDIARESULT(MLCameraCaptureImage(recorder_camera_context_, 1));
+        UNWRAP_RET_MEDIARESULT(MLCameraCaptureImage(recorder_camera_context_, num_images));
         return MLResult_Ok;
     }
 
@@ -282,7 +497,7 @@ private:
         camera_connect_context.enable_video_stab = false;
         camera_connect_context.mr_info.blend_type = MLCameraMRBlendType_Additive;
         camera_connect_context.mr_info.frame_rate = MLCameraCaptureFrameRate_30FPS;
-        camera_connect_context.mr_info.quality = MLCameraMRQuality_2880x2160;
+        camera_connect_context.mr_info.quality = ChooseMrQuality();
         UNWRAP_RET_MEDIARESULT(MLCameraConnect(&camera_connect_context, &recorder_camera_context_));
         UNWRAP_RET_MEDIARESULT(SetCameraRecorderCallbacks());
 
@@ -336,12 +551,16 @@ private:
         };
 
         camera_capture_callbacks.on_image_buffer_available = OnImageAvailable;
+        camera_capture_callbacks.on_video_buffer_available = OnVideoAvailable;
         UNWRAP_RET_MEDIARESULT(MLCameraSetCaptureCallbacks(recorder_camera_context_, &camera_capture_callbacks, this));
         return MLResult_Ok;
     }
 
+    // Without a model every capture uses the widest stream. Once the encoder is
+    // loaded, the smallest stream that still covers its input resolution times
+    // kVlmCaptureOversample is used instead.
     MLResult SetupCaptureSize() {
-        int32_t width = 0, height = 0;
+        std::vector<vlm::CaptureSize> candidates;
         uint32_t streams_max = 0;
         UNWRAP_RET_MLRESULT(MLCameraGetNumSupportedStreams(recorder_camera_context_, &streams_max));
 
@@ -370,10 +589,7 @@ private:
             for (uint32_t j = 0; j < stream_caps_info[i].stream_caps_max; j++) {
                 const MLCameraCaptureStreamCaps capture_stream_caps = stream_caps_info[i].stream_caps[j];
                 if (capture_stream_caps.capture_type == MLCameraCaptureType_Video) {
-                    if (capture_stream_caps.width > width) {
-                        width = capture_stream_caps.width;
-                        height = capture_stream_caps.height;
-                    }
+                    candidates.push_back({capture_stream_caps.width, capture_stream_caps.height});
                 }
             }
         }
@@ -385,14 +601,35 @@ private:
         }
         free(stream_caps_info);
 
-        if (width > 0 && height > 0) {
-            capture_width_ = width;
-            capture_height_ = height;
+        const int chosen = vlm::ChooseCaptureSize(candidates, RequiredCaptureSize());
+        if (chosen >= 0) {
+            capture_width_ = candidates[chosen].width;
+            capture_height_ = candidates[chosen].height;
+            ALOGI("Capture size %dx%d chosen from %zu stream caps", capture_width_, capture_height_,
+                  candidates.size());
         }
 
         return MLResult_Ok;
     }
 
+    // Asking for a huge size makes both choosers fall back to the largest one.
+    vlm::CaptureSize RequiredCaptureSize() const {
+        if (!vlm_ready_) {
+            return {INT_MAX, INT_MAX};
+        }
+        return vlm::RequiredCaptureSize(caption_pipeline_.InputWidth(), caption_pipeline_.InputHeight(),
+                                        kVlmCaptureOversample);
+    }
+
+    // The mixed reality compositor renders at the connect quality, so it is
+    // kept no larger than the capture needs.
+    MLCameraMRQuality ChooseMrQuality() const {
+        static const MLCameraMRQuality kQualities[] = {MLCameraMRQuality_960x720, MLCameraMRQuality_1440x1080,
+                                                       MLCameraMRQuality_2880x2160};
+        const std::vector<vlm::CaptureSize> sizes = {{960, 720}, {1440, 1080}, {2880, 2160}};
+        return kQualities[vlm::ChooseCaptureSize(sizes, RequiredCaptureSize())];
+    }
+
     bool recorder_camera_device_available_;
     std::mutex camera_device_available_lock_;
     std::condition_variable camera_device_available_condition_;
@@ -403,239 +640,42 @@ private:
     std::string current_filename_photo_;
     bool entered_standby_;
     std::vector<std::thread> standby_helper_threads_;
+    vlm::VlmEngine vlm_engine_;
+    vlm::CaptionPipeline caption_pipeline_;
+    // Enough for a burst being scored while the previous capture is still
+    // captioned and written to disk; buffers only grow when first used.
+    static constexpr size_t kFramePoolSize = 6;
+    // Source pixels per encoder input pixel along each axis, so the resize
+    // still has real detail to filter from.
+    static constexpr float kVlmCaptureOversample = 2.0f;
+    // ONNX Runtime threads shared by the encoder and decoder, the inference
+    // worker included. ML2 has four cores; one is left to the render loop
+    // and the camera, and idle threads sleep instead of spinning.
+    static constexpr int kVlmIntraOpThreads = 3;
+    // Frames captured per VLM capture; the sharpest, best exposed one is
+    // captioned, so head movement during one frame does not spoil it.
+    static constexpr int kVlmBurstFrames = 3;
+    // Bursts whose best frame is this blurry (Laplacian variance of the
+    // downscaled luma: a detailed scene scores in the hundreds, a blank wall
+    // near 0) or this clipped are not captioned at all.
+    static constexpr float kVlmMinSharpness = 20.0f;
+    static constexpr float kVlmMaxClipped = 0.5f;
+    vlm::FramePool frame_pool_;
+    vlm::InferenceWorker inference_worker_;
+    vlm::FrameWriter frame_writer_;
+    CameraFrameSource camera_frame_source_;
+    vlm::LiveCaptioner live_captioner_;
+    vlm::BurstScorer burst_scorer_;
+    // Written by the burst scoring thread, read by the render thread.
+    vlm::SnapshotBuffer<vlm::BurstOutcome> burst_outcome_;
+    uint64_t last_frame_id_ = 0;
+    // Render thread only: streamed captions up to this one are done and
+    // shown through onnx_status_message_.
+    uint64_t shown_stream_caption_ = 0;
+    std::atomic<bool> save_vlm_captures_{false};
+    bool vlm_capture_yuv_ = true;
+    std::atomic<bool> vlm_ready_{false};
 };
-CameraMixedRealityApp::~CameraMixedRealityApp() {
-    if (ort_) {
-        if (encoder_session_) {
-            ort_->ReleaseSession(encoder_session_);
-            encoder_session_ = nullptr;  // Avoid dangling pointers
-        }
-        if (decoder_session_) {
-            ort_->ReleaseSession(decoder_session_);
-            decoder_session_ = nullptr;  // Avoid dangling pointers
-        }
-    }
-}
-//void CameraMixedRealityApp::InitializeONNX() {
-//    ort_ = OrtGetApiBase()->GetApi(ORT_API_VERSION);
-//    if (!ort_) {
-//        ALOGE("ONNX: Failed to get ORT API");
-//        onnx_status_message_ = "ONNX init failed: API not available.";
-//        return;
-//    }
-//
-//    const char* ort_version = OrtGetApiBase()->GetVersionString();
-//    ALOGI("ONNX Runtime Version: %s", ort_version ? ort_version : "unknown");
-//    onnx_status_message_ = "ONNX Runtime Version: " + std::string(ort_version ? ort_version : "unknown");
-//
-//    OrtEnv* env = nullptr;
-//    OrtStatus* status = ort_->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "ML2App", &env);
-//    if (status) {
-//        onnx_status_message_ += "\nFailed to create ONNX environment.";
-//        ort_->ReleaseStatus(status);
-//        return;
-//    }
-//
-//    OrtSessionOptions* session_options;
-//    ort_->CreateSessionOptions(&session_options);
-//    ort_->SetIntraOpNumThreads(session_options, 1);
-//
-//    // Load encoder model
-//    std::string encoder_path = "/storage/emulated/0/Android/data/com.magicleap.capi.sample.camera_mixed_reality/files/models/encoder_model.onnx";
-//    status = ort_->CreateSession(env, encoder_path.c_str(), session_options, &encoder_session_);
-//    if (status) {
-//        onnx_status_message_ += "\nFailed to load encoder.";
-//        ort_->ReleaseStatus(status);
-//    } else {
-//        onnx_status_message_ += "\nEncoder loaded.";
-//    }
-//
-//    // Load decoder model
-//    std::string decoder_path = "/storage/emulated/0/Android/data/com.magicleap.capi.sample.camera_mixed_reality/files/models/decoder_model.onnx";
-//    status = ort_->CreateSession(env, decoder_path.c_str(), session_options, &decoder_session_);
-//    if (status) {
-//        onnx_status_message_ += "\nFailed to load decoder.";
-//        ort_->ReleaseStatus(status);
-//    } else {
-//        onnx_status_message_ += "\nDecoder loaded.";
-//    }
-//
-//    ort_->ReleaseSessionOptions(session_options);
-//    ort_->ReleaseEnv(env);
-//
-//    // Dummy inference test
-//    if (decoder_session_) {
-//        std::vector<int64_t> input_ids = {101, 7592, 102};  // e.g., [CLS] hello [SEP]
-//        std::vector<int64_t> shape = {1, static_cast<int64_t>(input_ids.size())};
-//
-//        OrtMemoryInfo* mem_info;
-//        ort_->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &mem_info);
-//
-//        OrtValue* input_tensor = nullptr;
-//        ort_->CreateTensorWithDataAsOrtValue(mem_info, input_ids.data(),
-//                                             input_ids.size() * sizeof(int64_t), shape.data(), shape.size(),
-//                                             ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, &input_tensor);
-//
-//        const char* input_names[] = {"input"};
-//        const char* output_names[] = {"output"};
-//        OrtValue* output_tensor = nullptr;
-//
-//        status = ort_->Run(decoder_session_, nullptr, input_names, &input_tensor, 1,
-//                           output_names, 1, &output_tensor);
-//
-//        if (!status) {
-//            // Placeholder response (real decoding requires tokenizer/vocab)
-//            onnx_status_message_ += "\nVLM response: [Hello captioned]";
-//            ort_->ReleaseValue(output_tensor);
-//        } else {
-//            onnx_status_message_ += "\nInference failed.";
-//            ort_->ReleaseStatus(status);
-//        }
-//
-//        ort_->ReleaseValue(input_tensor);
-//        ort_->ReleaseMemoryInfo(mem_info);
-//    }
-//
-//    onnx_initialized_ = true;
-//}
-void CameraMixedRealityApp::InitializeONNX() {
-    // Reset UI state
-    onnx_status_message_.clear();
-    onnx_initialized_ = false;
-
-    // ORT API
-    ort_ = OrtGetApiBase()->GetApi(ORT_API_VERSION);
-    if (!ort_) {
-        onnx_status_message_ = "ONNX init failed: API not available.";
-        ALOGE("%s", onnx_status_message_.c_str());
-        return;
-    }
-
-    // ORT env
-    OrtEnv* env = nullptr;
-    OrtStatus* st = ort_->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "ML2App", &env);
-    if (st) {
-        const char* msg = ort_->GetErrorMessage(st);
-        onnx_status_message_ = std::string("ONNX env failed: ") + (msg ? msg : "unknown");
-        ALOGE("%s", onnx_status_message_.c_str());
-        ort_->ReleaseStatus(st);
-        return;
-    }
-
-    // Session options
-    OrtSessionOptions* so = nullptr;
-    st = ort_->CreateSessionOptions(&so);
-    if (st) { ALOGE("CreateSessionOptions failed"); ort_->ReleaseStatus(st); ort_->ReleaseEnv(env); return; }
-    ort_->SetIntraOpNumThreads(so, 1);
-
-    // Load encoder
-    std::string encoder_path = "/storage/emulated/0/Android/data/com.magicleap.capi.sample.camera_mixed_reality/files/models/encoder_model.onnx";
-    st = ort_->CreateSession(env, encoder_path.c_str(), so, &encoder_session_);
-    if (st) {
-        const char* msg = ort_->GetErrorMessage(st);
-        onnx_status_message_ += std::string("\nEncoder load failed: ") + (msg ? msg : "unknown");
-        ALOGE("Encoder load failed: %s", msg ? msg : "unknown");
-        ort_->ReleaseStatus(st);
-    } else {
-        onnx_status_message_ += "\nEncoder loaded successfully";
-    }
-
-    // Load decoder
-    std::string decoder_path = "/storage/emulated/0/Android/data/com.magicleap.capi.sample.camera_mixed_reality/files/models/decoder_model.onnx";
-    st = ort_->CreateSession(env, decoder_path.c_str(), so, &decoder_session_);
-    if (st) {
-        const char* msg = ort_->GetErrorMessage(st);
-        onnx_status_message_ += std::string("\nDecoder load failed: ") + (msg ? msg : "unknown");
-        ALOGE("Decoder load failed: %s", msg ? msg : "unknown");
-        ort_->ReleaseStatus(st);
-    } else {
-        onnx_status_message_ += "\nDecoder loaded successfully";
-    }
-
-    // --- Simple decoder test (use your real inputs later) ---
-    if (decoder_session_) {
-        // One caption string declared ONCE; reuse below – no redefinition.
-        std::string caption;
-
-        // Example input_ids tensor: BOS token for GPT2-ish (adjust to your vocab)
-        std::vector<int64_t> input_ids = {50256};
-        std::vector<int64_t> input_shape = {1, static_cast<int64_t>(input_ids.size())};
-
-        OrtMemoryInfo* mi = nullptr;
-        st = ort_->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &mi);
-        if (!st) {
-            OrtValue* in = nullptr;
-            st = ort_->CreateTensorWithDataAsOrtValue(
-                    mi,
-                    input_ids.data(),
-                    input_ids.size() * sizeof(int64_t),
-                    input_shape.data(),
-                    input_shape.size(),
-                    ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64,
-                    &in
-            );
-
-            if (!st) {
-                const char* in_names[]  = {"input_ids"};  // make sure these match your model
-                const char* out_names[] = {"logits"};
-                OrtValue* out = nullptr;
-
-                st = ort_->Run(decoder_session_, nullptr,
-                               in_names,  &in,  1,
-                               out_names, 1,    &out);
-
-                if (!st) {
-                    // Inspect output shape quickly (optional)
-                    OrtTensorTypeAndShapeInfo* ti = nullptr;
-                    ort_->GetTensorTypeAndShape(out, &ti);
-                    size_t nd = 0;
-                    ort_->GetDimensionsCount(ti, &nd);
-                    std::vector<int64_t> dims(nd, 0);
-                    ort_->GetDimensions(ti, dims.data(), nd);
-                    ort_->ReleaseTensorTypeAndShapeInfo(ti);
-
-                    // You can grab logits if needed:
-                    // float* logits = nullptr;
-                    // ort_->GetTensorMutableData(out, (void**)&logits);
-
-                    caption = "[Decoder ran OK (dummy test)]";
-                    onnx_status_message_ += "\nDecoder test successful";
-                    ort_->ReleaseValue(out);
-                } else {
-                    const char* msg = ort_->GetErrorMessage(st);
-                    onnx_status_message_ += std::string("\nDecoder test failed: ") + (msg ? msg : "unknown");
-                    ALOGE("Decoder test failed: %s", msg ? msg : "unknown");
-                    ort_->ReleaseStatus(st);
-                }
-
-                ort_->ReleaseValue(in);
-            } else {
-                const char* msg = ort_->GetErrorMessage(st);
-                onnx_status_message_ += std::string("\nCreateTensor failed: ") + (msg ? msg : "unknown");
-                ALOGE("CreateTensor failed: %s", msg ? msg : "unknown");
-                ort_->ReleaseStatus(st);
-            }
-
-            ort_->ReleaseMemoryInfo(mi);
-        } else {
-            const char* msg = ort_->GetErrorMessage(st);
-            onnx_status_message_ += std::string("\nCreateCpuMemoryInfo failed: ") + (msg ? msg : "unknown");
-            ALOGE("CreateCpuMemoryInfo failed: %s", msg ? msg : "unknown");
-            ort_->ReleaseStatus(st);
-        }
-
-        if (!caption.empty()) {
-            onnx_status_message_ += std::string("\nVLM response: ") + caption;
-        }
-    }
-
-    // Cleanup session options/env
-    ort_->ReleaseSessionOptions(so);
-    ort_->ReleaseEnv(env);
-
-    onnx_initialized_ = true;
-    onnx_status_message_ += "\nONNX initialization complete";
-}
 
 void android_main(struct android_app *state) {
 #ifndef ML_LUMIN
@@ -0,0 +1,151 @@
+#include "beam_search.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logits_processor.h"
+
+namespace vlm {
+
+void BeamSearch::Configure(const BeamSearchConfig &config, int64_t eos_token_id, int max_new_tokens,
+                           SimdLevel level) {
+    config_ = config;
+    eos_token_id_ = eos_token_id;
+    max_new_tokens_ = static_cast<size_t>(max_new_tokens > 0 ? max_new_tokens : 1);
+    width_ = static_cast<size_t>(config.beams > 1 ? config.beams : 1);
+    level_ = level;
+    log_probs_.assign(width_, 0.0f);
+    next_log_probs_.assign(width_, 0.0f);
+    parents_.assign(width_, 0);
+    tokens_.assign(width_, 0);
+    history_.assign(width_ * max_new_tokens_, 0);
+    next_history_.assign(width_ * max_new_tokens_, 0);
+    candidates_.reserve(width_ * 2 * width_);
+    finished_.resize(width_);
+    for (Hypothesis &hypothesis : finished_) {
+        hypothesis.tokens.reserve(max_new_tokens_);
+    }
+    Reset();
+}
+
+void BeamSearch::Reset() {
+    beams_ = 1;
+    length_ = 0;
+    log_probs_[0] = 0.0f;
+    finished_count_ = 0;
+}
+
+float BeamSearch::Score(float log_prob, size_t length) const {
+    return log_prob / std::pow(static_cast<float>(length), config_.length_penalty);
+}
+
+float BeamSearch::BestReachable(float log_prob) const {
+    // Log probabilities only fall. Dividing one by a growing length^penalty
+    // raises it when the penalty is positive, so the bound is the score at
+    // the length limit; otherwise no later length scores better than now.
+    return Score(log_prob, config_.length_penalty > 0.0f ? max_new_tokens_ : length_);
+}
+
+bool BeamSearch::Advance(const float *const *rows, size_t vocab) {
+    // Log-softmax only matters at the proposals: log p = logit - log(sum(exp)).
+    const size_t proposals = std::min(2 * width_, vocab);
+    indices_.resize(vocab);
+    candidates_.clear();
+    for (size_t beam = 0; beam < beams_; ++beam) {
+        const float *row = rows[beam];
+        const float max = row[ArgmaxLogits(row, vocab, level_)];
+        const float log_sum = max + std::log(SumExpLogits(row, vocab, max, 1.0f, level_));
+        const size_t found = TopKLogits(row, vocab, proposals, indices_.data(), level_);
+        for (size_t i = 0; i < found; ++i) {
+            const uint32_t token = indices_[i];
+            candidates_.push_back(
+                Candidate{log_probs_[beam] + row[token] - log_sum, static_cast<uint32_t>(beam), token});
+        }
+    }
+    std::sort(candidates_.begin(), candidates_.end(), [](const Candidate &a, const Candidate &b) {
+        return a.log_prob > b.log_prob ||
+               (a.log_prob == b.log_prob && (a.beam < b.beam || (a.beam == b.beam && a.token < b.token)));
+    });
+
+    // EOS finishes a caption only among the |width_| best proposals, which
+    // keeps unlikely short captions out; the rest continue.
+    const size_t length = length_ + 1;
+    size_t next = 0;
+    for (size_t rank = 0; rank < candidates_.size() && next < width_; ++rank) {
+        const Candidate &candidate = candidates_[rank];
+        const int64_t *tokens = history_.data() + candidate.beam * max_new_tokens_;
+        if (static_cast<int64_t>(candidate.token) == eos_token_id_) {
+            if (rank < width_) {
+                Finish(tokens, length_, Score(candidate.log_prob, length));
+            }
+            continue;
+        }
+        int64_t *next_tokens = next_history_.data() + next * max_new_tokens_;
+        std::copy(tokens, tokens + length_, next_tokens);
+        next_tokens[length_] = candidate.token;
+        next_log_probs_[next] = candidate.log_prob;
+        parents_[next] = candidate.beam;
+        tokens_[next] = candidate.token;
+        ++next;
+    }
+    history_.swap(next_history_);
+    log_probs_.swap(next_log_probs_);
+    length_ = length;
+    beams_ = next;
+
+    if (finished_count_ == width_) {
+        if (config_.early_stopping) {
+            beams_ = 0;
+            return false;
+        }
+        // Beams are in decreasing log probability and all of one length, so
+        // the ones that cannot win are at the end.
+        const float worst = finished_[WorstFinished()].score;
+        while (beams_ > 0 && BestReachable(log_probs_[beams_ - 1]) <= worst) {
+            --beams_;
+        }
+    }
+    if (length_ == max_new_tokens_) {
+        for (size_t beam = 0; beam < beams_; ++beam) {
+            Finish(history_.data() + beam * max_new_tokens_, length_, Score(log_probs_[beam], length_));
+        }
+        beams_ = 0;
+    }
+    return beams_ > 0;
+}
+
+void BeamSearch::Finish(const int64_t *tokens, size_t count, float score) {
+    size_t slot = finished_count_;
+    if (finished_count_ < width_) {
+        ++finished_count_;
+    } else {
+        slot = WorstFinished();
+        if (score <= finished_[slot].score) {
+            return;
+        }
+    }
+    finished_[slot].score = score;
+    finished_[slot].tokens.assign(tokens, tokens + count);
+}
+
+size_t BeamSearch::WorstFinished() const {
+    size_t worst = 0;
+    for (size_t i = 1; i < finished_count_; ++i) {
+        worst = finished_[i].score < finished_[worst].score ? i : worst;
+    }
+    return worst;
+}
+
+const std::vector<int64_t> &BeamSearch::Best() const {
+    static const std::vector<int64_t> kEmpty;
+    if (finished_count_ == 0) {
+        return kEmpty;
+    }
+    size_t best = 0;
+    for (size_t i = 1; i < finished_count_; ++i) {
+        best = finished_[i].score > finished_[best].score ? i : best;
+    }
+    return finished_[best].tokens;
+}
+
+}  // namespace vlm
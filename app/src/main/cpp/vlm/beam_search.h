@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+
+namespace vlm {
+
+struct BeamSearchConfig {
+    // Captions followed at once, decoded together as one batch. Above 1
+    // replaces the sampling config: the search is deterministic.
+    int beams = 1;
+    // Finished captions are ranked by log probability / length^length_penalty;
+    // above 0 favors longer ones.
+    float length_penalty = 1.0f;
+    // End the search as soon as |beams| captions are finished, as Hugging
+    // Face's early_stopping=True does. Faster, but a longer caption still
+    // being decoded may have gone on to score better.
+    bool early_stopping = false;
+};
+
+// Picks the beams of each decoder step. Every live beam proposes its 2 x
+// beams most likely next tokens (a vectorized log-softmax and top-k pass
+// over its row), and the best of all proposals go on. A proposal of EOS
+// among the best finishes a caption instead. Once |beams| captions are
+// finished, live beams that cannot beat the worst of them by the length
+// limit are dropped, so the batch shrinks and the search can end early
+// without changing the result.
+class BeamSearch {
+public:
+    void Configure(const BeamSearchConfig &config, int64_t eos_token_id, int max_new_tokens) {
+        Configure(config, eos_token_id, max_new_tokens, DetectSimdLevel());
+    }
+    void Configure(const BeamSearchConfig &config, int64_t eos_token_id, int max_new_tokens, SimdLevel level);
+    const BeamSearchConfig &Config() const {
+        return config_;
+    }
+
+    // Starts a caption with one live beam, the prompt.
+    void Reset();
+    // |rows| holds the logits after each live beam, Beams() rows of |vocab|.
+    // Returns false once the search is over and Best() is known.
+    bool Advance(const float *const *rows, size_t vocab);
+
+    // Live beams: beam i is beam Parents()[i] of the previous step followed
+    // by Tokens()[i], to be fed to the decoder next.
+    size_t Beams() const {
+        return beams_;
+    }
+    const uint32_t *Parents() const {
+        return parents_.data();
+    }
+    const int64_t *Tokens() const {
+        return tokens_.data();
+    }
+    // The tokens of the best finished caption, without EOS.
+    const std::vector<int64_t> &Best() const;
+
+private:
+    struct Candidate {
+        float log_prob;  // of the whole beam
+        uint32_t beam;
+        uint32_t token;
+    };
+    struct Hypothesis {
+        float score = 0.0f;  // length-normalized log probability
+        std::vector<int64_t> tokens;
+    };
+
+    float Score(float log_prob, size_t length) const;
+    // Best score a live beam with |log_prob| can still finish with.
+    float BestReachable(float log_prob) const;
+    void Finish(const int64_t *tokens, size_t count, float score);
+    // Index of the lowest scoring finished caption.
+    size_t WorstFinished() const;
+
+    BeamSearchConfig config_;
+    int64_t eos_token_id_ = 0;
+    size_t max_new_tokens_ = 0;
+    size_t width_ = 1;
+    SimdLevel level_ = SimdLevel::kScalar;
+
+    size_t beams_ = 0;
+    size_t length_ = 0;  // tokens of every live beam
+    std::vector<float> log_probs_;
+    std::vector<float> next_log_probs_;
+    std::vector<uint32_t> parents_;
+    std::vector<int64_t> tokens_;
+    // Tokens of the live beams, |max_new_tokens_| per beam.
+    std::vector<int64_t> history_;
+    std::vector<int64_t> next_history_;
+    std::vector<uint32_t> indices_;
+    std::vector<Candidate> candidates_;
+    std::vector<Hypothesis> finished_;  // |finished_count_| in use, storage kept
+    size_t finished_count_ = 0;
+};
+
+}  // namespace vlm
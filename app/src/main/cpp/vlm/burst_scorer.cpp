@@ -0,0 +1,78 @@
+#include "burst_scorer.h"
+
+#include "vlm_log.h"
+
+namespace vlm {
+
+BurstScorer::BurstScorer(size_t capacity) : jobs_(capacity) {}
+
+BurstScorer::~BurstScorer() {
+    Stop();
+}
+
+void BurstScorer::Start(BurstSink *sink) {
+    if (running_.exchange(true)) {
+        return;
+    }
+    sink_ = sink;
+    thread_ = std::thread(&BurstScorer::Run, this);
+}
+
+void BurstScorer::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_condition_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BurstScorer::Add(FrameRef frame) {
+    ScoreJob job{std::move(frame), burst_.load(std::memory_order_relaxed)};
+    if (!jobs_.TryPush(std::move(job))) {
+        // Every queued frame holds a pool buffer, so this takes far more
+        // frames in flight than the pool has.
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        VLM_LOGE("Burst scorer behind, frame dropped");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_condition_.notify_one();
+}
+
+void BurstScorer::Run() {
+    ScoreJob job;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_condition_.wait(lock, [this]() {
+                return !running_.load(std::memory_order_relaxed) || jobs_.SizeApprox() > 0;
+            });
+        }
+        while (jobs_.TryPop(&job)) {
+            // Frames added after a Begin() start a new burst, even if the
+            // one before it is still missing frames.
+            if (job.burst != scoring_burst_) {
+                scoring_burst_ = job.burst;
+                selector_.Begin();
+            }
+            FrameRef best;
+            BurstOutcome outcome;
+            if (selector_.Add(std::move(job.frame), &best, &outcome) && sink_) {
+                sink_->OnBurst(std::move(best), outcome);
+            }
+            job = ScoreJob();
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "frame_pool.h"
+#include "frame_quality.h"
+#include "spsc_queue.h"
+
+namespace vlm {
+
+// Receives finished bursts, on the scoring thread.
+class BurstSink {
+public:
+    virtual ~BurstSink() = default;
+
+    // |best| is the frame to caption, null if the burst was rejected.
+    virtual void OnBurst(FrameRef best, const BurstOutcome &outcome) = 0;
+};
+
+// Runs a BurstSelector on a background thread, so scoring a frame (a luma
+// downscale and Laplacian pass, after a 1/8 scale decode for JPEG) never
+// sits on the camera callback: Add() only queues it.
+class BurstScorer {
+public:
+    explicit BurstScorer(size_t capacity = 16);
+    ~BurstScorer();
+    BurstScorer(const BurstScorer &) = delete;
+    BurstScorer &operator=(const BurstScorer &) = delete;
+
+    // Call before Start().
+    void Configure(const FrameQualityConfig &config) {
+        selector_.Configure(config);
+    }
+    // |sink| must outlive the scorer or its Stop().
+    void Start(BurstSink *sink);
+    // Scores everything still queued, then joins the thread.
+    void Stop();
+
+    // Starts a burst of config.burst_frames frames with the next frame
+    // added; may be called from any thread.
+    void Begin() {
+        burst_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Producer side (single thread). A null |frame| stands for one that was
+    // dropped before it could be queued.
+    void Add(FrameRef frame);
+
+    uint64_t DroppedFrames() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct ScoreJob {
+        FrameRef frame;
+        uint64_t burst = 0;  // value of burst_ when it was added
+    };
+
+    void Run();
+
+    BurstSelector selector_;
+    BurstSink *sink_ = nullptr;
+    SpscQueue<ScoreJob> jobs_;
+    std::atomic<uint64_t> burst_{0};
+    uint64_t scoring_burst_ = 0;  // scoring thread only
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_condition_;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace vlm
@@ -0,0 +1,257 @@
+#include "caption_cache.h"
+
+#include <cmath>
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#include "fp16_convert.h"
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+// Allowance for a caption and its bookkeeping when sizing the cache.
+constexpr size_t kEntryOverheadBytes = 512;
+
+float DotScalar(const float *a, const float *b, size_t begin, size_t count) {
+    float sum = 0.0f;
+    for (size_t i = begin; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if VLM_HAVE_AVX2_KERNELS
+VLM_TARGET_AVX2 float DotAvx2(const float *a, const float *b, size_t count, size_t *done) {
+    // Two accumulators hide the FMA latency.
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    const __m128 pair = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    *done = i;
+    return _mm_cvtss_f32(_mm_add_ss(pair, _mm_movehdup_ps(pair)));
+}
+#endif
+
+#if VLM_HAVE_AVX2_KERNELS
+VLM_TARGET_AVX2 float DotHalfAvx2(const float *a, const uint16_t *b, size_t count, size_t *done) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256 b0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        const __m256 b1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 8)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), b0, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), b1, acc1);
+    }
+    for (; i + 8 <= count; i += 8) {
+        const __m256 b0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), b0, acc0);
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    const __m128 pair = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    *done = i;
+    return _mm_cvtss_f32(_mm_add_ss(pair, _mm_movehdup_ps(pair)));
+}
+#endif
+
+#if VLM_HAVE_NEON_FP16_KERNELS
+float DotHalfNeon(const float *a, const uint16_t *b, size_t count, size_t *done) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float16x8_t half = vreinterpretq_f16_u16(vld1q_u16(b + i));
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vcvt_f32_f16(vget_low_f16(half)));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vcvt_high_f32_f16(half));
+    }
+    *done = i;
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+}
+#endif
+
+#if VLM_HAVE_NEON_KERNELS
+float DotNeon(const float *a, const float *b, size_t count, size_t *done) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i + 4 <= count; i += 4) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    const float32x4_t acc = vaddq_f32(acc0, acc1);
+    const float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    *done = i;
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+}
+#endif
+
+}  // namespace
+
+float DotProduct(const float *a, const float *b, size_t count, SimdLevel level) {
+    size_t done = 0;
+    float sum = 0.0f;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        sum = DotAvx2(a, b, count, &done);
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    if (level == SimdLevel::kNeon) {
+        sum = DotNeon(a, b, count, &done);
+    }
+#endif
+    return sum + DotScalar(a, b, done, count);
+}
+
+float DotProductHalf(const float *a, const uint16_t *b, size_t count, SimdLevel level) {
+    size_t done = 0;
+    float sum = 0.0f;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        sum = DotHalfAvx2(a, b, count, &done);
+    }
+#endif
+#if VLM_HAVE_NEON_FP16_KERNELS
+    if (level == SimdLevel::kNeon) {
+        sum = DotHalfNeon(a, b, count, &done);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        sum += a[i] * HalfToFloat(b[i]);
+    }
+    return sum;
+}
+
+void CaptionCache::Configure(const CaptionCacheConfig &config) {
+    config_ = config;
+    dims_ = 0;
+    Clear();
+}
+
+void CaptionCache::Clear() {
+    keys_.clear();
+    half_keys_.clear();
+    values_.clear();
+    entries_.store(0, std::memory_order_relaxed);
+    bytes_.store(0, std::memory_order_relaxed);
+}
+
+void CaptionCache::Resize(size_t dims) {
+    Clear();
+    dims_ = dims;
+    const size_t capacity = config_.max_bytes / (KeyBytes() + kEntryOverheadBytes);
+    capacity_.store(capacity, std::memory_order_relaxed);
+    if (config_.half_keys) {
+        half_keys_.reserve(capacity * dims);
+        scratch_.resize(dims);
+    } else {
+        keys_.reserve(capacity * dims);
+    }
+    values_.reserve(capacity);
+    const char *type = config_.half_keys ? "float16" : "float";
+    if (capacity == 0) {
+        VLM_LOGW("Caption cache of %zu bytes cannot hold a %zu-%s embedding", config_.max_bytes, dims, type);
+    } else {
+        VLM_LOGI("Caption cache: %zu entries of %zu %s values", capacity, dims, type);
+    }
+}
+
+size_t CaptionCache::EntryBytes(const Entry &entry) const {
+    return KeyBytes() + entry.text.size() + entry.token_ids.size() * sizeof(int64_t);
+}
+
+bool CaptionCache::Lookup(const float *embedding, size_t count, std::string *text, std::vector<int64_t> *token_ids,
+                          float *similarity, SimdLevel level) {
+    *similarity = 0.0f;
+    const float norm = std::sqrt(DotProduct(embedding, embedding, count, level));
+    if (count != dims_ || values_.empty() || norm <= 0.0f) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    size_t best = 0;
+    float best_dot = -INFINITY;
+    for (size_t i = 0; i < values_.size(); ++i) {
+        const float dot = config_.half_keys ? DotProductHalf(embedding, half_keys_.data() + i * dims_, dims_, level)
+                                            : DotProduct(embedding, keys_.data() + i * dims_, dims_, level);
+        if (dot > best_dot) {
+            best_dot = dot;
+            best = i;
+        }
+    }
+    *similarity = best_dot / norm;
+    if (*similarity < config_.min_similarity) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Entry &entry = values_[best];
+    entry.last_used = ++clock_;
+    *text = entry.text;
+    *token_ids = entry.token_ids;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void CaptionCache::Insert(const float *embedding, size_t count, const std::string &text,
+                          const std::vector<int64_t> &token_ids) {
+    if (count != dims_) {
+        Resize(count);
+    }
+    const size_t capacity = Capacity();
+    const float norm = std::sqrt(DotProduct(embedding, embedding, count, DetectSimdLevel()));
+    if (capacity == 0 || norm <= 0.0f) {
+        return;
+    }
+    size_t slot = values_.size();
+    if (slot < capacity) {
+        values_.emplace_back();
+        if (config_.half_keys) {
+            half_keys_.resize(half_keys_.size() + dims_);
+        } else {
+            keys_.resize(keys_.size() + dims_);
+        }
+    } else {
+        slot = 0;
+        for (size_t i = 1; i < values_.size(); ++i) {
+            if (values_[i].last_used < values_[slot].last_used) {
+                slot = i;
+            }
+        }
+        bytes_.fetch_sub(EntryBytes(values_[slot]), std::memory_order_relaxed);
+    }
+    float *key = config_.half_keys ? scratch_.data() : keys_.data() + slot * dims_;
+    const float scale = 1.0f / norm;
+    for (size_t i = 0; i < count; ++i) {
+        key[i] = embedding[i] * scale;
+    }
+    if (config_.half_keys) {
+        FloatToHalf(key, half_keys_.data() + slot * dims_, dims_);
+    }
+    Entry &entry = values_[slot];
+    entry.text = text;
+    entry.token_ids = token_ids;
+    entry.last_used = ++clock_;
+    bytes_.fetch_add(EntryBytes(entry), std::memory_order_relaxed);
+    entries_.store(values_.size(), std::memory_order_relaxed);
+}
+
+}  // namespace vlm
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+
+namespace vlm {
+
+struct CaptionCacheConfig {
+    bool enabled = false;
+    // Cosine similarity between image embeddings at or above which the
+    // cached caption is returned instead of decoding.
+    float min_similarity = 0.97f;
+    // Upper bound on keys plus captions; sets how many entries fit.
+    size_t max_bytes = 16u << 20;
+    // Stores keys as float16: twice the entries in the same memory, with
+    // similarities off by about 1e-3.
+    bool half_keys = false;
+};
+
+// sum(a[i] * b[i]) with the given kernel.
+float DotProduct(const float *a, const float *b, size_t count, SimdLevel level);
+// The same with |b| in float16.
+float DotProductHalf(const float *a, const uint16_t *b, size_t count, SimdLevel level);
+
+// In-memory LRU map from image embeddings to captions. Keys are the whole
+// encoder output, L2-normalized and stored back to back in one flat array,
+// so a lookup is one linear pass of dot products over it; with a few MB of
+// keys that costs a small fraction of a single decoder step.
+//
+// Lookup() and Insert() belong to one thread (the decoder stage); the
+// counters can be read from any thread.
+class CaptionCache {
+public:
+    void Configure(const CaptionCacheConfig &config);
+    bool Enabled() const {
+        return config_.enabled;
+    }
+
+    // Finds the most similar key. On a hit fills |text|/|token_ids| and
+    // returns true; |similarity| receives the best score either way.
+    bool Lookup(const float *embedding, size_t count, std::string *text, std::vector<int64_t> *token_ids,
+                float *similarity) {
+        return Lookup(embedding, count, text, token_ids, similarity, DetectSimdLevel());
+    }
+    bool Lookup(const float *embedding, size_t count, std::string *text, std::vector<int64_t> *token_ids,
+                float *similarity, SimdLevel level);
+    // Adds a caption, evicting the least recently used entry when full.
+    // Embeddings of a different size than the cached ones clear the cache.
+    void Insert(const float *embedding, size_t count, const std::string &text, const std::vector<int64_t> &token_ids);
+    void Clear();
+
+    uint64_t Hits() const {
+        return hits_.load(std::memory_order_relaxed);
+    }
+    uint64_t Misses() const {
+        return misses_.load(std::memory_order_relaxed);
+    }
+    size_t Entries() const {
+        return entries_.load(std::memory_order_relaxed);
+    }
+    size_t Capacity() const {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+    size_t MemoryBytes() const {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::string text;
+        std::vector<int64_t> token_ids;
+        uint64_t last_used = 0;
+    };
+
+    void Resize(size_t dims);
+    size_t KeyBytes() const {
+        return dims_ * (config_.half_keys ? sizeof(uint16_t) : sizeof(float));
+    }
+    size_t EntryBytes(const Entry &entry) const;
+
+    CaptionCacheConfig config_;
+    size_t dims_ = 0;
+    std::vector<float> keys_;  // |entries_| rows of |dims_| floats
+    std::vector<uint16_t> half_keys_;  // the same in float16, used instead with |half_keys|
+    std::vector<float> scratch_;
+    std::vector<Entry> values_;
+    uint64_t clock_ = 0;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<size_t> entries_{0};
+    std::atomic<size_t> capacity_{0};
+    std::atomic<size_t> bytes_{0};
+};
+
+}  // namespace vlm
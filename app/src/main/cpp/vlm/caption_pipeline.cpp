@@ -0,0 +1,785 @@
+#include "caption_pipeline.h"
+
+#include <algorithm>
+#include <string_view>
+
+#include "file_utils.h"
+#include "fp16_convert.h"
+#include "jpeg_decoder.h"
+#include "ort_utils.h"
+#include "vlm_engine.h"
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+// Data of |value|, its element type and element count.
+bool TensorData(const OrtApi *ort, OrtValue *value, const void **data, ONNXTensorElementDataType *type,
+                size_t *count, std::string *error) {
+    OrtTensorTypeAndShapeInfo *info = nullptr;
+    if (!CheckOrtStatus(ort, ort->GetTensorTypeAndShape(value, &info), "GetTensorTypeAndShape", error)) {
+        return false;
+    }
+    const bool ok = CheckOrtStatus(ort, ort->GetTensorShapeElementCount(info, count), "GetTensorShapeElementCount",
+                                   error) &&
+                    CheckOrtStatus(ort, ort->GetTensorElementType(info, type), "GetTensorElementType", error);
+    ort->ReleaseTensorTypeAndShapeInfo(info);
+    void *mutable_data = nullptr;
+    if (!ok || !CheckOrtStatus(ort, ort->GetTensorMutableData(value, &mutable_data),
+                               "GetTensorMutableData(image embeddings)", error)) {
+        return false;
+    }
+    *data = mutable_data;
+    return true;
+}
+
+}  // namespace
+
+EncodedFrame::~EncodedFrame() {
+    ReleaseOutput();
+    if (buffer_value_) {
+        ort_->ReleaseValue(buffer_value_);
+    }
+}
+
+void EncodedFrame::ReleaseOutput() {
+    if (embeddings_ && embeddings_ != buffer_value_) {
+        ort_->ReleaseValue(embeddings_);
+    }
+    embeddings_ = nullptr;
+}
+
+CaptionPipeline::~CaptionPipeline() {
+    if (ort_) {
+        ReleaseEncoderBinding();
+    }
+    if (memory_info_) {
+        ort_->ReleaseMemoryInfo(memory_info_);
+    }
+}
+
+bool CaptionPipeline::Initialize(VlmEngine *engine, const CaptionConfig &config, std::string *error) {
+    if (!engine->IsReady()) {
+        *error = "VLM engine is not ready";
+        return false;
+    }
+    engine_ = engine;
+    ort_ = engine->Api();
+    config_ = config;
+    if (!memory_info_ &&
+        !CheckOrtStatus(ort_, ort_->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memory_info_),
+                        "CreateCpuMemoryInfo failed", error)) {
+        return false;
+    }
+    if (!tokenizer_.Load(config_.vocab_path, error)) {
+        return false;
+    }
+    prefix_.assign(1, config_.bos_token_id);
+    if (!config_.prompt.empty()) {
+        if (!tokenizer_.CanEncode()) {
+            *error = "A prompt needs the tokenizer merges to encode it";
+            return false;
+        }
+        tokenizer_.Encode(config_.prompt, &prefix_);
+    }
+    if (!ResolveModelIo(error)) {
+        return false;
+    }
+    pixels_.resize(static_cast<size_t>(3) * config_.preprocess.width * config_.preprocess.height);
+    half_pixels_.resize(pixel_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 ? pixels_.size() : 0);
+    gate_.Configure(config_.gate);
+    cache_.Configure(config_.cache);
+    sampler_.Configure(config_.sampling);
+    draft_sampler_.Configure(SamplingConfig());
+    beam_search_.Configure(config_.beam_search, config_.eos_token_id, config_.max_new_tokens);
+    has_last_caption_ = false;
+    if (!BindEncoder(error)) {
+        return false;
+    }
+    VLM_LOGI("Caption pipeline ready: %dx%d input, vocab of %zu tokens, %zu prompt tokens", config_.preprocess.width,
+             config_.preprocess.height, tokenizer_.VocabSize(), prefix_.size() - 1);
+    return true;
+}
+
+bool CaptionPipeline::ResolveModelIo(std::string *error) {
+    const std::vector<TensorInfo> &enc_in = engine_->EncoderInputs();
+    const std::vector<TensorInfo> &enc_out = engine_->EncoderOutputs();
+    if (enc_in.size() != 1 || enc_in[0].shape.size() != 4 || enc_out.empty()) {
+        *error = "Encoder must take a single [N, 3, H, W] pixel tensor";
+        return false;
+    }
+    encoder_input_name_ = enc_in[0].name;
+    pixel_type_ = enc_in[0].type;
+    if (FloatElementSize(pixel_type_) == 0) {
+        *error = "Encoder pixel input must be float or float16";
+        return false;
+    }
+    if (enc_in[0].shape[2] > 0 && enc_in[0].shape[3] > 0) {
+        config_.preprocess.height = static_cast<int>(enc_in[0].shape[2]);
+        config_.preprocess.width = static_cast<int>(enc_in[0].shape[3]);
+    }
+    encoder_output_name_ = enc_out[0].name;
+    for (const char *preferred : {"image_embeds", "last_hidden_state"}) {
+        if (FindTensor(enc_out, preferred) >= 0) {
+            encoder_output_name_ = preferred;
+            break;
+        }
+    }
+
+    // BOS and the prompt come first; every generated token but the last is fed back.
+    const int max_sequence_length = static_cast<int>(prefix_.size()) + config_.max_new_tokens;
+    if (!decoder_.Initialize(engine_, DecoderModel::kMain, memory_info_, max_sequence_length,
+                             config_.beam_search.beams, error)) {
+        return false;
+    }
+    if (config_.draft_tokens <= 0) {
+        return true;
+    }
+    if (config_.beam_search.beams > 1) {
+        *error = "Speculative decoding does not combine with beam search";
+        return false;
+    }
+    if (!draft_decoder_.Initialize(engine_, DecoderModel::kDraft, memory_info_, max_sequence_length, 1, error)) {
+        return false;
+    }
+    if (draft_decoder_.ImageEmbeddingsType() != decoder_.ImageEmbeddingsType()) {
+        *error = "Draft decoder and decoder take image embeddings of different types";
+        return false;
+    }
+    return true;
+}
+
+bool CaptionPipeline::CaptionFile(const std::string &path, CaptionResult *result, std::string *error) {
+    std::vector<uint8_t> bytes;
+    if (!ReadFile(path, &bytes, error)) {
+        return false;
+    }
+    return CaptionJpeg(bytes.data(), bytes.size(), result, error);
+}
+
+bool CaptionPipeline::CaptionJpeg(const uint8_t *data, size_t size, CaptionResult *result, std::string *error) {
+    return EncodeJpeg(data, size, &encoded_, error) && Decode(&encoded_, result, error);
+}
+
+bool CaptionPipeline::CaptionYuv(const YuvImage &image, CaptionResult *result, std::string *error) {
+    return EncodeYuv(image, &encoded_, error) && Decode(&encoded_, result, error);
+}
+
+bool CaptionPipeline::PrepareEncodedFrame(EncodedFrame *frame, std::string *error) {
+    if (!engine_) {
+        *error = "Caption pipeline is not initialized";
+        return false;
+    }
+    frame->ort_ = ort_;
+    if (frame->id_ == 0) {
+        frame->id_ = ++next_frame_id_;
+    }
+    if (embeddings_elements_ == 0 || frame->buffer_value_) {
+        return true;
+    }
+    frame->buffer_.assign(EmbeddingsBytes(), 0);
+    return CheckOrtStatus(ort_,
+                          ort_->CreateTensorWithDataAsOrtValue(
+                              memory_info_, frame->buffer_.data(), frame->buffer_.size(), embeddings_shape_.data(),
+                              embeddings_shape_.size(), EmbeddingsType(), &frame->buffer_value_),
+                          "CreateTensor(image embeddings) failed", error);
+}
+
+bool CaptionPipeline::EncodeJpeg(const uint8_t *data, size_t size, EncodedFrame *frame, std::string *error) {
+    if (!engine_) {
+        *error = "Caption pipeline is not initialized";
+        return false;
+    }
+    frame->total_.Restart();
+    CaptionTimings &timings = frame->timings_;
+    timings = CaptionTimings();
+    Stopwatch stage;
+
+    int src_width = 0;
+    int src_height = 0;
+    JpegDecodeOptions options;
+    if (ReadJpegSize(data, size, &src_width, &src_height)) {
+        options.scale_denom = ChooseJpegScaleDenom(src_width, src_height, config_.preprocess.width,
+                                                   config_.preprocess.height);
+    }
+    RgbImage image;
+    if (!DecodeJpeg(data, size, options, &image, error)) {
+        return false;
+    }
+    timings.image_decode_ms = stage.ElapsedMs();
+
+    stage.Restart();
+    ResizeNormalizeRgb(image, config_.preprocess, pixels_.data());
+    timings.preprocess_ms = stage.ElapsedMs();
+    return GateAndEncode(frame, error);
+}
+
+bool CaptionPipeline::EncodeYuv(const YuvImage &image, EncodedFrame *frame, std::string *error) {
+    if (!engine_) {
+        *error = "Caption pipeline is not initialized";
+        return false;
+    }
+    frame->total_.Restart();
+    frame->timings_ = CaptionTimings();
+    yuv_preprocessor_.Run(image, config_.preprocess, pixels_.data());
+    frame->timings_.preprocess_ms = frame->total_.ElapsedMs();
+    return GateAndEncode(frame, error);
+}
+
+bool CaptionPipeline::Decode(EncodedFrame *frame, CaptionResult *result, std::string *error) {
+    if (frame->reused_) {
+        if (!has_last_caption_) {
+            *error = "Frame is unchanged but the previous caption failed";
+            return false;
+        }
+        ReuseLastCaption(frame, result);
+        if (config_.stream) {
+            BeginStream();
+            PublishStream(*result, true);
+        }
+        return true;
+    }
+    result->reused = false;
+    if (!frame->embeddings_) {
+        *error = "Frame has not been encoded";
+        return false;
+    }
+    if (config_.stream) {
+        BeginStream();
+    }
+    CaptionTimings &timings = result->timings;
+    timings = frame->timings_;
+    timings.queue_ms = frame->encoded_.ElapsedMs();
+    const Stopwatch &total = frame->total_;
+
+    Stopwatch stage;
+    const float *embeddings = nullptr;
+    size_t embedding_count = 0;
+    bool decoded = true;
+    result->cache_hit = false;
+    if (cache_.Enabled()) {
+        float similarity = 0.0f;
+        decoded = FloatEmbeddings(frame, &embeddings, &embedding_count, error);
+        result->cache_hit = decoded && cache_.Lookup(embeddings, embedding_count, &result->text,
+                                                     &result->token_ids, &similarity);
+        timings.cache_ms = stage.ElapsedMs();
+        if (result->cache_hit) {
+            result->step_ms.clear();
+            VLM_LOGI("Caption cache hit (similarity %.4f), decoder skipped", similarity);
+        }
+    }
+    if (decoded && !result->cache_hit) {
+        stage.Restart();
+        decoded = Generate(frame->embeddings_, total, result, error);
+        timings.decoder_ms = stage.ElapsedMs();
+        timings.generated_tokens = static_cast<int>(result->token_ids.size());
+        if (decoded) {
+            stage.Restart();
+            result->text = tokenizer_.Decode(result->token_ids.data(), result->token_ids.size());
+            const size_t first = result->text.find_first_not_of(' ');
+            result->text.erase(0, first == std::string::npos ? result->text.size() : first);
+            timings.detokenize_ms = stage.ElapsedMs();
+            if (cache_.Enabled()) {
+                cache_.Insert(embeddings, embedding_count, result->text, result->token_ids);
+            }
+        }
+    }
+    frame->ReleaseOutput();
+    has_last_caption_ = false;
+    if (config_.stream) {
+        if (!decoded) {
+            result->text.clear();
+        }
+        PublishStream(*result, true);
+    }
+    if (!decoded) {
+        // Frames matching this one must not wait for a caption that never
+        // comes: the next frame is encoded again.
+        gate_reset_.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    timings.total_ms = total.ElapsedMs();
+    if (gate_.Enabled()) {
+        last_text_ = result->text;
+        last_token_ids_ = result->token_ids;
+        has_last_caption_ = true;
+    }
+
+    if (result->cache_hit) {
+        ++counters_.cached_captions;
+        return true;
+    }
+    Record(timings);
+    VLM_LOGI("Caption \"%s\": decode %.1f ms, preprocess %.1f ms, encoder %.1f ms, decoder %.1f ms (%d tokens), "
+             "total %.1f ms",
+             result->text.c_str(), timings.image_decode_ms, timings.preprocess_ms, timings.encoder_ms,
+             timings.decoder_ms, timings.generated_tokens, timings.total_ms);
+    return true;
+}
+
+// Binds |pixels_| as the encoder input once for every caption and works out
+// whether frames can hold a preallocated output buffer.
+bool CaptionPipeline::BindEncoder(std::string *error) {
+    ReleaseEncoderBinding();
+    if (!CheckOrtStatus(ort_, ort_->CreateIoBinding(engine_->EncoderSession(), &encoder_binding_),
+                        "CreateIoBinding failed", error)) {
+        return false;
+    }
+    const int64_t pixel_shape[4] = {1, 3, config_.preprocess.height, config_.preprocess.width};
+    void *pixels = half_pixels_.empty() ? static_cast<void *>(pixels_.data()) : half_pixels_.data();
+    if (!CheckOrtStatus(ort_,
+                        ort_->CreateTensorWithDataAsOrtValue(memory_info_, pixels,
+                                                             pixels_.size() * FloatElementSize(pixel_type_),
+                                                             pixel_shape, 4, pixel_type_, &pixel_value_),
+                        "CreateTensor(pixel_values) failed", error) ||
+        !CheckOrtStatus(ort_, ort_->BindInput(encoder_binding_, encoder_input_name_.c_str(), pixel_value_),
+                        "BindInput(pixel_values) failed", error)) {
+        return false;
+    }
+
+    const std::vector<TensorInfo> &enc_out = engine_->EncoderOutputs();
+    const TensorInfo &out = enc_out[FindTensor(enc_out, encoder_output_name_)];
+    size_t elements = 1;
+    for (int64_t dim : out.shape) {
+        elements = dim > 0 ? elements * static_cast<size_t>(dim) : 0;
+    }
+    encoder_output_type_ = out.type;
+    const bool convert = encoder_output_type_ != EmbeddingsType();
+    if (FloatElementSize(encoder_output_type_) == 0) {
+        *error = "Encoder output must be float or float16";
+        return false;
+    }
+    if (out.shape.empty() || elements == 0) {
+        if (convert) {
+            *error = "Encoder output and decoder input types differ, which needs a static encoder output shape";
+            return false;
+        }
+        embeddings_shape_.clear();
+        embeddings_elements_ = 0;
+        if (!CheckOrtStatus(ort_,
+                            ort_->BindOutputToDevice(encoder_binding_, encoder_output_name_.c_str(), memory_info_),
+                            "BindOutputToDevice(image embeddings) failed", error)) {
+            return false;
+        }
+    } else {
+        embeddings_shape_ = out.shape;
+        embeddings_elements_ = elements;
+    }
+    if (convert) {
+        encoder_output_.assign(elements * FloatElementSize(encoder_output_type_), 0);
+        if (!CheckOrtStatus(ort_,
+                            ort_->CreateTensorWithDataAsOrtValue(memory_info_, encoder_output_.data(),
+                                                                 encoder_output_.size(), embeddings_shape_.data(),
+                                                                 embeddings_shape_.size(), encoder_output_type_,
+                                                                 &encoder_output_value_),
+                            "CreateTensor(encoder output) failed", error) ||
+            !CheckOrtStatus(ort_,
+                            ort_->BindOutput(encoder_binding_, encoder_output_name_.c_str(), encoder_output_value_),
+                            "BindOutput(image embeddings) failed", error)) {
+            return false;
+        }
+        VLM_LOGI("Image embeddings are converted from %s to %s between the models",
+                 FloatTypeName(encoder_output_type_), FloatTypeName(EmbeddingsType()));
+    }
+    return PrepareEncodedFrame(&encoded_, error);
+}
+
+void CaptionPipeline::ReleaseEncoderBinding() {
+    if (encoder_binding_) {
+        ort_->ReleaseIoBinding(encoder_binding_);
+        encoder_binding_ = nullptr;
+    }
+    if (pixel_value_) {
+        ort_->ReleaseValue(pixel_value_);
+        pixel_value_ = nullptr;
+    }
+    if (encoder_output_value_) {
+        ort_->ReleaseValue(encoder_output_value_);
+        encoder_output_value_ = nullptr;
+    }
+    bound_frame_id_ = 0;
+}
+
+bool CaptionPipeline::GateAndEncode(EncodedFrame *frame, std::string *error) {
+    frame->reused_ = false;
+    if (gate_.Enabled()) {
+        if (gate_reset_.exchange(false, std::memory_order_relaxed)) {
+            gate_.Reset();
+        }
+        const Stopwatch stage;
+        frame->reused_ = gate_.Unchanged(pixels_.data(), config_.preprocess);
+        frame->timings_.gate_ms = stage.ElapsedMs();
+        if (frame->reused_) {
+            gated_frames_.fetch_add(1, std::memory_order_relaxed);
+            VLM_LOGI("Frame unchanged (hash distance %d, mean difference %.3f), reusing the last caption",
+                     gate_.LastHashDistance(), gate_.LastMeanDifference());
+            frame->ReleaseOutput();
+            frame->encoded_.Restart();
+            return true;
+        }
+    }
+    if (!RunEncoder(frame, error)) {
+        gate_.Reset();
+        return false;
+    }
+    if (gate_.Enabled()) {
+        gate_.Accept();
+    }
+    encoded_frames_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool CaptionPipeline::RunEncoder(EncodedFrame *frame, std::string *error) {
+    const Stopwatch stage;
+    frame->ReleaseOutput();
+    if (!half_pixels_.empty()) {
+        FloatToHalf(pixels_.data(), half_pixels_.data(), pixels_.size());
+    }
+    if (frame->buffer_value_ && !encoder_output_value_ && bound_frame_id_ != frame->id_) {
+        if (!CheckOrtStatus(ort_,
+                            ort_->BindOutput(encoder_binding_, encoder_output_name_.c_str(), frame->buffer_value_),
+                            "BindOutput(image embeddings) failed", error)) {
+            return false;
+        }
+        bound_frame_id_ = frame->id_;
+    }
+    if (!CheckOrtStatus(ort_, ort_->RunWithBinding(engine_->EncoderSession(), nullptr, encoder_binding_),
+                        "Encoder run failed", error)) {
+        return false;
+    }
+    if (encoder_output_value_) {
+        if (encoder_output_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+            HalfToFloat(reinterpret_cast<const uint16_t *>(encoder_output_.data()),
+                        reinterpret_cast<float *>(frame->buffer_.data()), embeddings_elements_);
+        } else {
+            FloatToHalf(reinterpret_cast<const float *>(encoder_output_.data()),
+                        reinterpret_cast<uint16_t *>(frame->buffer_.data()), embeddings_elements_);
+        }
+        frame->embeddings_ = frame->buffer_value_;
+    } else if (frame->buffer_value_) {
+        frame->embeddings_ = frame->buffer_value_;
+    } else {
+        // Dynamic output shape: take the tensor ORT allocated.
+        OrtAllocator *allocator = nullptr;
+        OrtValue **values = nullptr;
+        size_t count = 0;
+        if (!CheckOrtStatus(ort_, ort_->GetAllocatorWithDefaultOptions(&allocator),
+                            "GetAllocatorWithDefaultOptions", error) ||
+            !CheckOrtStatus(ort_, ort_->GetBoundOutputValues(encoder_binding_, allocator, &values, &count),
+                            "GetBoundOutputValues failed", error)) {
+            return false;
+        }
+        if (count > 0) {
+            frame->embeddings_ = values[0];
+        }
+        for (size_t i = 1; i < count; ++i) {
+            ort_->ReleaseValue(values[i]);
+        }
+        allocator->Free(allocator, values);
+        if (!frame->embeddings_) {
+            *error = "Encoder produced no output";
+            return false;
+        }
+    }
+    frame->timings_.encoder_ms = stage.ElapsedMs();
+    frame->encoded_.Restart();
+    return true;
+}
+
+bool CaptionPipeline::FloatEmbeddings(EncodedFrame *frame, const float **data, size_t *count, std::string *error) {
+    const void *raw = nullptr;
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    if (!TensorData(ort_, frame->embeddings_, &raw, &type, count, error)) {
+        return false;
+    }
+    if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        *data = static_cast<const float *>(raw);
+        return true;
+    }
+    float_embeddings_.resize(*count);
+    HalfToFloat(static_cast<const uint16_t *>(raw), float_embeddings_.data(), *count);
+    *data = float_embeddings_.data();
+    return true;
+}
+
+bool CaptionPipeline::TokenLogits(EncodedFrame *frame, const std::vector<int64_t> &tokens, std::vector<float> *logits,
+                                  std::string *error) {
+    if (!frame->embeddings_) {
+        *error = "Frame has not been encoded";
+        return false;
+    }
+    if (tokens.size() > static_cast<size_t>(config_.max_new_tokens)) {
+        *error = "Too many tokens to score";
+        return false;
+    }
+    std::vector<int64_t> sequence = prefix_;
+    sequence.insert(sequence.end(), tokens.begin(), tokens.end());
+    bool ok = decoder_.Reset(frame->embeddings_, error) && decoder_.Step(sequence.data(), sequence.size(), error);
+    const size_t vocab = static_cast<size_t>(decoder_.VocabSize());
+    const size_t first = prefix_.size() - 1;
+    logits->resize((tokens.size() + 1) * vocab);
+    for (size_t i = 0; ok && i <= tokens.size(); ++i) {
+        const float *row = decoder_.Logits(first + i);
+        if (!row) {
+            *error = "Decoder returns logits for the last position only";
+            ok = false;
+        } else {
+            std::copy(row, row + vocab, logits->data() + i * vocab);
+        }
+    }
+    frame->ReleaseOutput();
+    return ok;
+}
+
+void CaptionPipeline::ReuseLastCaption(EncodedFrame *frame, CaptionResult *result) {
+    CaptionTimings &timings = result->timings;
+    timings = frame->timings_;
+    timings.queue_ms = frame->encoded_.ElapsedMs();
+    result->reused = true;
+    result->cache_hit = false;
+    result->text = last_text_;
+    result->token_ids = last_token_ids_;
+    result->step_ms.clear();
+    timings.total_ms = frame->total_.ElapsedMs();
+    ++counters_.reused_captions;
+}
+
+bool CaptionPipeline::Generate(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result,
+                               std::string *error) {
+    if (config_.beam_search.beams > 1) {
+        return SearchBeams(embeddings, total, result, error);
+    }
+    if (config_.draft_tokens > 0) {
+        return GenerateSpeculative(embeddings, total, result, error);
+    }
+    result->token_ids.clear();
+    result->step_ms.clear();
+    if (!decoder_.Reset(embeddings, error)) {
+        return false;
+    }
+    sampler_.Reset(prefix_.data(), prefix_.size());
+    int64_t token = 0;
+    for (int step = 0; step < config_.max_new_tokens; ++step) {
+        const Stopwatch step_time;
+        const bool stepped = step == 0 ? decoder_.Step(prefix_.data(), prefix_.size(), error)
+                                       : decoder_.Step(&token, 1, error);
+        if (!stepped) {
+            return false;
+        }
+        const Stopwatch select_time;
+        token = sampler_.Select(decoder_.LastLogits(), static_cast<size_t>(decoder_.VocabSize()));
+        result->timings.select_ms += select_time.ElapsedMs();
+        result->step_ms.push_back(step_time.ElapsedMs());
+        if (step == 0) {
+            result->timings.first_token_ms = total.ElapsedMs();
+        }
+        if (token == config_.eos_token_id) {
+            break;
+        }
+        AddToken(token, total, result);
+        sampler_.Accept(token);
+    }
+    return true;
+}
+
+bool CaptionPipeline::SearchBeams(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result,
+                                  std::string *error) {
+    result->token_ids.clear();
+    result->step_ms.clear();
+    if (!decoder_.Reset(embeddings, error)) {
+        return false;
+    }
+    beam_search_.Reset();
+    for (int step = 0; step < config_.max_new_tokens; ++step) {
+        const Stopwatch step_time;
+        const bool stepped = step == 0 ? decoder_.Step(prefix_.data(), prefix_.size(), error)
+                                       : decoder_.StepBatch(beam_search_.Tokens(), beam_search_.Parents(),
+                                                            beam_search_.Beams(), error);
+        if (!stepped) {
+            return false;
+        }
+        const Stopwatch select_time;
+        beam_rows_.resize(decoder_.BatchSize());
+        for (size_t beam = 0; beam < beam_rows_.size(); ++beam) {
+            beam_rows_[beam] = decoder_.SequenceLogits(beam);
+        }
+        const bool searching = beam_search_.Advance(beam_rows_.data(), static_cast<size_t>(decoder_.VocabSize()));
+        result->timings.select_ms += select_time.ElapsedMs();
+        result->step_ms.push_back(step_time.ElapsedMs());
+        if (step == 0) {
+            result->timings.first_token_ms = total.ElapsedMs();
+        }
+        if (!searching) {
+            break;
+        }
+    }
+    result->token_ids = beam_search_.Best();
+    return true;
+}
+
+bool CaptionPipeline::GenerateSpeculative(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result,
+                                          std::string *error) {
+    result->token_ids.clear();
+    result->step_ms.clear();
+    if (!decoder_.Reset(embeddings, error) || !draft_decoder_.Reset(embeddings, error)) {
+        return false;
+    }
+    sampler_.Reset(prefix_.data(), prefix_.size());
+    sequence_ = prefix_;
+    Stopwatch step_time;
+    if (!decoder_.Step(prefix_.data(), prefix_.size(), error)) {
+        return false;
+    }
+    const size_t vocab = static_cast<size_t>(decoder_.VocabSize());
+    Stopwatch select_time;
+    int64_t token = sampler_.Select(decoder_.LastLogits(), vocab);
+    result->timings.select_ms += select_time.ElapsedMs();
+    result->step_ms.push_back(step_time.ElapsedMs());
+    result->timings.first_token_ms = total.ElapsedMs();
+
+    const size_t max_tokens = static_cast<size_t>(config_.max_new_tokens);
+    while (token != config_.eos_token_id && result->token_ids.size() < max_tokens) {
+        AddToken(token, total, result);
+        sampler_.Accept(token);
+        sequence_.push_back(token);
+        const size_t remaining = max_tokens - result->token_ids.size();
+        if (remaining == 0) {
+            break;
+        }
+        step_time.Restart();
+
+        // The draft decoder catches up on the tokens it has not read and
+        // proposes how the caption goes on, one token per run. Every
+        // accepted proposal adds a token after it, so the caption never
+        // outgrows max_new_tokens.
+        const Stopwatch draft_time;
+        proposal_.assign(1, token);
+        const size_t proposals = std::min(static_cast<size_t>(config_.draft_tokens), remaining - 1);
+        for (size_t i = 0; i < proposals && proposal_.back() != config_.eos_token_id; ++i) {
+            const size_t read = draft_decoder_.SequenceLength();
+            const bool stepped = i == 0 ? draft_decoder_.Step(sequence_.data() + read, sequence_.size() - read, error)
+                                        : draft_decoder_.Step(&proposal_.back(), 1, error);
+            if (!stepped) {
+                return false;
+            }
+            if (draft_decoder_.VocabSize() != decoder_.VocabSize()) {
+                *error = "Draft decoder and decoder have different vocabularies";
+                return false;
+            }
+            proposal_.push_back(draft_sampler_.Select(draft_decoder_.LastLogits(), vocab));
+        }
+        result->timings.draft_ms += draft_time.ElapsedMs();
+        result->timings.draft_tokens += static_cast<int>(proposal_.size() - 1);
+
+        // One decoder run over the token and the proposals. Row i is what
+        // follows proposal i, so the decoder picks its own next token there
+        // exactly as it would have one run at a time, and goes on while that
+        // pick is the next proposal.
+        if (!decoder_.Step(proposal_.data(), proposal_.size(), error)) {
+            return false;
+        }
+        select_time.Restart();
+        size_t accepted = 0;
+        while (true) {
+            float *row = decoder_.Logits(accepted);
+            if (!row) {
+                *error = "Speculative decoding needs the decoder's logits at every position";
+                return false;
+            }
+            token = sampler_.Select(row, vocab);
+            if (accepted + 1 == proposal_.size() || token != proposal_[accepted + 1] ||
+                token == config_.eos_token_id) {
+                break;
+            }
+            AddToken(token, total, result);
+            sampler_.Accept(token);
+            sequence_.push_back(token);
+            ++accepted;
+        }
+        result->timings.select_ms += select_time.ElapsedMs();
+        result->timings.accepted_tokens += static_cast<int>(accepted);
+
+        // Both decoders forget the rejected proposals.
+        if (!decoder_.Truncate(sequence_.size(), error) ||
+            (draft_decoder_.SequenceLength() > sequence_.size() &&
+             !draft_decoder_.Truncate(sequence_.size(), error))) {
+            return false;
+        }
+        result->step_ms.push_back(step_time.ElapsedMs());
+    }
+    return true;
+}
+
+void CaptionPipeline::AddToken(int64_t token, const Stopwatch &total, CaptionResult *result) {
+    const double now = total.ElapsedMs();
+    CaptionTimings &timings = result->timings;
+    const size_t gaps = result->token_ids.size();
+    if (gaps > 0) {
+        const double gap = now - last_token_ms_;
+        timings.inter_token_ms += (gap - timings.inter_token_ms) / static_cast<double>(gaps);
+        timings.max_inter_token_ms = std::max(timings.max_inter_token_ms, gap);
+    }
+    last_token_ms_ = now;
+    result->token_ids.push_back(token);
+    if (config_.stream) {
+        stream_detokenizer_.Push(token);
+        PublishStream(*result, false);
+    }
+}
+
+void CaptionPipeline::BeginStream() {
+    ++stream_captions_;
+    stream_detokenizer_.Reset();
+    last_token_ms_ = 0.0;
+    CaptionSnapshot &snapshot = stream_.Write();
+    snapshot.caption = stream_captions_;
+    snapshot.text.clear();
+    snapshot.tokens = 0;
+    snapshot.done = false;
+    snapshot.first_token_ms = 0.0;
+    snapshot.last_token_ms = 0.0;
+    stream_.Publish();
+}
+
+void CaptionPipeline::PublishStream(const CaptionResult &result, bool done) {
+    CaptionSnapshot &snapshot = stream_.Write();
+    snapshot.caption = stream_captions_;
+    if (done) {
+        snapshot.text = result.text;
+    } else {
+        // Like the final text, without the leading space of the first word.
+        const std::string_view text = stream_detokenizer_.Text();
+        const size_t first = text.find_first_not_of(' ');
+        snapshot.text.assign(first == std::string_view::npos ? std::string_view() : text.substr(first));
+    }
+    snapshot.tokens = static_cast<int>(result.token_ids.size());
+    snapshot.done = done;
+    snapshot.first_token_ms = snapshot.tokens > 0 ? result.timings.first_token_ms : 0.0;
+    snapshot.last_token_ms = snapshot.tokens > 0 ? last_token_ms_ : 0.0;
+    stream_.Publish();
+}
+
+void CaptionPipeline::Record(const CaptionTimings &timings) {
+    counters_.image_decode.Add(timings.image_decode_ms);
+    counters_.preprocess.Add(timings.preprocess_ms);
+    counters_.gate.Add(timings.gate_ms);
+    counters_.encoder.Add(timings.encoder_ms);
+    counters_.decoder.Add(timings.decoder_ms);
+    counters_.select.Add(timings.select_ms);
+    if (config_.draft_tokens > 0) {
+        counters_.draft.Add(timings.draft_ms);
+    }
+    counters_.detokenize.Add(timings.detokenize_ms);
+    counters_.first_token.Add(timings.first_token_ms);
+    // Beam search and cache hits have no gaps between tokens to measure.
+    if (timings.inter_token_ms > 0.0) {
+        counters_.inter_token.Add(timings.inter_token_ms);
+    }
+    counters_.total.Add(timings.total_ms);
+    counters_.generated_tokens += static_cast<uint64_t>(timings.generated_tokens);
+    counters_.draft_tokens += static_cast<uint64_t>(timings.draft_tokens);
+    counters_.accepted_tokens += static_cast<uint64_t>(timings.accepted_tokens);
+}
+
+}  // namespace vlm
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "beam_search.h"
+#include "caption_cache.h"
+#include "decoder_runner.h"
+#include "frame_gate.h"
+#include "image_preprocess.h"
+#include "latency_stats.h"
+#include "logits_processor.h"
+#include "ort_utils.h"
+#include "onnxruntime/core/session/onnxruntime_c_api.h"
+#include "snapshot_buffer.h"
+#include "tokenizer.h"
+#include "yuv_preprocess.h"
+
+namespace vlm {
+
+class VlmEngine;
+
+struct CaptionConfig {
+    // vocab.json (with merges.txt next to it) or tokenizer.json.
+    std::string vocab_path;
+    int64_t bos_token_id = 50256;
+    int64_t eos_token_id = 50256;
+    int max_new_tokens = 30;
+    // Text the caption continues, e.g. "a photo of", fed after BOS in the
+    // first decoder step. Needs merges to encode; not part of the caption.
+    std::string prompt;
+    // How each token is picked from the logits; greedy by default.
+    SamplingConfig sampling;
+    // Several captions decoded side by side in one batch, the best one kept.
+    BeamSearchConfig beam_search;
+    // Speculative decoding: tokens the engine's draft decoder proposes ahead
+    // of each decoder run, which checks them all at once; 0 is off. Captions
+    // come out the same as without it.
+    int draft_tokens = 0;
+    // Publish the caption to StreamSnapshot() token by token as it is
+    // generated; beam search publishes it once done.
+    bool stream = false;
+    // Width/height are replaced by the encoder's input shape when it is static.
+    PreprocessConfig preprocess;
+    // Skips the models for frames that match the last one encoded.
+    FrameGateConfig gate;
+    // Returns the caption of a similar earlier image instead of decoding.
+    CaptionCacheConfig cache;
+};
+
+struct CaptionTimings {
+    double image_decode_ms = 0.0;
+    double preprocess_ms = 0.0;
+    double gate_ms = 0.0;
+    double encoder_ms = 0.0;
+    double cache_ms = 0.0;
+    double decoder_ms = 0.0;
+    // Picking the tokens from the logits, part of |decoder_ms|.
+    double select_ms = 0.0;
+    // Draft decoder runs, likewise.
+    double draft_ms = 0.0;
+    double detokenize_ms = 0.0;
+    double total_ms = 0.0;
+    // From the start of the caption until the first token is known.
+    double first_token_ms = 0.0;
+    // Mean and longest wait between consecutive caption tokens, as a reader
+    // of the streamed caption sees them.
+    double inter_token_ms = 0.0;
+    double max_inter_token_ms = 0.0;
+    // Wait between the encoder finishing and the decoder starting, non-zero
+    // only when the two stages run on different threads.
+    double queue_ms = 0.0;
+    int generated_tokens = 0;
+    // Speculative decoding: tokens the draft decoder proposed and how many
+    // of them the decoder went on with.
+    int draft_tokens = 0;
+    int accepted_tokens = 0;
+};
+
+// The caption being generated, as published for another thread.
+struct CaptionSnapshot {
+    // Captions started by the decoder stage so far, 0 before the first.
+    uint64_t caption = 0;
+    // Whole characters generated so far; the final caption once done.
+    std::string text;
+    int tokens = 0;
+    bool done = false;  // finished, or failed
+    // Since the caption started, until the first and the latest token were
+    // known; 0 before the first.
+    double first_token_ms = 0.0;
+    double last_token_ms = 0.0;
+};
+
+struct CaptionResult {
+    std::string text;
+    std::vector<int64_t> token_ids;
+    CaptionTimings timings;
+    // The frame showed the same scene as the last one encoded, and the
+    // caption of that frame was returned without running the models.
+    bool reused = false;
+    // The image embeddings matched a cached caption; the decoder did not run.
+    bool cache_hit = false;
+    // Latency of every decoder step, the first one included; with a draft
+    // decoder a step also covers the proposals it checks. Reusing the result
+    // across captions keeps the capacity.
+    std::vector<double> step_ms;
+};
+
+// Accumulated per-stage latency over every caption produced by a pipeline.
+struct PipelineCounters {
+    StageCounter image_decode;
+    StageCounter preprocess;
+    StageCounter gate;
+    StageCounter encoder;
+    StageCounter decoder;
+    StageCounter select;
+    StageCounter draft;
+    StageCounter detokenize;
+    StageCounter first_token;
+    StageCounter inter_token;
+    StageCounter total;
+    uint64_t generated_tokens = 0;
+    uint64_t draft_tokens = 0;
+    uint64_t accepted_tokens = 0;
+    // Captions reused by the frame gate, not part of the stage counters.
+    uint64_t reused_captions = 0;
+    // Captions served by the caption cache, likewise.
+    uint64_t cached_captions = 0;
+};
+
+// Image embeddings passed from the encoder stage to the decoder stage, with
+// the timings of the first stage. When the encoder output shape is static the
+// embeddings live in a buffer owned by the frame, so frames can be recycled
+// without allocating. The buffer holds the element type the decoder takes,
+// float16 for half precision decoders: half the bytes of float.
+class EncodedFrame {
+public:
+    EncodedFrame() = default;
+    ~EncodedFrame();
+    EncodedFrame(const EncodedFrame &) = delete;
+    EncodedFrame &operator=(const EncodedFrame &) = delete;
+
+private:
+    friend class CaptionPipeline;
+    // Drops a tensor ORT allocated for a dynamic output shape.
+    void ReleaseOutput();
+
+    const OrtApi *ort_ = nullptr;
+    uint64_t id_ = 0;  // tells frames apart for the encoder binding
+    bool reused_ = false;  // gated: nothing was encoded
+    std::vector<uint8_t> buffer_;
+    OrtValue *buffer_value_ = nullptr;
+    OrtValue *embeddings_ = nullptr;  // |buffer_value_| or an ORT-owned tensor
+    CaptionTimings timings_;
+    Stopwatch total_;    // since the caption started
+    Stopwatch encoded_;  // since the encoder finished
+};
+
+// JPEG or camera YUV -> pixel tensor -> encoder -> autoregressive decoder
+// -> text, running on the sessions owned by a VlmEngine.
+//
+// The decoder is expected to take "input_ids" plus the encoder output as a
+// float or float16 [batch, image_tokens, hidden] input (for example
+// "encoder_hidden_states"), optionally with "attention_mask",
+// "encoder_attention_mask", "position_ids" and a past_key_values/present KV
+// cache, and to produce "logits". See DecoderRunner. Either model may use
+// float16 inputs and outputs (fp16 variants exported without keeping float
+// I/O): pixels are converted for the encoder, and embeddings are converted
+// in the encoder stage when the two models disagree on their type.
+class CaptionPipeline {
+public:
+    CaptionPipeline() = default;
+    ~CaptionPipeline();
+    CaptionPipeline(const CaptionPipeline &) = delete;
+    CaptionPipeline &operator=(const CaptionPipeline &) = delete;
+
+    // |engine| must be ready and outlive the pipeline.
+    bool Initialize(VlmEngine *engine, const CaptionConfig &config, std::string *error);
+
+    bool CaptionJpeg(const uint8_t *data, size_t size, CaptionResult *result, std::string *error);
+    // Skips image decoding entirely: the fused YUV kernel writes the encoder
+    // input directly.
+    bool CaptionYuv(const YuvImage &image, CaptionResult *result, std::string *error);
+    bool CaptionFile(const std::string &path, CaptionResult *result, std::string *error);
+
+    // The same work as two stages, so the encoder can run on the next frame
+    // while the decoder is still on the previous one: Encode*() on one
+    // thread, Decode() on another, each stage on one thread at a time.
+    // Frames are set up once with PrepareEncodedFrame() and then reused.
+    bool PrepareEncodedFrame(EncodedFrame *frame, std::string *error);
+    bool EncodeJpeg(const uint8_t *data, size_t size, EncodedFrame *frame, std::string *error);
+    bool EncodeYuv(const YuvImage &image, EncodedFrame *frame, std::string *error);
+    bool Decode(EncodedFrame *frame, CaptionResult *result, std::string *error);
+
+    // Teacher forcing, for comparing model variants: runs the decoder once
+    // over BOS and the prompt followed by |tokens| (at most max_new_tokens)
+    // on an encoded |frame| and returns the logits after the prompt and after
+    // each token, tokens.size() + 1 rows of VocabSize() floats. Call instead
+    // of Decode().
+    bool TokenLogits(EncodedFrame *frame, const std::vector<int64_t> &tokens, std::vector<float> *logits,
+                     std::string *error);
+
+    // Encoder input resolution, resolved from the session metadata.
+    int InputWidth() const {
+        return config_.preprocess.width;
+    }
+    int InputHeight() const {
+        return config_.preprocess.height;
+    }
+
+    bool UsesKvCache() const {
+        return decoder_.UsesKvCache();
+    }
+    const Tokenizer &GetTokenizer() const {
+        return tokenizer_;
+    }
+    // Known once the decoder has run.
+    int64_t VocabSize() const {
+        return decoder_.VocabSize();
+    }
+    // Element types at the model boundaries, and the size of the embeddings
+    // one frame carries from the encoder to the decoder stage (0 when the
+    // encoder output shape is dynamic).
+    ONNXTensorElementDataType PixelType() const {
+        return pixel_type_;
+    }
+    ONNXTensorElementDataType EmbeddingsType() const {
+        return decoder_.ImageEmbeddingsType();
+    }
+    ONNXTensorElementDataType LogitsType() const {
+        return decoder_.LogitsType();
+    }
+    size_t EmbeddingsBytes() const {
+        return embeddings_elements_ * FloatElementSize(EmbeddingsType());
+    }
+
+    const PipelineCounters &Counters() const {
+        return counters_;
+    }
+
+    // The caption being decoded with the text so far, or the last one once
+    // done, when CaptionConfig::stream is set. For a single reader thread,
+    // such as the render loop polling it every frame; it never waits for the
+    // decoder stage, which publishes without waiting either.
+    const CaptionSnapshot &StreamSnapshot() {
+        return stream_.Read();
+    }
+
+    // Frames the gate let through to the encoder and frames it stopped,
+    // readable from any thread.
+    uint64_t EncodedFrames() const {
+        return encoded_frames_.load(std::memory_order_relaxed);
+    }
+    uint64_t GatedFrames() const {
+        return gated_frames_.load(std::memory_order_relaxed);
+    }
+    // Hit/miss counters and size, readable from any thread.
+    const CaptionCache &Cache() const {
+        return cache_;
+    }
+
+private:
+    bool ResolveModelIo(std::string *error);
+    bool BindEncoder(std::string *error);
+    void ReleaseEncoderBinding();
+    // Runs the encoder on the already filled |pixels_| into |frame|, unless
+    // the gate finds the frame unchanged.
+    bool GateAndEncode(EncodedFrame *frame, std::string *error);
+    bool RunEncoder(EncodedFrame *frame, std::string *error);
+    // Float view of the embeddings of |frame| for the caption cache.
+    bool FloatEmbeddings(EncodedFrame *frame, const float **data, size_t *count, std::string *error);
+    void ReuseLastCaption(EncodedFrame *frame, CaptionResult *result);
+    // Runs the decoder until EOS or max_new_tokens, each token picked by
+    // |sampler_|, or hands over to SearchBeams().
+    bool Generate(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result, std::string *error);
+    // One batched decoder step per token for all the beams of |beam_search_|.
+    bool SearchBeams(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result, std::string *error);
+    // Generate() with |draft_decoder_| proposing the tokens |decoder_|
+    // checks.
+    bool GenerateSpeculative(OrtValue *embeddings, const Stopwatch &total, CaptionResult *result,
+                             std::string *error);
+    void Record(const CaptionTimings &timings);
+    // Appends a generated token to |result|, timing it and streaming it.
+    void AddToken(int64_t token, const Stopwatch &total, CaptionResult *result);
+    // Starts a streamed caption; PublishStream() then publishes its text so
+    // far, or |result|'s final text when |done|.
+    void BeginStream();
+    void PublishStream(const CaptionResult &result, bool done);
+
+    VlmEngine *engine_ = nullptr;
+    const OrtApi *ort_ = nullptr;
+    OrtMemoryInfo *memory_info_ = nullptr;
+    CaptionConfig config_;
+    Tokenizer tokenizer_;
+    std::vector<int64_t> prefix_;  // BOS and the prompt tokens
+
+    std::string encoder_input_name_;
+    std::string encoder_output_name_;
+    DecoderRunner decoder_;
+    LogitsProcessor sampler_;
+    BeamSearch beam_search_;
+    std::vector<const float *> beam_rows_;
+    DecoderRunner draft_decoder_;
+    // Greedy: a proposal only has to guess what |sampler_| picks.
+    LogitsProcessor draft_sampler_;
+    std::vector<int64_t> sequence_;  // prefix and caption so far
+    std::vector<int64_t> proposal_;  // the last token and the proposals after it
+
+    YuvPreprocessor yuv_preprocessor_;
+    // Encoder input, bound once in Initialize(). The output is bound to the
+    // buffer of the frame being encoded; |embeddings_shape_| is empty when
+    // the output shape is dynamic and ORT allocates it instead.
+    std::vector<float> pixels_;
+    OrtIoBinding *encoder_binding_ = nullptr;
+    OrtValue *pixel_value_ = nullptr;
+    std::vector<int64_t> embeddings_shape_;
+    size_t embeddings_elements_ = 0;
+    // Float16 encoders read |half_pixels_|, converted from |pixels_|.
+    ONNXTensorElementDataType pixel_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    std::vector<uint16_t> half_pixels_;
+    // When the encoder output type differs from the decoder input type the
+    // encoder writes here and the frame receives the converted embeddings.
+    ONNXTensorElementDataType encoder_output_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    std::vector<uint8_t> encoder_output_;
+    OrtValue *encoder_output_value_ = nullptr;
+    uint64_t bound_frame_id_ = 0;
+    uint64_t next_frame_id_ = 0;
+    // Used by the single-threaded Caption*() calls.
+    EncodedFrame encoded_;
+    PipelineCounters counters_;
+
+    // Encoder stage only.
+    FrameGate gate_;
+    std::atomic<uint64_t> encoded_frames_{0};
+    std::atomic<uint64_t> gated_frames_{0};
+    // Set by the decoder stage when a caption fails.
+    std::atomic<bool> gate_reset_{false};
+    // Decoder stage only.
+    CaptionCache cache_;
+    std::vector<float> float_embeddings_;  // cache keys from float16 frames
+    // Decoder stage only: the caption gated frames reuse.
+    std::string last_text_;
+    std::vector<int64_t> last_token_ids_;
+    bool has_last_caption_ = false;
+    // Decoder stage only: streaming.
+    StreamDetokenizer stream_detokenizer_{&tokenizer_};
+    SnapshotBuffer<CaptionSnapshot> stream_;
+    uint64_t stream_captions_ = 0;
+    double last_token_ms_ = 0.0;
+};
+
+}  // namespace vlm
@@ -0,0 +1,42 @@
+#include "capture_size.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace vlm {
+
+CaptureSize RequiredCaptureSize(int model_width, int model_height, float oversample) {
+    if (oversample < 1.0f) {
+        oversample = 1.0f;
+    }
+    CaptureSize size;
+    size.width = static_cast<int>(std::ceil(model_width * oversample));
+    size.height = static_cast<int>(std::ceil(model_height * oversample));
+    return size;
+}
+
+int ChooseCaptureSize(const std::vector<CaptureSize> &candidates, const CaptureSize &required) {
+    int best_covering = -1;
+    int64_t best_covering_area = 0;
+    int largest = -1;
+    int64_t largest_area = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const CaptureSize &c = candidates[i];
+        const int64_t area = static_cast<int64_t>(c.width) * c.height;
+        if (area <= 0) {
+            continue;
+        }
+        if (largest < 0 || area > largest_area) {
+            largest = static_cast<int>(i);
+            largest_area = area;
+        }
+        if (c.width >= required.width && c.height >= required.height &&
+            (best_covering < 0 || area < best_covering_area)) {
+            best_covering = static_cast<int>(i);
+            best_covering_area = area;
+        }
+    }
+    return best_covering >= 0 ? best_covering : largest;
+}
+
+}  // namespace vlm
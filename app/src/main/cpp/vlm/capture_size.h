@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+namespace vlm {
+
+struct CaptureSize {
+    int width = 0;
+    int height = 0;
+};
+
+// Smallest capture that still gives the encoder |oversample| source pixels
+// per model input pixel along each axis.
+CaptureSize RequiredCaptureSize(int model_width, int model_height, float oversample);
+
+// Returns the index of the smallest (by area) candidate that covers
+// |required| in both dimensions. If none does, the largest candidate is
+// returned so the model gets as much detail as the sensor offers. Returns -1
+// when |candidates| is empty.
+int ChooseCaptureSize(const std::vector<CaptureSize> &candidates, const CaptureSize &required);
+
+}  // namespace vlm
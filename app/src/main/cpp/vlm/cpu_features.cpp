@@ -0,0 +1,36 @@
+#include "cpu_features.h"
+
+namespace vlm {
+
+namespace {
+
+SimdLevel Probe() {
+#if VLM_HAVE_AVX2_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        return SimdLevel::kAvx2;
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    return SimdLevel::kNeon;
+#else
+    return SimdLevel::kScalar;
+#endif
+}
+
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel level = Probe();
+    return level;
+}
+
+const char *SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::kAvx2: return "avx2";
+        case SimdLevel::kNeon: return "neon";
+        default: return "scalar";
+    }
+}
+
+}  // namespace vlm
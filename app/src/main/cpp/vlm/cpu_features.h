@@ -0,0 +1,39 @@
+#pragma once
+
+namespace vlm {
+
+// Vector instruction set used by the hand-written kernels in vlm/.
+enum class SimdLevel {
+    kScalar,
+    kAvx2,  // x86_64 with AVX2 + FMA + F16C (Magic Leap 2, most build hosts)
+    kNeon,  // arm64
+};
+
+// Best level supported by the running CPU. Cached after the first call.
+SimdLevel DetectSimdLevel();
+
+const char *SimdLevelName(SimdLevel level);
+
+}  // namespace vlm
+
+// Kernels compiled for AVX2 regardless of the target baseline use this on
+// their definitions and are only called when DetectSimdLevel() says so.
+#if defined(__x86_64__) || defined(_M_X64)
+#define VLM_HAVE_AVX2_KERNELS 1
+#define VLM_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#else
+#define VLM_HAVE_AVX2_KERNELS 0
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define VLM_HAVE_NEON_KERNELS 1
+#else
+#define VLM_HAVE_NEON_KERNELS 0
+#endif
+
+// Half precision conversions are arm64-only among the NEON targets.
+#if defined(__aarch64__)
+#define VLM_HAVE_NEON_FP16_KERNELS 1
+#else
+#define VLM_HAVE_NEON_FP16_KERNELS 0
+#endif
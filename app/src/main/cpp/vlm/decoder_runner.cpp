@@ -0,0 +1,708 @@
+#include "decoder_runner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fp16_convert.h"
+#include "ort_utils.h"
+#include "vlm_engine.h"
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+bool Contains(const std::string &haystack, const char *needle) {
+    return haystack.find(needle) != std::string::npos;
+}
+
+// "past_key_values.0.key" -> "present.0.key".
+std::string PresentName(const std::string &past_name) {
+    static const std::string kPast = "past_key_values";
+    std::string name = past_name;
+    return name.replace(name.find(kPast), kPast.size(), "present");
+}
+
+}  // namespace
+
+DecoderRunner::~DecoderRunner() {
+    Release();
+}
+
+void DecoderRunner::Release() {
+    ReleaseLogits();
+    for (CacheSlot &cache : cache_) {
+        ReleaseViews(&cache.views[0]);
+        ReleaseViews(&cache.views[1]);
+    }
+    ReleaseViews(&image_mask_views_);
+    ReleaseViews(&embeddings_views_);
+    ReleaseViews(&ids_views_);
+    ReleaseViews(&position_views_);
+    ReleaseViews(&batch_position_views_);
+    ReleaseViews(&mask_views_);
+    ReleaseViews(&logits_views_);
+    ReleaseViews(&cache_flag_views_);
+    if (binding_) {
+        ort_->ReleaseIoBinding(binding_);
+        binding_ = nullptr;
+    }
+    image_embeddings_ = nullptr;
+}
+
+bool DecoderRunner::Initialize(VlmEngine *engine, DecoderModel model, OrtMemoryInfo *memory_info,
+                               int max_sequence_length, int max_batch, std::string *error) {
+    Release();
+    engine_ = engine;
+    session_ = model == DecoderModel::kDraft ? engine->DraftDecoderSession() : engine->DecoderSession();
+    ort_ = engine->Api();
+    memory_info_ = memory_info;
+    max_sequence_length_ = static_cast<size_t>(max_sequence_length > 0 ? max_sequence_length : 1);
+    max_batch_ = static_cast<size_t>(max_batch > 0 ? max_batch : 1);
+    if (!session_) {
+        *error = "No draft decoder loaded";
+        return false;
+    }
+    const bool draft = model == DecoderModel::kDraft;
+    if (!ResolveInputs(draft ? engine->DraftDecoderInputs() : engine->DecoderInputs(),
+                       draft ? engine->DraftDecoderOutputs() : engine->DecoderOutputs(), error) ||
+        !ResolveCache(error)) {
+        return false;
+    }
+    if (!CheckOrtStatus(ort_, ort_->CreateIoBinding(session_, &binding_), "CreateIoBinding failed", error)) {
+        return false;
+    }
+
+    const size_t max = max_sequence_length_;
+    const bool batched = max_batch_ > 1;
+    ids_.assign(max * max_batch_, 0);
+    positions_.resize(max);
+    for (size_t i = 0; i < max; ++i) {
+        positions_[i] = static_cast<int64_t>(i);
+    }
+    batch_positions_.assign(batched ? max * max_batch_ : 0, 0);
+    ones_.assign(max * max_batch_, 1);
+    ids_views_.assign(max_batch_ * (max + 1), nullptr);
+    position_views_.assign(max * (max + 1), nullptr);
+    batch_position_views_.assign(batched ? max_batch_ * (max + 1) : 0, nullptr);
+    mask_views_.assign(max_batch_ * (max + 1), nullptr);
+    logits_views_.assign(max_batch_ * (max + 1), nullptr);
+    cache_flag_views_.assign(2, nullptr);
+    image_mask_views_.assign(max_batch_ + 1, nullptr);
+    embeddings_views_.assign(max_batch_ + 1, nullptr);
+    gather_readers_.assign(max_batch_, 0);
+    gather_done_.assign(max_batch_, 0);
+    gather_ready_.reserve(max_batch_);
+    gather_moves_.reserve(2 * max_batch_);
+    // Sized for |max_batch_| on the next Reset().
+    image_tokens_ = 0;
+    image_hidden_ = 0;
+    batch_embeddings_.clear();
+    bound_logits_ = nullptr;
+
+    if (vocab_size_ > 0) {
+        AllocateLogits();
+    } else if (!CheckOrtStatus(ort_, ort_->BindOutputToDevice(binding_, logits_name_.c_str(), memory_info_),
+                               "BindOutputToDevice(logits) failed", error)) {
+        return false;
+    }
+    VLM_LOGI("Decoder: %zu inputs, %s", inputs_.size(),
+             UsesKvCache() ? "KV cache enabled" : "no KV cache, full prefix per step");
+    return true;
+}
+
+bool DecoderRunner::ResolveInputs(const std::vector<TensorInfo> &model_inputs,
+                                  const std::vector<TensorInfo> &outputs, std::string *error) {
+    inputs_.clear();
+    cache_.clear();
+    bool has_ids = false;
+    bool has_embeddings = false;
+    for (const TensorInfo &info : model_inputs) {
+        InputSlot slot;
+        slot.name = info.name;
+        if (Contains(info.name, "past_key_values")) {
+            const std::string present = PresentName(info.name);
+            if (FindTensor(outputs, present) < 0) {
+                *error = "Decoder input '" + info.name + "' has no matching '" + present + "' output";
+                return false;
+            }
+            CacheSlot cache;
+            cache.present_name = present;
+            cache.type = info.type;
+            cache.cross_attention = Contains(info.name, ".encoder.");
+            if (info.shape.size() == 4) {
+                cache.heads = info.shape[1];
+                cache.head_dim = info.shape[3];
+            }
+            slot.role = Input::kPastKeyValue;
+            slot.cache_index = static_cast<int>(cache_.size());
+            cache_.push_back(std::move(cache));
+        } else if (info.name == "use_cache_branch") {
+            slot.role = Input::kUseCacheBranch;
+        } else if (Contains(info.name, "input_ids")) {
+            slot.role = Input::kInputIds;
+            has_ids = true;
+            if (max_batch_ > 1 && !info.shape.empty() && info.shape[0] > 0) {
+                *error = "Decoder has a fixed batch size of " + std::to_string(info.shape[0]) +
+                         "; decoding several sequences at once needs a dynamic one";
+                return false;
+            }
+        } else if (Contains(info.name, "position_ids")) {
+            slot.role = Input::kPositionIds;
+        } else if (Contains(info.name, "attention_mask")) {
+            slot.role = Contains(info.name, "encoder") || Contains(info.name, "image") ? Input::kImageAttentionMask
+                                                                                      : Input::kAttentionMask;
+        } else if (FloatElementSize(info.type) != 0 && info.shape.size() == 3) {
+            slot.role = Input::kImageEmbeddings;
+            embeddings_type_ = info.type;
+            has_embeddings = true;
+        } else {
+            *error = "Unsupported decoder input '" + info.name + "'";
+            return false;
+        }
+        inputs_.push_back(std::move(slot));
+    }
+    if (!has_ids || !has_embeddings) {
+        *error = "Decoder must take input_ids and the encoder's image embeddings";
+        return false;
+    }
+
+    if (outputs.empty()) {
+        *error = "Decoder has no outputs";
+        return false;
+    }
+    const int logits_index = FindTensor(outputs, "logits") >= 0 ? FindTensor(outputs, "logits") : 0;
+    const TensorInfo &logits = outputs[logits_index];
+    logits_name_ = logits.name;
+    logits_type_ = logits.type;
+    if (FloatElementSize(logits_type_) == 0) {
+        *error = "Decoder logits must be float or float16";
+        return false;
+    }
+    logits_rank_ = logits.shape.size() == 2 ? 2 : 3;
+    vocab_size_ = logits.shape.empty() ? -1 : logits.shape.back();
+    if (vocab_size_ <= 0) {
+        vocab_size_ = 0;  // learned from the first run
+    }
+    return true;
+}
+
+bool DecoderRunner::ResolveCache(std::string *error) {
+    for (CacheSlot &cache : cache_) {
+        cache.element_size = FloatElementSize(cache.type);
+        if (cache.element_size == 0 || cache.heads <= 0 || cache.head_dim <= 0) {
+            *error = "KV cache '" + cache.present_name +
+                     "' must be a float/float16 [batch, heads, sequence, head_dim] tensor with static heads and "
+                     "head_dim";
+            return false;
+        }
+    }
+    return true;
+}
+
+void DecoderRunner::AllocateLogits() {
+    // The prompt step has the longest run with a KV cache; without one every
+    // sequence of a batch is run whole.
+    size_t rows = max_batch_;
+    if (logits_rank_ == 3) {
+        rows = UsesKvCache() ? std::max(max_sequence_length_, max_batch_) : max_sequence_length_ * max_batch_;
+    }
+    ReleaseViews(&logits_views_);
+    logits_.assign(rows * static_cast<size_t>(vocab_size_), 0.0f);
+    if (logits_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        half_logits_.assign(logits_.size(), 0);
+    }
+    bound_logits_ = nullptr;
+}
+
+bool DecoderRunner::Reset(OrtValue *image_embeddings, std::string *error) {
+    if (!binding_) {
+        *error = "Decoder is not initialized";
+        return false;
+    }
+    OrtTensorTypeAndShapeInfo *info = nullptr;
+    if (!CheckOrtStatus(ort_, ort_->GetTensorTypeAndShape(image_embeddings, &info), "GetTensorTypeAndShape",
+                        error)) {
+        return false;
+    }
+    int64_t dims[3] = {0, 0, 0};
+    const bool have_dims = CheckOrtStatus(ort_, ort_->GetDimensions(info, dims, 3), "GetDimensions", error);
+    ort_->ReleaseTensorTypeAndShapeInfo(info);
+    if (!have_dims) {
+        return false;
+    }
+    image_embeddings_ = image_embeddings;
+    if (dims[1] != image_tokens_ || dims[2] != image_hidden_) {
+        image_tokens_ = dims[1];
+        image_hidden_ = dims[2];
+        ReleaseViews(&image_mask_views_);
+        ReleaseViews(&embeddings_views_);
+        image_mask_.assign(static_cast<size_t>(image_tokens_) * max_batch_, 1);
+        batch_embeddings_.clear();
+    }
+    embedding_rows_ = 0;
+
+    size_t scratch_bytes = UsesKvCache() ? 0 : max_sequence_length_ * sizeof(int64_t);
+    for (CacheSlot &cache : cache_) {
+        const int64_t capacity = cache.cross_attention ? image_tokens_ : static_cast<int64_t>(max_sequence_length_);
+        const size_t row_bytes = static_cast<size_t>(cache.heads * capacity * cache.head_dim) * cache.element_size;
+        const size_t bytes = row_bytes * max_batch_;
+        cache.capacity = capacity;
+        if (!cache.cross_attention) {
+            scratch_bytes = std::max(scratch_bytes, row_bytes);
+        }
+        for (int b = 0; b < 2; ++b) {
+            // Same geometry as the previous sequence: keep the buffer and its views.
+            if (cache.buffers[b].size() == bytes) {
+                continue;
+            }
+            ReleaseViews(&cache.views[b]);
+            cache.buffers[b].assign(bytes, 0);
+            cache.views[b].assign(max_batch_ * (static_cast<size_t>(capacity) + 1), nullptr);
+        }
+    }
+    gather_scratch_.resize(max_batch_ > 1 ? scratch_bytes : 0);
+
+    // Views may have been recreated, so rebind everything on the next step.
+    for (InputSlot &slot : inputs_) {
+        slot.bound = nullptr;
+    }
+    for (CacheSlot &cache : cache_) {
+        cache.bound_output = nullptr;
+    }
+    bound_logits_ = nullptr;
+
+    sequence_length_ = 0;
+    batch_ = 1;
+    current_buffer_ = 0;
+    step_tokens_ = 0;
+    step_batch_ = 1;
+    logits_data_ = nullptr;
+    return true;
+}
+
+bool DecoderRunner::View(std::vector<OrtValue *> *views, size_t index, void *data, size_t bytes,
+                         const int64_t *shape, size_t rank, ONNXTensorElementDataType type, OrtValue **value,
+                         std::string *error) {
+    OrtValue *&view = (*views)[index];
+    if (!view && !CheckOrtStatus(ort_,
+                                 ort_->CreateTensorWithDataAsOrtValue(memory_info_, data, bytes, shape, rank, type,
+                                                                      &view),
+                                 "CreateTensor(view) failed", error)) {
+        return false;
+    }
+    *value = view;
+    return true;
+}
+
+int64_t DecoderRunner::CacheLength(const CacheSlot &cache, size_t sequence_length) const {
+    if (cache.cross_attention) {
+        return sequence_length > 0 ? image_tokens_ : 0;
+    }
+    return static_cast<int64_t>(sequence_length);
+}
+
+bool DecoderRunner::CacheView(CacheSlot *cache, int buffer, size_t batch, int64_t length, OrtValue **value,
+                              std::string *error) {
+    const int64_t shape[4] = {static_cast<int64_t>(batch), cache->heads, length, cache->head_dim};
+    const size_t bytes = batch * static_cast<size_t>(cache->heads * length * cache->head_dim) * cache->element_size;
+    return View(&cache->views[buffer],
+                BatchIndex(batch, static_cast<size_t>(length), static_cast<size_t>(cache->capacity)),
+                cache->buffers[buffer].data(), bytes, shape, 4, cache->type, value, error);
+}
+
+bool DecoderRunner::InputValue(InputSlot *slot, size_t batch, size_t run_tokens, size_t total, OrtValue **value,
+                               std::string *error) {
+    const size_t max = max_sequence_length_;
+    const int64_t run_shape[2] = {static_cast<int64_t>(batch), static_cast<int64_t>(run_tokens)};
+    switch (slot->role) {
+        case Input::kInputIds:
+            return View(&ids_views_, BatchIndex(batch, run_tokens, max), ids_.data(),
+                        batch * run_tokens * sizeof(int64_t), run_shape, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, value,
+                        error);
+        case Input::kPositionIds: {
+            const size_t offset = total - run_tokens;
+            if (batch == 1) {
+                return View(&position_views_, offset * (max + 1) + run_tokens, positions_.data() + offset,
+                            run_tokens * sizeof(int64_t), run_shape, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, value,
+                            error);
+            }
+            for (size_t b = 0; b < batch; ++b) {
+                std::copy(positions_.begin() + offset, positions_.begin() + total,
+                          batch_positions_.begin() + b * run_tokens);
+            }
+            return View(&batch_position_views_, BatchIndex(batch, run_tokens, max), batch_positions_.data(),
+                        batch * run_tokens * sizeof(int64_t), run_shape, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, value,
+                        error);
+        }
+        case Input::kAttentionMask: {
+            const int64_t shape[2] = {static_cast<int64_t>(batch), static_cast<int64_t>(total)};
+            return View(&mask_views_, BatchIndex(batch, total, max), ones_.data(), batch * total * sizeof(int64_t),
+                        shape, 2, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, value, error);
+        }
+        case Input::kUseCacheBranch: {
+            const int64_t shape[1] = {1};
+            const size_t flag = sequence_length_ > 0 ? 1 : 0;
+            return View(&cache_flag_views_, flag, &cache_flags_[flag], sizeof(bool), shape, 1,
+                        ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL, value, error);
+        }
+        case Input::kPastKeyValue: {
+            CacheSlot &cache = cache_[slot->cache_index];
+            return CacheView(&cache, current_buffer_, batch, CacheLength(cache, sequence_length_), value, error);
+        }
+        case Input::kImageEmbeddings: {
+            if (batch == 1) {
+                *value = image_embeddings_;
+                return true;
+            }
+            const int64_t shape[3] = {static_cast<int64_t>(batch), image_tokens_, image_hidden_};
+            return View(&embeddings_views_, batch, batch_embeddings_.data(),
+                        batch * batch_embeddings_.size() / max_batch_, shape, 3, embeddings_type_, value, error);
+        }
+        case Input::kImageAttentionMask: {
+            const int64_t shape[2] = {static_cast<int64_t>(batch), image_tokens_};
+            return View(&image_mask_views_, batch, image_mask_.data(),
+                        batch * static_cast<size_t>(image_tokens_) * sizeof(int64_t), shape, 2,
+                        ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64, value, error);
+        }
+    }
+    *error = "Unsupported decoder input '" + slot->name + "'";
+    return false;
+}
+
+bool DecoderRunner::Step(const int64_t *tokens, size_t count, std::string *error) {
+    if (!image_embeddings_) {
+        *error = "Decoder step before Reset()";
+        return false;
+    }
+    if (batch_ != 1) {
+        *error = "Decoder holds several sequences; continue them with StepBatch()";
+        return false;
+    }
+    if (count == 0 || sequence_length_ + count > max_sequence_length_) {
+        *error = "Decoder sequence exceeds its maximum length";
+        return false;
+    }
+
+    // With a KV cache only the new tokens are fed; otherwise |ids_| keeps the
+    // whole sequence and the new tokens are appended to it.
+    const size_t total = sequence_length_ + count;
+    const size_t run_tokens = UsesKvCache() ? count : total;
+    const size_t write_offset = UsesKvCache() ? 0 : sequence_length_;
+    std::copy(tokens, tokens + count, ids_.begin() + write_offset);
+    return Run(1, run_tokens, total, error);
+}
+
+bool DecoderRunner::StepBatch(const int64_t *tokens, const uint32_t *parents, size_t count, std::string *error) {
+    if (!image_embeddings_ || sequence_length_ == 0) {
+        *error = "Batched decoder step before the first Step()";
+        return false;
+    }
+    if (count == 0 || count > max_batch_) {
+        *error = "Decoder batch exceeds its maximum size";
+        return false;
+    }
+    if (sequence_length_ + 1 > max_sequence_length_) {
+        *error = "Decoder sequence exceeds its maximum length";
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (parents[i] >= batch_) {
+            *error = "Parent sequence out of range";
+            return false;
+        }
+    }
+    if (count > 1 && !FillBatchEmbeddings(count, error)) {
+        return false;
+    }
+
+    GatherSequences(parents, count);
+    const size_t length = sequence_length_;
+    if (UsesKvCache()) {
+        std::copy(tokens, tokens + count, ids_.begin());
+    } else {
+        // Rows grow by one token: move them apart from the last one down,
+        // so no row is overwritten before it has moved.
+        for (size_t row = count; row-- > 0;) {
+            int64_t *ids = ids_.data() + row * (length + 1);
+            std::memmove(ids, ids_.data() + row * length, length * sizeof(int64_t));
+            ids[length] = tokens[row];
+        }
+    }
+    batch_ = count;
+    return Run(count, UsesKvCache() ? 1 : length + 1, length + 1, error);
+}
+
+bool DecoderRunner::Truncate(size_t length, std::string *error) {
+    if (batch_ != 1 || length > sequence_length_) {
+        *error = "Decoder can only truncate a single sequence to a shorter length";
+        return false;
+    }
+    if (UsesKvCache() && length < sequence_length_) {
+        // Each head keeps its first |length| positions, moved down to the
+        // shorter stride in head order, so nothing is overwritten before it
+        // has moved. Without a KV cache |ids_| already holds the prefix.
+        for (CacheSlot &cache : cache_) {
+            if (cache.cross_attention) {
+                continue;
+            }
+            uint8_t *data = cache.buffers[current_buffer_].data();
+            const size_t position_bytes = static_cast<size_t>(cache.head_dim) * cache.element_size;
+            for (size_t head = 1; head < static_cast<size_t>(cache.heads); ++head) {
+                std::memmove(data + head * length * position_bytes, data + head * sequence_length_ * position_bytes,
+                             length * position_bytes);
+            }
+        }
+    }
+    sequence_length_ = length;
+    return true;
+}
+
+bool DecoderRunner::Run(size_t batch, size_t run_tokens, size_t total, std::string *error) {
+    ReleaseLogits();
+    logits_data_ = nullptr;
+
+    bool ok = true;
+    for (size_t i = 0; i < inputs_.size() && ok; ++i) {
+        InputSlot &slot = inputs_[i];
+        OrtValue *value = nullptr;
+        ok = InputValue(&slot, batch, run_tokens, total, &value, error);
+        if (ok && value != slot.bound) {
+            ok = CheckOrtStatus(ort_, ort_->BindInput(binding_, slot.name.c_str(), value), "BindInput failed",
+                                error);
+            slot.bound = ok ? value : nullptr;
+        }
+    }
+    const size_t rows = batch * (logits_rank_ == 3 ? run_tokens : 1);
+    if (ok && vocab_size_ > 0) {
+        const int64_t shape3[3] = {static_cast<int64_t>(batch), static_cast<int64_t>(run_tokens), vocab_size_};
+        const int64_t shape2[2] = {static_cast<int64_t>(batch), vocab_size_};
+        const bool half = logits_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+        OrtValue *value = nullptr;
+        ok = View(&logits_views_, BatchIndex(batch, logits_rank_ == 3 ? run_tokens : 1, max_sequence_length_),
+                  half ? static_cast<void *>(half_logits_.data()) : logits_.data(),
+                  rows * static_cast<size_t>(vocab_size_) * FloatElementSize(logits_type_),
+                  logits_rank_ == 3 ? shape3 : shape2, static_cast<size_t>(logits_rank_), logits_type_, &value,
+                  error);
+        if (ok && value != bound_logits_) {
+            ok = CheckOrtStatus(ort_, ort_->BindOutput(binding_, logits_name_.c_str(), value),
+                                "BindOutput(logits) failed", error);
+            bound_logits_ = ok ? value : nullptr;
+        }
+    }
+    for (size_t c = 0; c < cache_.size() && ok; ++c) {
+        CacheSlot &cache = cache_[c];
+        OrtValue *value = nullptr;
+        ok = CacheView(&cache, current_buffer_ ^ 1, batch, CacheLength(cache, total), &value, error);
+        if (ok && value != cache.bound_output) {
+            ok = CheckOrtStatus(ort_, ort_->BindOutput(binding_, cache.present_name.c_str(), value),
+                                "BindOutput(present) failed", error);
+            cache.bound_output = ok ? value : nullptr;
+        }
+    }
+
+    ok = ok && CheckOrtStatus(ort_, ort_->RunWithBinding(session_, nullptr, binding_),
+                              "Decoder run failed", error);
+    if (ok && vocab_size_ > 0) {
+        if (logits_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+            HalfToFloat(half_logits_.data(), logits_.data(), rows * static_cast<size_t>(vocab_size_));
+        }
+        logits_data_ = logits_.data();
+        logits_rows_ = rows;
+    } else if (ok) {
+        ok = ReadLogitsFromBinding(error);
+    }
+    if (!ok) {
+        return false;
+    }
+    current_buffer_ ^= 1;
+    step_tokens_ = total - sequence_length_;
+    step_batch_ = batch;
+    sequence_length_ = total;
+    return true;
+}
+
+bool DecoderRunner::FillBatchEmbeddings(size_t count, std::string *error) {
+    const size_t row_bytes =
+        static_cast<size_t>(image_tokens_ * image_hidden_) * FloatElementSize(embeddings_type_);
+    if (batch_embeddings_.empty()) {
+        batch_embeddings_.assign(row_bytes * max_batch_, 0);
+    }
+    if (embedding_rows_ >= count) {
+        return true;
+    }
+    void *data = nullptr;
+    if (!CheckOrtStatus(ort_, ort_->GetTensorMutableData(image_embeddings_, &data),
+                        "GetTensorMutableData(image embeddings)", error)) {
+        return false;
+    }
+    for (size_t row = embedding_rows_; row < count; ++row) {
+        std::memcpy(batch_embeddings_.data() + row * row_bytes, data, row_bytes);
+    }
+    embedding_rows_ = count;
+    return true;
+}
+
+void DecoderRunner::GatherSequences(const uint32_t *parents, size_t count) {
+    PlanGather(parents, count);
+    const size_t length = sequence_length_;
+    if (!UsesKvCache()) {
+        GatherRows(reinterpret_cast<uint8_t *>(ids_.data()), length * sizeof(int64_t));
+        return;
+    }
+    for (CacheSlot &cache : cache_) {
+        uint8_t *data = cache.buffers[current_buffer_].data();
+        const size_t row_bytes =
+            static_cast<size_t>(cache.heads * CacheLength(cache, length) * cache.head_dim) * cache.element_size;
+        if (cache.cross_attention) {
+            // Every sequence attends to the same image: new rows copy the first.
+            for (size_t row = batch_; row < count; ++row) {
+                std::memcpy(data + row * row_bytes, data, row_bytes);
+            }
+        } else {
+            GatherRows(data, row_bytes);
+        }
+    }
+}
+
+void DecoderRunner::PlanGather(const uint32_t *parents, size_t count) {
+    // Row i is read by the rows that take it as parent, so it is written
+    // once they all have been; rows that keep their contents are skipped.
+    // What is left are cycles, rotated through one scratch row.
+    gather_moves_.clear();
+    gather_ready_.clear();
+    std::fill(gather_readers_.begin(), gather_readers_.end(), 0);
+    std::fill(gather_done_.begin(), gather_done_.end(), 0);
+    for (size_t row = 0; row < count; ++row) {
+        if (parents[row] != row) {
+            ++gather_readers_[parents[row]];
+        }
+    }
+    for (size_t row = 0; row < count; ++row) {
+        if (parents[row] != row && gather_readers_[row] == 0) {
+            gather_ready_.push_back(static_cast<uint32_t>(row));
+        }
+    }
+    while (!gather_ready_.empty()) {
+        const uint32_t row = gather_ready_.back();
+        gather_ready_.pop_back();
+        const uint32_t parent = parents[row];
+        gather_moves_.push_back(GatherMove{static_cast<int>(parent), static_cast<int>(row)});
+        gather_done_[row] = 1;
+        if (--gather_readers_[parent] == 0 && parent < count && parents[parent] != parent) {
+            gather_ready_.push_back(parent);
+        }
+    }
+    for (size_t start = 0; start < count; ++start) {
+        if (parents[start] == start || gather_done_[start]) {
+            continue;
+        }
+        gather_moves_.push_back(GatherMove{static_cast<int>(start), kScratchRow});
+        size_t row = start;
+        while (parents[row] != start) {
+            gather_moves_.push_back(GatherMove{static_cast<int>(parents[row]), static_cast<int>(row)});
+            gather_done_[row] = 1;
+            row = parents[row];
+        }
+        gather_moves_.push_back(GatherMove{kScratchRow, static_cast<int>(row)});
+        gather_done_[row] = 1;
+    }
+}
+
+void DecoderRunner::GatherRows(uint8_t *data, size_t row_bytes) {
+    for (const GatherMove &move : gather_moves_) {
+        const uint8_t *from = move.from == kScratchRow ? gather_scratch_.data() : data + move.from * row_bytes;
+        uint8_t *to = move.to == kScratchRow ? gather_scratch_.data() : data + move.to * row_bytes;
+        std::memcpy(to, from, row_bytes);
+    }
+}
+
+// Used only until the vocab size is known: takes the logits ORT allocated,
+// learns the shape and switches to the preallocated logits buffer.
+bool DecoderRunner::ReadLogitsFromBinding(std::string *error) {
+    OrtAllocator *allocator = nullptr;
+    OrtValue **values = nullptr;
+    size_t count = 0;
+    if (!CheckOrtStatus(ort_, ort_->GetAllocatorWithDefaultOptions(&allocator), "GetAllocatorWithDefaultOptions",
+                        error) ||
+        !CheckOrtStatus(ort_, ort_->GetBoundOutputValues(binding_, allocator, &values, &count),
+                        "GetBoundOutputValues failed", error)) {
+        return false;
+    }
+    // Logits are bound first, in Initialize().
+    ort_logits_ = count > 0 ? values[0] : nullptr;
+    for (size_t i = 1; i < count; ++i) {
+        ort_->ReleaseValue(values[i]);
+    }
+    allocator->Free(allocator, values);
+    if (!ort_logits_) {
+        *error = "Decoder produced no logits";
+        return false;
+    }
+
+    OrtTensorTypeAndShapeInfo *info = nullptr;
+    size_t rank = 0;
+    int64_t dims[3] = {0, 0, 0};
+    void *data = nullptr;
+    bool ok = CheckOrtStatus(ort_, ort_->GetTensorTypeAndShape(ort_logits_, &info), "GetTensorTypeAndShape", error);
+    if (ok) {
+        ok = CheckOrtStatus(ort_, ort_->GetDimensionsCount(info, &rank), "GetDimensionsCount", error);
+        if (ok && (rank < 2 || rank > 3)) {
+            *error = "Unexpected logits rank";
+            ok = false;
+        }
+        ok = ok && CheckOrtStatus(ort_, ort_->GetDimensions(info, dims, rank), "GetDimensions", error);
+        ort_->ReleaseTensorTypeAndShapeInfo(info);
+    }
+    ok = ok && CheckOrtStatus(ort_, ort_->GetTensorMutableData(ort_logits_, &data), "GetTensorMutableData(logits)",
+                              error);
+    if (!ok) {
+        return false;
+    }
+    logits_rank_ = static_cast<int>(rank);
+    vocab_size_ = dims[rank - 1];
+    logits_rows_ = static_cast<size_t>(dims[0]) * (rank == 3 ? static_cast<size_t>(dims[1]) : 1);
+    AllocateLogits();
+    if (logits_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        HalfToFloat(static_cast<const uint16_t *>(data), logits_.data(),
+                    logits_rows_ * static_cast<size_t>(vocab_size_));
+        logits_data_ = logits_.data();
+    } else {
+        logits_data_ = static_cast<float *>(data);
+    }
+    return true;
+}
+
+float *DecoderRunner::Logits(size_t position) {
+    if (!logits_data_ || step_batch_ != 1 || position >= step_tokens_ || logits_rows_ + position < step_tokens_) {
+        return nullptr;
+    }
+    const size_t row = logits_rows_ - step_tokens_ + position;
+    return logits_data_ + row * static_cast<size_t>(vocab_size_);
+}
+
+float *DecoderRunner::SequenceLogits(size_t sequence) {
+    if (!logits_data_ || sequence >= step_batch_) {
+        return nullptr;
+    }
+    const size_t rows = logits_rows_ / step_batch_;
+    return logits_data_ + (sequence * rows + rows - 1) * static_cast<size_t>(vocab_size_);
+}
+
+void DecoderRunner::ReleaseViews(std::vector<OrtValue *> *views) {
+    for (OrtValue *&view : *views) {
+        if (view) {
+            ort_->ReleaseValue(view);
+            view = nullptr;
+        }
+    }
+}
+
+void DecoderRunner::ReleaseLogits() {
+    if (ort_logits_) {
+        ort_->ReleaseValue(ort_logits_);
+        ort_logits_ = nullptr;
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "onnxruntime/core/session/onnxruntime_c_api.h"
+#include "ort_utils.h"
+
+namespace vlm {
+
+class VlmEngine;
+
+// Which of the engine's decoder sessions a runner drives.
+enum class DecoderModel {
+    kMain,
+    kDraft,
+};
+
+// Runs the text decoder one step at a time on the session owned by a
+// VlmEngine.
+//
+// If the decoder exposes "past_key_values.*" inputs with matching "present.*"
+// outputs (for example an optimum "decoder_model_merged.onnx"), only the new
+// tokens are fed on each step and the KV cache is kept in two preallocated
+// buffers per cache tensor, sized for the maximum sequence length. The
+// decoder writes "present" straight into the spare buffer, which becomes
+// "past" on the next step, so the cache is never copied and per-token cost
+// stays flat. Other decoders are run on the whole prefix every step.
+//
+// The image embeddings and the logits may be float or float16. Float16
+// logits are converted to float once per step, so callers always read float.
+//
+// After the prompt, StepBatch() continues several sequences at once in the
+// batch dimension, for beam search: the cache rows of the sequences that go
+// on are gathered in place, so a step costs one decoder run however the
+// batch was reordered.
+//
+// Truncate() drops the last tokens of a single sequence again, for
+// speculative decoding: a draft decoder proposes several tokens, the main
+// one checks them all in one Step(), and the ones it rejects are taken back.
+//
+// All inputs and outputs live in fixed buffers and are passed through an
+// OrtIoBinding. The OrtValue views over those buffers are created the first
+// time each shape is needed and then reused, so once every sequence length
+// has been seen a step makes no allocations of its own.
+class DecoderRunner {
+public:
+    DecoderRunner() = default;
+    ~DecoderRunner();
+    DecoderRunner(const DecoderRunner &) = delete;
+    DecoderRunner &operator=(const DecoderRunner &) = delete;
+
+    // Resolves the inputs/outputs of |model|. |max_sequence_length| bounds
+    // the total number of tokens (prompt included) of one sequence,
+    // |max_batch| the sequences of a StepBatch(); above 1 the decoder needs a
+    // dynamic batch dimension.
+    bool Initialize(VlmEngine *engine, DecoderModel model, OrtMemoryInfo *memory_info, int max_sequence_length,
+                    int max_batch, std::string *error);
+
+    // Starts a new sequence conditioned on |image_embeddings| ([1, tokens,
+    // hidden] of ImageEmbeddingsType()), which must stay alive until the
+    // sequence ends.
+    bool Reset(OrtValue *image_embeddings, std::string *error);
+
+    // Appends |count| tokens to the sequence and runs the decoder. Afterwards
+    // Logits(i) is the next-token distribution after the i-th appended token.
+    // Only while there is a single sequence.
+    bool Step(const int64_t *tokens, size_t count, std::string *error);
+
+    // Continues |count| sequences by one token each: the i-th new sequence
+    // is sequence |parents[i]| of the last step followed by |tokens[i]|.
+    // Parents may repeat or be left out, so the batch can grow and shrink.
+    // Afterwards SequenceLogits(i) is the next-token distribution of the
+    // i-th sequence.
+    bool StepBatch(const int64_t *tokens, const uint32_t *parents, size_t count, std::string *error);
+
+    // Shortens the single sequence to its first |length| tokens, so the next
+    // Step() continues from there. The logits of the last step are left as
+    // they are.
+    bool Truncate(size_t length, std::string *error);
+
+    // Row of VocabSize() logits; |position| is in [0, count) of the last Step().
+    // Rows may be changed in place, e.g. by a repetition penalty, until the
+    // next Step().
+    float *Logits(size_t position);
+    const float *Logits(size_t position) const {
+        return const_cast<DecoderRunner *>(this)->Logits(position);
+    }
+    float *LastLogits() {
+        return Logits(step_tokens_ - 1);
+    }
+    // Row after the last token of sequence |sequence| of the last step.
+    float *SequenceLogits(size_t sequence);
+    int64_t VocabSize() const {
+        return vocab_size_;
+    }
+    ONNXTensorElementDataType ImageEmbeddingsType() const {
+        return embeddings_type_;
+    }
+    ONNXTensorElementDataType LogitsType() const {
+        return logits_type_;
+    }
+
+    // Tokens consumed so far in each current sequence.
+    size_t SequenceLength() const {
+        return sequence_length_;
+    }
+    size_t BatchSize() const {
+        return batch_;
+    }
+    bool UsesKvCache() const {
+        return !cache_.empty();
+    }
+
+private:
+    enum class Input {
+        kInputIds,
+        kAttentionMask,
+        kPositionIds,
+        kImageEmbeddings,
+        kImageAttentionMask,
+        kPastKeyValue,
+        kUseCacheBranch,
+    };
+
+    struct InputSlot {
+        std::string name;
+        Input role = Input::kInputIds;
+        int cache_index = -1;       // kPastKeyValue only
+        OrtValue *bound = nullptr;  // last value handed to the binding
+    };
+
+    // One past/present pair. Cross-attention entries (".encoder.") hold the
+    // projected image tokens and keep a fixed length once filled.
+    struct CacheSlot {
+        std::string present_name;
+        ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        size_t element_size = 0;
+        int64_t heads = 0;
+        int64_t head_dim = 0;
+        int64_t capacity = 0;  // sequence length of the buffers
+        bool cross_attention = false;
+        std::vector<uint8_t> buffers[2];
+        std::vector<OrtValue *> views[2];  // indexed by (batch, sequence length)
+        OrtValue *bound_output = nullptr;
+    };
+
+    // One row copy of a gather; kScratchRow stands for |gather_scratch_|.
+    struct GatherMove {
+        int from;
+        int to;
+    };
+    static constexpr int kScratchRow = -1;
+
+    void Release();
+    bool ResolveInputs(const std::vector<TensorInfo> &model_inputs, const std::vector<TensorInfo> &outputs,
+                       std::string *error);
+    bool ResolveCache(std::string *error);
+    void AllocateLogits();
+    // Index of the view of a [batch, length, ...] tensor.
+    size_t BatchIndex(size_t batch, size_t length, size_t max_length) const {
+        return (batch - 1) * (max_length + 1) + length;
+    }
+    // Binds the inputs and outputs for |batch| sequences of |run_tokens|
+    // new tokens, |total| tokens long each, and runs the decoder.
+    bool Run(size_t batch, size_t run_tokens, size_t total, std::string *error);
+    // Orders the row copies that make row i hold row parents[i] in place.
+    void PlanGather(const uint32_t *parents, size_t count);
+    void GatherRows(uint8_t *data, size_t row_bytes);
+    // Reorders the KV cache, or the token rows without one, for StepBatch().
+    void GatherSequences(const uint32_t *parents, size_t count);
+    // Copies the image embeddings into the first |count| rows of
+    // |batch_embeddings_|.
+    bool FillBatchEmbeddings(size_t count, std::string *error);
+    // Returns the cached view at (*views)[index], creating it on first use.
+    bool View(std::vector<OrtValue *> *views, size_t index, void *data, size_t bytes, const int64_t *shape,
+              size_t rank, ONNXTensorElementDataType type, OrtValue **value, std::string *error);
+    bool InputValue(InputSlot *slot, size_t batch, size_t run_tokens, size_t total, OrtValue **value,
+                    std::string *error);
+    bool CacheView(CacheSlot *cache, int buffer, size_t batch, int64_t length, OrtValue **value, std::string *error);
+    int64_t CacheLength(const CacheSlot &cache, size_t sequence_length) const;
+    bool ReadLogitsFromBinding(std::string *error);
+    void ReleaseViews(std::vector<OrtValue *> *views);
+    void ReleaseLogits();
+
+    VlmEngine *engine_ = nullptr;
+    OrtSession *session_ = nullptr;
+    const OrtApi *ort_ = nullptr;
+    OrtMemoryInfo *memory_info_ = nullptr;
+    OrtIoBinding *binding_ = nullptr;
+    size_t max_sequence_length_ = 0;
+    size_t max_batch_ = 1;
+
+    std::vector<InputSlot> inputs_;
+    std::vector<CacheSlot> cache_;
+    std::string logits_name_;
+    int64_t vocab_size_ = 0;
+    int logits_rank_ = 3;
+    ONNXTensorElementDataType logits_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    ONNXTensorElementDataType embeddings_type_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+
+    OrtValue *image_embeddings_ = nullptr;
+    int64_t image_tokens_ = 0;
+    int64_t image_hidden_ = 0;
+    std::vector<int64_t> image_mask_;
+    std::vector<OrtValue *> image_mask_views_;  // by batch
+    // Copies of the image embeddings, one per sequence of a batch, made on
+    // the first StepBatch() of a sequence that needs them.
+    std::vector<uint8_t> batch_embeddings_;
+    std::vector<OrtValue *> embeddings_views_;  // by batch
+    size_t embedding_rows_ = 0;
+
+    size_t sequence_length_ = 0;
+    size_t batch_ = 1;
+    int current_buffer_ = 0;
+
+    std::vector<GatherMove> gather_moves_;
+    std::vector<uint32_t> gather_readers_;  // rows still to be read, by row
+    std::vector<uint32_t> gather_ready_;
+    std::vector<uint8_t> gather_done_;
+    std::vector<uint8_t> gather_scratch_;  // one row of the largest gathered tensor
+
+    // Fixed-size backing stores for the bound tensors. Without a KV cache
+    // |ids_| holds the whole sequences, one row after the other; with one,
+    // just the new tokens.
+    std::vector<int64_t> ids_;
+    std::vector<int64_t> positions_;        // 0, 1, 2, ...
+    std::vector<int64_t> batch_positions_;  // written by each batched step
+    std::vector<int64_t> ones_;             // attention mask
+    std::vector<float> logits_;
+    std::vector<uint16_t> half_logits_;  // bound instead of |logits_| for float16 logits
+    OrtValue *bound_logits_ = nullptr;
+    bool cache_flags_[2] = {false, true};
+    std::vector<OrtValue *> ids_views_;             // by (batch, length)
+    std::vector<OrtValue *> position_views_;        // by (offset, length)
+    std::vector<OrtValue *> batch_position_views_;  // by (batch, length)
+    std::vector<OrtValue *> mask_views_;            // by (batch, length)
+    std::vector<OrtValue *> logits_views_;          // by (batch, length)
+    std::vector<OrtValue *> cache_flag_views_;      // by flag
+
+    OrtValue *ort_logits_ = nullptr;  // used while the vocab size is unknown
+    float *logits_data_ = nullptr;
+    size_t logits_rows_ = 0;
+    size_t step_tokens_ = 0;
+    size_t step_batch_ = 1;
+};
+
+}  // namespace vlm
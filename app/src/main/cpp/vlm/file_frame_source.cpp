@@ -0,0 +1,81 @@
+#include "file_frame_source.h"
+
+#include <chrono>
+#include <utility>
+
+#include "file_utils.h"
+
+namespace vlm {
+
+FileFrameSource::FileFrameSource(FramePool *pool, std::vector<std::string> paths, double fps, int loops)
+    : pool_(pool), paths_(std::move(paths)), fps_(fps > 0.0 ? fps : 30.0), loops_(loops < 0 ? 0 : loops) {}
+
+FileFrameSource::~FileFrameSource() {
+    Stop();
+}
+
+bool FileFrameSource::Start(FrameSink *sink, std::string *error) {
+    Stop();
+    if (paths_.empty()) {
+        *error = "No frames to replay";
+        return false;
+    }
+    images_.resize(paths_.size());
+    for (size_t i = 0; i < paths_.size(); ++i) {
+        if (!ReadFile(paths_[i], &images_[i], error)) {
+            return false;
+        }
+    }
+    sink_ = sink;
+    offered_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    finished_.store(false, std::memory_order_release);
+    running_.store(true, std::memory_order_relaxed);
+    thread_ = std::thread(&FileFrameSource::Run, this);
+    return true;
+}
+
+void FileFrameSource::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_.store(false, std::memory_order_relaxed);
+    }
+    stop_condition_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void FileFrameSource::Run() {
+    using Clock = std::chrono::steady_clock;
+    const std::chrono::nanoseconds period(static_cast<int64_t>(1e9 / fps_));
+    const Clock::time_point start = Clock::now();
+    const uint64_t total = loops_ > 0 ? static_cast<uint64_t>(loops_) * images_.size() : UINT64_MAX;
+    for (uint64_t n = 0; n < total; ++n) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stop_condition_.wait_until(lock, start + period * n,
+                                           [this]() { return !running_.load(std::memory_order_relaxed); })) {
+                return;
+            }
+        }
+        const int64_t timestamp_ns = static_cast<int64_t>(n) * period.count();
+        offered_.fetch_add(1, std::memory_order_relaxed);
+        if (!sink_->WantsFrame(timestamp_ns)) {
+            continue;
+        }
+        std::shared_ptr<Frame> frame = pool_->Acquire();
+        if (!frame) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        const std::vector<uint8_t> &image = images_[n % images_.size()];
+        frame->Assign(image.data(), image.size());
+        frame->frame_id = n;
+        frame->timestamp_ns = timestamp_ns;
+        sink_->OnFrame(std::move(frame));
+    }
+    finished_.store(true, std::memory_order_release);
+}
+
+}  // namespace vlm
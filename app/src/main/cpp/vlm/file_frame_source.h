@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_source.h"
+
+namespace vlm {
+
+// Replays JPEG files as a video stream on its own thread: one file per frame
+// at |fps|, in order, |loops| times over the list (0 repeats forever).
+// Timestamps start at zero and advance by the frame period, like a camera's,
+// so live captioning can be exercised without a headset.
+class FileFrameSource : public FrameSource {
+public:
+    FileFrameSource(FramePool *pool, std::vector<std::string> paths, double fps, int loops);
+    ~FileFrameSource() override;
+    FileFrameSource(const FileFrameSource &) = delete;
+    FileFrameSource &operator=(const FileFrameSource &) = delete;
+
+    // Reads every file up front so disk I/O does not disturb the timing.
+    bool Start(FrameSink *sink, std::string *error) override;
+    void Stop() override;
+
+    // True once the last frame has been offered to the sink.
+    bool Finished() const {
+        return finished_.load(std::memory_order_acquire);
+    }
+    uint64_t FramesOffered() const {
+        return offered_.load(std::memory_order_relaxed);
+    }
+    // Frames the sink wanted but no pool buffer was free for.
+    uint64_t FramesDropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Run();
+
+    FramePool *pool_;
+    std::vector<std::string> paths_;
+    std::vector<std::vector<uint8_t>> images_;
+    double fps_;
+    int loops_;
+    FrameSink *sink_ = nullptr;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> finished_{false};
+    std::atomic<uint64_t> offered_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::mutex mutex_;
+    std::condition_variable stop_condition_;
+};
+
+}  // namespace vlm
@@ -0,0 +1,92 @@
+#include "file_utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace vlm {
+
+bool ReadFile(const std::string &path, std::vector<uint8_t> *out, std::string *error) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        if (error) {
+            *error = "Failed to open " + path + ": " + strerror(errno);
+        }
+        return false;
+    }
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    const long size = ok ? ftell(file) : -1;
+    ok = ok && size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        out->resize(static_cast<size_t>(size));
+        ok = size == 0 || fread(out->data(), static_cast<size_t>(size), 1, file) == 1;
+    }
+    fclose(file);
+    if (!ok && error) {
+        *error = "Failed to read " + path;
+    }
+    return ok;
+}
+
+bool FileExists(const std::string &path) {
+    struct stat info = {};
+    return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+size_t FileSize(const std::string &path) {
+    struct stat info = {};
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return 0;
+    }
+    return static_cast<size_t>(info.st_size);
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string &path, std::string *error) {
+    Close();
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (error) {
+            *error = "Failed to open " + path + ": " + strerror(errno);
+        }
+        return false;
+    }
+    struct stat info = {};
+    bool ok = fstat(fd, &info) == 0;
+    if (ok && info.st_size == 0) {
+        errno = EINVAL;  // mmap of an empty file is not possible
+        ok = false;
+    }
+    if (ok) {
+        void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = data != MAP_FAILED;
+        if (ok) {
+            data_ = data;
+            size_ = static_cast<size_t>(info.st_size);
+        }
+    }
+    if (!ok && error) {
+        *error = "Failed to map " + path + ": " + strerror(errno);
+    }
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    return ok;
+}
+
+void MappedFile::Close() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vlm {
+
+// Reads the whole file at |path| into |out|. Returns false and fills |error|
+// if it cannot be opened or read.
+bool ReadFile(const std::string &path, std::vector<uint8_t> *out, std::string *error);
+
+bool FileExists(const std::string &path);
+// Size of the regular file at |path| in bytes, 0 if it does not exist.
+size_t FileSize(const std::string &path);
+
+// Read-only mapping of a whole file. Pages are faulted in from the file on
+// first touch and can be dropped by the kernel under pressure, so the
+// contents never have to be copied into heap memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool Open(const std::string &path, std::string *error);
+    void Close();
+
+    bool IsOpen() const {
+        return data_ != nullptr;
+    }
+    const uint8_t *Data() const {
+        return static_cast<const uint8_t *>(data_);
+    }
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace vlm
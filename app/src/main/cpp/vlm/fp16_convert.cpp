@@ -0,0 +1,131 @@
+#include "fp16_convert.h"
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#include "onnxruntime/core/session/onnxruntime_float16.h"
+
+namespace vlm {
+
+namespace {
+
+// Exposes the scalar conversions of the ONNX Runtime float16 header.
+struct Half : onnxruntime_float16::Float16Impl<Half> {
+    static uint16_t FromFloat(float value) {
+        return ToUint16Impl(value);
+    }
+    static float ToFloat(uint16_t bits) {
+        Half half;
+        half.val = bits;
+        return half.ToFloatImpl();
+    }
+};
+
+#if VLM_HAVE_AVX2_KERNELS
+VLM_TARGET_AVX2 size_t FloatToHalfAvx2(const float *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i lo = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        const __m128i hi = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), hi);
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+VLM_TARGET_AVX2 size_t HalfToFloatAvx2(const uint16_t *src, float *dst, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(lo));
+        _mm256_storeu_ps(dst + i + 8, _mm256_cvtph_ps(hi));
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i))));
+    }
+    return i;
+}
+#endif
+
+#if VLM_HAVE_NEON_FP16_KERNELS
+size_t FloatToHalfNeon(const float *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float16x4_t lo = vcvt_f16_f32(vld1q_f32(src + i));
+        const float16x4_t hi = vcvt_f16_f32(vld1q_f32(src + i + 4));
+        vst1q_u16(dst + i, vreinterpretq_u16_f16(vcombine_f16(lo, hi)));
+    }
+    for (; i + 4 <= count; i += 4) {
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+    }
+    return i;
+}
+
+size_t HalfToFloatNeon(const uint16_t *src, float *dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float16x8_t half = vreinterpretq_f16_u16(vld1q_u16(src + i));
+        vst1q_f32(dst + i, vcvt_f32_f16(vget_low_f16(half)));
+        vst1q_f32(dst + i + 4, vcvt_high_f32_f16(half));
+    }
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+    return i;
+}
+#endif
+
+}  // namespace
+
+uint16_t FloatToHalf(float value) {
+    return Half::FromFloat(value);
+}
+
+float HalfToFloat(uint16_t value) {
+    return Half::ToFloat(value);
+}
+
+void FloatToHalf(const float *src, uint16_t *dst, size_t count, SimdLevel level) {
+    size_t done = 0;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        done = FloatToHalfAvx2(src, dst, count);
+    }
+#endif
+#if VLM_HAVE_NEON_FP16_KERNELS
+    if (level == SimdLevel::kNeon) {
+        done = FloatToHalfNeon(src, dst, count);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        dst[i] = Half::FromFloat(src[i]);
+    }
+}
+
+void HalfToFloat(const uint16_t *src, float *dst, size_t count, SimdLevel level) {
+    size_t done = 0;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        done = HalfToFloatAvx2(src, dst, count);
+    }
+#endif
+#if VLM_HAVE_NEON_FP16_KERNELS
+    if (level == SimdLevel::kNeon) {
+        done = HalfToFloatNeon(src, dst, count);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        dst[i] = Half::ToFloat(src[i]);
+    }
+}
+
+}  // namespace vlm
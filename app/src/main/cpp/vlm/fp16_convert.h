@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_features.h"
+
+namespace vlm {
+
+// IEEE half precision values are passed around as their uint16_t bit
+// patterns, the layout of ONNX Runtime's float16 tensors.
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// Whole-array conversions with the given kernel (F16C on x86_64, the NEON
+// conversion instructions on arm64). Rounding is to nearest even, the same
+// as ONNX Runtime's Cast, so tensors converted here match the ones the models
+// would produce themselves.
+void FloatToHalf(const float *src, uint16_t *dst, size_t count, SimdLevel level);
+void HalfToFloat(const uint16_t *src, float *dst, size_t count, SimdLevel level);
+
+inline void FloatToHalf(const float *src, uint16_t *dst, size_t count) {
+    FloatToHalf(src, dst, count, DetectSimdLevel());
+}
+inline void HalfToFloat(const uint16_t *src, float *dst, size_t count) {
+    HalfToFloat(src, dst, count, DetectSimdLevel());
+}
+
+}  // namespace vlm
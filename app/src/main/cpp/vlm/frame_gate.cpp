@@ -0,0 +1,168 @@
+#include "frame_gate.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace vlm {
+
+namespace {
+
+// BT.601 luma of the un-normalized channels: sum(weight * (p * std + mean))
+// is a per-channel scale of the tensor plus a constant.
+constexpr float kLumaWeights[3] = {0.299f, 0.587f, 0.114f};
+
+// sums[x] += r[x] * k0 + g[x] * k1 + b[x] * k2 over [begin, end).
+void AccumulateLumaScalar(const float *r, const float *g, const float *b, const float *k, float *sums, int begin,
+                          int end) {
+    for (int x = begin; x < end; ++x) {
+        sums[x] += r[x] * k[0] + g[x] * k[1] + b[x] * k[2];
+    }
+}
+
+#if VLM_HAVE_AVX2_KERNELS
+VLM_TARGET_AVX2 int AccumulateLumaAvx2(const float *r, const float *g, const float *b, const float *k, float *sums,
+                                       int end) {
+    const __m256 k0 = _mm256_set1_ps(k[0]);
+    const __m256 k1 = _mm256_set1_ps(k[1]);
+    const __m256 k2 = _mm256_set1_ps(k[2]);
+    int x = 0;
+    for (; x + 8 <= end; x += 8) {
+        __m256 acc = _mm256_loadu_ps(sums + x);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(r + x), k0, acc);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(g + x), k1, acc);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(b + x), k2, acc);
+        _mm256_storeu_ps(sums + x, acc);
+    }
+    return x;
+}
+#endif
+
+#if VLM_HAVE_NEON_KERNELS
+int AccumulateLumaNeon(const float *r, const float *g, const float *b, const float *k, float *sums, int end) {
+    int x = 0;
+    for (; x + 4 <= end; x += 4) {
+        float32x4_t acc = vld1q_f32(sums + x);
+        acc = vmlaq_n_f32(acc, vld1q_f32(r + x), k[0]);
+        acc = vmlaq_n_f32(acc, vld1q_f32(g + x), k[1]);
+        acc = vmlaq_n_f32(acc, vld1q_f32(b + x), k[2]);
+        vst1q_f32(sums + x, acc);
+    }
+    return x;
+}
+#endif
+
+// First source index of thumbnail cell |cell| when |size| pixels are split
+// into |cells| nearly equal runs.
+inline int CellStart(int cell, int size, int cells) {
+    return static_cast<int>(static_cast<int64_t>(cell) * size / cells);
+}
+
+}  // namespace
+
+void ComputeFrameSignature(const float *pixels, const PreprocessConfig &config, FrameSignature *signature,
+                           std::vector<float> *row_sums, SimdLevel level) {
+    constexpr int kWidth = FrameSignature::kWidth;
+    constexpr int kHeight = FrameSignature::kHeight;
+    const int width = config.width;
+    const int height = config.height;
+    const size_t plane = static_cast<size_t>(width) * height;
+
+    float k[3];
+    float offset = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        k[c] = kLumaWeights[c] * config.std[c];
+        offset += kLumaWeights[c] * config.mean[c];
+    }
+
+    row_sums->resize(width);
+    float *sums = row_sums->data();
+    for (int cy = 0; cy < kHeight; ++cy) {
+        const int y_begin = CellStart(cy, height, kHeight);
+        const int y_end = CellStart(cy + 1, height, kHeight);
+        // Columns are summed over the rows of the cell first, vectorized,
+        // then each run of columns collapses into one cell.
+        std::fill(sums, sums + width, 0.0f);
+        for (int y = y_begin; y < y_end; ++y) {
+            const float *r = pixels + static_cast<size_t>(y) * width;
+            const float *g = r + plane;
+            const float *b = g + plane;
+            int done = 0;
+#if VLM_HAVE_AVX2_KERNELS
+            if (level == SimdLevel::kAvx2) {
+                done = AccumulateLumaAvx2(r, g, b, k, sums, width);
+            }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+            if (level == SimdLevel::kNeon) {
+                done = AccumulateLumaNeon(r, g, b, k, sums, width);
+            }
+#endif
+            AccumulateLumaScalar(r, g, b, k, sums, done, width);
+        }
+        for (int cx = 0; cx < kWidth; ++cx) {
+            const int x_begin = CellStart(cx, width, kWidth);
+            const int x_end = CellStart(cx + 1, width, kWidth);
+            float sum = 0.0f;
+            for (int x = x_begin; x < x_end; ++x) {
+                sum += sums[x];
+            }
+            const int count = (x_end - x_begin) * (y_end - y_begin);
+            signature->thumbnail[cy * kWidth + cx] = count > 0 ? sum / count + offset : offset;
+        }
+    }
+
+    // dHash over the thumbnail pooled 2x2 to 9x8: one bit per horizontal
+    // neighbour pair.
+    uint64_t hash = 0;
+    for (int hy = 0; hy < kHeight / 2; ++hy) {
+        const float *top = signature->thumbnail + (2 * hy) * kWidth;
+        const float *bottom = top + kWidth;
+        float left = top[0] + top[1] + bottom[0] + bottom[1];
+        for (int hx = 1; hx < kWidth / 2; ++hx) {
+            const float right = top[2 * hx] + top[2 * hx + 1] + bottom[2 * hx] + bottom[2 * hx + 1];
+            hash = (hash << 1) | (left > right ? 1u : 0u);
+            left = right;
+        }
+    }
+    signature->hash = hash;
+}
+
+int HashDistance(const FrameSignature &a, const FrameSignature &b) {
+    return __builtin_popcountll(a.hash ^ b.hash);
+}
+
+float MeanDifference(const FrameSignature &a, const FrameSignature &b) {
+    constexpr int kCells = FrameSignature::kWidth * FrameSignature::kHeight;
+    float sum = 0.0f;
+    for (int i = 0; i < kCells; ++i) {
+        sum += std::fabs(a.thumbnail[i] - b.thumbnail[i]);
+    }
+    return sum / kCells;
+}
+
+bool FrameGate::Unchanged(const float *pixels, const PreprocessConfig &config, SimdLevel level) {
+    ComputeFrameSignature(pixels, config, &current_, &row_sums_, level);
+    if (!has_reference_) {
+        last_hash_distance_ = 64;
+        last_mean_difference_ = 1.0f;
+        return false;
+    }
+    last_hash_distance_ = HashDistance(current_, reference_);
+    last_mean_difference_ = MeanDifference(current_, reference_);
+    return last_hash_distance_ <= config_.max_hash_distance &&
+           last_mean_difference_ <= config_.max_mean_difference;
+}
+
+void FrameGate::Accept() {
+    reference_ = current_;
+    has_reference_ = true;
+}
+
+}  // namespace vlm
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+#include "image_preprocess.h"
+
+namespace vlm {
+
+struct FrameGateConfig {
+    bool enabled = false;
+    // A frame counts as the same scene as the last one encoded when both of
+    // its distances to it are within these bounds.
+    int max_hash_distance = 5;         // differing bits out of 64
+    float max_mean_difference = 0.03f;  // mean absolute luma change, 0..1
+};
+
+// Small luma summary of an encoder input: an 18x16 thumbnail (box averages,
+// 0..1) and a 64-bit difference hash of it. The hash ignores brightness and
+// catches structural change; the thumbnail difference catches lighting and
+// small objects the hash is blind to.
+struct FrameSignature {
+    static constexpr int kWidth = 18;
+    static constexpr int kHeight = 16;
+
+    uint64_t hash = 0;
+    float thumbnail[kWidth * kHeight] = {};
+};
+
+// Summarizes |pixels|, the normalized planar CHW tensor described by
+// |config|. |row_sums| is scratch space reused between calls.
+void ComputeFrameSignature(const float *pixels, const PreprocessConfig &config, FrameSignature *signature,
+                           std::vector<float> *row_sums, SimdLevel level);
+
+int HashDistance(const FrameSignature &a, const FrameSignature &b);
+float MeanDifference(const FrameSignature &a, const FrameSignature &b);
+
+// Decides whether a frame is worth encoding, by comparing it with the last
+// frame that was. Costs one pass over the encoder input, a small fraction of
+// the preprocessing it follows.
+class FrameGate {
+public:
+    void Configure(const FrameGateConfig &config) {
+        config_ = config;
+        Reset();
+    }
+    bool Enabled() const {
+        return config_.enabled;
+    }
+
+    // True when |pixels| shows the same scene as the last Accept()ed frame.
+    bool Unchanged(const float *pixels, const PreprocessConfig &config) {
+        return Unchanged(pixels, config, DetectSimdLevel());
+    }
+    bool Unchanged(const float *pixels, const PreprocessConfig &config, SimdLevel level);
+    // The frame last passed to Unchanged() becomes the reference.
+    void Accept();
+    // Forgets the reference, so the next frame is always encoded.
+    void Reset() {
+        has_reference_ = false;
+    }
+
+    // Distances measured by the last Unchanged() call.
+    int LastHashDistance() const {
+        return last_hash_distance_;
+    }
+    float LastMeanDifference() const {
+        return last_mean_difference_;
+    }
+
+private:
+    FrameGateConfig config_;
+    FrameSignature current_;
+    FrameSignature reference_;
+    bool has_reference_ = false;
+    int last_hash_distance_ = 0;
+    float last_mean_difference_ = 0.0f;
+    std::vector<float> row_sums_;
+};
+
+}  // namespace vlm
@@ -0,0 +1,77 @@
+#include "frame_pool.h"
+
+#include <cstring>
+
+namespace vlm {
+
+void Frame::AssignYuv420(int image_width, int image_height, const uint8_t *const planes[3], const size_t sizes[3],
+                         int luma_stride, int chroma_stride, int chroma_pixel_stride) {
+    format = FrameFormat::kYuv420;
+    width = image_width;
+    height = image_height;
+    y_stride = luma_stride;
+    uv_stride = chroma_stride;
+    uv_pixel_stride = chroma_pixel_stride;
+    size_t total = 0;
+    for (int i = 0; i < 3; ++i) {
+        plane_offset[i] = total;
+        plane_size[i] = sizes[i];
+        total += sizes[i];
+    }
+    // resize() keeps the pooled capacity; only the first, larger frame grows it.
+    data.resize(total);
+    for (int i = 0; i < 3; ++i) {
+        std::memcpy(data.data() + plane_offset[i], planes[i], sizes[i]);
+    }
+}
+
+YuvImage Frame::Yuv() const {
+    YuvImage image;
+    image.width = width;
+    image.height = height;
+    image.y = data.data() + plane_offset[0];
+    image.u = data.data() + plane_offset[1];
+    image.v = data.data() + plane_offset[2];
+    image.y_size = plane_size[0];
+    image.u_size = plane_size[1];
+    image.v_size = plane_size[2];
+    image.y_stride = y_stride;
+    image.uv_stride = uv_stride;
+    image.uv_pixel_stride = uv_pixel_stride;
+    return image;
+}
+
+FramePool::FramePool(size_t count, size_t reserve_bytes) {
+    storage_.reserve(count);
+    free_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        storage_.emplace_back(new Frame());
+        storage_.back()->data.reserve(reserve_bytes);
+        free_.push_back(storage_.back().get());
+    }
+}
+
+std::shared_ptr<Frame> FramePool::Acquire() {
+    Frame *frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            return nullptr;
+        }
+        frame = free_.back();
+        free_.pop_back();
+    }
+    return std::shared_ptr<Frame>(frame, [this](Frame *f) { Release(f); });
+}
+
+size_t FramePool::FreeCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+void FramePool::Release(Frame *frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(frame);
+}
+
+}  // namespace vlm
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "yuv_preprocess.h"
+
+namespace vlm {
+
+enum class FrameFormat {
+    kJpeg,    // |data| is an encoded JPEG
+    kYuv420,  // |data| holds the Y, U and V planes of a YUV_420_888 image
+};
+
+// A captured camera frame. |data| keeps its capacity across reuses, so
+// copying a camera plane into a recycled frame does not allocate.
+struct Frame {
+    std::vector<uint8_t> data;
+    FrameFormat format = FrameFormat::kJpeg;
+    uint64_t frame_id = 0;
+    int64_t timestamp_ns = 0;
+
+    // kYuv420 only: geometry and where each plane starts inside |data|.
+    int width = 0;
+    int height = 0;
+    size_t plane_offset[3] = {};
+    size_t plane_size[3] = {};
+    int y_stride = 0;
+    int uv_stride = 0;
+    int uv_pixel_stride = 1;
+
+    // Copies |size| bytes of JPEG from |bytes|, reusing the existing capacity.
+    void Assign(const uint8_t *bytes, size_t size) {
+        format = FrameFormat::kJpeg;
+        data.assign(bytes, bytes + size);
+    }
+
+    // Copies the three planes of a YUV_420_888 image back to back.
+    void AssignYuv420(int image_width, int image_height, const uint8_t *const planes[3], const size_t sizes[3],
+                      int luma_stride, int chroma_stride, int chroma_pixel_stride);
+
+    // View of a kYuv420 frame for YuvPreprocessor.
+    YuvImage Yuv() const;
+};
+
+// Shared so the inference worker and the optional disk writer can read the
+// same bytes; the frame returns to its pool when the last reference drops.
+using FrameRef = std::shared_ptr<const Frame>;
+
+// Fixed set of reusable frame buffers handed from the camera callback to the
+// consumers. The pool must outlive every FrameRef it hands out.
+class FramePool {
+public:
+    FramePool(size_t count, size_t reserve_bytes);
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // Returns a free frame, or null if every frame is still in use. The
+    // returned frame is writable until it is published as a FrameRef.
+    std::shared_ptr<Frame> Acquire();
+
+    size_t FreeCount() const;
+
+private:
+    void Release(Frame *frame);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Frame>> storage_;
+    std::vector<Frame *> free_;
+};
+
+}  // namespace vlm
@@ -0,0 +1,291 @@
+#include "frame_quality.h"
+
+#include <algorithm>
+
+#include "latency_stats.h"
+#include "vlm_log.h"
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace vlm {
+
+namespace {
+
+// Box averaged luma at or beyond these counts as clipped.
+constexpr uint8_t kClipLow = 8;
+constexpr uint8_t kClipHigh = 247;
+
+constexpr int kMaxRowWidth = 8192;
+
+// Laplacian 4 * c - left - right - up - down of one row, x in [begin, end).
+void SumLaplacianScalar(const uint8_t *up, const uint8_t *row, const uint8_t *down, int begin, int end,
+                        int64_t *sum, int64_t *sum_squares) {
+    int64_t s = 0;
+    int64_t s2 = 0;
+    for (int x = begin; x < end; ++x) {
+        const int l = 4 * row[x] - row[x - 1] - row[x + 1] - up[x] - down[x];
+        s += l;
+        s2 += l * l;
+    }
+    *sum += s;
+    *sum_squares += s2;
+}
+
+// The vector kernels keep 32-bit lane sums for one row: |l| <= 1020, so a
+// lane gains at most 2 * 1020^2 per step and cannot overflow on rows of up
+// to kMaxRowWidth pixels. They return the first x they did not cover.
+#if VLM_HAVE_AVX2_KERNELS
+// 16 pixels widened to 16 bits.
+VLM_TARGET_AVX2 inline __m256i LoadWidenAvx2(const uint8_t *p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+VLM_TARGET_AVX2 int SumLaplacianAvx2(const uint8_t *up, const uint8_t *row, const uint8_t *down, int end,
+                                     int64_t *sum, int64_t *sum_squares) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i s = _mm256_setzero_si256();
+    __m256i s2 = _mm256_setzero_si256();
+    int x = 1;
+    for (; x + 16 <= end; x += 16) {
+        const __m256i neighbours =
+                _mm256_add_epi16(_mm256_add_epi16(LoadWidenAvx2(row + x - 1), LoadWidenAvx2(row + x + 1)),
+                                 _mm256_add_epi16(LoadWidenAvx2(up + x), LoadWidenAvx2(down + x)));
+        const __m256i l = _mm256_sub_epi16(_mm256_slli_epi16(LoadWidenAvx2(row + x), 2), neighbours);
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(l, ones));
+        s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(l, l));
+    }
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), s);
+    for (int32_t lane : lanes) {
+        *sum += lane;
+    }
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), s2);
+    for (int32_t lane : lanes) {
+        *sum_squares += lane;
+    }
+    return x;
+}
+#endif
+
+#if VLM_HAVE_NEON_KERNELS
+// 8 pixels widened to 16 bits.
+inline int16x8_t LoadWidenNeon(const uint8_t *p) {
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+int SumLaplacianNeon(const uint8_t *up, const uint8_t *row, const uint8_t *down, int end, int64_t *sum,
+                     int64_t *sum_squares) {
+    int32x4_t s = vdupq_n_s32(0);
+    int32x4_t s2 = vdupq_n_s32(0);
+    int x = 1;
+    for (; x + 8 <= end; x += 8) {
+        const int16x8_t neighbours = vaddq_s16(vaddq_s16(LoadWidenNeon(row + x - 1), LoadWidenNeon(row + x + 1)),
+                                               vaddq_s16(LoadWidenNeon(up + x), LoadWidenNeon(down + x)));
+        const int16x8_t l = vsubq_s16(vshlq_n_s16(LoadWidenNeon(row + x), 2), neighbours);
+        s = vpadalq_s16(s, l);
+        s2 = vmlal_s16(s2, vget_low_s16(l), vget_low_s16(l));
+        s2 = vmlal_s16(s2, vget_high_s16(l), vget_high_s16(l));
+    }
+    int32_t lanes[4];
+    vst1q_s32(lanes, s);
+    for (int32_t lane : lanes) {
+        *sum += lane;
+    }
+    vst1q_s32(lanes, s2);
+    for (int32_t lane : lanes) {
+        *sum_squares += lane;
+    }
+    return x;
+}
+#endif
+
+}  // namespace
+
+void SumLaplacian(const uint8_t *pixels, int width, int height, int stride, int64_t *sum, int64_t *sum_squares,
+                  SimdLevel level) {
+    *sum = 0;
+    *sum_squares = 0;
+    if (width > kMaxRowWidth) {
+        level = SimdLevel::kScalar;
+    }
+    for (int y = 1; y + 1 < height; ++y) {
+        const uint8_t *row = pixels + static_cast<size_t>(y) * stride;
+        const uint8_t *up = row - stride;
+        const uint8_t *down = row + stride;
+        const int end = width - 1;
+        int done = 1;
+#if VLM_HAVE_AVX2_KERNELS
+        if (level == SimdLevel::kAvx2) {
+            done = SumLaplacianAvx2(up, row, down, end, sum, sum_squares);
+        }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+        if (level == SimdLevel::kNeon) {
+            done = SumLaplacianNeon(up, row, down, end, sum, sum_squares);
+        }
+#endif
+        SumLaplacianScalar(up, row, down, done, end, sum, sum_squares);
+    }
+}
+
+bool FrameScorer::Score(const Frame &frame, FrameQuality *quality, std::string *error, SimdLevel level) {
+    const Stopwatch timer;
+    if (frame.format == FrameFormat::kYuv420) {
+        const size_t needed = frame.height > 0 ? static_cast<size_t>(frame.height - 1) * frame.y_stride + frame.width
+                                               : 0;
+        if (frame.width <= 0 || frame.y_stride < frame.width || frame.plane_size[0] < needed) {
+            *error = "Frame luma plane is truncated";
+            return false;
+        }
+        const int factor = std::max(1, frame.width / kAnalysisWidth);
+        Downscale(frame.data.data() + frame.plane_offset[0], frame.width, frame.height, frame.y_stride, factor);
+    } else {
+        // The DC coefficients alone give a 1/8 scale image without any IDCT.
+        JpegDecodeOptions options;
+        options.scale_denom = 8;
+        if (!DecodeJpeg(frame.data.data(), frame.data.size(), options, &rgb_, error)) {
+            return false;
+        }
+        // BT.601 luma, written over the RGB pixels it is computed from.
+        uint8_t *pixels = rgb_.pixels.data();
+        const size_t count = static_cast<size_t>(rgb_.width) * rgb_.height;
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t *rgb = pixels + 3 * i;
+            pixels[i] = static_cast<uint8_t>((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8);
+        }
+        const int factor = std::max(1, rgb_.width / kAnalysisWidth);
+        Downscale(pixels, rgb_.width, rgb_.height, rgb_.width, factor);
+    }
+    if (luma_width_ < 3 || luma_height_ < 3) {
+        *error = "Frame too small to score";
+        return false;
+    }
+    Measure(quality, level);
+    quality->score_ms = timer.ElapsedMs();
+    return true;
+}
+
+void FrameScorer::Downscale(const uint8_t *plane, int width, int height, int stride, int factor) {
+    luma_width_ = width / factor;
+    luma_height_ = height / factor;
+    const int columns = luma_width_ * factor;
+    const uint32_t area = static_cast<uint32_t>(factor * factor);
+    luma_.resize(static_cast<size_t>(luma_width_) * luma_height_);
+    column_sums_.resize(columns);
+    uint16_t *sums = column_sums_.data();
+    for (int oy = 0; oy < luma_height_; ++oy) {
+        // Rows of the block are summed per column first, a loop the compiler
+        // vectorizes, then each run of |factor| columns becomes one pixel.
+        std::fill(sums, sums + columns, 0);
+        for (int r = 0; r < factor; ++r) {
+            const uint8_t *row = plane + static_cast<size_t>(oy * factor + r) * stride;
+            for (int x = 0; x < columns; ++x) {
+                sums[x] = static_cast<uint16_t>(sums[x] + row[x]);
+            }
+        }
+        uint8_t *out = luma_.data() + static_cast<size_t>(oy) * luma_width_;
+        for (int ox = 0; ox < luma_width_; ++ox) {
+            uint32_t sum = 0;
+            for (int x = ox * factor; x < (ox + 1) * factor; ++x) {
+                sum += sums[x];
+            }
+            out[ox] = static_cast<uint8_t>((sum + area / 2) / area);
+        }
+    }
+}
+
+void FrameScorer::Measure(FrameQuality *quality, SimdLevel level) const {
+    uint64_t luma_sum = 0;
+    size_t clipped = 0;
+    for (uint8_t value : luma_) {
+        luma_sum += value;
+        clipped += value <= kClipLow || value >= kClipHigh ? 1 : 0;
+    }
+    const double pixels = static_cast<double>(luma_.size());
+    quality->mean_luma = static_cast<float>(luma_sum / pixels);
+    quality->clipped = static_cast<float>(clipped / pixels);
+
+    int64_t sum = 0;
+    int64_t sum_squares = 0;
+    SumLaplacian(luma_.data(), luma_width_, luma_height_, luma_width_, &sum, &sum_squares, level);
+    const double interior = static_cast<double>(luma_width_ - 2) * (luma_height_ - 2);
+    const double mean = sum / interior;
+    quality->sharpness = static_cast<float>(std::max(0.0, sum_squares / interior - mean * mean));
+}
+
+bool BurstSelector::Passes(const FrameQuality &quality) const {
+    return quality.sharpness >= config_.min_sharpness && quality.clipped <= config_.max_clipped;
+}
+
+void BurstSelector::Configure(const FrameQualityConfig &config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    config_.burst_frames = std::max(1, config_.burst_frames);
+    remaining_ = 0;
+    best_frame_.reset();
+}
+
+void BurstSelector::Begin() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    remaining_ = config_.burst_frames;
+    best_frame_.reset();
+    outcome_ = BurstOutcome();
+    outcome_.frames = config_.burst_frames;
+}
+
+bool BurstSelector::Add(FrameRef frame, FrameRef *best, BurstOutcome *outcome) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (remaining_ == 0) {
+        remaining_ = 1;
+        best_frame_.reset();
+        outcome_ = BurstOutcome();
+        outcome_.frames = 1;
+    }
+    const int index = outcome_.frames - remaining_;
+    --remaining_;
+
+    FrameQuality quality;
+    std::string error;
+    if (!frame) {
+        VLM_LOGW("Burst frame %d of %d was dropped", index + 1, outcome_.frames);
+    } else if (!scorer_.Score(*frame, &quality, &error)) {
+        VLM_LOGW("Burst frame %d of %d not scored: %s", index + 1, outcome_.frames, error.c_str());
+    } else {
+        VLM_LOGI("Burst frame %d of %d: sharpness %.1f, mean luma %.0f, %.1f%% clipped (%.2f ms)", index + 1,
+                 outcome_.frames, quality.sharpness, quality.mean_luma, 100.0f * quality.clipped, quality.score_ms);
+        ++outcome_.scored;
+        // Any frame above the floor beats every frame below it.
+        const bool passes = Passes(quality);
+        if (outcome_.best_index < 0 || passes > Passes(outcome_.best) ||
+            (passes == Passes(outcome_.best) && quality.Score() > outcome_.best.Score())) {
+            outcome_.best_index = index;
+            outcome_.best = quality;
+            best_frame_ = std::move(frame);
+        }
+    }
+    if (remaining_ > 0) {
+        return false;
+    }
+
+    outcome_.accepted = outcome_.best_index >= 0 && Passes(outcome_.best);
+    if (outcome_.accepted) {
+        *best = std::move(best_frame_);
+    } else {
+        best->reset();
+        if (outcome_.best_index >= 0) {
+            VLM_LOGW("Burst rejected: best frame has sharpness %.1f (floor %.1f), %.1f%% clipped (at most %.1f%%)",
+                     outcome_.best.sharpness, config_.min_sharpness, 100.0f * outcome_.best.clipped,
+                     100.0f * config_.max_clipped);
+        }
+    }
+    best_frame_.reset();
+    *outcome = outcome_;
+    return true;
+}
+
+}  // namespace vlm
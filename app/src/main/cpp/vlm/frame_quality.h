@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+#include "frame_pool.h"
+#include "jpeg_decoder.h"
+
+namespace vlm {
+
+struct FrameQualityConfig {
+    // Frames captured per photo; only the best one is captioned.
+    int burst_frames = 1;
+    // Quality floor: a burst whose best frame is blurrier or more clipped
+    // than this is not captioned at all. The defaults let everything through.
+    float min_sharpness = 0.0f;
+    float max_clipped = 1.0f;
+};
+
+// How usable a frame is for captioning, measured on its luma plane box
+// averaged down to about kAnalysisWidth pixels wide: motion blur and
+// defocus lower the sharpness, bad exposure raises the clipped fraction.
+struct FrameQuality {
+    // Variance of the 4-neighbour Laplacian, in 8-bit luma units squared.
+    float sharpness = 0.0f;
+    float mean_luma = 0.0f;  // 0..255
+    // Fraction of pixels crushed to black or blown out to white.
+    float clipped = 0.0f;
+    double score_ms = 0.0;
+
+    // What frames of a burst are ranked by.
+    float Score() const {
+        return sharpness * (1.0f - clipped);
+    }
+};
+
+// Sum and sum of squares of the Laplacian over the interior pixels of an
+// 8-bit plane, the two moments its variance is computed from.
+void SumLaplacian(const uint8_t *pixels, int width, int height, int stride, int64_t *sum, int64_t *sum_squares,
+                  SimdLevel level);
+
+// Scores frames as they come from the camera. JPEG frames are decoded at
+// 1/8 scale only, which reads sharper than the YUV luma plane of the same
+// shot; a floor tuned on YUV captures errs on the side of letting JPEG
+// frames through.
+class FrameScorer {
+public:
+    static constexpr int kAnalysisWidth = 320;
+
+    bool Score(const Frame &frame, FrameQuality *quality, std::string *error) {
+        return Score(frame, quality, error, DetectSimdLevel());
+    }
+    bool Score(const Frame &frame, FrameQuality *quality, std::string *error, SimdLevel level);
+
+private:
+    // Box averages |factor| x |factor| blocks of |plane| into luma_.
+    void Downscale(const uint8_t *plane, int width, int height, int stride, int factor);
+    void Measure(FrameQuality *quality, SimdLevel level) const;
+
+    std::vector<uint8_t> luma_;
+    int luma_width_ = 0;
+    int luma_height_ = 0;
+    std::vector<uint16_t> column_sums_;
+    RgbImage rgb_;
+};
+
+// Outcome of a finished burst.
+struct BurstOutcome {
+    int frames = 0;       // frames the burst was to have
+    int scored = 0;       // frames that arrived and were scored
+    int best_index = -1;  // position of the best frame in the burst, -1 if none was scored
+    FrameQuality best;
+    bool accepted = false;  // the best frame passed the quality floor
+};
+
+// Keeps the best frame of a camera burst and hands it on once the burst is
+// complete, or nothing when every frame is below the quality floor. Frames
+// above the floor are ranked by FrameQuality::Score(). Only the best frame
+// so far is held, so a burst of any length needs two frame buffers.
+// Begin() and Add() may be called from different threads.
+class BurstSelector {
+public:
+    void Configure(const FrameQualityConfig &config);
+
+    // Starts a burst of config.burst_frames frames, forgetting the rest of
+    // an unfinished one.
+    void Begin();
+
+    // Scores the next frame of the burst; a null |frame| stands for one that
+    // was dropped before it could be. Returns true when this completed the
+    // burst: |best| is then the frame to caption, null if the burst was
+    // rejected, and |outcome| says why. A frame outside any burst is a burst
+    // of its own.
+    bool Add(FrameRef frame, FrameRef *best, BurstOutcome *outcome);
+
+private:
+    bool Passes(const FrameQuality &quality) const;
+
+    std::mutex mutex_;
+    FrameQualityConfig config_;
+    FrameScorer scorer_;
+    int remaining_ = 0;
+    FrameRef best_frame_;
+    BurstOutcome outcome_;
+};
+
+}  // namespace vlm
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "frame_pool.h"
+
+namespace vlm {
+
+// Receives the frames of a FrameSource, on the source's thread.
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    // Asked for every frame before it is copied out of the source, so frames
+    // nobody wants cost nothing.
+    virtual bool WantsFrame(int64_t timestamp_ns) = 0;
+    virtual void OnFrame(FrameRef frame) = 0;
+};
+
+// A continuous stream of frames: the headset camera in the app, image files
+// replayed at a fixed rate on a host.
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool Start(FrameSink *sink, std::string *error) = 0;
+    // No frame reaches the sink once this returns.
+    virtual void Stop() = 0;
+};
+
+}  // namespace vlm
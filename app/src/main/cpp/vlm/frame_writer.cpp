@@ -0,0 +1,88 @@
+#include "frame_writer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "vlm_log.h"
+
+namespace vlm {
+
+FrameWriter::FrameWriter(size_t capacity) : jobs_(capacity) {}
+
+FrameWriter::~FrameWriter() {
+    Stop();
+}
+
+void FrameWriter::Start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&FrameWriter::Run, this);
+}
+
+void FrameWriter::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_condition_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void FrameWriter::Enqueue(FrameRef frame, std::string path) {
+    WriteJob job{std::move(frame), std::move(path)};
+    const size_t dropped = jobs_.PushDropOldest(std::move(job));
+    if (dropped) {
+        dropped_.fetch_add(dropped, std::memory_order_relaxed);
+        VLM_LOGE("Disk writer behind, dropped %zu pending capture(s)", dropped);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_condition_.notify_one();
+}
+
+void FrameWriter::Run() {
+    WriteJob job;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_condition_.wait(lock, [this]() {
+                return !running_.load(std::memory_order_relaxed) || jobs_.SizeApprox() > 0;
+            });
+        }
+        while (jobs_.TryPop(&job)) {
+            Write(job);
+            job = WriteJob();
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+void FrameWriter::Write(const WriteJob &job) {
+    FILE *file = fopen(job.path.c_str(), "wb");
+    if (!file) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        VLM_LOGE("Failed to open %s, with error: %s!", job.path.c_str(), strerror(errno));
+        return;
+    }
+    const std::vector<uint8_t> &data = job.frame->data;
+    const bool ok = data.empty() || fwrite(data.data(), data.size(), 1, file) == 1;
+    fclose(file);
+    if (ok) {
+        written_.fetch_add(1, std::memory_order_relaxed);
+        VLM_LOGI("Saved capture %s", job.path.c_str());
+    } else {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        VLM_LOGE("Failed to write %s", job.path.c_str());
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "frame_pool.h"
+#include "spsc_queue.h"
+
+namespace vlm {
+
+// Persists frames to disk on a background thread so that saving a capture
+// never sits on the camera callback or the inference critical path.
+class FrameWriter {
+public:
+    explicit FrameWriter(size_t capacity = 8);
+    ~FrameWriter();
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    void Start();
+    // Writes everything still queued, then joins the thread.
+    void Stop();
+
+    // Producer side (single thread). If the queue is full the oldest pending
+    // write is dropped.
+    void Enqueue(FrameRef frame, std::string path);
+
+    uint64_t WrittenFrames() const {
+        return written_.load(std::memory_order_relaxed);
+    }
+    uint64_t FailedFrames() const {
+        return failed_.load(std::memory_order_relaxed);
+    }
+    uint64_t DroppedFrames() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct WriteJob {
+        FrameRef frame;
+        std::string path;
+    };
+
+    void Run();
+    void Write(const WriteJob &job);
+
+    SpscQueue<WriteJob> jobs_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_condition_;
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace vlm
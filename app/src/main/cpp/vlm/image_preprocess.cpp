@@ -0,0 +1,71 @@
+#include "image_preprocess.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace vlm {
+
+namespace {
+
+// Source sample positions for one output axis, using pixel-center alignment.
+struct AxisTaps {
+    std::vector<int> lo;
+    std::vector<int> hi;
+    std::vector<float> frac;
+};
+
+AxisTaps ComputeTaps(int src, int dst) {
+    AxisTaps taps;
+    taps.lo.resize(dst);
+    taps.hi.resize(dst);
+    taps.frac.resize(dst);
+    const float scale = static_cast<float>(src) / static_cast<float>(dst);
+    for (int i = 0; i < dst; ++i) {
+        float pos = (static_cast<float>(i) + 0.5f) * scale - 0.5f;
+        pos = std::max(pos, 0.0f);
+        const int lo = std::min(static_cast<int>(pos), src - 1);
+        taps.lo[i] = lo;
+        taps.hi[i] = std::min(lo + 1, src - 1);
+        taps.frac[i] = pos - static_cast<float>(lo);
+    }
+    return taps;
+}
+
+}  // namespace
+
+void ResizeNormalizeRgb(const RgbImage &image, const PreprocessConfig &config, float *out) {
+    const int dst_w = config.width;
+    const int dst_h = config.height;
+    const AxisTaps xs = ComputeTaps(image.width, dst_w);
+    const AxisTaps ys = ComputeTaps(image.height, dst_h);
+
+    // Fold /255, mean and std into a single multiply-add per sample.
+    float scale[3];
+    float bias[3];
+    for (int c = 0; c < 3; ++c) {
+        scale[c] = 1.0f / (255.0f * config.std[c]);
+        bias[c] = -config.mean[c] / config.std[c];
+    }
+
+    const size_t plane = static_cast<size_t>(dst_w) * dst_h;
+    const size_t stride = static_cast<size_t>(image.width) * 3;
+    const uint8_t *pixels = image.pixels.data();
+    for (int y = 0; y < dst_h; ++y) {
+        const uint8_t *row0 = pixels + ys.lo[y] * stride;
+        const uint8_t *row1 = pixels + ys.hi[y] * stride;
+        const float fy = ys.frac[y];
+        for (int x = 0; x < dst_w; ++x) {
+            const int x0 = xs.lo[x] * 3;
+            const int x1 = xs.hi[x] * 3;
+            const float fx = xs.frac[x];
+            for (int c = 0; c < 3; ++c) {
+                const float top = row0[x0 + c] + (row0[x1 + c] - row0[x0 + c]) * fx;
+                const float bottom = row1[x0 + c] + (row1[x1 + c] - row1[x0 + c]) * fx;
+                const float value = top + (bottom - top) * fy;
+                out[c * plane + static_cast<size_t>(y) * dst_w + x] = value * scale[c] + bias[c];
+            }
+        }
+    }
+}
+
+}  // namespace vlm
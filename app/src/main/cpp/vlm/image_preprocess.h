@@ -0,0 +1,21 @@
+#pragma once
+
+#include "jpeg_decoder.h"
+
+namespace vlm {
+
+// Encoder input geometry and normalization. The defaults are the BLIP-2
+// (CLIP) image processor values.
+struct PreprocessConfig {
+    int width = 224;
+    int height = 224;
+    float mean[3] = {0.48145466f, 0.4578275f, 0.40821073f};
+    float std[3] = {0.26862954f, 0.26130258f, 0.27577711f};
+};
+
+// Bilinearly resizes |image| to config.width x config.height and writes
+// ((value / 255) - mean) / std per channel into |out| as planar CHW floats.
+// |out| must hold 3 * width * height floats.
+void ResizeNormalizeRgb(const RgbImage &image, const PreprocessConfig &config, float *out);
+
+}  // namespace vlm
@@ -0,0 +1,199 @@
+#include "inference_worker.h"
+
+#include "vlm_log.h"
+
+namespace vlm {
+
+InferenceWorker::InferenceWorker(size_t job_capacity, size_t completion_capacity, size_t encoded_capacity)
+    : jobs_(job_capacity),
+      completions_(completion_capacity),
+      encoded_capacity_(encoded_capacity < 2 ? 2 : encoded_capacity),
+      free_encoded_(encoded_capacity_),
+      encoded_jobs_(encoded_capacity_) {}
+
+InferenceWorker::~InferenceWorker() {
+    Stop();
+}
+
+void InferenceWorker::Start(CaptionPipeline *pipeline, InferenceMode mode) {
+    if (running_.exchange(true)) {
+        return;
+    }
+    pipeline_ = pipeline;
+    mode_ = mode;
+    if (mode_ == InferenceMode::kPipelined) {
+        encoded_frames_.clear();
+        for (size_t i = 0; i < encoded_capacity_; ++i) {
+            std::unique_ptr<EncodedFrame> frame(new EncodedFrame());
+            std::string error;
+            if (!pipeline_->PrepareEncodedFrame(frame.get(), &error)) {
+                VLM_LOGE("Pipelined inference unavailable, running serially: %s", error.c_str());
+                encoded_frames_.clear();
+                mode_ = InferenceMode::kSerial;
+                break;
+            }
+            EncodedFrame *free_frame = frame.get();
+            free_encoded_.TryPush(std::move(free_frame));
+            encoded_frames_.push_back(std::move(frame));
+        }
+    }
+    if (mode_ == InferenceMode::kPipelined) {
+        thread_ = std::thread(&InferenceWorker::RunEncoderStage, this);
+        decoder_thread_ = std::thread(&InferenceWorker::RunDecoderStage, this);
+    } else {
+        thread_ = std::thread(&InferenceWorker::Run, this);
+    }
+}
+
+void InferenceWorker::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    Wake(&wake_condition_);
+    Wake(&decoder_wake_);
+    for (std::thread *thread : {&thread_, &decoder_thread_}) {
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
+    FrameJob discarded;
+    while (jobs_.TryPop(&discarded)) {
+    }
+    EncodedJob encoded;
+    while (encoded_jobs_.TryPop(&encoded)) {
+    }
+    EncodedFrame *frame = nullptr;
+    while (free_encoded_.TryPop(&frame)) {
+    }
+    encoded_frames_.clear();
+    in_flight_.store(0, std::memory_order_relaxed);
+}
+
+void InferenceWorker::Submit(FrameJob &&job) {
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    const size_t dropped = jobs_.PushDropOldest(std::move(job));
+    if (dropped) {
+        dropped_.fetch_add(dropped, std::memory_order_relaxed);
+        VLM_LOGW("Inference busy, dropped %zu queued frame(s)", dropped);
+    }
+    Wake(&wake_condition_);
+}
+
+bool InferenceWorker::PollCompletion(CaptionCompletion *completion) {
+    return completions_.TryPop(completion);
+}
+
+void InferenceWorker::Wake(std::condition_variable *condition) {
+    // The empty critical section orders the caller's push before the
+    // waiter's predicate check, so the wakeup cannot be lost.
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    condition->notify_one();
+}
+
+void InferenceWorker::Publish(CaptionCompletion &&completion) {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    completed_.fetch_add(1, std::memory_order_relaxed);
+    completions_.PushDropOldest(std::move(completion));
+}
+
+void InferenceWorker::Run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_condition_.wait(lock, [this]() {
+                return !running_.load(std::memory_order_relaxed) || jobs_.SizeApprox() > 0;
+            });
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        FrameJob job;
+        while (running_.load(std::memory_order_relaxed) && jobs_.TryPop(&job)) {
+            in_flight_.fetch_add(1, std::memory_order_relaxed);
+            CaptionCompletion completion;
+            completion.frame_id = job.frame_id;
+            const Frame &frame = *job.frame;
+            if (frame.format == FrameFormat::kYuv420) {
+                completion.ok = pipeline_->CaptionYuv(frame.Yuv(), &completion.caption, &completion.error);
+            } else {
+                completion.ok = pipeline_->CaptionJpeg(frame.data.data(), frame.data.size(), &completion.caption,
+                                                       &completion.error);
+            }
+            // Hand the buffer back to the pool before publishing the result.
+            job.frame.reset();
+            Publish(std::move(completion));
+        }
+    }
+}
+
+void InferenceWorker::RunEncoderStage() {
+    // A free frame is held here until a job arrives for it. A job is only
+    // taken off |jobs_| once there is a frame to encode it into, so while the
+    // decoder is behind, newer captures keep replacing older ones there.
+    EncodedFrame *encoded = nullptr;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_condition_.wait(lock, [this, &encoded]() {
+                return !running_.load(std::memory_order_relaxed) ||
+                       (jobs_.SizeApprox() > 0 && (encoded || free_encoded_.SizeApprox() > 0));
+            });
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        FrameJob job;
+        while (running_.load(std::memory_order_relaxed) && (encoded || free_encoded_.TryPop(&encoded)) &&
+               jobs_.TryPop(&job)) {
+            in_flight_.fetch_add(1, std::memory_order_relaxed);
+            EncodedJob out;
+            out.frame_id = job.frame_id;
+            out.frame = encoded;
+            const Frame &frame = *job.frame;
+            if (frame.format == FrameFormat::kYuv420) {
+                out.ok = pipeline_->EncodeYuv(frame.Yuv(), encoded, &out.error);
+            } else {
+                out.ok = pipeline_->EncodeJpeg(frame.data.data(), frame.data.size(), encoded, &out.error);
+            }
+            // The image is in the embeddings now; the camera buffer can go.
+            job.frame.reset();
+            encoded = nullptr;
+            // Cannot fail: the queue holds as many entries as there are frames.
+            encoded_jobs_.TryPush(std::move(out));
+            Wake(&decoder_wake_);
+        }
+    }
+}
+
+void InferenceWorker::RunDecoderStage() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            decoder_wake_.wait(lock, [this]() {
+                return !running_.load(std::memory_order_relaxed) || encoded_jobs_.SizeApprox() > 0;
+            });
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        EncodedJob job;
+        while (running_.load(std::memory_order_relaxed) && encoded_jobs_.TryPop(&job)) {
+            CaptionCompletion completion;
+            completion.frame_id = job.frame_id;
+            completion.ok = job.ok;
+            if (job.ok) {
+                completion.ok = pipeline_->Decode(job.frame, &completion.caption, &completion.error);
+            } else {
+                completion.error = std::move(job.error);
+            }
+            // Return the embeddings buffer before publishing the result.
+            free_encoded_.TryPush(std::move(job.frame));
+            Wake(&wake_condition_);
+            Publish(std::move(completion));
+        }
+    }
+}
+
+}  // namespace vlm
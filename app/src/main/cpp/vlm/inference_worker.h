@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caption_pipeline.h"
+#include "frame_pool.h"
+#include "spsc_queue.h"
+
+namespace vlm {
+
+// One captured frame waiting to be captioned. The encoded image is read
+// straight from the pooled frame; nothing goes through the filesystem.
+struct FrameJob {
+    uint64_t frame_id = 0;
+    FrameRef frame;
+};
+
+struct CaptionCompletion {
+    uint64_t frame_id = 0;
+    bool ok = false;
+    std::string error;
+    CaptionResult caption;
+};
+
+enum class InferenceMode {
+    // One thread runs each frame from image decode to text.
+    kSerial,
+    // An encoder thread and a decoder thread connected by a bounded queue of
+    // image embeddings: frame N+1 is encoded while frame N is decoded, so
+    // back-to-back captures finish at the pace of the slower stage instead
+    // of the sum of both.
+    kPipelined,
+};
+
+// Runs a CaptionPipeline on a dedicated thread. Frames are submitted from the
+// camera callback thread and captions are polled from the render loop; both
+// sides go through lock-free bounded queues, so neither ever waits on a model.
+// When inference falls behind, the oldest queued frames are dropped.
+class InferenceWorker {
+public:
+    // |encoded_capacity| is the number of embedding buffers in flight in
+    // kPipelined mode: one being decoded, the rest encoded ahead.
+    explicit InferenceWorker(size_t job_capacity = 2, size_t completion_capacity = 8, size_t encoded_capacity = 2);
+    ~InferenceWorker();
+    InferenceWorker(const InferenceWorker &) = delete;
+    InferenceWorker &operator=(const InferenceWorker &) = delete;
+
+    // |pipeline| must be initialized and is used only from the worker thread
+    // until Stop() returns.
+    void Start(CaptionPipeline *pipeline, InferenceMode mode = InferenceMode::kSerial);
+    void Stop();
+
+    // Producer side (single thread). Never blocks on inference.
+    void Submit(FrameJob &&job);
+    // Consumer side (single thread). Returns false when nothing is ready.
+    bool PollCompletion(CaptionCompletion *completion);
+
+    uint64_t SubmittedFrames() const {
+        return submitted_.load(std::memory_order_relaxed);
+    }
+    uint64_t DroppedFrames() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+    uint64_t CompletedFrames() const {
+        return completed_.load(std::memory_order_relaxed);
+    }
+    size_t QueuedJobs() const {
+        return jobs_.SizeApprox();
+    }
+    bool IsBusy() const {
+        return in_flight_.load(std::memory_order_relaxed) > 0 || jobs_.SizeApprox() > 0;
+    }
+    InferenceMode Mode() const {
+        return mode_;
+    }
+
+private:
+    // Hand-off between the two stages of kPipelined mode.
+    struct EncodedJob {
+        uint64_t frame_id = 0;
+        EncodedFrame *frame = nullptr;
+        bool ok = false;
+        std::string error;
+    };
+
+    void Run();
+    void RunEncoderStage();
+    void RunDecoderStage();
+    void Wake(std::condition_variable *condition);
+    void Publish(CaptionCompletion &&completion);
+
+    CaptionPipeline *pipeline_ = nullptr;
+    InferenceMode mode_ = InferenceMode::kSerial;
+    SpscQueue<FrameJob> jobs_;
+    SpscQueue<CaptionCompletion> completions_;
+    std::thread thread_;  // the encoder stage in kPipelined mode
+    std::thread decoder_thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<int> in_flight_{0};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_condition_;
+    std::condition_variable decoder_wake_;
+
+    // kPipelined only. Every frame is always in exactly one of the two
+    // queues or held by one of the stages.
+    size_t encoded_capacity_;
+    std::vector<std::unique_ptr<EncodedFrame>> encoded_frames_;
+    SpscQueue<EncodedFrame *> free_encoded_;  // decoder -> encoder
+    SpscQueue<EncodedJob> encoded_jobs_;      // encoder -> decoder
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> completed_{0};
+};
+
+}  // namespace vlm
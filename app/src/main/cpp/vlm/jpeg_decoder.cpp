@@ -0,0 +1,603 @@
+#include "jpeg_decoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace vlm {
+
+namespace {
+
+constexpr int kMaxComponents = 3;
+
+constexpr uint8_t kZigZag[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+constexpr int kFastBits = 9;
+
+struct HuffmanTable {
+    bool defined = false;
+    uint8_t symbols[256] = {};
+    // Canonical decoding tables indexed by code length (1..16).
+    int32_t max_code[18] = {};
+    int32_t val_offset[17] = {};
+    // (length << 8 | symbol) for codes of at most kFastBits bits, 0 otherwise.
+    uint16_t fast[1 << kFastBits] = {};
+};
+
+struct Component {
+    int id = 0;
+    int h = 1;
+    int v = 1;
+    int quant_table = 0;
+    int dc_table = 0;
+    int ac_table = 0;
+    int dc_pred = 0;
+    int plane_stride = 0;
+    std::vector<uint8_t> plane;
+};
+
+bool BuildHuffmanTable(const uint8_t *counts, const uint8_t *symbols, int total, HuffmanTable *table) {
+    std::memcpy(table->symbols, symbols, total);
+    std::memset(table->fast, 0, sizeof(table->fast));
+    int code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; ++len) {
+        table->val_offset[len] = k - code;
+        for (int i = 0; i < counts[len - 1]; ++i, ++k, ++code) {
+            if (len <= kFastBits) {
+                const int shift = kFastBits - len;
+                for (int fill = 0; fill < (1 << shift); ++fill) {
+                    table->fast[(code << shift) | fill] = static_cast<uint16_t>((len << 8) | symbols[k]);
+                }
+            }
+        }
+        table->max_code[len] = counts[len - 1] ? code - 1 : -1;
+        if (code > (1 << len)) {
+            return false;
+        }
+        code <<= 1;
+    }
+    table->max_code[17] = 0x7fffffff;
+    table->defined = true;
+    return true;
+}
+
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t size, size_t pos) : data_(data), size_(size), pos_(pos) {}
+
+    size_t Position() const {
+        return pos_;
+    }
+
+    void Reset() {
+        bits_ = 0;
+        count_ = 0;
+        hit_marker_ = false;
+    }
+
+    // Consumes an RSTn marker, which must be the next thing in the stream.
+    bool SkipRestartMarker() {
+        Reset();
+        if (pos_ + 1 < size_ && data_[pos_] == 0xFF && data_[pos_ + 1] >= 0xD0 && data_[pos_ + 1] <= 0xD7) {
+            pos_ += 2;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t Peek(int n) {
+        Fill();
+        return (bits_ >> (32 - n));
+    }
+
+    void Skip(int n) {
+        bits_ <<= n;
+        count_ -= n;
+    }
+
+    int GetBits(int n) {
+        if (n == 0) {
+            return 0;
+        }
+        const uint32_t v = Peek(n);
+        Skip(n);
+        return static_cast<int>(v);
+    }
+
+    // Reads |n| bits and sign-extends them as described in F.2.2.1 (EXTEND).
+    int Receive(int n) {
+        if (n == 0) {
+            return 0;
+        }
+        const int v = GetBits(n);
+        return v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+    }
+
+    bool Decode(const HuffmanTable &table, int *symbol) {
+        const uint32_t look = Peek(kFastBits);
+        const uint16_t fast = table.fast[look];
+        if (fast) {
+            Skip(fast >> 8);
+            *symbol = fast & 0xFF;
+            return true;
+        }
+        const uint32_t bits16 = Peek(16);
+        for (int len = kFastBits + 1; len <= 16; ++len) {
+            const int32_t code = static_cast<int32_t>(bits16 >> (16 - len));
+            if (code <= table.max_code[len]) {
+                Skip(len);
+                *symbol = table.symbols[code + table.val_offset[len]];
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    void Fill() {
+        while (count_ <= 24) {
+            uint32_t byte = 0;
+            if (!hit_marker_ && pos_ < size_) {
+                byte = data_[pos_];
+                if (byte == 0xFF) {
+                    const uint8_t next = pos_ + 1 < size_ ? data_[pos_ + 1] : 0;
+                    if (next == 0x00) {
+                        pos_ += 2;
+                    } else {
+                        // A marker ends the entropy coded segment; pad with zeros.
+                        hit_marker_ = true;
+                        byte = 0;
+                    }
+                } else {
+                    ++pos_;
+                }
+            }
+            bits_ |= byte << (24 - count_);
+            count_ += 8;
+        }
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    size_t pos_;
+    uint32_t bits_ = 0;
+    int count_ = 0;
+    bool hit_marker_ = false;
+};
+
+// cos_table[x][u] = C(u) / 2 * cos((2x + 1) * u * pi / 16)
+struct IdctTable {
+    float c[8][8];
+    IdctTable() {
+        for (int x = 0; x < 8; ++x) {
+            for (int u = 0; u < 8; ++u) {
+                const float cu = u == 0 ? 1.0f / std::sqrt(2.0f) : 1.0f;
+                c[x][u] = 0.5f * cu * std::cos((2 * x + 1) * u * static_cast<float>(M_PI) / 16.0f);
+            }
+        }
+    }
+};
+
+inline uint8_t ClampToByte(int v) {
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+void InverseDct(const int *coef, uint8_t *out, int stride) {
+    static const IdctTable table;
+    float tmp[64];
+    for (int v = 0; v < 8; ++v) {
+        // Columns of zero AC coefficients are common; skip their multiplies.
+        const int *row = coef + v * 8;
+        for (int x = 0; x < 8; ++x) {
+            float sum = 0.0f;
+            for (int u = 0; u < 8; ++u) {
+                if (row[u]) {
+                    sum += table.c[x][u] * static_cast<float>(row[u]);
+                }
+            }
+            tmp[v * 8 + x] = sum;
+        }
+    }
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            float sum = 0.0f;
+            for (int v = 0; v < 8; ++v) {
+                sum += table.c[y][v] * tmp[v * 8 + x];
+            }
+            out[y * stride + x] = ClampToByte(static_cast<int>(std::lround(sum)) + 128);
+        }
+    }
+}
+
+inline uint16_t ReadU16(const uint8_t *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+class JpegDecoder {
+public:
+    JpegDecoder(const uint8_t *data, size_t size, int scale_denom)
+        : data_(data), size_(size), block_size_(scale_denom == 8 ? 1 : 8) {}
+
+    bool Decode(RgbImage *out, std::string *error) {
+        if (size_ < 4 || data_[0] != 0xFF || data_[1] != 0xD8) {
+            return Fail("not a JPEG (missing SOI)", error);
+        }
+        size_t pos = 2;
+        while (pos + 4 <= size_) {
+            if (data_[pos] != 0xFF) {
+                ++pos;
+                continue;
+            }
+            const uint8_t marker = data_[pos + 1];
+            if (marker == 0xFF || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+                ++pos;
+                continue;
+            }
+            if (marker == 0xD9) {
+                break;
+            }
+            const size_t length = ReadU16(data_ + pos + 2);
+            const uint8_t *segment = data_ + pos + 4;
+            if (length < 2 || pos + 2 + length > size_) {
+                return Fail("truncated marker segment", error);
+            }
+            const size_t payload = length - 2;
+            switch (marker) {
+                case 0xC0:
+                case 0xC1:
+                    if (!ParseFrame(segment, payload, error)) {
+                        return false;
+                    }
+                    break;
+                case 0xC2:
+                case 0xC6:
+                case 0xCA:
+                case 0xCE:
+                    return Fail("progressive JPEG is not supported", error);
+                case 0xC3:
+                case 0xC5:
+                case 0xC7:
+                case 0xC9:
+                case 0xCB:
+                case 0xCD:
+                case 0xCF:
+                    return Fail("lossless/hierarchical/arithmetic JPEG is not supported", error);
+                case 0xC4:
+                    if (!ParseHuffmanTables(segment, payload, error)) {
+                        return false;
+                    }
+                    break;
+                case 0xDB:
+                    if (!ParseQuantTables(segment, payload, error)) {
+                        return false;
+                    }
+                    break;
+                case 0xDD:
+                    if (payload < 2) {
+                        return Fail("bad DRI segment", error);
+                    }
+                    restart_interval_ = ReadU16(segment);
+                    break;
+                case 0xDA: {
+                    if (!ParseScanHeader(segment, payload, error)) {
+                        return false;
+                    }
+                    BitReader reader(data_, size_, pos + 2 + length);
+                    if (!DecodeScan(&reader, error)) {
+                        return false;
+                    }
+                    ConvertToRgb(out);
+                    return true;
+                }
+                default:
+                    // APPn, COM and anything else we do not need.
+                    break;
+            }
+            pos += 2 + length;
+        }
+        return Fail("no scan found", error);
+    }
+
+private:
+    static bool Fail(const char *what, std::string *error) {
+        if (error) {
+            *error = std::string("JPEG decode failed: ") + what;
+        }
+        return false;
+    }
+
+    bool ParseFrame(const uint8_t *p, size_t n, std::string *error) {
+        if (n < 6) {
+            return Fail("bad SOF segment", error);
+        }
+        if (p[0] != 8) {
+            return Fail("only 8-bit precision is supported", error);
+        }
+        height_ = ReadU16(p + 1);
+        width_ = ReadU16(p + 3);
+        num_components_ = p[5];
+        if (width_ == 0 || height_ == 0) {
+            return Fail("image has no size", error);
+        }
+        if ((num_components_ != 1 && num_components_ != 3) || n < 6 + 3u * num_components_) {
+            return Fail("only grayscale and YCbCr images are supported", error);
+        }
+        for (int i = 0; i < num_components_; ++i) {
+            Component &c = components_[i];
+            c.id = p[6 + i * 3];
+            c.h = p[7 + i * 3] >> 4;
+            c.v = p[7 + i * 3] & 0x0F;
+            c.quant_table = p[8 + i * 3] & 0x03;
+            if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4) {
+                return Fail("bad sampling factors", error);
+            }
+            max_h_ = std::max(max_h_, c.h);
+            max_v_ = std::max(max_v_, c.v);
+        }
+        if (num_components_ == 1) {
+            // A single component scan is never interleaved: one block per MCU.
+            components_[0].h = components_[0].v = max_h_ = max_v_ = 1;
+        }
+        return true;
+    }
+
+    bool ParseQuantTables(const uint8_t *p, size_t n, std::string *error) {
+        size_t i = 0;
+        while (i < n) {
+            const int precision = p[i] >> 4;
+            const int id = p[i] & 0x0F;
+            ++i;
+            if (id > 3 || i + (precision ? 128 : 64) > n) {
+                return Fail("bad DQT segment", error);
+            }
+            for (int k = 0; k < 64; ++k) {
+                quant_[id][k] = precision ? ReadU16(p + i + 2 * k) : p[i + k];
+            }
+            i += precision ? 128 : 64;
+        }
+        return true;
+    }
+
+    bool ParseHuffmanTables(const uint8_t *p, size_t n, std::string *error) {
+        size_t i = 0;
+        while (i + 17 <= n) {
+            const int table_class = p[i] >> 4;
+            const int id = p[i] & 0x0F;
+            const uint8_t *counts = p + i + 1;
+            int total = 0;
+            for (int k = 0; k < 16; ++k) {
+                total += counts[k];
+            }
+            if (table_class > 1 || id > 3 || total > 256 || i + 17 + total > n) {
+                return Fail("bad DHT segment", error);
+            }
+            HuffmanTable &table = table_class == 0 ? dc_tables_[id] : ac_tables_[id];
+            if (!BuildHuffmanTable(counts, p + i + 17, total, &table)) {
+                return Fail("invalid Huffman table", error);
+            }
+            i += 17 + total;
+        }
+        return true;
+    }
+
+    bool ParseScanHeader(const uint8_t *p, size_t n, std::string *error) {
+        if (width_ == 0) {
+            return Fail("scan before frame header", error);
+        }
+        const int count = n > 0 ? p[0] : 0;
+        if (count != num_components_ || n < 1 + 2u * count) {
+            return Fail("only single interleaved scans are supported", error);
+        }
+        for (int i = 0; i < count; ++i) {
+            const int id = p[1 + i * 2];
+            Component *c = nullptr;
+            for (int k = 0; k < num_components_; ++k) {
+                if (components_[k].id == id) {
+                    c = &components_[k];
+                }
+            }
+            if (!c) {
+                return Fail("scan references unknown component", error);
+            }
+            c->dc_table = p[2 + i * 2] >> 4;
+            c->ac_table = p[2 + i * 2] & 0x0F;
+            if (c->dc_table > 3 || c->ac_table > 3 || !dc_tables_[c->dc_table].defined ||
+                !ac_tables_[c->ac_table].defined) {
+                return Fail("scan references undefined Huffman table", error);
+            }
+        }
+        return true;
+    }
+
+    bool DecodeBlock(BitReader *reader, Component *c, int *coef, std::string *error) {
+        int symbol = 0;
+        if (!reader->Decode(dc_tables_[c->dc_table], &symbol) || symbol > 15) {
+            return Fail("corrupt DC coefficient", error);
+        }
+        c->dc_pred += reader->Receive(symbol);
+        const uint16_t *q = quant_[c->quant_table];
+        std::memset(coef, 0, 64 * sizeof(int));
+        coef[0] = c->dc_pred * q[0];
+
+        const HuffmanTable &ac = ac_tables_[c->ac_table];
+        for (int k = 1; k < 64;) {
+            if (!reader->Decode(ac, &symbol)) {
+                return Fail("corrupt AC coefficient", error);
+            }
+            const int run = symbol >> 4;
+            const int size = symbol & 0x0F;
+            if (size == 0) {
+                if (run != 15) {
+                    break;  // EOB
+                }
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63) {
+                return Fail("AC coefficient index out of range", error);
+            }
+            const int value = reader->Receive(size);
+            // At 1/8 scale only the DC term is used, but the AC codes must
+            // still be consumed to stay in sync with the bitstream.
+            if (block_size_ == 8) {
+                coef[kZigZag[k]] = value * q[k];
+            }
+            ++k;
+        }
+        return true;
+    }
+
+    bool DecodeScan(BitReader *reader, std::string *error) {
+        const int mcu_w = 8 * max_h_;
+        const int mcu_h = 8 * max_v_;
+        const int mcus_x = (width_ + mcu_w - 1) / mcu_w;
+        const int mcus_y = (height_ + mcu_h - 1) / mcu_h;
+        for (int i = 0; i < num_components_; ++i) {
+            Component &c = components_[i];
+            c.plane_stride = mcus_x * c.h * block_size_;
+            c.plane.assign(static_cast<size_t>(c.plane_stride) * mcus_y * c.v * block_size_, 0);
+            c.dc_pred = 0;
+        }
+
+        int coef[64];
+        int mcus_until_restart = restart_interval_;
+        for (int my = 0; my < mcus_y; ++my) {
+            for (int mx = 0; mx < mcus_x; ++mx) {
+                if (restart_interval_ && mcus_until_restart == 0) {
+                    if (!reader->SkipRestartMarker()) {
+                        return Fail("missing restart marker", error);
+                    }
+                    for (int i = 0; i < num_components_; ++i) {
+                        components_[i].dc_pred = 0;
+                    }
+                    mcus_until_restart = restart_interval_;
+                }
+                for (int i = 0; i < num_components_; ++i) {
+                    Component &c = components_[i];
+                    for (int by = 0; by < c.v; ++by) {
+                        for (int bx = 0; bx < c.h; ++bx) {
+                            if (!DecodeBlock(reader, &c, coef, error)) {
+                                return false;
+                            }
+                            const int px = (mx * c.h + bx) * block_size_;
+                            const int py = (my * c.v + by) * block_size_;
+                            uint8_t *dst = c.plane.data() + static_cast<size_t>(py) * c.plane_stride + px;
+                            if (block_size_ == 8) {
+                                InverseDct(coef, dst, c.plane_stride);
+                            } else {
+                                // DC of the orthonormal 2-D DCT is 8x the block mean.
+                                *dst = ClampToByte(((coef[0] + (coef[0] >= 0 ? 4 : -4)) / 8) + 128);
+                            }
+                        }
+                    }
+                }
+                --mcus_until_restart;
+            }
+        }
+        return true;
+    }
+
+    void ConvertToRgb(RgbImage *out) const {
+        const int scale = 8 / block_size_;
+        out->width = (width_ + scale - 1) / scale;
+        out->height = (height_ + scale - 1) / scale;
+        out->pixels.resize(static_cast<size_t>(out->width) * out->height * 3);
+
+        const Component &y_c = components_[0];
+        uint8_t *dst = out->pixels.data();
+        for (int y = 0; y < out->height; ++y) {
+            const uint8_t *y_row = y_c.plane.data() + static_cast<size_t>(y) * y_c.plane_stride;
+            if (num_components_ == 1) {
+                for (int x = 0; x < out->width; ++x, dst += 3) {
+                    dst[0] = dst[1] = dst[2] = y_row[x];
+                }
+                continue;
+            }
+            const Component &cb_c = components_[1];
+            const Component &cr_c = components_[2];
+            const uint8_t *cb_row =
+                    cb_c.plane.data() + static_cast<size_t>(y * cb_c.v / max_v_) * cb_c.plane_stride;
+            const uint8_t *cr_row =
+                    cr_c.plane.data() + static_cast<size_t>(y * cr_c.v / max_v_) * cr_c.plane_stride;
+            for (int x = 0; x < out->width; ++x, dst += 3) {
+                // JFIF YCbCr -> RGB in 16.16 fixed point.
+                const int luma = y_row[x] << 16;
+                const int cb = cb_row[x * cb_c.h / max_h_] - 128;
+                const int cr = cr_row[x * cr_c.h / max_h_] - 128;
+                dst[0] = ClampToByte((luma + 91881 * cr + 32768) >> 16);
+                dst[1] = ClampToByte((luma - 22554 * cb - 46802 * cr + 32768) >> 16);
+                dst[2] = ClampToByte((luma + 116130 * cb + 32768) >> 16);
+            }
+        }
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    const int block_size_;
+    int width_ = 0;
+    int height_ = 0;
+    int num_components_ = 0;
+    int max_h_ = 1;
+    int max_v_ = 1;
+    int restart_interval_ = 0;
+    uint16_t quant_[4][64] = {};
+    HuffmanTable dc_tables_[4];
+    HuffmanTable ac_tables_[4];
+    Component components_[kMaxComponents];
+};
+
+}  // namespace
+
+bool DecodeJpeg(const uint8_t *data, size_t size, const JpegDecodeOptions &options, RgbImage *out,
+                std::string *error) {
+    if (options.scale_denom != 1 && options.scale_denom != 8) {
+        if (error) {
+            *error = "JPEG decode failed: scale_denom must be 1 or 8";
+        }
+        return false;
+    }
+    JpegDecoder decoder(data, size, options.scale_denom);
+    return decoder.Decode(out, error);
+}
+
+int ChooseJpegScaleDenom(int src_width, int src_height, int min_width, int min_height) {
+    if (src_width / 8 >= min_width && src_height / 8 >= min_height) {
+        return 8;
+    }
+    return 1;
+}
+
+bool ReadJpegSize(const uint8_t *data, size_t size, int *width, int *height) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+    size_t pos = 2;
+    while (pos + 9 < size) {
+        if (data[pos] != 0xFF) {
+            ++pos;
+            continue;
+        }
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            ++pos;
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *height = ReadU16(data + pos + 5);
+            *width = ReadU16(data + pos + 7);
+            return true;
+        }
+        if (marker == 0xDA || marker == 0xD9) {
+            return false;
+        }
+        pos += 2 + ReadU16(data + pos + 2);
+    }
+    return false;
+}
+
+}  // namespace vlm
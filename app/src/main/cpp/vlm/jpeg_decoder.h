@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vlm {
+
+// Interleaved 8-bit RGB image.
+struct RgbImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;  // width * height * 3 bytes
+};
+
+struct JpegDecodeOptions {
+    // 1 decodes at full resolution. 8 decodes only the DC coefficient of each
+    // block, producing a 1/8 scale image without running any IDCT, which is
+    // plenty when the result is immediately resized for the encoder.
+    int scale_denom = 1;
+};
+
+// Decodes a baseline (sequential, Huffman coded, 8-bit) JPEG such as the ones
+// produced by MLCameraOutputFormat_JPEG. Progressive and arithmetic coded files
+// are rejected. Returns false and fills |error| on malformed input.
+bool DecodeJpeg(const uint8_t *data, size_t size, const JpegDecodeOptions &options, RgbImage *out,
+                std::string *error);
+
+// Picks the largest scale_denom supported by DecodeJpeg() that still yields an
+// image at least |min_width| x |min_height|.
+int ChooseJpegScaleDenom(int src_width, int src_height, int min_width, int min_height);
+
+// Reads width/height from the SOF marker without decoding. Returns false if no
+// frame header is found.
+bool ReadJpegSize(const uint8_t *data, size_t size, int *width, int *height);
+
+}  // namespace vlm
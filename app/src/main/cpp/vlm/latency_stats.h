@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace vlm {
+
+class Stopwatch {
+public:
+    Stopwatch() : start_(Clock::now()) {}
+
+    void Restart() {
+        start_ = Clock::now();
+    }
+
+    double ElapsedMs() const {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start_;
+};
+
+// Running latency counter for one pipeline stage.
+struct StageCounter {
+    uint64_t count = 0;
+    double last_ms = 0.0;
+    double total_ms = 0.0;
+    double max_ms = 0.0;
+
+    void Add(double ms) {
+        ++count;
+        last_ms = ms;
+        total_ms += ms;
+        if (ms > max_ms) {
+            max_ms = ms;
+        }
+    }
+
+    double MeanMs() const {
+        return count ? total_ms / static_cast<double>(count) : 0.0;
+    }
+};
+
+// Keeps every sample so tail latencies can be reported; meant for offline
+// benchmarks rather than the running app.
+class LatencySamples {
+public:
+    void Add(double ms) {
+        samples_.push_back(ms);
+        sorted_ = false;
+    }
+
+    size_t Count() const {
+        return samples_.size();
+    }
+
+    double Mean() const {
+        double sum = 0.0;
+        for (double ms : samples_) {
+            sum += ms;
+        }
+        return samples_.empty() ? 0.0 : sum / static_cast<double>(samples_.size());
+    }
+
+    // Nearest-rank percentile, |p| in [0, 100].
+    double Percentile(double p) {
+        if (samples_.empty()) {
+            return 0.0;
+        }
+        Sort();
+        const double rank = std::ceil(p / 100.0 * static_cast<double>(samples_.size()));
+        const size_t index = rank < 1.0 ? 0 : static_cast<size_t>(rank) - 1;
+        return samples_[std::min(index, samples_.size() - 1)];
+    }
+
+    double Min() {
+        return Percentile(0.0);
+    }
+    double Max() {
+        return Percentile(100.0);
+    }
+
+private:
+    void Sort() {
+        if (!sorted_) {
+            std::sort(samples_.begin(), samples_.end());
+            sorted_ = true;
+        }
+    }
+
+    std::vector<double> samples_;
+    bool sorted_ = true;
+};
+
+}  // namespace vlm
@@ -0,0 +1,77 @@
+#include "live_captioner.h"
+
+#include <algorithm>
+
+#include "vlm_log.h"
+
+namespace vlm {
+
+LiveCaptioner::LiveCaptioner(InferenceWorker *worker, const LiveCaptionConfig &config)
+    : worker_(worker), config_(config), interval_ms_(config.min_interval_ms) {}
+
+LiveCaptioner::~LiveCaptioner() {
+    Stop();
+}
+
+bool LiveCaptioner::Start(FrameSource *source, std::string *error) {
+    Stop();
+    interval_ms_.store(config_.min_interval_ms, std::memory_order_relaxed);
+    latency_ms_ = 0.0;
+    has_sample_ = false;
+    sampled_.store(0, std::memory_order_relaxed);
+    skipped_.store(0, std::memory_order_relaxed);
+    if (!source->Start(this, error)) {
+        return false;
+    }
+    source_ = source;
+    VLM_LOGI("Live captioning started");
+    return true;
+}
+
+void LiveCaptioner::Stop() {
+    if (!source_) {
+        return;
+    }
+    source_->Stop();
+    source_ = nullptr;
+    VLM_LOGI("Live captioning stopped: %llu frames captioned, %llu skipped",
+             static_cast<unsigned long long>(SampledFrames()), static_cast<unsigned long long>(SkippedFrames()));
+}
+
+void LiveCaptioner::OnCompletion(const CaptionCompletion &completion) {
+    // Reused captions say nothing about how long the models take.
+    if (!completion.ok || completion.caption.reused) {
+        return;
+    }
+    const CaptionTimings &t = completion.caption.timings;
+    double busy_ms = t.total_ms - t.queue_ms;
+    if (worker_->Mode() == InferenceMode::kPipelined) {
+        busy_ms = std::max(t.image_decode_ms + t.preprocess_ms + t.encoder_ms, t.decoder_ms + t.detokenize_ms);
+    }
+    latency_ms_ = latency_ms_ > 0.0 ? latency_ms_ + config_.smoothing * (busy_ms - latency_ms_) : busy_ms;
+    interval_ms_.store(std::min(std::max(latency_ms_, config_.min_interval_ms), config_.max_interval_ms),
+                       std::memory_order_relaxed);
+}
+
+bool LiveCaptioner::WantsFrame(int64_t timestamp_ns) {
+    const double interval_ns = IntervalMs() * 1e6;
+    // A frame still waiting for the worker means it is behind already.
+    if (worker_->QueuedJobs() > 0 ||
+        (has_sample_ && static_cast<double>(timestamp_ns - last_sample_ns_) < interval_ns)) {
+        skipped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    has_sample_ = true;
+    last_sample_ns_ = timestamp_ns;
+    return true;
+}
+
+void LiveCaptioner::OnFrame(FrameRef frame) {
+    sampled_.fetch_add(1, std::memory_order_relaxed);
+    FrameJob job;
+    job.frame_id = frame->frame_id;
+    job.frame = std::move(frame);
+    worker_->Submit(std::move(job));
+}
+
+}  // namespace vlm
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "frame_source.h"
+#include "inference_worker.h"
+
+namespace vlm {
+
+struct LiveCaptionConfig {
+    // Bounds on the time between two sampled frames.
+    double min_interval_ms = 200.0;
+    double max_interval_ms = 5000.0;
+    // Weight of the newest measurement in the running latency average.
+    double smoothing = 0.3;
+};
+
+// Captions a FrameSource continuously. Frames are sampled no faster than the
+// pipeline can caption them: the interval follows a running average of the
+// slowest stage (the whole caption when serial, the encoder or decoder half
+// when pipelined), and no frame is taken while one is still waiting for the
+// worker. Captions come out of the worker as usual.
+class LiveCaptioner : public FrameSink {
+public:
+    explicit LiveCaptioner(InferenceWorker *worker, const LiveCaptionConfig &config = LiveCaptionConfig());
+    ~LiveCaptioner() override;
+    LiveCaptioner(const LiveCaptioner &) = delete;
+    LiveCaptioner &operator=(const LiveCaptioner &) = delete;
+
+    // The worker must be started. Resets the interval and the counters.
+    bool Start(FrameSource *source, std::string *error);
+    void Stop();
+    bool IsRunning() const {
+        return source_ != nullptr;
+    }
+
+    // Consumer thread: pass every completion polled from the worker so the
+    // sampling rate tracks the measured latency.
+    void OnCompletion(const CaptionCompletion &completion);
+
+    double IntervalMs() const {
+        return interval_ms_.load(std::memory_order_relaxed);
+    }
+    uint64_t SampledFrames() const {
+        return sampled_.load(std::memory_order_relaxed);
+    }
+    uint64_t SkippedFrames() const {
+        return skipped_.load(std::memory_order_relaxed);
+    }
+
+    // FrameSink, called on the source's thread.
+    bool WantsFrame(int64_t timestamp_ns) override;
+    void OnFrame(FrameRef frame) override;
+
+private:
+    InferenceWorker *worker_;
+    LiveCaptionConfig config_;
+    FrameSource *source_ = nullptr;
+    std::atomic<double> interval_ms_;
+    double latency_ms_ = 0.0;  // consumer thread only
+    bool has_sample_ = false;  // source thread only
+    int64_t last_sample_ns_ = 0;
+    std::atomic<uint64_t> sampled_{0};
+    std::atomic<uint64_t> skipped_{0};
+};
+
+}  // namespace vlm
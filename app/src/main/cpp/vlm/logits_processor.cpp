@@ -0,0 +1,552 @@
+#include "logits_processor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace vlm {
+
+namespace {
+
+// exp() in the vector kernels: Cephes' range reduction to 2^n * e^r with a
+// degree 6 polynomial for e^r, within 2 ulp of expf. Inputs are clamped to
+// [-87, 88], so anything less than e^-87 comes out as that instead of 0.
+constexpr float kExpMin = -87.0f;
+constexpr float kExpMax = 88.0f;
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpPoly[6] = {1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+                               4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+
+// Probability cutoffs, relative to the most likely token, for the candidates
+// of top-p sampling: each one is tried until the candidates hold the
+// nucleus, after that the whole vocabulary.
+constexpr float kCandidateLogRatios[] = {-9.21f, -27.6f};  // 1e-4, 1e-12
+
+// Logits scanned between two cuts of the top-k candidates.
+constexpr size_t kTopKChunk = 1024;
+
+#if VLM_HAVE_AVX2_KERNELS
+VLM_TARGET_AVX2 __m256 ExpAvx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(kExpMin)), _mm256_set1_ps(kExpMax));
+    const __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(kLog2e), _mm256_set1_ps(0.5f)));
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), x);
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), x);
+    __m256 y = _mm256_set1_ps(kExpPoly[0]);
+    for (int i = 1; i < 6; ++i) {
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(kExpPoly[i]));
+    }
+    y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+    const __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+VLM_TARGET_AVX2 float HorizontalSumAvx2(__m256 v) {
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 pair = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(pair, _mm_movehdup_ps(pair)));
+}
+
+VLM_TARGET_AVX2 size_t ArgmaxAvx2(const float *row, size_t count, size_t *done) {
+    *done = 0;
+    if (count < 16) {
+        return 0;
+    }
+    // Two chains of compare + blend, each lane keeping the first maximum of
+    // its own elements.
+    __m256 best0 = _mm256_loadu_ps(row);
+    __m256 best1 = _mm256_loadu_ps(row + 8);
+    __m256i index0 = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i index1 = _mm256_add_epi32(index0, _mm256_set1_epi32(8));
+    __m256i best_index0 = index0;
+    __m256i best_index1 = index1;
+    const __m256i step = _mm256_set1_epi32(16);
+    size_t i = 16;
+    for (; i + 16 <= count; i += 16) {
+        index0 = _mm256_add_epi32(index0, step);
+        index1 = _mm256_add_epi32(index1, step);
+        const __m256 v0 = _mm256_loadu_ps(row + i);
+        const __m256 v1 = _mm256_loadu_ps(row + i + 8);
+        const __m256 greater0 = _mm256_cmp_ps(v0, best0, _CMP_GT_OQ);
+        const __m256 greater1 = _mm256_cmp_ps(v1, best1, _CMP_GT_OQ);
+        best0 = _mm256_blendv_ps(best0, v0, greater0);
+        best1 = _mm256_blendv_ps(best1, v1, greater1);
+        best_index0 = _mm256_blendv_epi8(best_index0, index0, _mm256_castps_si256(greater0));
+        best_index1 = _mm256_blendv_epi8(best_index1, index1, _mm256_castps_si256(greater1));
+    }
+    alignas(32) float values[16];
+    alignas(32) int32_t indices[16];
+    _mm256_store_ps(values, best0);
+    _mm256_store_ps(values + 8, best1);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(indices), best_index0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(indices + 8), best_index1);
+    int lane = 0;
+    for (int l = 1; l < 16; ++l) {
+        if (values[l] > values[lane] || (values[l] == values[lane] && indices[l] < indices[lane])) {
+            lane = l;
+        }
+    }
+    *done = i;
+    return static_cast<size_t>(indices[lane]);
+}
+
+VLM_TARGET_AVX2 float SumExpAvx2(const float *row, size_t count, float max, float scale, size_t *done) {
+    const __m256 vmax = _mm256_set1_ps(max);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256 x0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + i), vmax), vscale);
+        const __m256 x1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + i + 8), vmax), vscale);
+        acc0 = _mm256_add_ps(acc0, ExpAvx2(x0));
+        acc1 = _mm256_add_ps(acc1, ExpAvx2(x1));
+    }
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm256_add_ps(acc0, ExpAvx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + i), vmax), vscale)));
+    }
+    *done = i;
+    return HorizontalSumAvx2(_mm256_add_ps(acc0, acc1));
+}
+
+VLM_TARGET_AVX2 size_t CollectAvx2(const float *row, size_t count, float threshold, uint32_t *indices,
+                                   size_t *done) {
+    const __m256 vthreshold = _mm256_set1_ps(threshold);
+    size_t found = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        unsigned mask = static_cast<unsigned>(
+            _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + i), vthreshold, _CMP_GE_OQ)));
+        while (mask) {
+            indices[found++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    *done = i;
+    return found;
+}
+
+VLM_TARGET_AVX2 size_t SampleAvx2(const float *row, size_t count, float max, float scale, float target, float *acc,
+                                  size_t *done) {
+    const __m256 vmax = _mm256_set1_ps(max);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 e = ExpAvx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + i), vmax), vscale));
+        const float block = HorizontalSumAvx2(e);
+        if (*acc + block > target) {
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, e);
+            for (int l = 0; l < 8; ++l) {
+                *acc += lanes[l];
+                if (*acc > target) {
+                    *done = i;
+                    return i + l;
+                }
+            }
+        } else {
+            *acc += block;
+        }
+    }
+    *done = i;
+    return count;
+}
+#endif
+
+#if VLM_HAVE_NEON_KERNELS
+float32x4_t ExpNeon(float32x4_t x) {
+    x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(kExpMin)), vdupq_n_f32(kExpMax));
+    const float32x4_t fx = vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(kLog2e));
+    // floor(): truncate, then step down where that rounded up.
+    const float32x4_t truncated = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+    const uint32x4_t rounded_up = vcgtq_f32(truncated, fx);
+    const float32x4_t n =
+        vsubq_f32(truncated, vreinterpretq_f32_u32(vandq_u32(rounded_up, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+    x = vmlsq_f32(x, n, vdupq_n_f32(kLn2Hi));
+    x = vmlsq_f32(x, n, vdupq_n_f32(kLn2Lo));
+    float32x4_t y = vdupq_n_f32(kExpPoly[0]);
+    for (int i = 1; i < 6; ++i) {
+        y = vmlaq_f32(vdupq_n_f32(kExpPoly[i]), y, x);
+    }
+    y = vmlaq_f32(vaddq_f32(x, vdupq_n_f32(1.0f)), y, vmulq_f32(x, x));
+    const int32x4_t pow2n = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+    return vmulq_f32(y, vreinterpretq_f32_s32(pow2n));
+}
+
+float HorizontalSumNeon(float32x4_t v) {
+    const float32x2_t pair = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+}
+
+size_t ArgmaxNeon(const float *row, size_t count, size_t *done) {
+    *done = 0;
+    if (count < 8) {
+        return 0;
+    }
+    static const uint32_t kLanes[4] = {0, 1, 2, 3};
+    float32x4_t best0 = vld1q_f32(row);
+    float32x4_t best1 = vld1q_f32(row + 4);
+    uint32x4_t index0 = vld1q_u32(kLanes);
+    uint32x4_t index1 = vaddq_u32(index0, vdupq_n_u32(4));
+    uint32x4_t best_index0 = index0;
+    uint32x4_t best_index1 = index1;
+    const uint32x4_t step = vdupq_n_u32(8);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8) {
+        index0 = vaddq_u32(index0, step);
+        index1 = vaddq_u32(index1, step);
+        const float32x4_t v0 = vld1q_f32(row + i);
+        const float32x4_t v1 = vld1q_f32(row + i + 4);
+        const uint32x4_t greater0 = vcgtq_f32(v0, best0);
+        const uint32x4_t greater1 = vcgtq_f32(v1, best1);
+        best0 = vbslq_f32(greater0, v0, best0);
+        best1 = vbslq_f32(greater1, v1, best1);
+        best_index0 = vbslq_u32(greater0, index0, best_index0);
+        best_index1 = vbslq_u32(greater1, index1, best_index1);
+    }
+    float values[8];
+    uint32_t indices[8];
+    vst1q_f32(values, best0);
+    vst1q_f32(values + 4, best1);
+    vst1q_u32(indices, best_index0);
+    vst1q_u32(indices + 4, best_index1);
+    int lane = 0;
+    for (int l = 1; l < 8; ++l) {
+        if (values[l] > values[lane] || (values[l] == values[lane] && indices[l] < indices[lane])) {
+            lane = l;
+        }
+    }
+    *done = i;
+    return indices[lane];
+}
+
+float SumExpNeon(const float *row, size_t count, float max, float scale, size_t *done) {
+    const float32x4_t vmax = vdupq_n_f32(max);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        acc0 = vaddq_f32(acc0, ExpNeon(vmulq_f32(vsubq_f32(vld1q_f32(row + i), vmax), vscale)));
+        acc1 = vaddq_f32(acc1, ExpNeon(vmulq_f32(vsubq_f32(vld1q_f32(row + i + 4), vmax), vscale)));
+    }
+    *done = i;
+    return HorizontalSumNeon(vaddq_f32(acc0, acc1));
+}
+
+size_t CollectNeon(const float *row, size_t count, float threshold, uint32_t *indices, size_t *done) {
+    const float32x4_t vthreshold = vdupq_n_f32(threshold);
+    size_t found = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t mask = vcgeq_f32(vld1q_f32(row + i), vthreshold);
+        const uint32x2_t any = vorr_u32(vget_low_u32(mask), vget_high_u32(mask));
+        if (vget_lane_u32(vpmax_u32(any, any), 0) == 0) {
+            continue;
+        }
+        for (size_t l = 0; l < 4; ++l) {
+            if (row[i + l] >= threshold) {
+                indices[found++] = static_cast<uint32_t>(i + l);
+            }
+        }
+    }
+    *done = i;
+    return found;
+}
+
+size_t SampleNeon(const float *row, size_t count, float max, float scale, float target, float *acc, size_t *done) {
+    const float32x4_t vmax = vdupq_n_f32(max);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t e = ExpNeon(vmulq_f32(vsubq_f32(vld1q_f32(row + i), vmax), vscale));
+        const float block = HorizontalSumNeon(e);
+        if (*acc + block > target) {
+            float lanes[4];
+            vst1q_f32(lanes, e);
+            for (int l = 0; l < 4; ++l) {
+                *acc += lanes[l];
+                if (*acc > target) {
+                    *done = i;
+                    return i + l;
+                }
+            }
+        } else {
+            *acc += block;
+        }
+    }
+    *done = i;
+    return count;
+}
+#endif
+
+}  // namespace
+
+size_t ArgmaxLogits(const float *row, size_t count, SimdLevel level) {
+    size_t done = 0;
+    size_t best = 0;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        best = ArgmaxAvx2(row, count, &done);
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    if (level == SimdLevel::kNeon) {
+        best = ArgmaxNeon(row, count, &done);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        if (row[i] > row[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+float SumExpLogits(const float *row, size_t count, float max, float scale, SimdLevel level) {
+    size_t done = 0;
+    float sum = 0.0f;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        sum = SumExpAvx2(row, count, max, scale, &done);
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    if (level == SimdLevel::kNeon) {
+        sum = SumExpNeon(row, count, max, scale, &done);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        sum += std::exp((row[i] - max) * scale);
+    }
+    return sum;
+}
+
+size_t CollectLogitsAbove(const float *row, size_t count, float threshold, uint32_t *indices, SimdLevel level) {
+    size_t done = 0;
+    size_t found = 0;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        found = CollectAvx2(row, count, threshold, indices, &done);
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    if (level == SimdLevel::kNeon) {
+        found = CollectNeon(row, count, threshold, indices, &done);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        if (row[i] >= threshold) {
+            indices[found++] = static_cast<uint32_t>(i);
+        }
+    }
+    return found;
+}
+
+size_t TopKLogits(const float *row, size_t count, size_t k, uint32_t *indices, SimdLevel level) {
+    // One vectorized pass in chunks against the k-th best logit seen so far;
+    // once that has risen above the noise few logits pass, and the ones that
+    // do are cut back to k whenever they reach 2k.
+    if (k == 0) {
+        return 0;
+    }
+    const auto more_likely = [row](uint32_t a, uint32_t b) {
+        return row[a] > row[b] || (row[a] == row[b] && a < b);
+    };
+    float threshold = -std::numeric_limits<float>::infinity();
+    size_t found = 0;
+    for (size_t begin = 0; begin < count; begin += kTopKChunk) {
+        const size_t size = std::min(kTopKChunk, count - begin);
+        uint32_t *chunk = indices + found;
+        const size_t added = CollectLogitsAbove(row + begin, size, threshold, chunk, level);
+        for (size_t i = 0; i < added; ++i) {
+            chunk[i] += static_cast<uint32_t>(begin);
+        }
+        found += added;
+        if (found > k && (found >= 2 * k || begin + size == count)) {
+            std::nth_element(indices, indices + (k - 1), indices + found, more_likely);
+            found = k;
+            threshold = row[indices[k - 1]];
+        }
+    }
+    return found;
+}
+
+size_t SampleLogits(const float *row, size_t count, float max, float scale, float target, SimdLevel level) {
+    size_t done = 0;
+    float acc = 0.0f;
+#if VLM_HAVE_AVX2_KERNELS
+    if (level == SimdLevel::kAvx2) {
+        const size_t index = SampleAvx2(row, count, max, scale, target, &acc, &done);
+        if (index < count) {
+            return index;
+        }
+    }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+    if (level == SimdLevel::kNeon) {
+        const size_t index = SampleNeon(row, count, max, scale, target, &acc, &done);
+        if (index < count) {
+            return index;
+        }
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        acc += std::exp((row[i] - max) * scale);
+        if (acc > target) {
+            return i;
+        }
+    }
+    return count;
+}
+
+void LogitsProcessor::Configure(const SamplingConfig &config, SimdLevel level) {
+    config_ = config;
+    level_ = level;
+    rng_.seed(config.seed);
+    seen_.clear();
+}
+
+void LogitsProcessor::Reset(const int64_t *prompt, size_t count) {
+    seen_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        Accept(prompt[i]);
+    }
+}
+
+void LogitsProcessor::Accept(int64_t token) {
+    if (config_.repetition_penalty != 1.0f && std::find(seen_.begin(), seen_.end(), token) == seen_.end()) {
+        seen_.push_back(token);
+    }
+}
+
+void LogitsProcessor::ApplyPenalty(float *logits, size_t vocab) const {
+    // A handful of tokens per caption, so a gather is all it takes.
+    const float penalty = config_.repetition_penalty;
+    for (int64_t token : seen_) {
+        if (token >= 0 && static_cast<size_t>(token) < vocab) {
+            float &logit = logits[token];
+            logit = logit > 0.0f ? logit / penalty : logit * penalty;
+        }
+    }
+}
+
+int64_t LogitsProcessor::Select(float *logits, size_t vocab) {
+    ApplyPenalty(logits, vocab);
+    const size_t best = ArgmaxLogits(logits, vocab, level_);
+    if (config_.Greedy()) {
+        return static_cast<int64_t>(best);
+    }
+    const float max = logits[best];
+    const float scale = 1.0f / config_.temperature;
+    const float sum = SumExpLogits(logits, vocab, max, scale, level_);
+    if ((config_.top_k <= 0 || static_cast<size_t>(config_.top_k) >= vocab) && config_.top_p >= 1.0f) {
+        const size_t index = SampleLogits(logits, vocab, max, scale, Uniform() * sum, level_);
+        // Rounding can leave the draw past the end of the row.
+        return static_cast<int64_t>(index < vocab ? index : best);
+    }
+    return SampleCandidates(logits, vocab, max, scale, sum);
+}
+
+float LogitsProcessor::CollectTopK(const float *logits, size_t vocab, size_t k, float max, float scale) {
+    return FillCandidates(logits, TopKLogits(logits, vocab, k, indices_.data(), level_), max, scale);
+}
+
+float LogitsProcessor::CollectNucleus(const float *logits, size_t vocab, float max, float scale, float sum) {
+    // Every token above a probability cutoff, lowered until their mass
+    // reaches the nucleus; they then include it.
+    for (size_t attempt = 0;; ++attempt) {
+        const bool last = attempt == sizeof(kCandidateLogRatios) / sizeof(kCandidateLogRatios[0]);
+        const float threshold =
+            last ? -std::numeric_limits<float>::infinity() : max + kCandidateLogRatios[attempt] / scale;
+        const size_t found = CollectLogitsAbove(logits, vocab, threshold, indices_.data(), level_);
+        const float mass = FillCandidates(logits, found, max, scale);
+        if (last || mass >= config_.top_p * sum) {
+            return mass;
+        }
+    }
+}
+
+float LogitsProcessor::FillCandidates(const float *logits, size_t count, float max, float scale) {
+    candidates_.resize(count);
+    float mass = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        const float logit = logits[indices_[i]];
+        const float weight = std::exp((logit - max) * scale);
+        candidates_[i] = Candidate{logit, weight, indices_[i]};
+        mass += weight;
+    }
+    return mass;
+}
+
+size_t LogitsProcessor::PartitionNucleus(float target) {
+    // Quickselect on the cumulative weight: [0, lo) is known to be in the
+    // nucleus with |above| of the weight, the boundary lies in [lo, hi).
+    const auto more_likely = [](const Candidate &a, const Candidate &b) {
+        return a.logit > b.logit || (a.logit == b.logit && a.id < b.id);
+    };
+    size_t lo = 0;
+    size_t hi = candidates_.size();
+    float above = 0.0f;
+    while (lo < hi) {
+        std::swap(candidates_[lo + (hi - lo) / 2], candidates_[hi - 1]);
+        const Candidate pivot = candidates_[hi - 1];
+        const auto split = std::partition(candidates_.begin() + lo, candidates_.begin() + (hi - 1),
+                                          [&](const Candidate &c) { return more_likely(c, pivot); });
+        const size_t mid = static_cast<size_t>(split - candidates_.begin());
+        std::swap(candidates_[mid], candidates_[hi - 1]);
+        float upper = 0.0f;
+        for (size_t i = lo; i < mid; ++i) {
+            upper += candidates_[i].weight;
+        }
+        if (above + upper >= target) {
+            hi = mid;
+        } else if (above + upper + pivot.weight >= target) {
+            return mid + 1;
+        } else {
+            above += upper + pivot.weight;
+            lo = mid + 1;
+        }
+    }
+    return std::max<size_t>(lo, 1);
+}
+
+int64_t LogitsProcessor::SampleCandidates(const float *logits, size_t vocab, float max, float scale, float sum) {
+    indices_.resize(vocab);
+    const bool top_k = config_.top_k > 0 && static_cast<size_t>(config_.top_k) < vocab;
+    // Top-p over what top-k left is normalized over those tokens.
+    float mass = top_k ? CollectTopK(logits, vocab, static_cast<size_t>(config_.top_k), max, scale)
+                       : CollectNucleus(logits, vocab, max, scale, sum);
+    size_t kept = candidates_.size();
+    if (config_.top_p < 1.0f) {
+        kept = PartitionNucleus(config_.top_p * (top_k ? mass : sum));
+        mass = 0.0f;
+        for (size_t i = 0; i < kept; ++i) {
+            mass += candidates_[i].weight;
+        }
+    }
+    if (kept == 1) {
+        return candidates_[0].id;
+    }
+
+    // The draw does not need the candidates in order.
+    const float target = Uniform() * mass;
+    float acc = 0.0f;
+    for (size_t i = 0; i < kept; ++i) {
+        acc += candidates_[i].weight;
+        if (acc > target) {
+            return candidates_[i].id;
+        }
+    }
+    return candidates_[kept - 1].id;
+}
+
+}  // namespace vlm
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+
+namespace vlm {
+
+struct SamplingConfig {
+    // 0 picks the most likely token (greedy); above 0 samples from
+    // softmax(logits / temperature).
+    float temperature = 0.0f;
+    // Sample among the |top_k| most likely tokens only, 0 for no limit.
+    int top_k = 0;
+    // Then among the most likely tokens whose probabilities add up to
+    // |top_p| (nucleus sampling), 1 for no limit.
+    float top_p = 1.0f;
+    // Logits of tokens already in the sequence, prompt included, are divided
+    // by this when positive and multiplied when negative (CTRL); 1 is off.
+    float repetition_penalty = 1.0f;
+    uint64_t seed = 0;
+
+    bool Greedy() const {
+        return temperature <= 0.0f || top_k == 1;
+    }
+};
+
+// Index of the largest of |count| logits, the first one on ties.
+size_t ArgmaxLogits(const float *row, size_t count, SimdLevel level);
+// sum(exp((row[i] - max) * scale)).
+float SumExpLogits(const float *row, size_t count, float max, float scale, SimdLevel level);
+// Writes the indices i with row[i] >= threshold in increasing order to
+// |indices|, which has room for |count|, and returns how many there are.
+size_t CollectLogitsAbove(const float *row, size_t count, float threshold, uint32_t *indices, SimdLevel level);
+// Writes the indices of the min(k, count) largest logits, in no particular
+// order and the first ones on ties, to |indices|, which has room for
+// |count|, and returns how many there are.
+size_t TopKLogits(const float *row, size_t count, size_t k, uint32_t *indices, SimdLevel level);
+// Smallest i at which sum(exp((row[j] - max) * scale)) over j <= i exceeds
+// |target|, or |count| when the whole row does not.
+size_t SampleLogits(const float *row, size_t count, float max, float scale, float target, SimdLevel level);
+
+// Picks the next token from a row of decoder logits. Greedy decoding is one
+// vectorized argmax pass. Sampling adds a pass for the softmax normalizer and
+// one that collects candidates, the top k or the tokens above a probability
+// cutoff; top-p (a quickselect on their weights) and the draw then work on
+// those few without sorting anything. Plain temperature sampling draws in one
+// more pass over the row instead. Buffers are sized on the first step and
+// reused.
+class LogitsProcessor {
+public:
+    void Configure(const SamplingConfig &config) {
+        Configure(config, DetectSimdLevel());
+    }
+    void Configure(const SamplingConfig &config, SimdLevel level);
+    const SamplingConfig &Config() const {
+        return config_;
+    }
+
+    // Starts a sequence; |prompt| counts towards the repetition penalty.
+    void Reset(const int64_t *prompt, size_t count);
+    // Returns the next token. Applies the repetition penalty to |logits| in
+    // place, the only change made to it.
+    int64_t Select(float *logits, size_t vocab);
+    // Adds a token to the sequence.
+    void Accept(int64_t token);
+
+private:
+    struct Candidate {
+        float logit;
+        float weight;  // exp((logit - max) / temperature)
+        uint32_t id;
+    };
+
+    void ApplyPenalty(float *logits, size_t vocab) const;
+    // Fill |candidates_| with exactly the k most likely tokens, or with a
+    // superset of the top-p nucleus, and return their total weight.
+    float CollectTopK(const float *logits, size_t vocab, size_t k, float max, float scale);
+    float CollectNucleus(const float *logits, size_t vocab, float max, float scale, float sum);
+    float FillCandidates(const float *logits, size_t count, float max, float scale);
+    // Moves the fewest most likely candidates holding |target| of the weight
+    // to the front, in no particular order, and returns how many they are.
+    size_t PartitionNucleus(float target);
+    int64_t SampleCandidates(const float *logits, size_t vocab, float max, float scale, float sum);
+    // Uniform in [0, 1).
+    float Uniform() {
+        return static_cast<float>(rng_() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    SamplingConfig config_;
+    SimdLevel level_ = SimdLevel::kScalar;
+    std::mt19937_64 rng_;
+    std::vector<int64_t> seen_;  // distinct tokens of the sequence
+    std::vector<uint32_t> indices_;
+    std::vector<Candidate> candidates_;
+};
+
+}  // namespace vlm
@@ -0,0 +1,150 @@
+#include "model_cache.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "file_utils.h"
+
+namespace vlm {
+
+namespace {
+
+constexpr size_t kKeyLength = 16;  // hex digits of a 64-bit hash
+
+std::string BaseName(const std::string &path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string Stem(const std::string &path) {
+    std::string name = BaseName(path);
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) {
+        name.resize(dot);
+    }
+    return name;
+}
+
+bool MakeDirectory(const std::string &path, std::string *error) {
+    if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST) {
+        return true;
+    }
+    if (error) {
+        *error = "Failed to create " + path + ": " + strerror(errno);
+    }
+    return false;
+}
+
+}  // namespace
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed) {
+    // FNV-1a over 64-bit words with a final avalanche; plenty to tell model
+    // versions apart.
+    constexpr uint64_t kPrime = 0x100000001b3ull;
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed ^ 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * kPrime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * kPrime;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool FindOptimizedModel(const std::string &cache_dir, const std::string &source_path,
+                        const std::string &options_signature, OptimizedModelEntry *entry, std::string *error) {
+    // The source is identified by its path, size and modification time, so
+    // a warm start does not read the model just to find its entry.
+    struct stat source;
+    if (stat(source_path.c_str(), &source) != 0 || !S_ISREG(source.st_mode)) {
+        if (error) {
+            *error = "Cannot stat " + source_path + ": " + strerror(errno);
+        }
+        return false;
+    }
+    if (!MakeDirectory(cache_dir, error)) {
+        return false;
+    }
+    const int64_t identity[3] = {static_cast<int64_t>(source.st_size), static_cast<int64_t>(source.st_mtim.tv_sec),
+                                 static_cast<int64_t>(source.st_mtim.tv_nsec)};
+    uint64_t seed = HashBytes(options_signature.data(), options_signature.size(), 0);
+    seed = HashBytes(source_path.data(), source_path.size(), seed);
+    char key[kKeyLength + 1];
+    std::snprintf(key, sizeof(key), "%016" PRIx64, HashBytes(identity, sizeof(identity), seed));
+
+    entry->stem = Stem(source_path);
+    entry->key = key;
+    const std::string base = entry->stem + "." + entry->key;
+    entry->model_path = cache_dir + base + ".onnx";
+    entry->data_file_name = base + ".onnx.data";
+    entry->timing_path = cache_dir + base + ".ms";
+    return true;
+}
+
+bool OptimizedModelExists(const OptimizedModelEntry &entry) {
+    return FileExists(entry.model_path);
+}
+
+void RemoveOptimizedModel(const OptimizedModelEntry &entry) {
+    const size_t slash = entry.model_path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "" : entry.model_path.substr(0, slash + 1);
+    unlink(entry.model_path.c_str());
+    unlink((dir + entry.data_file_name).c_str());
+    unlink(entry.timing_path.c_str());
+}
+
+void RemoveStaleOptimizedModels(const std::string &cache_dir, const OptimizedModelEntry &keep) {
+    DIR *dir = opendir(cache_dir.c_str());
+    if (!dir) {
+        return;
+    }
+    const std::string prefix = keep.stem + ".";
+    while (const dirent *item = readdir(dir)) {
+        const std::string name = item->d_name;
+        // <stem>.<16 hex digits>.<suffix>
+        if (name.size() > prefix.size() + kKeyLength + 1 && name.compare(0, prefix.size(), prefix) == 0 &&
+            name[prefix.size() + kKeyLength] == '.' &&
+            name.find_first_not_of("0123456789abcdef", prefix.size()) == prefix.size() + kKeyLength &&
+            name.compare(prefix.size(), kKeyLength, keep.key) != 0) {
+            unlink((cache_dir + name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+void SaveColdStartMs(const OptimizedModelEntry &entry, double ms) {
+    FILE *file = fopen(entry.timing_path.c_str(), "w");
+    if (file) {
+        fprintf(file, "%.3f\n", ms);
+        fclose(file);
+    }
+}
+
+double LoadColdStartMs(const OptimizedModelEntry &entry) {
+    FILE *file = fopen(entry.timing_path.c_str(), "r");
+    if (!file) {
+        return -1.0;
+    }
+    double ms = -1.0;
+    if (fscanf(file, "%lf", &ms) != 1) {
+        ms = -1.0;
+    }
+    fclose(file);
+    return ms;
+}
+
+}  // namespace vlm
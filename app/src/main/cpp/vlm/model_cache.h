@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vlm {
+
+// On-disk cache of models after ONNX Runtime's graph optimizations. An entry
+// for <dir>/<stem>.onnx consists of
+//   <cache>/<stem>.<key>.onnx       optimized graph
+//   <cache>/<stem>.<key>.onnx.data  external initializers, prepacked weights
+//   <cache>/<stem>.<key>.ms         session creation time of the cold start
+// where <key> hashes the source model's path, size and modification time
+// together with everything else that changes the optimized graph (ORT
+// version, CPU features, options). Replacing the model changes its size or
+// time, so the model itself is never read to find its entry.
+struct OptimizedModelEntry {
+    std::string model_path;
+    std::string data_file_name;  // relative to the model, as ORT expects
+    std::string timing_path;
+    std::string stem;
+    std::string key;
+};
+
+// 64-bit hash of |size| bytes, eight at a time.
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed);
+
+// Fills in the entry of the model at |source_path| in |cache_dir|
+// (with trailing separator). |options_signature| describes the session
+// options the optimized graph depends on. Creates |cache_dir| if needed.
+bool FindOptimizedModel(const std::string &cache_dir, const std::string &source_path,
+                        const std::string &options_signature, OptimizedModelEntry *entry, std::string *error);
+
+// True once the optimized model has been written. It is saved under a
+// temporary name and renamed last, so a partial write never counts.
+bool OptimizedModelExists(const OptimizedModelEntry &entry);
+
+// Deletes the files of |entry|, e.g. after they failed to load.
+void RemoveOptimizedModel(const OptimizedModelEntry &entry);
+
+// Deletes entries for other versions of the same model.
+void RemoveStaleOptimizedModels(const std::string &cache_dir, const OptimizedModelEntry &keep);
+
+// Cold-start session creation time stored next to the entry, or a negative
+// value if unknown.
+void SaveColdStartMs(const OptimizedModelEntry &entry, double ms);
+double LoadColdStartMs(const OptimizedModelEntry &entry);
+
+}  // namespace vlm
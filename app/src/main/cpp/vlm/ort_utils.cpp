@@ -0,0 +1,124 @@
+#include "ort_utils.h"
+
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+bool DescribeTypeInfo(const OrtApi *ort, OrtTypeInfo *type_info, TensorInfo *info, std::string *error) {
+    const OrtTensorTypeAndShapeInfo *tensor_info = nullptr;
+    if (!CheckOrtStatus(ort, ort->CastTypeInfoToTensorInfo(type_info, &tensor_info), "CastTypeInfoToTensorInfo",
+                        error)) {
+        return false;
+    }
+    if (tensor_info == nullptr) {
+        // Not a tensor (sequence/map); leave type undefined.
+        return true;
+    }
+    size_t rank = 0;
+    bool ok = CheckOrtStatus(ort, ort->GetTensorElementType(tensor_info, &info->type), "GetTensorElementType",
+                             error) &&
+              CheckOrtStatus(ort, ort->GetDimensionsCount(tensor_info, &rank), "GetDimensionsCount", error);
+    if (ok) {
+        info->shape.assign(rank, -1);
+        ok = CheckOrtStatus(ort, ort->GetDimensions(tensor_info, info->shape.data(), rank), "GetDimensions", error);
+    }
+    return ok;
+}
+
+bool DescribeList(const OrtApi *ort, OrtSession *session, bool outputs, std::vector<TensorInfo> *infos,
+                  std::string *error) {
+    OrtAllocator *allocator = nullptr;
+    if (!CheckOrtStatus(ort, ort->GetAllocatorWithDefaultOptions(&allocator), "GetAllocatorWithDefaultOptions",
+                        error)) {
+        return false;
+    }
+    size_t count = 0;
+    if (!CheckOrtStatus(ort,
+                        outputs ? ort->SessionGetOutputCount(session, &count)
+                                : ort->SessionGetInputCount(session, &count),
+                        "SessionGetCount", error)) {
+        return false;
+    }
+    infos->assign(count, TensorInfo());
+    for (size_t i = 0; i < count; ++i) {
+        char *name = nullptr;
+        if (!CheckOrtStatus(ort,
+                            outputs ? ort->SessionGetOutputName(session, i, allocator, &name)
+                                    : ort->SessionGetInputName(session, i, allocator, &name),
+                            "SessionGetName", error)) {
+            return false;
+        }
+        (*infos)[i].name = name;
+        allocator->Free(allocator, name);
+
+        OrtTypeInfo *type_info = nullptr;
+        if (!CheckOrtStatus(ort,
+                            outputs ? ort->SessionGetOutputTypeInfo(session, i, &type_info)
+                                    : ort->SessionGetInputTypeInfo(session, i, &type_info),
+                            "SessionGetTypeInfo", error)) {
+            return false;
+        }
+        const bool ok = DescribeTypeInfo(ort, type_info, &(*infos)[i], error);
+        ort->ReleaseTypeInfo(type_info);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool CheckOrtStatus(const OrtApi *ort, OrtStatus *status, const char *what, std::string *error) {
+    if (status == nullptr) {
+        return true;
+    }
+    const char *msg = ort->GetErrorMessage(status);
+    std::string text = std::string(what) + ": " + (msg ? msg : "unknown");
+    VLM_LOGE("%s", text.c_str());
+    if (error) {
+        *error = text;
+    }
+    ort->ReleaseStatus(status);
+    return false;
+}
+
+bool DescribeSession(const OrtApi *ort, OrtSession *session, std::vector<TensorInfo> *inputs,
+                     std::vector<TensorInfo> *outputs, std::string *error) {
+    return DescribeList(ort, session, false, inputs, error) && DescribeList(ort, session, true, outputs, error);
+}
+
+int FindTensor(const std::vector<TensorInfo> &infos, const std::string &name) {
+    for (size_t i = 0; i < infos.size(); ++i) {
+        if (infos[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+size_t FloatElementSize(ONNXTensorElementDataType type) {
+    switch (type) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+            return 4;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+const char *FloatTypeName(ONNXTensorElementDataType type) {
+    switch (type) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+            return "float";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+            return "float16";
+        default:
+            return "other";
+    }
+}
+
+}  // namespace vlm
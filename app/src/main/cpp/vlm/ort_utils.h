@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "onnxruntime/core/session/onnxruntime_c_api.h"
+
+namespace vlm {
+
+// Name, element type and shape of one session input or output. Symbolic
+// dimensions are reported as -1.
+struct TensorInfo {
+    std::string name;
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    std::vector<int64_t> shape;
+};
+
+// Takes ownership of |status|. Returns true if |status| is null (success).
+// Otherwise logs "<what>: <message>", stores the same text in |error| when it
+// is non-null, releases the status and returns false.
+bool CheckOrtStatus(const OrtApi *ort, OrtStatus *status, const char *what, std::string *error = nullptr);
+
+// Queries the inputs and outputs of |session|.
+bool DescribeSession(const OrtApi *ort, OrtSession *session, std::vector<TensorInfo> *inputs,
+                     std::vector<TensorInfo> *outputs, std::string *error);
+
+// Returns the index of the entry named |name|, or -1.
+int FindTensor(const std::vector<TensorInfo> &infos, const std::string &name);
+
+// Bytes per element of float and float16 tensors, 0 for any other type.
+size_t FloatElementSize(ONNXTensorElementDataType type);
+// "float", "float16" or "other".
+const char *FloatTypeName(ONNXTensorElementDataType type);
+
+}  // namespace vlm
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace vlm {
+
+// Latest-value hand-off from one writer thread to one reader thread, neither
+// of which ever waits: a triple buffer. The writer fills Write() and
+// Publish()es it; Read() returns the most recent published value, which
+// stays untouched until the reader's next Read(). Values published in
+// between are skipped.
+//
+// The writer, the reader and the slot in between each own one of three
+// slots and trade them with a single atomic exchange, so no slot is ever
+// touched by both threads at once. Slots are reused, so a T that keeps its
+// capacity (a std::string, say) stops allocating once it has grown.
+template <typename T>
+class SnapshotBuffer {
+public:
+    SnapshotBuffer() = default;
+    SnapshotBuffer(const SnapshotBuffer &) = delete;
+    SnapshotBuffer &operator=(const SnapshotBuffer &) = delete;
+
+    // Writer only. The slot to fill, holding some older value.
+    T &Write() {
+        return slots_[write_];
+    }
+    // Writer only. Makes the filled slot the latest value; Write() moves on
+    // to another slot.
+    void Publish() {
+        write_ = shared_.exchange(static_cast<uint8_t>(write_ | kFresh), std::memory_order_acq_rel) & kIndex;
+    }
+
+    // Reader only. The latest published value, a default T before the first.
+    const T &Read() {
+        if (shared_.load(std::memory_order_relaxed) & kFresh) {
+            read_ = shared_.exchange(read_, std::memory_order_acq_rel) & kIndex;
+        }
+        return slots_[read_];
+    }
+
+private:
+    static constexpr uint8_t kIndex = 3;
+    static constexpr uint8_t kFresh = 4;  // published since the reader last took it
+
+    T slots_[3];
+    uint8_t write_ = 0;  // writer's slot
+    uint8_t read_ = 1;   // reader's slot
+    std::atomic<uint8_t> shared_{2};
+};
+
+}  // namespace vlm
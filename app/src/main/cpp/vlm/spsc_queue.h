@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace vlm {
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+//
+// Each slot carries a sequence number (as in Vyukov's bounded queue) and the
+// read position is claimed with a CAS. That lets the producer evict the oldest
+// entry when the queue is full (PushDropOldest) while the consumer may be
+// popping concurrently, without either side ever taking a lock or touching a
+// slot the other one owns.
+template <typename T>
+class SpscQueue {
+public:
+    // |capacity| is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        mask_ = rounded - 1;
+        slots_.reset(new Slot[rounded]);
+        for (size_t i = 0; i < rounded; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    size_t Capacity() const {
+        return mask_ + 1;
+    }
+
+    // Producer only. Returns false (leaving |item| untouched) if full.
+    bool TryPush(T &&item) {
+        const size_t pos = write_pos_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[pos & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != pos) {
+            return false;
+        }
+        slot.value = std::move(item);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        write_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer, or the producer when evicting. Returns false if empty.
+    bool TryPop(T *item) {
+        size_t pos = read_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots_[pos & mask_];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff < 0) {
+                return false;
+            }
+            if (diff == 0) {
+                if (read_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *item = std::move(slot.value);
+                    slot.value = T();
+                    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else {
+                pos = read_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Producer only. Pushes |item|, evicting the oldest entries while the
+    // queue is full. The last evicted entry is moved into |evicted| when it is
+    // non-null so the caller can recycle it. Returns the number evicted.
+    size_t PushDropOldest(T &&item, T *evicted = nullptr) {
+        size_t dropped = 0;
+        T scratch;
+        while (!TryPush(std::move(item))) {
+            // Only evict when actually full. Otherwise the consumer has claimed
+            // the slot we want and is about to release it, so just retry.
+            const size_t write = write_pos_.load(std::memory_order_relaxed);
+            const size_t read = read_pos_.load(std::memory_order_relaxed);
+            if (write - read > mask_ && TryPop(evicted ? evicted : &scratch)) {
+                ++dropped;
+            }
+        }
+        return dropped;
+    }
+
+    // Approximate; exact only when called from the consumer with the producer
+    // idle (or vice versa).
+    size_t SizeApprox() const {
+        const size_t write = write_pos_.load(std::memory_order_relaxed);
+        const size_t read = read_pos_.load(std::memory_order_relaxed);
+        return write >= read ? write - read : 0;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    // Keep the indices on separate cache lines from each other and the slots.
+    alignas(64) std::atomic<size_t> write_pos_{0};
+    alignas(64) std::atomic<size_t> read_pos_{0};
+    alignas(64) size_t mask_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+}  // namespace vlm
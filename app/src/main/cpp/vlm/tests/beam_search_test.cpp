@@ -0,0 +1,198 @@
+#include "beam_search.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+constexpr int64_t kEos = 0;
+constexpr int64_t kA = 1;
+constexpr int64_t kB = 2;
+constexpr int64_t kC = 3;
+constexpr size_t kVocab = 4;
+constexpr int kMaxTokens = 6;
+
+using Tokens = std::vector<int64_t>;
+
+// A decoder whose next-token probabilities depend on the caption so far:
+//   ""        -> A 0.85, B 0.10
+//   "A"       -> EOS 0.5, A 0.4
+//   "AA"      -> EOS 0.7
+//   "B", "BC", "BCC", ... -> C 0.98
+// and uniform after anything else. "A" and "AA" finish first and score best
+// at their length, but "BCCCCC" overtakes them at the length limit once
+// divided by its length, after having scored far below them for most of the
+// search.
+std::vector<float> ScriptedLogits(const Tokens &prefix) {
+    std::vector<float> probabilities(kVocab, 0.25f);
+    bool b_then_c = !prefix.empty() && prefix[0] == kB;
+    for (size_t i = 1; i < prefix.size(); ++i) {
+        b_then_c = b_then_c && prefix[i] == kC;
+    }
+    if (prefix.empty()) {
+        probabilities = {0.02f, 0.85f, 0.10f, 0.03f};
+    } else if (prefix == Tokens{kA}) {
+        probabilities = {0.5f, 0.4f, 0.05f, 0.05f};
+    } else if (prefix == Tokens{kA, kA}) {
+        probabilities = {0.7f, 0.1f, 0.1f, 0.1f};
+    } else if (b_then_c) {
+        probabilities = {0.01f, 0.005f, 0.005f, 0.98f};
+    }
+    std::vector<float> logits(kVocab);
+    for (size_t i = 0; i < kVocab; ++i) {
+        logits[i] = std::log(probabilities[i]);
+    }
+    return logits;
+}
+
+float Score(double log_prob, size_t length, float length_penalty) {
+    return static_cast<float>(log_prob / std::pow(static_cast<double>(length), length_penalty));
+}
+
+// Every caption up to the length limit, ending in EOS or cut off by the
+// limit, scored the way BeamSearch scores them.
+void Exhaustive(const Tokens &prefix, double log_prob, float length_penalty, float *best_score, Tokens *best) {
+    if (prefix.size() == static_cast<size_t>(kMaxTokens)) {
+        const float score = Score(log_prob, prefix.size(), length_penalty);
+        if (score > *best_score) {
+            *best_score = score;
+            *best = prefix;
+        }
+        return;
+    }
+    const std::vector<float> logits = ScriptedLogits(prefix);
+    for (int64_t token = 0; token < static_cast<int64_t>(kVocab); ++token) {
+        const double next = log_prob + logits[static_cast<size_t>(token)];
+        if (token == kEos) {
+            const float score = Score(next, prefix.size() + 1, length_penalty);
+            if (score > *best_score) {
+                *best_score = score;
+                *best = prefix;
+            }
+            continue;
+        }
+        Tokens longer = prefix;
+        longer.push_back(token);
+        Exhaustive(longer, next, length_penalty, best_score, best);
+    }
+}
+
+Tokens ExhaustiveBest(float length_penalty) {
+    float best_score = -INFINITY;
+    Tokens best;
+    Exhaustive(Tokens(), 0.0, length_penalty, &best_score, &best);
+    return best;
+}
+
+// Runs the search against ScriptedLogits and returns the best caption;
+// |steps| is how many decoder steps it took.
+Tokens Search(const BeamSearchConfig &config, SimdLevel level, int *steps) {
+    BeamSearch search;
+    search.Configure(config, kEos, kMaxTokens, level);
+    search.Reset();
+    std::vector<Tokens> prefixes(1);
+    std::vector<std::vector<float>> logits;
+    std::vector<const float *> rows;
+    *steps = 0;
+    bool live = true;
+    while (live) {
+        logits.clear();
+        rows.clear();
+        for (const Tokens &prefix : prefixes) {
+            logits.push_back(ScriptedLogits(prefix));
+        }
+        for (const std::vector<float> &row : logits) {
+            rows.push_back(row.data());
+        }
+        live = search.Advance(rows.data(), kVocab);
+        ++*steps;
+        std::vector<Tokens> next(search.Beams());
+        for (size_t i = 0; i < next.size(); ++i) {
+            next[i] = prefixes[search.Parents()[i]];
+            next[i].push_back(search.Tokens()[i]);
+        }
+        prefixes.swap(next);
+        if (*steps > kMaxTokens) {
+            test::Fail(__FILE__, __LINE__, "search ran past the length limit");
+            break;
+        }
+    }
+    return search.Best();
+}
+
+std::string Show(const Tokens &tokens) {
+    std::string text;
+    for (const int64_t token : tokens) {
+        text.push_back(token == kA ? 'A' : token == kB ? 'B' : token == kC ? 'C' : '?');
+    }
+    return "\"" + text + "\"";
+}
+
+void ExpectBest(const Tokens &expected, const Tokens &actual, const std::string &what) {
+    if (actual != expected) {
+        test::Fail(__FILE__, __LINE__, what + ": best caption " + Show(actual) + ", expected " + Show(expected));
+    }
+}
+
+std::vector<SimdLevel> AllLevels() {
+    std::vector<SimdLevel> levels = test::SimdLevels();
+    levels.push_back(SimdLevel::kScalar);
+    return levels;
+}
+
+VLM_TEST(beam_search, LongBeamOvertakesFinishedCaptions) {
+    const Tokens expected = ExhaustiveBest(1.0f);
+    ExpectBest(Tokens({kB, kC, kC, kC, kC, kC}), expected, "exhaustive search");
+    for (const SimdLevel level : AllLevels()) {
+        BeamSearchConfig config;
+        config.beams = 2;
+        int steps = 0;
+        ExpectBest(expected, Search(config, level, &steps), "beam search");
+        VLM_EXPECT_EQ(kMaxTokens, steps);
+    }
+}
+
+VLM_TEST(beam_search, MatchesExhaustiveSearch) {
+    for (const float length_penalty : {-0.5f, 0.0f, 0.5f, 1.0f, 2.0f}) {
+        const Tokens expected = ExhaustiveBest(length_penalty);
+        for (const int beams : {2, 3, 4}) {
+            BeamSearchConfig config;
+            config.beams = beams;
+            config.length_penalty = length_penalty;
+            int steps = 0;
+            ExpectBest(expected, Search(config, SimdLevel::kScalar, &steps),
+                       "length_penalty " + std::to_string(length_penalty) + ", " + std::to_string(beams) + " beams");
+        }
+    }
+}
+
+VLM_TEST(beam_search, PrunesBeamsThatCannotWin) {
+    // Without a length bonus no beam gains by going on, so once "A" and "AA"
+    // are finished the rest are dropped and the search ends early.
+    BeamSearchConfig config;
+    config.beams = 2;
+    config.length_penalty = 0.0f;
+    int steps = 0;
+    ExpectBest(ExhaustiveBest(0.0f), Search(config, SimdLevel::kScalar, &steps), "length_penalty 0");
+    ExpectBest(Tokens({kA}), Search(config, SimdLevel::kScalar, &steps), "length_penalty 0");
+    VLM_EXPECT_EQ(3, steps);
+}
+
+VLM_TEST(beam_search, EarlyStoppingEndsOnceBeamsFinish) {
+    // Stops as soon as "A" and "AA" are finished, before "BCCCCC" can
+    // overtake them.
+    BeamSearchConfig config;
+    config.beams = 2;
+    config.early_stopping = true;
+    int steps = 0;
+    ExpectBest(Tokens({kA}), Search(config, SimdLevel::kScalar, &steps), "early stopping");
+    VLM_EXPECT_EQ(3, steps);
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,160 @@
+#include "caption_cache.h"
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+constexpr size_t kDims = 256;
+
+std::vector<float> RandomEmbedding(uint32_t seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<float> value(0.0f, 1.0f);
+    std::vector<float> embedding(kDims);
+    for (float &v : embedding) {
+        v = value(random);
+    }
+    return embedding;
+}
+
+// |base| plus a little noise: cosine similarity about 0.995.
+std::vector<float> Near(const std::vector<float> &base, uint32_t seed) {
+    std::vector<float> embedding = RandomEmbedding(seed);
+    for (size_t i = 0; i < kDims; ++i) {
+        embedding[i] = base[i] + 0.1f * embedding[i];
+    }
+    return embedding;
+}
+
+// Room for exactly |entries| float keys with short captions.
+CaptionCacheConfig ConfigFor(size_t entries) {
+    CaptionCacheConfig config;
+    config.enabled = true;
+    config.min_similarity = 0.97f;
+    config.max_bytes = entries * (kDims * sizeof(float) + 512);
+    return config;
+}
+
+bool Find(CaptionCache *cache, const std::vector<float> &embedding, std::string *text, float *similarity) {
+    std::vector<int64_t> token_ids;
+    return cache->Lookup(embedding.data(), embedding.size(), text, &token_ids, similarity);
+}
+
+VLM_TEST(caption_cache, HitAboveThresholdMissBelow) {
+    for (const bool half_keys : {false, true}) {
+        CaptionCacheConfig config = ConfigFor(8);
+        config.half_keys = half_keys;
+        CaptionCache cache;
+        cache.Configure(config);
+        const std::vector<float> cat = RandomEmbedding(1);
+        cache.Insert(cat.data(), cat.size(), "a cat on a sofa", {64, 3797});
+
+        std::string text;
+        std::vector<int64_t> token_ids;
+        float similarity = 0.0f;
+        const std::vector<float> near = Near(cat, 2);
+        VLM_EXPECT(cache.Lookup(near.data(), near.size(), &text, &token_ids, &similarity));
+        VLM_EXPECT(text == "a cat on a sofa");
+        VLM_EXPECT_EQ(2u, token_ids.size());
+        VLM_EXPECT(similarity >= 0.97f && similarity < 1.0f);
+
+        // Scaling does not change the direction.
+        std::vector<float> scaled = cat;
+        for (float &v : scaled) {
+            v *= 3.0f;
+        }
+        VLM_EXPECT(Find(&cache, scaled, &text, &similarity));
+        VLM_EXPECT_NEAR(1.0, similarity, half_keys ? 2e-3 : 1e-5);
+
+        // An unrelated image is nearly orthogonal.
+        text.clear();
+        VLM_EXPECT(!Find(&cache, RandomEmbedding(3), &text, &similarity));
+        VLM_EXPECT(text.empty());
+        VLM_EXPECT(similarity < 0.5f);
+
+        // Just below the threshold misses.
+        config.min_similarity = 0.999f;
+        cache.Configure(config);
+        cache.Insert(cat.data(), cat.size(), "a cat on a sofa", {});
+        VLM_EXPECT(!Find(&cache, near, &text, &similarity));
+        VLM_EXPECT_EQ(2u, cache.Hits());
+        VLM_EXPECT_EQ(2u, cache.Misses());
+    }
+}
+
+VLM_TEST(caption_cache, EvictsLeastRecentlyUsedAtBudget) {
+    CaptionCache cache;
+    cache.Configure(ConfigFor(3));
+    VLM_EXPECT_EQ(0u, cache.Capacity());
+    const std::vector<float> a = RandomEmbedding(10);
+    const std::vector<float> b = RandomEmbedding(11);
+    const std::vector<float> c = RandomEmbedding(12);
+    const std::vector<float> d = RandomEmbedding(13);
+    cache.Insert(a.data(), kDims, "a", {});
+    VLM_EXPECT_EQ(3u, cache.Capacity());
+    cache.Insert(b.data(), kDims, "b", {});
+    cache.Insert(c.data(), kDims, "c", {});
+    VLM_EXPECT_EQ(3u, cache.Entries());
+    VLM_EXPECT(cache.MemoryBytes() <= ConfigFor(3).max_bytes);
+
+    // A lookup refreshes |a|, so |b| is the least recently used.
+    std::string text;
+    float similarity = 0.0f;
+    VLM_EXPECT(Find(&cache, a, &text, &similarity));
+    cache.Insert(d.data(), kDims, "d", {});
+    VLM_EXPECT_EQ(3u, cache.Entries());
+    VLM_EXPECT(!Find(&cache, b, &text, &similarity));
+    VLM_EXPECT(Find(&cache, a, &text, &similarity) && text == "a");
+    VLM_EXPECT(Find(&cache, c, &text, &similarity) && text == "c");
+    VLM_EXPECT(Find(&cache, d, &text, &similarity) && text == "d");
+
+    // |a| was looked up before |c| and |d|, so it goes next.
+    cache.Insert(b.data(), kDims, "b", {});
+    VLM_EXPECT(!Find(&cache, a, &text, &similarity));
+    VLM_EXPECT(Find(&cache, b, &text, &similarity) && text == "b");
+    VLM_EXPECT(cache.MemoryBytes() <= ConfigFor(3).max_bytes);
+}
+
+VLM_TEST(caption_cache, OtherEmbeddingSizeClears) {
+    CaptionCache cache;
+    cache.Configure(ConfigFor(4));
+    const std::vector<float> a = RandomEmbedding(20);
+    cache.Insert(a.data(), kDims, "a", {});
+    cache.Insert(a.data(), kDims / 2, "half", {});
+    VLM_EXPECT_EQ(1u, cache.Entries());
+    std::string text;
+    float similarity = 0.0f;
+    VLM_EXPECT(!Find(&cache, a, &text, &similarity));
+}
+
+VLM_TEST(caption_cache, SimdDotProductMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    for (const size_t count : {0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 33, 256, 1001}) {
+        std::vector<float> a(count);
+        std::vector<float> b(count);
+        double magnitude = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = value(random);
+            b[i] = value(random);
+            magnitude += std::fabs(a[i] * b[i]);
+        }
+        const float reference = DotProduct(a.data(), b.data(), count, SimdLevel::kScalar);
+        for (const SimdLevel level : levels) {
+            // Only the order of the additions differs.
+            VLM_EXPECT_NEAR(reference, DotProduct(a.data(), b.data(), count, level), 1e-5 * (magnitude + 1.0));
+        }
+    }
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,34 @@
+#include "capture_size.h"
+
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+VLM_TEST(capture_size, RequiredSizeOversamplesTheModelInput) {
+    const CaptureSize size = RequiredCaptureSize(224, 224, 1.5f);
+    VLM_EXPECT_EQ(336, size.width);
+    VLM_EXPECT_EQ(336, size.height);
+    // Below 1 the model would be fed upsampled pixels.
+    const CaptureSize floor = RequiredCaptureSize(384, 224, 0.5f);
+    VLM_EXPECT_EQ(384, floor.width);
+    VLM_EXPECT_EQ(224, floor.height);
+}
+
+VLM_TEST(capture_size, PicksSmallestCoveringCandidate) {
+    const std::vector<CaptureSize> candidates = {{1920, 1080}, {640, 480}, {1280, 720}, {320, 240}, {0, 0}};
+    VLM_EXPECT_EQ(1, ChooseCaptureSize(candidates, CaptureSize{336, 336}));
+    VLM_EXPECT_EQ(2, ChooseCaptureSize(candidates, CaptureSize{672, 672}));
+    VLM_EXPECT_EQ(3, ChooseCaptureSize(candidates, CaptureSize{320, 240}));
+}
+
+VLM_TEST(capture_size, FallsBackToLargestCandidate) {
+    const std::vector<CaptureSize> candidates = {{640, 480}, {1920, 1080}, {1280, 720}};
+    VLM_EXPECT_EQ(1, ChooseCaptureSize(candidates, CaptureSize{4000, 3000}));
+    VLM_EXPECT_EQ(-1, ChooseCaptureSize({}, CaptureSize{224, 224}));
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,325 @@
+// Checks that decoder steps make no heap allocations of their own once every
+// shape has been seen: global operator new is replaced with one that counts
+// on the calling thread, and the engine runs on a copy of the ORT API whose
+// entry points used by a step stop the count while ONNX Runtime works.
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "decoder_runner.h"
+#include "ort_utils.h"
+#include "vlm_engine.h"
+#include "vlm_test.h"
+
+namespace {
+
+thread_local bool t_counting = false;
+thread_local int t_in_ort = 0;
+thread_local uint64_t t_allocations = 0;
+
+void *CountedAllocation(size_t size) {
+    if (t_counting && t_in_ort == 0) {
+        ++t_allocations;
+    }
+    void *p = std::malloc(size > 0 ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}  // namespace
+
+void *operator new(size_t size) {
+    return CountedAllocation(size);
+}
+
+void *operator new[](size_t size) {
+    return CountedAllocation(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace vlm {
+namespace {
+
+// Allocations on this thread between Start() and Stop(), outside ORT.
+class AllocationCounter {
+public:
+    void Start() {
+        t_allocations = 0;
+        t_counting = true;
+    }
+    uint64_t Stop() {
+        t_counting = false;
+        return t_allocations;
+    }
+};
+
+struct OrtScope {
+    OrtScope() {
+        ++t_in_ort;
+    }
+    ~OrtScope() {
+        --t_in_ort;
+    }
+};
+
+const OrtApi *g_ort = nullptr;
+// OrtValue views created while counting: a steady-state step reuses them.
+uint64_t g_views_created = 0;
+
+OrtStatus *ORT_API_CALL RunWithBinding(OrtSession *session, const OrtRunOptions *options,
+                                       const OrtIoBinding *binding) NO_EXCEPTION {
+    OrtScope scope;
+    return g_ort->RunWithBinding(session, options, binding);
+}
+
+OrtStatus *ORT_API_CALL BindInput(OrtIoBinding *binding, const char *name, const OrtValue *value) NO_EXCEPTION {
+    OrtScope scope;
+    return g_ort->BindInput(binding, name, value);
+}
+
+OrtStatus *ORT_API_CALL BindOutput(OrtIoBinding *binding, const char *name, const OrtValue *value) NO_EXCEPTION {
+    OrtScope scope;
+    return g_ort->BindOutput(binding, name, value);
+}
+
+OrtStatus *ORT_API_CALL GetTensorMutableData(OrtValue *value, void **out) NO_EXCEPTION {
+    OrtScope scope;
+    return g_ort->GetTensorMutableData(value, out);
+}
+
+OrtStatus *ORT_API_CALL CreateTensorWithDataAsOrtValue(const OrtMemoryInfo *info, void *data, size_t bytes,
+                                                       const int64_t *shape, size_t rank,
+                                                       ONNXTensorElementDataType type, OrtValue **out) NO_EXCEPTION {
+    OrtScope scope;
+    if (t_counting) {
+        ++g_views_created;
+    }
+    return g_ort->CreateTensorWithDataAsOrtValue(info, data, bytes, shape, rank, type, out);
+}
+
+const OrtApi *CountingApi() {
+    static OrtApi api;
+    if (!g_ort) {
+        g_ort = OrtGetApiBase()->GetApi(ORT_API_VERSION);
+        if (!g_ort) {
+            return nullptr;
+        }
+        api = *g_ort;
+        api.RunWithBinding = RunWithBinding;
+        api.BindInput = BindInput;
+        api.BindOutput = BindOutput;
+        api.GetTensorMutableData = GetTensorMutableData;
+        api.CreateTensorWithDataAsOrtValue = CreateTensorWithDataAsOrtValue;
+    }
+    return &api;
+}
+
+constexpr int kCaptionTokens = 12;
+constexpr int kMaxBatch = 3;
+
+// The engine plus constant image embeddings in the decoder's input shape.
+class DecoderFixture {
+public:
+    ~DecoderFixture() {
+        if (embeddings_) {
+            ort_->ReleaseValue(embeddings_);
+        }
+        if (memory_info_) {
+            ort_->ReleaseMemoryInfo(memory_info_);
+        }
+    }
+
+    // False with |skip_reason| set when there are no models to run.
+    bool SetUp(std::string *skip_reason) {
+        const std::string models = test::ModelsDir();
+        if (models.empty()) {
+            *skip_reason = "VLM_TEST_MODELS is not set";
+            return false;
+        }
+        VlmEngineConfig config;
+        config.models_dir = models;
+        config.api = CountingApi();
+        if (!config.api) {
+            *skip_reason = "ONNX Runtime API not available";
+            return false;
+        }
+        ort_ = config.api;
+        VLM_EXPECT(engine_.Initialize(config));
+        VLM_EXPECT(CheckOrtStatus(ort_, ort_->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault,
+                                                                  &memory_info_),
+                                  "CreateCpuMemoryInfo failed"));
+        return test::Passing() && CreateEmbeddings();
+    }
+
+    VlmEngine *Engine() {
+        return &engine_;
+    }
+    OrtMemoryInfo *MemoryInfo() const {
+        return memory_info_;
+    }
+    OrtValue *Embeddings() const {
+        return embeddings_;
+    }
+
+private:
+    // Dynamic dimensions of the decoder input are taken from the encoder
+    // output.
+    bool CreateEmbeddings() {
+        const std::vector<TensorInfo> &inputs = engine_.DecoderInputs();
+        const std::vector<TensorInfo> &encoder_outputs = engine_.EncoderOutputs();
+        for (const TensorInfo &info : inputs) {
+            if (FloatElementSize(info.type) == 0 || info.shape.size() != 3) {
+                continue;
+            }
+            int64_t shape[3] = {1, info.shape[1], info.shape[2]};
+            for (int d = 1; d < 3; ++d) {
+                if (shape[d] <= 0 && !encoder_outputs.empty() && encoder_outputs[0].shape.size() == 3) {
+                    shape[d] = encoder_outputs[0].shape[d];
+                }
+                if (shape[d] <= 0) {
+                    test::Fail(__FILE__, __LINE__, "image embeddings shape is not known");
+                    return false;
+                }
+            }
+            buffer_.assign(static_cast<size_t>(shape[1] * shape[2]) * FloatElementSize(info.type), 0);
+            return CheckOrtStatus(ort_,
+                                  ort_->CreateTensorWithDataAsOrtValue(memory_info_, buffer_.data(), buffer_.size(),
+                                                                       shape, 3, info.type, &embeddings_),
+                                  "CreateTensor(embeddings) failed");
+        }
+        test::Fail(__FILE__, __LINE__, "decoder has no image embeddings input");
+        return false;
+    }
+
+    VlmEngine engine_;
+    const OrtApi *ort_ = nullptr;
+    OrtMemoryInfo *memory_info_ = nullptr;
+    std::vector<uint8_t> buffer_;
+    OrtValue *embeddings_ = nullptr;
+};
+
+int64_t ArgMax(const float *row, int64_t vocab) {
+    int64_t best = 0;
+    for (int64_t i = 1; i < vocab; ++i) {
+        if (row[i] > row[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Greedy caption of a fixed length. Only the steps are counted.
+void GreedyCaption(DecoderRunner *decoder, OrtValue *embeddings, AllocationCounter *counter, uint64_t *allocations) {
+    std::string error;
+    VLM_ASSERT(decoder->Reset(embeddings, &error));
+    int64_t token = 50256;
+    for (int step = 0; step < kCaptionTokens; ++step) {
+        if (counter) {
+            counter->Start();
+        }
+        const bool ok = decoder->Step(&token, 1, &error);
+        if (counter) {
+            *allocations += counter->Stop();
+        }
+        VLM_ASSERT(ok);
+        token = ArgMax(decoder->LastLogits(), decoder->VocabSize());
+    }
+}
+
+// Beam-search shaped caption: the batch grows, reorders and shrinks along a
+// fixed schedule of parents.
+void BatchedCaption(DecoderRunner *decoder, OrtValue *embeddings, AllocationCounter *counter,
+                    uint64_t *allocations) {
+    static const std::vector<std::vector<uint32_t>> kParents = {
+        {0, 0, 0}, {1, 0, 2}, {2, 2, 1}, {0, 1}, {1, 1, 0}, {2, 0, 1}, {0}, {0, 0}, {1, 0, 1},
+    };
+    std::string error;
+    VLM_ASSERT(decoder->Reset(embeddings, &error));
+    const int64_t bos = 50256;
+    VLM_ASSERT(decoder->Step(&bos, 1, &error));
+    int64_t tokens[kMaxBatch];
+    for (const std::vector<uint32_t> &parents : kParents) {
+        for (size_t i = 0; i < parents.size(); ++i) {
+            tokens[i] = ArgMax(decoder->SequenceLogits(parents[i]), decoder->VocabSize());
+        }
+        if (counter) {
+            counter->Start();
+        }
+        const bool ok = decoder->StepBatch(tokens, parents.data(), parents.size(), &error);
+        if (counter) {
+            *allocations += counter->Stop();
+        }
+        VLM_ASSERT(ok);
+    }
+}
+
+VLM_TEST(decoder_allocations, SteadyStateStepDoesNotAllocate) {
+    DecoderFixture fixture;
+    std::string skip;
+    if (!fixture.SetUp(&skip)) {
+        if (test::Passing()) {
+            VLM_SKIP(skip);
+        }
+        return;
+    }
+    DecoderRunner decoder;
+    std::string error;
+    VLM_ASSERT(decoder.Initialize(fixture.Engine(), DecoderModel::kMain, fixture.MemoryInfo(), kCaptionTokens + 1, 1,
+                                  &error));
+    GreedyCaption(&decoder, fixture.Embeddings(), nullptr, nullptr);
+
+    AllocationCounter counter;
+    uint64_t allocations = 0;
+    g_views_created = 0;
+    GreedyCaption(&decoder, fixture.Embeddings(), &counter, &allocations);
+    VLM_EXPECT_EQ(0u, allocations);
+    VLM_EXPECT_EQ(0u, g_views_created);
+}
+
+VLM_TEST(decoder_allocations, SteadyStateStepBatchDoesNotAllocate) {
+    DecoderFixture fixture;
+    std::string skip;
+    if (!fixture.SetUp(&skip)) {
+        if (test::Passing()) {
+            VLM_SKIP(skip);
+        }
+        return;
+    }
+    DecoderRunner decoder;
+    std::string error;
+    if (!decoder.Initialize(fixture.Engine(), DecoderModel::kMain, fixture.MemoryInfo(), kCaptionTokens + 1,
+                            kMaxBatch, &error)) {
+        VLM_SKIP("decoder cannot run batches: " + error);
+    }
+    BatchedCaption(&decoder, fixture.Embeddings(), nullptr, nullptr);
+
+    AllocationCounter counter;
+    uint64_t allocations = 0;
+    g_views_created = 0;
+    BatchedCaption(&decoder, fixture.Embeddings(), &counter, &allocations);
+    VLM_EXPECT_EQ(0u, allocations);
+    VLM_EXPECT_EQ(0u, g_views_created);
+}
+
+}  // namespace
+}  // namespace vlm
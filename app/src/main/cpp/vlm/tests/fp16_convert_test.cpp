@@ -0,0 +1,192 @@
+#include "fp16_convert.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "caption_cache.h"
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+uint32_t Bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float FromBits(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// The scalar path canonicalizes NaN payloads while the hardware conversions
+// keep them (quieted), so NaNs only have to agree on being NaN and on sign.
+bool SameFloat(float expected, float actual) {
+    if (std::isnan(expected) || std::isnan(actual)) {
+        return std::isnan(expected) && std::isnan(actual) && std::signbit(expected) == std::signbit(actual);
+    }
+    return Bits(expected) == Bits(actual);
+}
+
+bool SameHalf(uint16_t expected, uint16_t actual) {
+    const auto is_nan = [](uint16_t half) { return (half & 0x7FFF) > 0x7C00; };
+    if (is_nan(expected) || is_nan(actual)) {
+        return is_nan(expected) && is_nan(actual) && (expected & 0x8000) == (actual & 0x8000);
+    }
+    return expected == actual;
+}
+
+// Floats at and around every rounding case of the conversion: ties between
+// two halves in the normal and subnormal range, the overflow boundary,
+// float subnormals, zeros, infinities and NaNs, plus random values over the
+// whole exponent range.
+std::vector<float> FloatCases() {
+    std::vector<float> values = {
+        0.0f, -0.0f, 1.0f, -1.0f, 65504.0f, 65519.0f, 65520.0f, 65536.0f, 1e10f, -1e10f,
+        std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN(),
+        std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::min(),
+        std::ldexp(1.0f, -24), std::ldexp(1.0f, -25), std::ldexp(3.0f, -26), std::ldexp(1.0f, -14),
+        std::ldexp(1023.0f, -24), std::ldexp(1.0f, -26),
+    };
+    // Ties: the midpoint between consecutive halves, for an even and an odd
+    // lower neighbour, in the normal and the subnormal range.
+    for (const uint16_t half : {0x3C00, 0x3C01, 0x0400, 0x0401, 0x0001, 0x0002, 0x7BFE, 0x5A5A}) {
+        const float lo = HalfToFloat(static_cast<uint16_t>(half));
+        const float hi = HalfToFloat(static_cast<uint16_t>(half + 1));
+        const float mid = lo + (hi - lo) / 2.0f;
+        values.push_back(mid);
+        values.push_back(-mid);
+        values.push_back(std::nextafter(mid, 0.0f));
+        values.push_back(std::nextafter(mid, 1e9f));
+    }
+    std::mt19937 random(19);
+    std::uniform_int_distribution<uint32_t> bits;
+    for (int i = 0; i < 4000; ++i) {
+        // Exponents around the half range, any mantissa and sign.
+        const uint32_t value = bits(random);
+        const uint32_t exponent = 127 - 30 + (value >> 24) % 50;
+        values.push_back(FromBits((value & 0x807FFFFFu) | (exponent << 23)));
+        values.push_back(FromBits(bits(random)));
+    }
+    return values;
+}
+
+VLM_TEST(fp16_convert, ScalarRoundsToNearestEven) {
+    VLM_EXPECT_EQ(0x3C00, FloatToHalf(1.0f));
+    VLM_EXPECT_EQ(0xC000, FloatToHalf(-2.0f));
+    VLM_EXPECT_EQ(0x7BFF, FloatToHalf(65504.0f));
+    VLM_EXPECT_EQ(0x7C00, FloatToHalf(65520.0f));
+    VLM_EXPECT_EQ(0x7BFF, FloatToHalf(65519.0f));
+    // 1 + 2^-11 lies halfway between 1 and 1 + 2^-10: to the even one.
+    VLM_EXPECT_EQ(0x3C00, FloatToHalf(1.0f + std::ldexp(1.0f, -11)));
+    VLM_EXPECT_EQ(0x3C02, FloatToHalf(1.0f + std::ldexp(3.0f, -11)));
+    // Subnormal halves: 2^-24 is the smallest, 2^-25 ties to zero.
+    VLM_EXPECT_EQ(0x0001, FloatToHalf(std::ldexp(1.0f, -24)));
+    VLM_EXPECT_EQ(0x0000, FloatToHalf(std::ldexp(1.0f, -25)));
+    VLM_EXPECT_EQ(0x0002, FloatToHalf(std::ldexp(3.0f, -25)));
+    VLM_EXPECT_EQ(0x8000, FloatToHalf(-0.0f));
+    VLM_EXPECT_EQ(0x7C00, FloatToHalf(std::numeric_limits<float>::infinity()));
+    VLM_EXPECT((FloatToHalf(std::numeric_limits<float>::quiet_NaN()) & 0x7FFF) > 0x7C00);
+}
+
+VLM_TEST(fp16_convert, EveryHalfRoundTrips) {
+    for (uint32_t bits = 0; bits < 0x10000; ++bits) {
+        const uint16_t half = static_cast<uint16_t>(bits);
+        const float value = HalfToFloat(half);
+        if (std::isnan(value)) {
+            VLM_EXPECT((half & 0x7C00) == 0x7C00 && (half & 0x03FF) != 0);
+            continue;
+        }
+        if (FloatToHalf(value) != half) {
+            VLM_EXPECT_EQ(bits, static_cast<uint32_t>(FloatToHalf(value)));
+        }
+    }
+}
+
+VLM_TEST(fp16_convert, SimdHalfToFloatMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // Every bit pattern, with a length that leaves a tail after the last
+    // full vector.
+    std::vector<uint16_t> halves(0x10000 + 7);
+    for (size_t i = 0; i < halves.size(); ++i) {
+        halves[i] = static_cast<uint16_t>(i);
+    }
+    std::vector<float> reference(halves.size());
+    std::vector<float> actual(halves.size());
+    HalfToFloat(halves.data(), reference.data(), halves.size(), SimdLevel::kScalar);
+    for (const SimdLevel level : levels) {
+        HalfToFloat(halves.data(), actual.data(), halves.size(), level);
+        int mismatches = 0;
+        for (size_t i = 0; i < halves.size() && mismatches < 8; ++i) {
+            if (!SameFloat(reference[i], actual[i])) {
+                ++mismatches;
+                VLM_EXPECT_EQ(Bits(reference[i]), Bits(actual[i]));
+            }
+        }
+    }
+}
+
+VLM_TEST(fp16_convert, SimdFloatToHalfMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    const std::vector<float> values = FloatCases();
+    std::vector<uint16_t> reference(values.size());
+    FloatToHalf(values.data(), reference.data(), values.size(), SimdLevel::kScalar);
+    for (size_t i = 0; i < values.size(); ++i) {
+        VLM_EXPECT(SameHalf(FloatToHalf(values[i]), reference[i]));
+    }
+    for (const SimdLevel level : levels) {
+        // Every offset, so each value also goes through the scalar tail.
+        for (size_t offset = 0; offset < 16; ++offset) {
+            std::vector<uint16_t> actual(values.size() - offset);
+            FloatToHalf(values.data() + offset, actual.data(), actual.size(), level);
+            int mismatches = 0;
+            for (size_t i = 0; i < actual.size() && mismatches < 8; ++i) {
+                if (!SameHalf(reference[i + offset], actual[i])) {
+                    ++mismatches;
+                    VLM_EXPECT_EQ(reference[i + offset], actual[i]);
+                }
+            }
+        }
+    }
+}
+
+VLM_TEST(fp16_convert, SimdDotProductHalfMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    for (const size_t count : {0, 1, 5, 8, 15, 16, 17, 33, 256, 1001}) {
+        std::vector<float> a(count);
+        std::vector<float> b(count);
+        std::vector<uint16_t> half(count);
+        double magnitude = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = value(random);
+            b[i] = value(random);
+            magnitude += std::fabs(a[i] * b[i]);
+        }
+        FloatToHalf(b.data(), half.data(), count, SimdLevel::kScalar);
+        const float reference = DotProductHalf(a.data(), half.data(), count, SimdLevel::kScalar);
+        for (const SimdLevel level : levels) {
+            VLM_EXPECT_NEAR(reference, DotProductHalf(a.data(), half.data(), count, level), 1e-5 * (magnitude + 1.0));
+        }
+    }
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,131 @@
+#include "frame_gate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// A scene of random grey blocks with some sensor noise, rendered into the
+// normalized tensor the encoder takes. |shift| moves the scene right by that
+// many pixels; |patch| paints a bright square over its centre.
+std::vector<float> Scene(const PreprocessConfig &config, int shift, bool patch, uint32_t noise_seed) {
+    constexpr int kBlock = 20;
+    std::mt19937 layout(7);
+    std::uniform_int_distribution<int> level(0, 255);
+    const int blocks_x = (config.width + shift) / kBlock + 2;
+    const int blocks_y = config.height / kBlock + 1;
+    std::vector<int> blocks(static_cast<size_t>(blocks_x) * blocks_y);
+    for (int &block : blocks) {
+        block = level(layout);
+    }
+    std::mt19937 noise(noise_seed);
+    std::uniform_int_distribution<int> jitter(-2, 2);
+    const size_t plane = static_cast<size_t>(config.width) * config.height;
+    std::vector<float> pixels(3 * plane);
+    for (int y = 0; y < config.height; ++y) {
+        for (int x = 0; x < config.width; ++x) {
+            int value = blocks[(y / kBlock) * blocks_x + (x + kBlock * 2 - shift) / kBlock];
+            if (patch && std::abs(x - config.width / 2) < config.width / 5 &&
+                std::abs(y - config.height / 2) < config.height / 5) {
+                value = 255;
+            }
+            for (int c = 0; c < 3; ++c) {
+                const int channel = std::min(std::max(value + jitter(noise), 0), 255);
+                pixels[c * plane + static_cast<size_t>(y) * config.width + x] =
+                    (channel / 255.0f - config.mean[c]) / config.std[c];
+            }
+        }
+    }
+    return pixels;
+}
+
+FrameGate EnabledGate() {
+    FrameGateConfig config;
+    config.enabled = true;
+    FrameGate gate;
+    gate.Configure(config);
+    return gate;
+}
+
+VLM_TEST(frame_gate, FirstFrameIsEncoded) {
+    FrameGate gate = EnabledGate();
+    PreprocessConfig config;
+    const std::vector<float> frame = Scene(config, 0, false, 1);
+    VLM_EXPECT(!gate.Unchanged(frame.data(), config));
+    gate.Accept();
+    gate.Reset();
+    VLM_EXPECT(!gate.Unchanged(frame.data(), config));
+}
+
+VLM_TEST(frame_gate, SameSceneIsGated) {
+    FrameGate gate = EnabledGate();
+    PreprocessConfig config;
+    const std::vector<float> first = Scene(config, 0, false, 1);
+    VLM_EXPECT(!gate.Unchanged(first.data(), config));
+    gate.Accept();
+    VLM_EXPECT(gate.Unchanged(first.data(), config));
+    VLM_EXPECT_EQ(0, gate.LastHashDistance());
+    // Same scene, new sensor noise.
+    const std::vector<float> again = Scene(config, 0, false, 2);
+    VLM_EXPECT(gate.Unchanged(again.data(), config));
+}
+
+VLM_TEST(frame_gate, ShiftedSceneIsEncoded) {
+    FrameGate gate = EnabledGate();
+    PreprocessConfig config;
+    const std::vector<float> first = Scene(config, 0, false, 1);
+    gate.Unchanged(first.data(), config);
+    gate.Accept();
+    const std::vector<float> shifted = Scene(config, 30, false, 1);
+    VLM_EXPECT(!gate.Unchanged(shifted.data(), config));
+    VLM_EXPECT(gate.LastHashDistance() > 5);
+}
+
+VLM_TEST(frame_gate, ChangedSceneIsEncoded) {
+    FrameGate gate = EnabledGate();
+    PreprocessConfig config;
+    const std::vector<float> first = Scene(config, 0, false, 1);
+    gate.Unchanged(first.data(), config);
+    gate.Accept();
+    const std::vector<float> changed = Scene(config, 0, true, 1);
+    VLM_EXPECT(!gate.Unchanged(changed.data(), config));
+    VLM_EXPECT(gate.LastMeanDifference() > 0.03f);
+    // The changed frame is the reference once accepted.
+    gate.Accept();
+    VLM_EXPECT(gate.Unchanged(changed.data(), config));
+}
+
+VLM_TEST(frame_gate, SimdSignatureMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // Widths that leave a tail after the last full vector, and cells of
+    // unequal size.
+    for (const int width : {224, 227, 37}) {
+        PreprocessConfig config;
+        config.width = width;
+        config.height = width == 37 ? 29 : 224;
+        const std::vector<float> frame = Scene(config, 3, false, 9);
+        FrameSignature reference;
+        std::vector<float> row_sums;
+        ComputeFrameSignature(frame.data(), config, &reference, &row_sums, SimdLevel::kScalar);
+        for (const SimdLevel level : levels) {
+            FrameSignature signature;
+            ComputeFrameSignature(frame.data(), config, &signature, &row_sums, level);
+            VLM_EXPECT_EQ(reference.hash, signature.hash);
+            for (int i = 0; i < FrameSignature::kWidth * FrameSignature::kHeight; ++i) {
+                VLM_EXPECT_NEAR(reference.thumbnail[i], signature.thumbnail[i], 1e-5);
+            }
+        }
+    }
+}
+
+}  // namespace
+}  // namespace vlm
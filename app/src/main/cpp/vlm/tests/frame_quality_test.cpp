@@ -0,0 +1,224 @@
+#include "frame_quality.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "burst_scorer.h"
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+constexpr int kStride = 672;  // padded, as camera planes often are
+
+std::vector<uint8_t> RandomPlane(int stride, int height, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> level(0, 255);
+    std::vector<uint8_t> plane(static_cast<size_t>(stride) * height);
+    for (uint8_t &value : plane) {
+        value = static_cast<uint8_t>(level(random));
+    }
+    return plane;
+}
+
+// A scene of random grey blocks with some sensor noise, the luma plane of a
+// sharp shot.
+std::vector<uint8_t> SharpLuma() {
+    constexpr int kBlock = 12;
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> level(40, 215);
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    const int blocks_x = kWidth / kBlock + 1;
+    std::vector<int> blocks(static_cast<size_t>(blocks_x) * (kHeight / kBlock + 1));
+    for (int &block : blocks) {
+        block = level(random);
+    }
+    std::vector<uint8_t> luma(static_cast<size_t>(kStride) * kHeight, 0);
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            const int value = blocks[(y / kBlock) * blocks_x + x / kBlock] + jitter(random);
+            luma[static_cast<size_t>(y) * kStride + x] = static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+        }
+    }
+    return luma;
+}
+
+// The same shot out of focus: a |radius| box blur, clamped at the edges.
+std::vector<uint8_t> Blurred(const std::vector<uint8_t> &luma, int radius) {
+    std::vector<uint8_t> blurred(luma.size(), 0);
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            int sum = 0;
+            int count = 0;
+            for (int dy = -radius; dy <= radius; ++dy) {
+                for (int dx = -radius; dx <= radius; ++dx) {
+                    const int sy = std::min(std::max(y + dy, 0), kHeight - 1);
+                    const int sx = std::min(std::max(x + dx, 0), kWidth - 1);
+                    sum += luma[static_cast<size_t>(sy) * kStride + sx];
+                    ++count;
+                }
+            }
+            blurred[static_cast<size_t>(y) * kStride + x] = static_cast<uint8_t>((sum + count / 2) / count);
+        }
+    }
+    return blurred;
+}
+
+// A YUV_420_888 frame with |luma| and neutral, interleaved chroma.
+FrameRef YuvFrame(const std::vector<uint8_t> &luma, uint64_t frame_id) {
+    const std::vector<uint8_t> chroma(static_cast<size_t>(kStride) * (kHeight / 2) - 1, 128);
+    const uint8_t *const planes[3] = {luma.data(), chroma.data(), chroma.data() + 1};
+    const size_t sizes[3] = {luma.size(), chroma.size(), chroma.size()};
+    auto frame = std::make_shared<Frame>();
+    frame->AssignYuv420(kWidth, kHeight, planes, sizes, kStride, kStride, 2);
+    frame->frame_id = frame_id;
+    return frame;
+}
+
+// Receives the bursts a BurstScorer finishes.
+class RecordingSink : public BurstSink {
+public:
+    void OnBurst(FrameRef best, const BurstOutcome &outcome) override {
+        bests.push_back(std::move(best));
+        outcomes.push_back(outcome);
+    }
+
+    std::vector<FrameRef> bests;
+    std::vector<BurstOutcome> outcomes;
+};
+
+VLM_TEST(frame_quality, SimdLaplacianMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // Widths around the 8 and 16 pixel vector blocks, so every tail length
+    // is covered, plus a full analysis row; all pixel values, so the sums of
+    // squares reach the largest Laplacian, 4 * 255.
+    uint32_t seed = 1;
+    for (const int width : {3, 4, 9, 10, 17, 18, 31, 33, 34, 47, 100, 320, 321}) {
+        for (const int height : {3, 4, 11}) {
+            for (const int padding : {0, 5}) {
+                const int stride = width + padding;
+                const std::vector<uint8_t> plane = RandomPlane(stride, height, seed++);
+                int64_t expected_sum = 0;
+                int64_t expected_squares = 0;
+                SumLaplacian(plane.data(), width, height, stride, &expected_sum, &expected_squares, SimdLevel::kScalar);
+                for (const SimdLevel level : levels) {
+                    int64_t sum = -1;
+                    int64_t squares = -1;
+                    SumLaplacian(plane.data(), width, height, stride, &sum, &squares, level);
+                    if (sum != expected_sum || squares != expected_squares) {
+                        test::Fail(__FILE__, __LINE__,
+                                   std::to_string(width) + "x" + std::to_string(height) + " stride " +
+                                       std::to_string(stride) + ": sum " + std::to_string(sum) + ", sum of squares " +
+                                       std::to_string(squares) + ", expected " + std::to_string(expected_sum) +
+                                       ", " + std::to_string(expected_squares));
+                    }
+                }
+            }
+        }
+    }
+}
+
+VLM_TEST(frame_quality, SharpFrameScoresAboveBlurredCopy) {
+    const std::vector<uint8_t> sharp = SharpLuma();
+    FrameScorer scorer;
+    FrameQuality sharp_quality;
+    FrameQuality blurred_quality;
+    std::string error;
+    VLM_ASSERT(scorer.Score(*YuvFrame(sharp, 1), &sharp_quality, &error));
+    VLM_ASSERT(scorer.Score(*YuvFrame(Blurred(sharp, 3), 2), &blurred_quality, &error));
+    VLM_EXPECT(sharp_quality.sharpness > 4.0f * blurred_quality.sharpness);
+    VLM_EXPECT_NEAR(sharp_quality.mean_luma, blurred_quality.mean_luma, 2.0f);
+    VLM_EXPECT_EQ(0.0f, sharp_quality.clipped);
+}
+
+VLM_TEST(frame_quality, BurstPicksSharpFrame) {
+    const std::vector<uint8_t> sharp = SharpLuma();
+    const std::vector<uint8_t> blurred = Blurred(sharp, 3);
+    FrameQualityConfig config;
+    config.burst_frames = 3;
+    BurstSelector selector;
+    selector.Configure(config);
+    // Wherever the sharp frame falls in the burst, and with a frame lost.
+    for (int position = 0; position < 3; ++position) {
+        selector.Begin();
+        FrameRef best;
+        BurstOutcome outcome;
+        for (int i = 0; i < 3; ++i) {
+            FrameRef frame;
+            if (i == position) {
+                frame = YuvFrame(sharp, 1);
+            } else if (i != (position + 1) % 3) {
+                frame = YuvFrame(blurred, 2);
+            }
+            const bool done = selector.Add(std::move(frame), &best, &outcome);
+            VLM_EXPECT(done == (i == 2));
+        }
+        VLM_ASSERT(best != nullptr);
+        VLM_EXPECT_EQ(1, best->frame_id);
+        VLM_EXPECT_EQ(position, outcome.best_index);
+        VLM_EXPECT_EQ(2, outcome.scored);
+        VLM_EXPECT(outcome.accepted);
+    }
+}
+
+VLM_TEST(frame_quality, BurstBelowFloorIsRejected) {
+    const std::vector<uint8_t> sharp = SharpLuma();
+    FrameScorer scorer;
+    FrameQuality quality;
+    std::string error;
+    VLM_ASSERT(scorer.Score(*YuvFrame(sharp, 1), &quality, &error));
+    FrameQualityConfig config;
+    config.burst_frames = 2;
+    config.min_sharpness = quality.sharpness * 2.0f;
+    BurstSelector selector;
+    selector.Configure(config);
+    selector.Begin();
+    FrameRef best;
+    BurstOutcome outcome;
+    VLM_EXPECT(!selector.Add(YuvFrame(Blurred(sharp, 3), 2), &best, &outcome));
+    VLM_EXPECT(selector.Add(YuvFrame(sharp, 1), &best, &outcome));
+    VLM_EXPECT(best == nullptr);
+    VLM_EXPECT(!outcome.accepted);
+    VLM_EXPECT_EQ(1, outcome.best_index);
+}
+
+VLM_TEST(frame_quality, ScorerHandsOnBestFrameOfEachBurst) {
+    const std::vector<uint8_t> sharp = SharpLuma();
+    const std::vector<uint8_t> blurred = Blurred(sharp, 3);
+    FrameQualityConfig config;
+    config.burst_frames = 2;
+    RecordingSink sink;
+    BurstScorer scorer;
+    scorer.Configure(config);
+    scorer.Start(&sink);
+    scorer.Begin();
+    scorer.Add(YuvFrame(blurred, 2));
+    scorer.Add(YuvFrame(sharp, 1));
+    // A new burst before the last one is complete drops what is left of it.
+    scorer.Begin();
+    scorer.Add(YuvFrame(blurred, 4));
+    scorer.Begin();
+    scorer.Add(YuvFrame(sharp, 3));
+    scorer.Add(YuvFrame(blurred, 4));
+    scorer.Stop();
+
+    VLM_ASSERT(sink.outcomes.size() == 2);
+    VLM_ASSERT(sink.bests[0] != nullptr && sink.bests[1] != nullptr);
+    VLM_EXPECT_EQ(1, sink.bests[0]->frame_id);
+    VLM_EXPECT_EQ(1, sink.outcomes[0].best_index);
+    VLM_EXPECT_EQ(3, sink.bests[1]->frame_id);
+    VLM_EXPECT_EQ(0, sink.outcomes[1].best_index);
+    VLM_EXPECT_EQ(0, scorer.DroppedFrames());
+}
+
+}  // namespace
+}  // namespace vlm
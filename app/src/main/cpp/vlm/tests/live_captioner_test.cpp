@@ -0,0 +1,241 @@
+#include "live_captioner.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_frame_source.h"
+#include "frame_pool.h"
+#include "inference_worker.h"
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// |count| small files in a fresh temporary directory, removed again on
+// destruction. FileFrameSource only copies their bytes, so they need not be
+// real JPEGs.
+class TempFrames {
+public:
+    explicit TempFrames(int count) {
+        char dir[] = "/tmp/vlm_live_test_XXXXXX";
+        if (!mkdtemp(dir)) {
+            return;
+        }
+        dir_ = dir;
+        for (int i = 0; i < count; ++i) {
+            const std::string path = dir_ + "/frame" + std::to_string(i) + ".jpg";
+            FILE *file = std::fopen(path.c_str(), "wb");
+            if (!file) {
+                continue;
+            }
+            const unsigned char bytes[4] = {0xFF, 0xD8, static_cast<unsigned char>(i), 0xD9};
+            std::fwrite(bytes, 1, sizeof(bytes), file);
+            std::fclose(file);
+            paths_.push_back(path);
+        }
+    }
+    ~TempFrames() {
+        for (const std::string &path : paths_) {
+            unlink(path.c_str());
+        }
+        if (!dir_.empty()) {
+            rmdir(dir_.c_str());
+        }
+    }
+
+    const std::vector<std::string> &Paths() const {
+        return paths_;
+    }
+
+private:
+    std::string dir_;
+    std::vector<std::string> paths_;
+};
+
+// Records what a FileFrameSource hands it. Sampling is left to a
+// LiveCaptioner when one is given, otherwise every frame is wanted. Frames
+// are kept when |hold_frames| is set, so their pool buffers stay in use.
+class RecordingSink : public FrameSink {
+public:
+    explicit RecordingSink(LiveCaptioner *sampler = nullptr, bool hold_frames = false)
+        : sampler_(sampler), hold_frames_(hold_frames) {}
+
+    bool WantsFrame(int64_t timestamp_ns) override {
+        return sampler_ ? sampler_->WantsFrame(timestamp_ns) : true;
+    }
+
+    void OnFrame(FrameRef frame) override {
+        in_on_frame_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timestamps_ns_.push_back(frame->timestamp_ns);
+            if (hold_frames_) {
+                held_.push_back(std::move(frame));
+            }
+        }
+        frames_.fetch_add(1);
+        in_on_frame_.store(false);
+    }
+
+    uint64_t Frames() const {
+        return frames_.load();
+    }
+    bool InOnFrame() const {
+        return in_on_frame_.load();
+    }
+    std::vector<int64_t> Timestamps() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return timestamps_ns_;
+    }
+    void ReleaseFrames() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        held_.clear();
+    }
+
+private:
+    LiveCaptioner *sampler_;
+    bool hold_frames_;
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<bool> in_on_frame_{false};
+    std::mutex mutex_;
+    std::vector<int64_t> timestamps_ns_;
+    std::vector<FrameRef> held_;
+};
+
+// Waits up to a few seconds for |condition|.
+template <typename Condition>
+bool WaitFor(Condition condition) {
+    for (int i = 0; i < 5000 && !condition(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return condition();
+}
+
+LiveCaptionConfig SamplingConfig() {
+    LiveCaptionConfig config;
+    config.min_interval_ms = 50.0;
+    config.max_interval_ms = 1000.0;
+    return config;
+}
+
+// Replays 60 frames at 200 fps, i.e. timestamps 0, 5, ..., 295 ms, and
+// returns the ones |captioner| sampled.
+std::vector<int64_t> SampleReplay(LiveCaptioner *captioner) {
+    const TempFrames files(3);
+    FramePool pool(4, 16);
+    FileFrameSource source(&pool, files.Paths(), 200.0, 20);
+    RecordingSink sink(captioner);
+    std::string error;
+    if (!source.Start(&sink, &error)) {
+        test::Fail(__FILE__, __LINE__, "FileFrameSource::Start failed: " + error);
+        return {};
+    }
+    VLM_EXPECT(WaitFor([&source]() { return source.Finished(); }));
+    source.Stop();
+    VLM_EXPECT_EQ(60u, source.FramesOffered());
+    VLM_EXPECT_EQ(0u, source.FramesDropped());
+    return sink.Timestamps();
+}
+
+VLM_TEST(live_captioner, SamplingFollowsInterval) {
+    InferenceWorker worker;
+    LiveCaptioner captioner(&worker, SamplingConfig());
+    VLM_EXPECT_NEAR(50.0, captioner.IntervalMs(), 1e-9);
+    const std::vector<int64_t> sampled = SampleReplay(&captioner);
+    const std::vector<int64_t> expected = {0, 50000000, 100000000, 150000000, 200000000, 250000000};
+    VLM_ASSERT(sampled.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        VLM_EXPECT_EQ(expected[i], sampled[i]);
+    }
+    VLM_EXPECT_EQ(54u, captioner.SkippedFrames());
+}
+
+VLM_TEST(live_captioner, SamplingSlowsToCaptionLatency) {
+    InferenceWorker worker;
+    LiveCaptioner captioner(&worker, SamplingConfig());
+    CaptionCompletion completion;
+    completion.ok = true;
+    completion.caption.timings.total_ms = 120.0;
+    captioner.OnCompletion(completion);
+    VLM_EXPECT_NEAR(120.0, captioner.IntervalMs(), 1e-9);
+    // Captions the frame gate reused do not count.
+    completion.caption.reused = true;
+    completion.caption.timings.total_ms = 1.0;
+    captioner.OnCompletion(completion);
+    VLM_EXPECT_NEAR(120.0, captioner.IntervalMs(), 1e-9);
+
+    const std::vector<int64_t> sampled = SampleReplay(&captioner);
+    const std::vector<int64_t> expected = {0, 120000000, 240000000};
+    VLM_ASSERT(sampled.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        VLM_EXPECT_EQ(expected[i], sampled[i]);
+    }
+}
+
+VLM_TEST(live_captioner, SkipsFramesWhileWorkerIsBehind) {
+    // The worker is never started, so the first frame stays queued and no
+    // other one is taken.
+    const TempFrames files(3);
+    FramePool pool(4, 16);
+    FileFrameSource source(&pool, files.Paths(), 500.0, 10);
+    InferenceWorker worker;
+    LiveCaptioner captioner(&worker, SamplingConfig());
+    std::string error;
+    VLM_ASSERT(captioner.Start(&source, &error));
+    VLM_EXPECT(captioner.IsRunning());
+    VLM_EXPECT(WaitFor([&source]() { return source.Finished(); }));
+    captioner.Stop();
+    VLM_EXPECT(!captioner.IsRunning());
+    VLM_EXPECT_EQ(30u, source.FramesOffered());
+    VLM_EXPECT_EQ(1u, captioner.SampledFrames());
+    VLM_EXPECT_EQ(29u, captioner.SkippedFrames());
+    VLM_EXPECT_EQ(1u, worker.SubmittedFrames());
+}
+
+VLM_TEST(live_captioner, StopEndsFrameDelivery) {
+    const TempFrames files(3);
+    FramePool pool(4, 16);
+    // Repeats until stopped.
+    FileFrameSource source(&pool, files.Paths(), 1000.0, 0);
+    RecordingSink sink;
+    std::string error;
+    VLM_ASSERT(source.Start(&sink, &error));
+    VLM_EXPECT(WaitFor([&sink]() { return sink.Frames() >= 5; }));
+    source.Stop();
+    VLM_EXPECT(!sink.InOnFrame());
+    const uint64_t frames = sink.Frames();
+    const uint64_t offered = source.FramesOffered();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    VLM_EXPECT_EQ(frames, sink.Frames());
+    VLM_EXPECT_EQ(offered, source.FramesOffered());
+    VLM_EXPECT(!source.Finished());
+}
+
+VLM_TEST(live_captioner, CountsFramesDroppedForAnExhaustedPool) {
+    const TempFrames files(5);
+    FramePool pool(2, 16);
+    FileFrameSource source(&pool, files.Paths(), 1000.0, 2);
+    // Holding on to every frame keeps both pool buffers in use.
+    RecordingSink sink(nullptr, true);
+    std::string error;
+    VLM_ASSERT(source.Start(&sink, &error));
+    VLM_EXPECT(WaitFor([&source]() { return source.Finished(); }));
+    source.Stop();
+    VLM_EXPECT_EQ(10u, source.FramesOffered());
+    VLM_EXPECT_EQ(2u, sink.Frames());
+    VLM_EXPECT_EQ(8u, source.FramesDropped());
+    VLM_EXPECT_EQ(0u, pool.FreeCount());
+    sink.ReleaseFrames();
+    VLM_EXPECT_EQ(2u, pool.FreeCount());
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,416 @@
+#include "logits_processor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+constexpr float kInf = std::numeric_limits<float>::infinity();
+
+// Lengths around every vector width and the top-k chunk, plus a GPT-2 vocab.
+const std::vector<size_t> &RowSizes() {
+    static const std::vector<size_t> sizes = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 23, 24, 31, 32, 33, 100, 1023, 1025,
+                                              4099, 50257};
+    return sizes;
+}
+
+// Random logits. With |levels| > 0 they are drawn from that many values, so
+// ties are common; |inf_percent| of them are -inf.
+std::vector<float> RandomRow(size_t count, uint32_t seed, int levels, int inf_percent) {
+    std::mt19937 random(seed);
+    std::normal_distribution<float> normal(0.0f, 4.0f);
+    std::uniform_int_distribution<int> level(0, levels > 0 ? levels - 1 : 0);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<float> row(count);
+    for (float &logit : row) {
+        logit = levels > 0 ? static_cast<float>(level(random)) : normal(random);
+        if (percent(random) < inf_percent) {
+            logit = -kInf;
+        }
+    }
+    return row;
+}
+
+// Rows of every size with and without ties and -inf entries.
+template <typename Check>
+void ForEachRow(Check check) {
+    uint32_t seed = 1;
+    for (const size_t count : RowSizes()) {
+        for (const int levels : {0, 3}) {
+            for (const int inf_percent : {0, 30}) {
+                check(RandomRow(count, seed++, levels, inf_percent), "size " + std::to_string(count) + " levels " +
+                                                                         std::to_string(levels) + " inf " +
+                                                                         std::to_string(inf_percent));
+            }
+        }
+    }
+}
+
+size_t FirstMax(const std::vector<float> &row) {
+    size_t best = 0;
+    for (size_t i = 1; i < row.size(); ++i) {
+        if (row[i] > row[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+double ReferenceSumExp(const std::vector<float> &row, float max, float scale) {
+    double sum = 0.0;
+    for (const float logit : row) {
+        sum += std::exp((static_cast<double>(logit) - max) * scale);
+    }
+    return sum;
+}
+
+VLM_TEST(logits_processor, ArgmaxPicksFirstMaximum) {
+    std::vector<SimdLevel> levels = test::SimdLevels();
+    levels.push_back(SimdLevel::kScalar);
+    ForEachRow([&](const std::vector<float> &row, const std::string &name) {
+        for (const SimdLevel level : levels) {
+            const size_t best = ArgmaxLogits(row.data(), row.size(), level);
+            if (best != FirstMax(row)) {
+                test::Fail(__FILE__, __LINE__, name + ": argmax " + std::to_string(best) + ", expected " +
+                                                   std::to_string(FirstMax(row)));
+            }
+        }
+    });
+    // The maximum in the last lane of a vector, in the tail, and a row of
+    // nothing but -inf.
+    for (const SimdLevel level : levels) {
+        for (const size_t count : {16, 17, 33}) {
+            for (const size_t at : {size_t{0}, size_t{7}, size_t{15}, count - 1}) {
+                std::vector<float> row(count, 1.0f);
+                row[at] = 2.0f;
+                VLM_EXPECT_EQ(at, ArgmaxLogits(row.data(), count, level));
+                // An equal value after it does not win.
+                if (at + 1 < count) {
+                    row[count - 1] = 2.0f;
+                    VLM_EXPECT_EQ(at, ArgmaxLogits(row.data(), count, level));
+                }
+            }
+        }
+        const std::vector<float> none(40, -kInf);
+        VLM_EXPECT_EQ(0u, ArgmaxLogits(none.data(), none.size(), level));
+    }
+}
+
+VLM_TEST(logits_processor, SimdSumExpMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    ForEachRow([&](const std::vector<float> &row, const std::string &name) {
+        const float max = row[FirstMax(row)];
+        if (max == -kInf) {
+            return;
+        }
+        for (const float scale : {1.0f, 1.0f / 0.7f, 1.0f / 1.5f}) {
+            // Float accumulation drifts with the length of the row, the
+            // scalar loop's one accumulator most of all.
+            const double expected = ReferenceSumExp(row, max, scale);
+            const double tolerance = (1e-6 + 1e-8 * static_cast<double>(row.size())) * expected;
+            VLM_EXPECT_NEAR(expected, SumExpLogits(row.data(), row.size(), max, scale, SimdLevel::kScalar), tolerance);
+            for (const SimdLevel level : levels) {
+                const float actual = SumExpLogits(row.data(), row.size(), max, scale, level);
+                if (std::fabs(actual - expected) > tolerance) {
+                    test::Fail(__FILE__, __LINE__, name + ": sum " + std::to_string(actual) + ", expected " +
+                                                       std::to_string(expected));
+                }
+            }
+        }
+    });
+}
+
+VLM_TEST(logits_processor, SimdExpIsAccurate) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // One finite logit per vector, so the sum is exp() of it and seven
+    // clamped e^-87 that are lost in rounding.
+    std::vector<float> row(8, -kInf);
+    for (float x = -60.0f; x <= 0.0f; x += 0.0137f) {
+        row[3] = x;
+        const double expected = std::exp(static_cast<double>(x));
+        for (const SimdLevel level : levels) {
+            const float actual = SumExpLogits(row.data(), row.size(), 0.0f, 1.0f, level);
+            if (std::fabs(actual - expected) > 4e-7 * expected) {
+                test::Fail(__FILE__, __LINE__, "exp(" + std::to_string(x) + ") is " + std::to_string(actual));
+            }
+        }
+    }
+}
+
+VLM_TEST(logits_processor, SimdCollectMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    ForEachRow([&](const std::vector<float> &row, const std::string &name) {
+        // Thresholds equal to logits of the row, so ties are at the cutoff.
+        for (const float threshold : {row[row.size() / 2], row[row.size() - 1], -kInf, 1.0f}) {
+            std::vector<uint32_t> expected(row.size());
+            std::vector<uint32_t> actual(row.size());
+            expected.resize(CollectLogitsAbove(row.data(), row.size(), threshold, expected.data(), SimdLevel::kScalar));
+            for (size_t i = 0, e = 0; i < row.size(); ++i) {
+                if (row[i] >= threshold) {
+                    VLM_EXPECT(e < expected.size() && expected[e++] == i);
+                }
+            }
+            for (const SimdLevel level : levels) {
+                actual.resize(row.size());
+                actual.resize(CollectLogitsAbove(row.data(), row.size(), threshold, actual.data(), level));
+                if (actual != expected) {
+                    test::Fail(__FILE__, __LINE__, name + ": collected " + std::to_string(actual.size()) +
+                                                       " indices, expected " + std::to_string(expected.size()));
+                }
+            }
+        }
+    });
+}
+
+VLM_TEST(logits_processor, TopKKeepsFirstOfTies) {
+    std::vector<SimdLevel> levels = test::SimdLevels();
+    levels.push_back(SimdLevel::kScalar);
+    ForEachRow([&](const std::vector<float> &row, const std::string &name) {
+        std::vector<uint32_t> order(row.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&row](uint32_t a, uint32_t b) { return row[a] > row[b]; });
+        for (const size_t k : {size_t{1}, size_t{5}, size_t{40}, size_t{1500}, row.size() + 3}) {
+            std::vector<uint32_t> expected(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(
+                                                                             std::min(k, order.size())));
+            std::sort(expected.begin(), expected.end());
+            for (const SimdLevel level : levels) {
+                std::vector<uint32_t> actual(row.size());
+                actual.resize(TopKLogits(row.data(), row.size(), k, actual.data(), level));
+                std::sort(actual.begin(), actual.end());
+                if (actual != expected) {
+                    test::Fail(__FILE__, __LINE__, name + ": wrong top " + std::to_string(k));
+                }
+            }
+        }
+    });
+}
+
+VLM_TEST(logits_processor, SimdSampleMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    std::mt19937 random(5);
+    ForEachRow([&](const std::vector<float> &row, const std::string &name) {
+        const float max = row[FirstMax(row)];
+        if (max == -kInf) {
+            return;
+        }
+        std::vector<double> cumulative(row.size());
+        double acc = 0.0;
+        for (size_t i = 0; i < row.size(); ++i) {
+            acc += std::exp(static_cast<double>(row[i]) - max);
+            cumulative[i] = acc;
+        }
+        // Targets halfway through the weight of a token, far from the
+        // rounding of either sum.
+        std::uniform_int_distribution<size_t> pick(0, row.size() - 1);
+        for (int draw = 0; draw < 20; ++draw) {
+            const size_t index = pick(random);
+            const double before = index > 0 ? cumulative[index - 1] : 0.0;
+            const double weight = cumulative[index] - before;
+            if (weight <= 1e-3 * cumulative[index]) {
+                continue;
+            }
+            const float target = static_cast<float>(before + weight / 2.0);
+            VLM_EXPECT_EQ(index, SampleLogits(row.data(), row.size(), max, 1.0f, target, SimdLevel::kScalar));
+            for (const SimdLevel level : levels) {
+                if (SampleLogits(row.data(), row.size(), max, 1.0f, target, level) != index) {
+                    test::Fail(__FILE__, __LINE__, name + ": sampled past token " + std::to_string(index));
+                }
+            }
+        }
+        for (const SimdLevel level : levels) {
+            VLM_EXPECT_EQ(row.size(), SampleLogits(row.data(), row.size(), max, 1.0f, static_cast<float>(acc * 1.01),
+                                                   level));
+        }
+    });
+}
+
+// Draws |draws| tokens from |logits| and counts how often each comes up.
+std::vector<int> Histogram(const SamplingConfig &config, SimdLevel level, const std::vector<float> &logits,
+                           int draws, std::vector<int64_t> *tokens = nullptr) {
+    LogitsProcessor processor;
+    processor.Configure(config, level);
+    processor.Reset(nullptr, 0);
+    std::vector<int> counts(logits.size());
+    std::vector<float> row;
+    for (int i = 0; i < draws; ++i) {
+        row = logits;
+        const int64_t token = processor.Select(row.data(), row.size());
+        if (token < 0 || static_cast<size_t>(token) >= logits.size()) {
+            test::Fail(__FILE__, __LINE__, "token " + std::to_string(token) + " outside the vocabulary");
+            continue;
+        }
+        ++counts[static_cast<size_t>(token)];
+        if (tokens) {
+            tokens->push_back(token);
+        }
+    }
+    return counts;
+}
+
+// A vocabulary with a few likely tokens in front: probabilities about
+// 0.5, 0.3, 0.15, 0.05 for tokens 0-3 and next to nothing for the rest.
+std::vector<float> PeakedLogits(size_t vocab) {
+    std::vector<float> logits = RandomRow(vocab, 11, 0, 10);
+    for (float &logit : logits) {
+        logit = logit == -kInf ? logit : logit * 0.25f - 20.0f;
+    }
+    const float probabilities[4] = {0.5f, 0.3f, 0.15f, 0.05f};
+    for (int i = 0; i < 4; ++i) {
+        logits[static_cast<size_t>(i)] = std::log(probabilities[i]);
+    }
+    return logits;
+}
+
+VLM_TEST(logits_processor, SelectGreedy) {
+    std::vector<SimdLevel> levels = test::SimdLevels();
+    levels.push_back(SimdLevel::kScalar);
+    for (const SimdLevel level : levels) {
+        LogitsProcessor processor;
+        processor.Configure(SamplingConfig(), level);
+        std::vector<float> row = RandomRow(50257, 3, 4, 20);
+        VLM_EXPECT_EQ(static_cast<int64_t>(FirstMax(row)), processor.Select(row.data(), row.size()));
+        // top_k 1 is greedy whatever the temperature.
+        SamplingConfig config;
+        config.temperature = 1.0f;
+        config.top_k = 1;
+        processor.Configure(config, level);
+        VLM_EXPECT_EQ(static_cast<int64_t>(FirstMax(row)), processor.Select(row.data(), row.size()));
+    }
+}
+
+VLM_TEST(logits_processor, SelectRepetitionPenalty) {
+    SamplingConfig config;
+    config.repetition_penalty = 2.0f;
+    LogitsProcessor processor;
+    processor.Configure(config, SimdLevel::kScalar);
+    const int64_t prompt[] = {0, 2};
+    processor.Reset(prompt, 2);
+    std::vector<float> row = {3.0f, 2.0f, -1.0f, -1.5f};
+    // 3 becomes 1.5 and -1 becomes -2: token 1 is now the best.
+    VLM_EXPECT_EQ(1, processor.Select(row.data(), row.size()));
+    VLM_EXPECT_NEAR(1.5f, row[0], 0.0f);
+    VLM_EXPECT_NEAR(-2.0f, row[2], 0.0f);
+    VLM_EXPECT_NEAR(-1.5f, row[3], 0.0f);
+    processor.Accept(1);
+    row = {3.0f, 2.0f, -1.0f, -1.5f};
+    VLM_EXPECT_EQ(0, processor.Select(row.data(), row.size()));
+}
+
+VLM_TEST(logits_processor, SelectSamplesSoftmax) {
+    SamplingConfig config;
+    config.temperature = 1.0f;
+    config.seed = 42;
+    const std::vector<float> logits = PeakedLogits(4099);
+    const int draws = 10000;
+    const std::vector<int> counts = Histogram(config, SimdLevel::kScalar, logits, draws);
+    const double expected[4] = {0.5, 0.3, 0.15, 0.05};
+    for (int i = 0; i < 4; ++i) {
+        VLM_EXPECT_NEAR(expected[i], counts[static_cast<size_t>(i)] / static_cast<double>(draws), 0.015);
+    }
+    for (size_t i = 0; i < logits.size(); ++i) {
+        if (logits[i] == -kInf) {
+            VLM_EXPECT_EQ(0, counts[i]);
+        }
+    }
+}
+
+VLM_TEST(logits_processor, SelectTopKAndTopP) {
+    const std::vector<float> logits = PeakedLogits(4099);
+    const int draws = 10000;
+    struct Case {
+        int top_k;
+        float top_p;
+        double expected[4];
+    };
+    // top-p keeps the fewest tokens reaching p: 0.5 + 0.3 >= 0.7.
+    const Case cases[] = {
+        {3, 1.0f, {0.5 / 0.95, 0.3 / 0.95, 0.15 / 0.95, 0.0}},
+        {0, 0.7f, {0.5 / 0.8, 0.3 / 0.8, 0.0, 0.0}},
+        {0, 0.4f, {1.0, 0.0, 0.0, 0.0}},
+        // p applies to what top-k kept: 0.7 of 0.8 needs both.
+        {2, 0.7f, {0.5 / 0.8, 0.3 / 0.8, 0.0, 0.0}},
+        {40, 0.9f, {0.5 / 0.95, 0.3 / 0.95, 0.15 / 0.95, 0.0}},
+    };
+    for (const Case &c : cases) {
+        SamplingConfig config;
+        config.temperature = 1.0f;
+        config.top_k = c.top_k;
+        config.top_p = c.top_p;
+        config.seed = 7;
+        const std::vector<int> counts = Histogram(config, SimdLevel::kScalar, logits, draws);
+        int total = 0;
+        for (int i = 0; i < 4; ++i) {
+            total += counts[static_cast<size_t>(i)];
+            VLM_EXPECT_NEAR(c.expected[i], counts[static_cast<size_t>(i)] / static_cast<double>(draws), 0.015);
+        }
+        VLM_EXPECT_EQ(draws, total);
+    }
+}
+
+VLM_TEST(logits_processor, SimdSelectMatchesScalar) {
+    const std::vector<SimdLevel> levels = test::SimdLevels();
+    if (levels.empty()) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    const std::vector<float> peaked = PeakedLogits(4099);
+    const std::vector<float> flat = RandomRow(4099, 13, 0, 5);
+    const std::vector<float> tied = RandomRow(1001, 17, 6, 5);
+    const int draws = 400;
+    for (const std::vector<float> *logits : {&peaked, &flat, &tied}) {
+        for (const int top_k : {0, 5, 50}) {
+            for (const float top_p : {1.0f, 0.9f}) {
+                SamplingConfig config;
+                config.temperature = 0.8f;
+                config.top_k = top_k;
+                config.top_p = top_p;
+                config.seed = 1234;
+                std::vector<int64_t> expected;
+                Histogram(config, SimdLevel::kScalar, *logits, draws, &expected);
+                // Plain temperature sampling draws against the softmax
+                // normalizer, whose last bits depend on the summation order,
+                // so a draw right at a token boundary may land next to it.
+                // The candidates of top-k and top-p are weighed the same way
+                // at every level.
+                const int allowed = top_k == 0 && top_p >= 1.0f ? draws / 100 : 0;
+                for (const SimdLevel level : levels) {
+                    std::vector<int64_t> actual;
+                    Histogram(config, level, *logits, draws, &actual);
+                    int differ = 0;
+                    for (size_t i = 0; i < expected.size() && i < actual.size(); ++i) {
+                        differ += actual[i] != expected[i] ? 1 : 0;
+                    }
+                    if (actual.size() != expected.size() || differ > allowed) {
+                        test::Fail(__FILE__, __LINE__, "top_k " + std::to_string(top_k) + " top_p " +
+                                                           std::to_string(top_p) + ": " + std::to_string(differ) +
+                                                           " draws differ from scalar");
+                    }
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+}  // namespace vlm
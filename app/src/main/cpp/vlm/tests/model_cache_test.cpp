@@ -0,0 +1,104 @@
+#include "model_cache.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// A temporary directory with a source model and the cache directory inside.
+class CacheDir {
+public:
+    CacheDir() {
+        char dir[] = "/tmp/vlm_cache_test_XXXXXX";
+        if (mkdtemp(dir)) {
+            dir_ = std::string(dir) + "/";
+        }
+    }
+    ~CacheDir() {
+        unlink(Model().c_str());
+        rmdir(Cache().c_str());
+        if (!dir_.empty()) {
+            rmdir(dir_.c_str());
+        }
+    }
+
+    std::string Model() const {
+        return dir_ + "encoder_model.onnx";
+    }
+    std::string Cache() const {
+        return dir_ + "cache/";
+    }
+
+    void WriteModel(const char *contents, long mtime_s) const {
+        FILE *file = std::fopen(Model().c_str(), "wb");
+        if (file) {
+            std::fputs(contents, file);
+            std::fclose(file);
+        }
+        SetModelTime(mtime_s);
+    }
+    void SetModelTime(long mtime_s) const {
+        const timeval times[2] = {{mtime_s, 0}, {mtime_s, 0}};
+        utimes(Model().c_str(), times);
+    }
+
+    std::string Key(const char *signature) const {
+        OptimizedModelEntry entry;
+        std::string error;
+        if (!FindOptimizedModel(Cache(), Model(), signature, &entry, &error)) {
+            test::Fail(__FILE__, __LINE__, "FindOptimizedModel failed: " + error);
+            return "";
+        }
+        return entry.key;
+    }
+
+private:
+    std::string dir_;
+};
+
+VLM_TEST(model_cache, EntryNamesFollowTheSource) {
+    CacheDir dir;
+    dir.WriteModel("model v1", 1000000);
+    OptimizedModelEntry entry;
+    std::string error;
+    VLM_ASSERT(FindOptimizedModel(dir.Cache(), dir.Model(), "ort=1", &entry, &error));
+    VLM_EXPECT(entry.stem == "encoder_model");
+    VLM_EXPECT_EQ(16u, entry.key.size());
+    VLM_EXPECT(entry.model_path == dir.Cache() + "encoder_model." + entry.key + ".onnx");
+    VLM_EXPECT(entry.data_file_name == "encoder_model." + entry.key + ".onnx.data");
+    VLM_EXPECT(!OptimizedModelExists(entry));
+}
+
+VLM_TEST(model_cache, KeyChangesWithTheSource) {
+    CacheDir dir;
+    dir.WriteModel("model v1", 1000000);
+    const std::string key = dir.Key("ort=1");
+    VLM_EXPECT(key == dir.Key("ort=1"));
+    VLM_EXPECT(key != dir.Key("ort=2"));
+    // Same size, new time, as after copying a retrained model over it.
+    dir.WriteModel("model v2", 1000001);
+    VLM_EXPECT(key != dir.Key("ort=1"));
+    dir.SetModelTime(1000000);
+    VLM_EXPECT(key == dir.Key("ort=1"));
+    dir.WriteModel("model v10", 1000000);
+    VLM_EXPECT(key != dir.Key("ort=1"));
+}
+
+VLM_TEST(model_cache, MissingSourceHasNoEntry) {
+    CacheDir dir;
+    OptimizedModelEntry entry;
+    std::string error;
+    VLM_EXPECT(!FindOptimizedModel(dir.Cache(), dir.Model(), "ort=1", &entry, &error));
+    VLM_EXPECT(!error.empty());
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vlm_engine.h"
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// A temporary models directory holding empty files with the given names.
+class ModelDir {
+public:
+    explicit ModelDir(const std::vector<std::string> &files) {
+        char dir[] = "/tmp/vlm_models_test_XXXXXX";
+        if (!mkdtemp(dir)) {
+            return;
+        }
+        dir_ = std::string(dir) + "/";
+        for (const std::string &name : files) {
+            FILE *file = std::fopen((dir_ + name).c_str(), "wb");
+            if (file) {
+                std::fclose(file);
+                files_.push_back(dir_ + name);
+            }
+        }
+    }
+    ~ModelDir() {
+        for (const std::string &path : files_) {
+            unlink(path.c_str());
+        }
+        if (!dir_.empty()) {
+            rmdir(dir_.c_str());
+        }
+    }
+
+    std::string Path(const std::string &name) const {
+        return dir_ + name;
+    }
+
+private:
+    std::string dir_;
+    std::vector<std::string> files_;
+};
+
+void ExpectResolved(const ModelDir &dir, ModelPrecision precision, bool prefer_ort_format, bool found,
+                    const std::string &file, ModelPrecision loaded_precision, bool ort_format) {
+    ModelLoadInfo info;
+    VLM_EXPECT_EQ(found, ResolveModelFile(dir.Path("encoder_model.onnx"), precision, prefer_ort_format, &info));
+    if (info.path != dir.Path(file)) {
+        test::Fail(__FILE__, __LINE__, "resolved " + info.path + ", expected " + dir.Path(file));
+    }
+    VLM_EXPECT(info.precision == loaded_precision);
+    VLM_EXPECT_EQ(ort_format, info.ort_format);
+}
+
+VLM_TEST(model_files, Fp32Only) {
+    const ModelDir dir({"encoder_model.onnx"});
+    ExpectResolved(dir, ModelPrecision::kFp32, true, true, "encoder_model.onnx", ModelPrecision::kFp32, false);
+    // A missing variant falls back to fp32 and says so.
+    ExpectResolved(dir, ModelPrecision::kInt8, true, false, "encoder_model.onnx", ModelPrecision::kFp32, false);
+}
+
+VLM_TEST(model_files, Fp32OrtFormat) {
+    const ModelDir dir({"encoder_model.onnx", "encoder_model.ort"});
+    ExpectResolved(dir, ModelPrecision::kFp32, true, true, "encoder_model.ort", ModelPrecision::kFp32, true);
+    ExpectResolved(dir, ModelPrecision::kFp32, false, true, "encoder_model.onnx", ModelPrecision::kFp32, false);
+    ExpectResolved(dir, ModelPrecision::kInt4, true, false, "encoder_model.ort", ModelPrecision::kFp32, true);
+}
+
+VLM_TEST(model_files, VariantOnnxOnly) {
+    // The fp32 .ort must not replace the variant.
+    const ModelDir dir({"encoder_model.onnx", "encoder_model.ort", "encoder_model_int8.onnx"});
+    ExpectResolved(dir, ModelPrecision::kInt8, true, true, "encoder_model_int8.onnx", ModelPrecision::kInt8, false);
+    ExpectResolved(dir, ModelPrecision::kFp32, true, true, "encoder_model.ort", ModelPrecision::kFp32, true);
+}
+
+VLM_TEST(model_files, VariantOrtOnly) {
+    const ModelDir dir({"encoder_model.onnx", "encoder_model.ort", "encoder_model_int8.ort"});
+    ExpectResolved(dir, ModelPrecision::kInt8, true, true, "encoder_model_int8.ort", ModelPrecision::kInt8, true);
+    // Without ORT format the variant is not there.
+    ExpectResolved(dir, ModelPrecision::kInt8, false, false, "encoder_model.onnx", ModelPrecision::kFp32, false);
+}
+
+VLM_TEST(model_files, VariantInBothFormats) {
+    const ModelDir dir({"encoder_model.onnx", "encoder_model_q4.onnx", "encoder_model_q4.ort"});
+    ExpectResolved(dir, ModelPrecision::kInt4, true, true, "encoder_model_q4.ort", ModelPrecision::kInt4, true);
+    ExpectResolved(dir, ModelPrecision::kInt4, false, true, "encoder_model_q4.onnx", ModelPrecision::kInt4, false);
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,108 @@
+// Runs the tests registered with VLM_TEST. Exits with 0 when every test that
+// ran passed, 77 (CTest's skip code) when every selected test was skipped,
+// and 1 on a failure or when no test was selected.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace test {
+
+namespace {
+
+struct TestCase {
+    const char *suite;
+    const char *name;
+    TestFunction function;
+};
+
+std::vector<TestCase> &Tests() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+bool g_failed = false;
+bool g_skipped = false;
+
+}  // namespace
+
+bool Register(const char *suite, const char *name, TestFunction function) {
+    Tests().push_back(TestCase{suite, name, function});
+    return true;
+}
+
+void Fail(const char *file, int line, const std::string &message) {
+    std::printf("%s:%d: FAILED: %s\n", file, line, message.c_str());
+    g_failed = true;
+}
+
+void Skip(const std::string &reason) {
+    std::printf("  skipped: %s\n", reason.c_str());
+    g_skipped = true;
+}
+
+bool Passing() {
+    return !g_failed;
+}
+
+std::string ModelsDir() {
+    const char *dir = std::getenv("VLM_TEST_MODELS");
+    std::string path = dir ? dir : "";
+    if (!path.empty() && path.back() != '/') {
+        path += '/';
+    }
+    return path;
+}
+
+std::vector<SimdLevel> SimdLevels() {
+    const SimdLevel level = DetectSimdLevel();
+    if (level == SimdLevel::kScalar) {
+        return {};
+    }
+    return {level};
+}
+
+}  // namespace test
+}  // namespace vlm
+
+int main(int argc, char **argv) {
+    using vlm::test::TestCase;
+    int passed = 0;
+    int failed = 0;
+    int skipped = 0;
+    for (const TestCase &test : vlm::test::Tests()) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || std::strcmp(argv[i], test.suite) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        std::printf("[ RUN  ] %s.%s\n", test.suite, test.name);
+        std::fflush(stdout);
+        vlm::test::g_failed = false;
+        vlm::test::g_skipped = false;
+        test.function();
+        const char *outcome = "  OK  ";
+        if (vlm::test::g_failed) {
+            outcome = "FAILED";
+            ++failed;
+        } else if (vlm::test::g_skipped) {
+            outcome = " SKIP ";
+            ++skipped;
+        } else {
+            ++passed;
+        }
+        std::printf("[%s] %s.%s\n", outcome, test.suite, test.name);
+    }
+    std::printf("%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    if (failed > 0 || passed + skipped == 0) {
+        return 1;
+    }
+    return passed == 0 && skipped > 0 ? 77 : 0;
+}
@@ -0,0 +1,324 @@
+#include "tokenizer.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// GPT-2's bytes_to_unicode(): the code point standing for each byte in a
+// byte-level vocabulary.
+uint32_t ByteCodePoint(uint8_t byte) {
+    uint32_t shifted = 0;
+    for (int b = 0; b < 256; ++b) {
+        const bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+        if (b == byte) {
+            return printable ? byte : 256 + shifted;
+        }
+        shifted += printable ? 0 : 1;
+    }
+    return 0;
+}
+
+// |bytes| as a byte-level token string, every code point \u-escaped.
+std::string JsonToken(const std::string &bytes) {
+    std::string out;
+    for (const char c : bytes) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04X", ByteCodePoint(static_cast<uint8_t>(c)));
+        out += escaped;
+    }
+    return out;
+}
+
+// |bytes| as a byte-level token string in UTF-8, as merges.txt has it.
+std::string Utf8Token(const std::string &bytes) {
+    std::string out;
+    for (const char c : bytes) {
+        const uint32_t cp = ByteCodePoint(static_cast<uint8_t>(c));
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+    return out;
+}
+
+// Merges of the fixture, lowest rank first. Byte b has id b and the token a
+// merge makes has id 256 + its rank.
+const std::vector<std::pair<std::string, std::string>> &FixtureMerges() {
+    static const std::vector<std::pair<std::string, std::string>> merges = {
+        {" ", "c"},           // 256 " c"
+        {"a", "t"},           // 257 "at"
+        {" c", "at"},         // 258 " cat"
+        {" ", " "},           // 259 "  "
+        {"\xC3", "\xA9"},     // 260 "é"
+        {"c", "a"},           // 261 "ca"
+        {"ca", "f"},          // 262 "caf"
+        {"caf", "\xC3\xA9"},  // 263 "café"
+        {"'", "s"},           // 264 "'s"
+        {"\xE5", "\x8C"},     // 265 the first two bytes of "北"
+    };
+    return merges;
+}
+
+// A temporary directory with vocab.json, merges.txt and the same tokenizer
+// as a tokenizer.json.
+class FixtureDir {
+public:
+    FixtureDir() {
+        char dir[] = "/tmp/vlm_tokenizer_test_XXXXXX";
+        if (!mkdtemp(dir)) {
+            return;
+        }
+        dir_ = std::string(dir) + "/";
+        std::string vocab = "{";
+        for (int b = 0; b < 256; ++b) {
+            vocab += "\"" + JsonToken(std::string(1, static_cast<char>(b))) + "\": " + std::to_string(b) + ", ";
+        }
+        std::string merges_txt = "#version: 0.2\n";
+        std::string merges_json = "[";
+        const auto &merges = FixtureMerges();
+        for (size_t i = 0; i < merges.size(); ++i) {
+            const std::string &left = merges[i].first;
+            const std::string &right = merges[i].second;
+            vocab += "\"" + JsonToken(left + right) + "\": " + std::to_string(256 + i);
+            vocab += i + 1 < merges.size() ? ", " : "";
+            merges_txt += Utf8Token(left) + " " + Utf8Token(right) + "\n";
+            merges_json += std::string(i > 0 ? ", " : "") + "\"" + JsonToken(left) + " " + JsonToken(right) + "\"";
+        }
+        vocab += "}";
+        merges_json += "]";
+        Write("vocab.json", vocab);
+        Write("merges.txt", merges_txt);
+        Write("tokenizer.json", "{\"version\": \"1.0\", \"added_tokens\": [], \"model\": {\"type\": \"BPE\", "
+                                "\"dropout\": null, \"vocab\": " + vocab + ", \"merges\": " + merges_json + "}}");
+    }
+    ~FixtureDir() {
+        for (const std::string &path : files_) {
+            unlink(path.c_str());
+        }
+        if (!dir_.empty()) {
+            rmdir(dir_.c_str());
+        }
+    }
+
+    std::string Path(const std::string &name) const {
+        return dir_ + name;
+    }
+
+private:
+    void Write(const std::string &name, const std::string &text) {
+        FILE *file = std::fopen((dir_ + name).c_str(), "wb");
+        if (!file) {
+            return;
+        }
+        std::fwrite(text.data(), 1, text.size(), file);
+        std::fclose(file);
+        files_.push_back(dir_ + name);
+    }
+
+    std::string dir_;
+    std::vector<std::string> files_;
+};
+
+bool LoadFixture(const FixtureDir &dir, const std::string &name, Tokenizer *tokenizer) {
+    std::string error;
+    if (!tokenizer->Load(dir.Path(name), &error)) {
+        test::Fail(__FILE__, __LINE__, "loading " + name + ": " + error);
+        return false;
+    }
+    return true;
+}
+
+std::string Show(const std::vector<int64_t> &ids) {
+    std::string text;
+    for (const int64_t id : ids) {
+        text += (text.empty() ? "" : " ") + std::to_string(id);
+    }
+    return "[" + text + "]";
+}
+
+void ExpectIds(const Tokenizer &tokenizer, const std::string &text, const std::vector<int64_t> &expected) {
+    std::vector<int64_t> ids;
+    tokenizer.Encode(text, &ids);
+    if (ids != expected) {
+        test::Fail(__FILE__, __LINE__, "\"" + text + "\" encodes to " + Show(ids) + ", expected " + Show(expected));
+    }
+}
+
+// True if |text| is whole, well-formed UTF-8 characters.
+bool WholeUtf8(std::string_view text) {
+    size_t i = 0;
+    while (i < text.size()) {
+        const uint8_t c = static_cast<uint8_t>(text[i]);
+        const size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+        if (length == 0 || i + length > text.size()) {
+            return false;
+        }
+        for (size_t k = 1; k < length; ++k) {
+            if ((static_cast<uint8_t>(text[i + k]) & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+const std::vector<std::string> &Texts() {
+    static const std::vector<std::string> texts = {
+        "a photo of a cat",
+        "it's a cat's toy, isn't it? We'll see; they'd've gone.",
+        "Room 101 has 3 chairs!!",
+        "caf\xC3\xA9 na\xC3\xAFve \xE5\x8C\x97\xE4\xBA\xAC \xF0\x9F\x99\x82 \xC2\xB5s",
+        "a  cat   sat\t\ton\n\nthe   ",
+        "   leading and trailing   ",
+        "x\r\n\r\ny \xC2\xA0z\xE3\x80\x80w",
+        " ",
+        "",
+    };
+    return texts;
+}
+
+VLM_TEST(tokenizer, LoadsFixture) {
+    const FixtureDir dir;
+    Tokenizer tokenizer;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &tokenizer));
+    VLM_EXPECT_EQ(256 + FixtureMerges().size(), tokenizer.VocabSize());
+    VLM_EXPECT_EQ(FixtureMerges().size(), tokenizer.MergeCount());
+    VLM_EXPECT(tokenizer.Piece(258) == " cat");
+    VLM_EXPECT(tokenizer.Piece(static_cast<int64_t>('"')) == "\"");
+    VLM_EXPECT(tokenizer.Piece(static_cast<int64_t>(' ')) == " ");
+    VLM_EXPECT(tokenizer.Piece(1000).empty());
+}
+
+VLM_TEST(tokenizer, AppliesMergesByRank) {
+    const FixtureDir dir;
+    Tokenizer tokenizer;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &tokenizer));
+    ExpectIds(tokenizer, " cat", {258});
+    // "a t" outranks "c a", so "cat" without a leading space stays split.
+    ExpectIds(tokenizer, "cat", {'c', 257});
+    ExpectIds(tokenizer, "caf\xC3\xA9", {263});
+    ExpectIds(tokenizer, "it's", {'i', 't', 264});
+    ExpectIds(tokenizer, "\xE5\x8C\x97", {265, 0x97});
+}
+
+VLM_TEST(tokenizer, SplitsWordsLikeGpt2) {
+    const FixtureDir dir;
+    Tokenizer tokenizer;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &tokenizer));
+    // The last space of a run leads the next word, the rest stand alone.
+    ExpectIds(tokenizer, "a  cat", {'a', ' ', 258});
+    ExpectIds(tokenizer, "a   cat", {'a', 259, 258});
+    // A run that ends the text keeps all its spaces.
+    ExpectIds(tokenizer, "at   ", {257, 259, ' '});
+    // A space only joins the word after it, not punctuation before it.
+    ExpectIds(tokenizer, "a. cat", {'a', '.', 258});
+    // Letters, digits and other characters are separate words, so "a" and
+    // "t" on either side of a digit are not merged.
+    ExpectIds(tokenizer, "a1t", {'a', '1', 't'});
+    // Non-ASCII letters join the word, no-break space splits it.
+    ExpectIds(tokenizer, "caf\xC3\xA9\xC2\xA0" "cat", {263, 0xC2, 0xA0, 'c', 257});
+}
+
+VLM_TEST(tokenizer, RoundTrips) {
+    const FixtureDir dir;
+    for (const char *name : {"vocab.json", "tokenizer.json"}) {
+        Tokenizer tokenizer;
+        VLM_ASSERT(LoadFixture(dir, name, &tokenizer));
+        for (const std::string &text : Texts()) {
+            std::vector<int64_t> ids;
+            tokenizer.Encode(text, &ids);
+            const std::string decoded = tokenizer.Decode(ids.data(), ids.size());
+            if (decoded != text) {
+                test::Fail(__FILE__, __LINE__, std::string(name) + ": \"" + text + "\" decodes as \"" + decoded + "\"");
+            }
+        }
+    }
+}
+
+VLM_TEST(tokenizer, TokenizerJsonMatchesVocabAndMerges) {
+    const FixtureDir dir;
+    Tokenizer files;
+    Tokenizer json;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &files));
+    VLM_ASSERT(LoadFixture(dir, "tokenizer.json", &json));
+    VLM_EXPECT_EQ(files.VocabSize(), json.VocabSize());
+    VLM_EXPECT_EQ(files.MergeCount(), json.MergeCount());
+    for (const std::string &text : Texts()) {
+        std::vector<int64_t> expected;
+        files.Encode(text, &expected);
+        ExpectIds(json, text, expected);
+    }
+}
+
+// Feeds |ids| one at a time and checks that every chunk is whole characters
+// and that the chunks add up to |text|.
+void ExpectStreams(StreamDetokenizer *stream, const std::vector<int64_t> &ids, const std::string &text) {
+    stream->Reset();
+    std::string streamed;
+    for (const int64_t id : ids) {
+        const std::string_view chunk = stream->Push(id);
+        if (!WholeUtf8(chunk)) {
+            test::Fail(__FILE__, __LINE__, "\"" + text + "\": chunk \"" + std::string(chunk) + "\" splits a character");
+        }
+        streamed += chunk;
+    }
+    VLM_EXPECT(stream->Flush().empty());
+    if (streamed != text || stream->Text() != text) {
+        test::Fail(__FILE__, __LINE__, "streamed \"" + streamed + "\", expected \"" + text + "\"");
+    }
+}
+
+VLM_TEST(tokenizer, StreamEmitsWholeCharacters) {
+    const FixtureDir dir;
+    Tokenizer tokenizer;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &tokenizer));
+    StreamDetokenizer stream(&tokenizer);
+    for (const std::string &text : Texts()) {
+        std::vector<int64_t> ids;
+        tokenizer.Encode(text, &ids);
+        ExpectStreams(&stream, ids, text);
+        // One token per byte splits every multi-byte character.
+        std::vector<int64_t> bytes;
+        for (const char c : text) {
+            bytes.push_back(static_cast<uint8_t>(c));
+        }
+        ExpectStreams(&stream, bytes, text);
+    }
+}
+
+VLM_TEST(tokenizer, StreamHoldsBackPartialCharacter) {
+    const FixtureDir dir;
+    Tokenizer tokenizer;
+    VLM_ASSERT(LoadFixture(dir, "vocab.json", &tokenizer));
+    StreamDetokenizer stream(&tokenizer);
+    VLM_EXPECT(stream.Push('a') == "a");
+    // Token 265 is the first two bytes of a three-byte character.
+    VLM_EXPECT(stream.Push(265).empty());
+    VLM_EXPECT(stream.Push(-1).empty());
+    VLM_EXPECT(stream.Push(0x97) == "\xE5\x8C\x97");
+    VLM_EXPECT(stream.Push(0xF0).empty());
+    VLM_EXPECT(stream.Push(0x9F).empty());
+    VLM_EXPECT(stream.Push(0x99).empty());
+    VLM_EXPECT(stream.Push(0x82) == "\xF0\x9F\x99\x82");
+    // A character cut off by the end of the caption comes out on Flush.
+    VLM_EXPECT(stream.Push(265).empty());
+    VLM_EXPECT(stream.Flush() == "\xE5\x8C");
+    VLM_EXPECT(stream.Text() == "a\xE5\x8C\x97\xF0\x9F\x99\x82\xE5\x8C");
+}
+
+}  // namespace
+}  // namespace vlm
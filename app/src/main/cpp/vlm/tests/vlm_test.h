@@ -0,0 +1,84 @@
+#pragma once
+
+// Minimal test harness for the host build, so the tests need nothing beyond
+// the compiler and CTest. A test is a function registered with VLM_TEST;
+// vlm_tests runs every test of the suites named on its command line (all of
+// them without arguments).
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+
+namespace vlm {
+namespace test {
+
+using TestFunction = void (*)();
+
+bool Register(const char *suite, const char *name, TestFunction function);
+// Marks the running test as failed; it keeps running unless it returns.
+void Fail(const char *file, int line, const std::string &message);
+// Marks the running test as skipped, e.g. when it needs models that are not
+// there. The caller returns right after.
+void Skip(const std::string &reason);
+// False once the running test has failed.
+bool Passing();
+// VLM_TEST_MODELS with a trailing separator, or empty when it is not set.
+std::string ModelsDir();
+// The vector kernels this CPU runs, i.e. every SimdLevel besides kScalar
+// that DetectSimdLevel() may pick here; empty on a CPU without any.
+std::vector<SimdLevel> SimdLevels();
+
+}  // namespace test
+}  // namespace vlm
+
+#define VLM_TEST(suite, name)                                                              \
+    static void suite##_##name##_Test();                                                   \
+    static const bool suite##_##name##_registered =                                        \
+        ::vlm::test::Register(#suite, #name, &suite##_##name##_Test);                      \
+    static void suite##_##name##_Test()
+
+#define VLM_EXPECT(condition)                                  \
+    do {                                                       \
+        if (!(condition)) {                                    \
+            ::vlm::test::Fail(__FILE__, __LINE__, #condition); \
+        }                                                      \
+    } while (0)
+
+#define VLM_EXPECT_EQ(expected, actual)                                                                       \
+    do {                                                                                                      \
+        const auto vlm_expected = (expected);                                                                 \
+        const auto vlm_actual = (actual);                                                                     \
+        if (!(vlm_expected == vlm_actual)) {                                                                  \
+            ::vlm::test::Fail(__FILE__, __LINE__,                                                             \
+                              std::string(#actual " is ") + std::to_string(vlm_actual) + ", expected " +      \
+                                  std::to_string(vlm_expected));                                              \
+        }                                                                                                     \
+    } while (0)
+
+#define VLM_EXPECT_NEAR(expected, actual, tolerance)                                                          \
+    do {                                                                                                      \
+        const double vlm_expected = (expected);                                                               \
+        const double vlm_actual = (actual);                                                                   \
+        if (!(std::fabs(vlm_expected - vlm_actual) <= (tolerance))) {                                         \
+            ::vlm::test::Fail(__FILE__, __LINE__,                                                             \
+                              std::string(#actual " is ") + std::to_string(vlm_actual) + ", expected " +      \
+                                  std::to_string(vlm_expected) + " +- " + std::to_string(tolerance));         \
+        }                                                                                                     \
+    } while (0)
+
+// Like VLM_EXPECT, but returns from the test on failure.
+#define VLM_ASSERT(condition)                                  \
+    do {                                                       \
+        if (!(condition)) {                                    \
+            ::vlm::test::Fail(__FILE__, __LINE__, #condition); \
+            return;                                            \
+        }                                                      \
+    } while (0)
+
+#define VLM_SKIP(reason)              \
+    do {                              \
+        ::vlm::test::Skip(reason);    \
+        return;                       \
+    } while (0)
@@ -0,0 +1,206 @@
+#include "yuv_preprocess.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "vlm_test.h"
+
+namespace vlm {
+namespace {
+
+// |size| bytes that end right before an inaccessible page, so a kernel that
+// reads past the end of its plane crashes instead of passing by luck.
+class GuardedBuffer {
+public:
+    explicit GuardedBuffer(size_t size) {
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t pages = (size + page - 1) / page;
+        mapping_bytes_ = (pages + 1) * page;
+        void *mapping = mmap(nullptr, mapping_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return;
+        }
+        mapping_ = static_cast<uint8_t *>(mapping);
+        mprotect(mapping_ + pages * page, page, PROT_NONE);
+        data_ = mapping_ + pages * page - size;
+    }
+    ~GuardedBuffer() {
+        if (mapping_) {
+            munmap(mapping_, mapping_bytes_);
+        }
+    }
+    GuardedBuffer(const GuardedBuffer &) = delete;
+    GuardedBuffer &operator=(const GuardedBuffer &) = delete;
+
+    uint8_t *Data() const {
+        return data_;
+    }
+
+private:
+    uint8_t *mapping_ = nullptr;
+    size_t mapping_bytes_ = 0;
+    uint8_t *data_ = nullptr;
+};
+
+// A random YUV_420_888 image whose planes each end exactly at the end of
+// their buffer. With |uv_pixel_stride| 2 the chroma planes interleave in
+// one buffer, V one byte after U, as the semi-planar camera layouts do.
+class RandomYuv {
+public:
+    RandomYuv(int width, int height, int y_stride, int uv_stride, int uv_pixel_stride, uint32_t seed) {
+        const int chroma_w = (width + 1) / 2;
+        const int chroma_h = (height + 1) / 2;
+        const size_t y_size = static_cast<size_t>(y_stride) * (height - 1) + width;
+        const size_t chroma_row = static_cast<size_t>(chroma_w - 1) * uv_pixel_stride + 1;
+        const size_t chroma_size = static_cast<size_t>(uv_stride) * (chroma_h - 1) + chroma_row;
+        y_.reset(new GuardedBuffer(y_size));
+        std::mt19937 random(seed);
+        Fill(y_->Data(), y_size, &random);
+
+        image_.width = width;
+        image_.height = height;
+        image_.y = y_->Data();
+        image_.y_stride = y_stride;
+        image_.y_size = y_size;
+        image_.uv_stride = uv_stride;
+        image_.uv_pixel_stride = uv_pixel_stride;
+        if (uv_pixel_stride == 1) {
+            u_.reset(new GuardedBuffer(chroma_size));
+            v_.reset(new GuardedBuffer(chroma_size));
+            Fill(u_->Data(), chroma_size, &random);
+            Fill(v_->Data(), chroma_size, &random);
+            image_.u = u_->Data();
+            image_.v = v_->Data();
+            image_.u_size = chroma_size;
+            image_.v_size = chroma_size;
+        } else {
+            u_.reset(new GuardedBuffer(chroma_size + 1));
+            Fill(u_->Data(), chroma_size + 1, &random);
+            image_.u = u_->Data();
+            image_.v = u_->Data() + 1;
+            image_.u_size = chroma_size + 1;
+            image_.v_size = chroma_size;
+        }
+    }
+
+    const YuvImage &Image() const {
+        return image_;
+    }
+
+private:
+    static void Fill(uint8_t *data, size_t size, std::mt19937 *random) {
+        std::uniform_int_distribution<int> byte(0, 255);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<uint8_t>(byte(*random));
+        }
+    }
+
+    std::unique_ptr<GuardedBuffer> y_;
+    std::unique_ptr<GuardedBuffer> u_;
+    std::unique_ptr<GuardedBuffer> v_;
+    YuvImage image_;
+};
+
+// Runs |image| through the scalar reference kernel and the CPU's SIMD
+// kernel and compares every output value.
+void ExpectSimdMatchesScalar(const YuvImage &image, int out_width, int out_height) {
+    const SimdLevel simd = DetectSimdLevel();
+    PreprocessConfig config;
+    config.width = out_width;
+    config.height = out_height;
+    const size_t count = 3 * static_cast<size_t>(out_width) * out_height;
+    std::vector<float> reference(count, 0.0f);
+    std::vector<float> actual(count, 0.0f);
+    YuvPreprocessor reference_preprocessor;
+    YuvPreprocessor preprocessor;
+    reference_preprocessor.Run(image, config, reference.data(), SimdLevel::kScalar);
+    preprocessor.Run(image, config, actual.data(), simd);
+    // Second run with cached taps, as in the app.
+    preprocessor.Run(image, config, actual.data(), simd);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count && mismatches < 8; ++i) {
+        // FMA rounds differently; outputs span about [-2, 2].
+        if (!(std::fabs(reference[i] - actual[i]) <= 1e-4f)) {
+            ++mismatches;
+            VLM_EXPECT_NEAR(reference[i], actual[i], 1e-4);
+        }
+    }
+}
+
+VLM_TEST(yuv_preprocess, PlanarMatchesScalar) {
+    if (DetectSimdLevel() == SimdLevel::kScalar) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // Odd sizes, padded strides, downscaled and upscaled.
+    const RandomYuv odd(333, 251, 352, 184, 1, 1);
+    ExpectSimdMatchesScalar(odd.Image(), 224, 224);
+    ExpectSimdMatchesScalar(odd.Image(), 37, 19);
+    const RandomYuv small(17, 13, 32, 16, 1, 2);
+    ExpectSimdMatchesScalar(small.Image(), 224, 224);
+    ExpectSimdMatchesScalar(small.Image(), 9, 7);
+}
+
+VLM_TEST(yuv_preprocess, SemiPlanarMatchesScalar) {
+    if (DetectSimdLevel() == SimdLevel::kScalar) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    const RandomYuv odd(333, 251, 384, 352, 2, 3);
+    ExpectSimdMatchesScalar(odd.Image(), 224, 224);
+    ExpectSimdMatchesScalar(odd.Image(), 37, 19);
+    const RandomYuv small(17, 13, 24, 24, 2, 4);
+    ExpectSimdMatchesScalar(small.Image(), 224, 224);
+    ExpectSimdMatchesScalar(small.Image(), 9, 7);
+}
+
+VLM_TEST(yuv_preprocess, TightPlanesMatchScalar) {
+    if (DetectSimdLevel() == SimdLevel::kScalar) {
+        VLM_SKIP("no SIMD kernel for this CPU");
+    }
+    // Strides equal to the width: the last rows have no slack at all, so
+    // the AVX2 kernel must hand them to the scalar one.
+    const RandomYuv planar(225, 225, 225, 113, 1, 5);
+    ExpectSimdMatchesScalar(planar.Image(), 224, 224);
+    const RandomYuv semi_planar(225, 225, 225, 226, 2, 6);
+    ExpectSimdMatchesScalar(semi_planar.Image(), 224, 224);
+}
+
+VLM_TEST(yuv_preprocess, ScalarConvertsFlatColour) {
+    // Mid grey with neutral chroma is 128 in every channel after conversion.
+    const int width = 15;
+    const int height = 9;
+    std::vector<uint8_t> y(static_cast<size_t>(width) * height, 128);
+    std::vector<uint8_t> uv(static_cast<size_t>(8) * 5, 128);
+    YuvImage image;
+    image.width = width;
+    image.height = height;
+    image.y = y.data();
+    image.u = uv.data();
+    image.v = uv.data();
+    image.y_stride = width;
+    image.uv_stride = 8;
+    image.y_size = y.size();
+    image.u_size = uv.size();
+    image.v_size = uv.size();
+    PreprocessConfig config;
+    config.width = 5;
+    config.height = 4;
+    std::vector<float> out(3 * 5 * 4, 0.0f);
+    YuvPreprocessor preprocessor;
+    preprocessor.Run(image, config, out.data(), SimdLevel::kScalar);
+    for (int c = 0; c < 3; ++c) {
+        const float expected = (128.0f / 255.0f - config.mean[c]) / config.std[c];
+        for (int i = 0; i < 5 * 4; ++i) {
+            VLM_EXPECT_NEAR(expected, out[c * 5 * 4 + i], 1e-5);
+        }
+    }
+}
+
+}  // namespace
+}  // namespace vlm
@@ -0,0 +1,798 @@
+#include "tokenizer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include "file_utils.h"
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+using CodePoints = std::vector<uint32_t>;
+
+constexpr uint32_t kNoRank = ~0u;
+
+// Inverse of GPT-2's bytes_to_unicode(): printable latin-1 bytes map to
+// themselves, the remaining 68 bytes were shifted to code points 256..323.
+void BuildByteDecoder(int byte_for_codepoint[324]) {
+    for (int i = 0; i < 324; ++i) {
+        byte_for_codepoint[i] = -1;
+    }
+    int shifted = 0;
+    for (int b = 0; b < 256; ++b) {
+        const bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+        if (printable) {
+            byte_for_codepoint[b] = b;
+        } else {
+            byte_for_codepoint[256 + shifted++] = b;
+        }
+    }
+}
+
+void AppendUtf8(uint32_t cp, std::string *out) {
+    if (cp < 0x80) {
+        out->push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+std::string ToUtf8(const CodePoints &cps) {
+    std::string text;
+    for (uint32_t cp : cps) {
+        AppendUtf8(cp, &text);
+    }
+    return text;
+}
+
+// Reads the parts of vocab.json, merges.txt and tokenizer.json the tokenizer
+// needs and skips the rest.
+class JsonReader {
+public:
+    JsonReader(const char *begin, const char *end) : p_(begin), end_(end) {}
+
+    // {"token": id, ...}
+    bool ParseVocab(std::vector<std::pair<CodePoints, int64_t>> *entries) {
+        return ParseObject([this, entries](const std::string &) {
+            CodePoints key = std::move(key_);
+            int64_t id = 0;
+            if (!ParseInt(&id)) {
+                return false;
+            }
+            entries->emplace_back(std::move(key), id);
+            return true;
+        });
+    }
+
+    // ["left right", ...] or [["left", "right"], ...]
+    bool ParseMerges(std::vector<std::pair<CodePoints, CodePoints>> *merges) {
+        return ParseArray([this, merges]() {
+            CodePoints left;
+            CodePoints right;
+            if (Peek('[')) {
+                ++p_;
+                SkipSpace();
+                if (!ParseString(&left)) {
+                    return false;
+                }
+                SkipSpace();
+                if (!Consume(',')) {
+                    return false;
+                }
+                SkipSpace();
+                if (!ParseString(&right)) {
+                    return false;
+                }
+                SkipSpace();
+                if (!Consume(']')) {
+                    return false;
+                }
+            } else {
+                CodePoints pair;
+                if (!ParseString(&pair) || !SplitMerge(pair, &left, &right)) {
+                    return false;
+                }
+            }
+            merges->emplace_back(std::move(left), std::move(right));
+            return true;
+        });
+    }
+
+    // [{"id": 2, "content": "</s>", ...}, ...]
+    bool ParseAddedTokens(std::vector<std::pair<CodePoints, int64_t>> *entries) {
+        return ParseArray([this, entries]() {
+            CodePoints content;
+            int64_t id = -1;
+            const bool ok = ParseObject([this, &content, &id](const std::string &key) {
+                if (key == "id") {
+                    return ParseInt(&id);
+                }
+                if (key == "content") {
+                    return ParseString(&content);
+                }
+                return SkipValue();
+            });
+            if (ok && id >= 0) {
+                entries->emplace_back(std::move(content), id);
+            }
+            return ok;
+        });
+    }
+
+    // tokenizer.json: {"added_tokens": [...], "model": {"type": "BPE", "vocab": {...}, "merges": [...]}, ...}
+    bool ParseTokenizerJson(std::vector<std::pair<CodePoints, int64_t>> *entries,
+                            std::vector<std::pair<CodePoints, CodePoints>> *merges, std::string *error) {
+        std::vector<std::pair<CodePoints, int64_t>> added;
+        bool bpe = true;
+        const bool ok = ParseObject([&](const std::string &key) {
+            if (key == "added_tokens") {
+                return ParseAddedTokens(&added);
+            }
+            if (key != "model") {
+                return SkipValue();
+            }
+            return ParseObject([&](const std::string &model_key) {
+                if (model_key == "vocab") {
+                    return ParseVocab(entries);
+                }
+                if (model_key == "merges") {
+                    return ParseMerges(merges);
+                }
+                if (model_key == "type") {
+                    CodePoints type;
+                    if (!ParseString(&type)) {
+                        return false;
+                    }
+                    bpe = ToUtf8(type) == "BPE";
+                    return true;
+                }
+                return SkipValue();
+            });
+        });
+        if (!ok) {
+            *error = "malformed JSON";
+            return false;
+        }
+        if (!bpe) {
+            *error = "only BPE models are supported";
+            return false;
+        }
+        entries->insert(entries->end(), added.begin(), added.end());
+        return true;
+    }
+
+    // Parses a JSON string into unicode code points.
+    bool ParseString(CodePoints *out) {
+        if (!Consume('"')) {
+            return false;
+        }
+        while (p_ < end_ && *p_ != '"') {
+            const uint8_t c = static_cast<uint8_t>(*p_++);
+            if (c == '\\') {
+                if (p_ >= end_) {
+                    return false;
+                }
+                const char e = *p_++;
+                uint32_t cp = 0;
+                switch (e) {
+                    case 'n': cp = '\n'; break;
+                    case 't': cp = '\t'; break;
+                    case 'r': cp = '\r'; break;
+                    case 'b': cp = '\b'; break;
+                    case 'f': cp = '\f'; break;
+                    case 'u':
+                        if (!ParseHex4(&cp)) {
+                            return false;
+                        }
+                        if (cp >= 0xD800 && cp <= 0xDBFF && end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+                            p_ += 2;
+                            uint32_t low = 0;
+                            if (!ParseHex4(&low)) {
+                                return false;
+                            }
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        break;
+                    default: cp = static_cast<uint8_t>(e); break;
+                }
+                out->push_back(cp);
+            } else if (c < 0x80) {
+                out->push_back(c);
+            } else {
+                // Decode a multi-byte UTF-8 sequence.
+                const int extra = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : 1);
+                uint32_t cp = c & (0x3F >> extra);
+                for (int i = 0; i < extra; ++i) {
+                    if (p_ >= end_) {
+                        return false;
+                    }
+                    cp = (cp << 6) | (static_cast<uint8_t>(*p_++) & 0x3F);
+                }
+                out->push_back(cp);
+            }
+        }
+        return Consume('"');
+    }
+
+    // "left right", split at the first space; byte-level tokens never
+    // contain a raw space.
+    static bool SplitMerge(const CodePoints &pair, CodePoints *left, CodePoints *right) {
+        for (size_t i = 1; i + 1 < pair.size(); ++i) {
+            if (pair[i] == ' ') {
+                left->assign(pair.begin(), pair.begin() + i);
+                right->assign(pair.begin() + i + 1, pair.end());
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Calls |on_member| with the key of every member, positioned at its
+    // value; the key's code points are left in |key_|.
+    template <typename OnMember>
+    bool ParseObject(OnMember on_member) {
+        SkipSpace();
+        if (!Consume('{')) {
+            return false;
+        }
+        SkipSpace();
+        if (Consume('}')) {
+            return true;
+        }
+        while (true) {
+            SkipSpace();
+            key_.clear();
+            if (!ParseString(&key_)) {
+                return false;
+            }
+            SkipSpace();
+            if (!Consume(':')) {
+                return false;
+            }
+            SkipSpace();
+            if (!on_member(ToUtf8(key_))) {
+                return false;
+            }
+            SkipSpace();
+            if (Consume(',')) {
+                continue;
+            }
+            return Consume('}');
+        }
+    }
+
+    // Calls |on_element| positioned at every element.
+    template <typename OnElement>
+    bool ParseArray(OnElement on_element) {
+        SkipSpace();
+        if (!Consume('[')) {
+            return false;
+        }
+        SkipSpace();
+        if (Consume(']')) {
+            return true;
+        }
+        while (true) {
+            SkipSpace();
+            if (!on_element()) {
+                return false;
+            }
+            SkipSpace();
+            if (Consume(',')) {
+                continue;
+            }
+            return Consume(']');
+        }
+    }
+
+    bool SkipValue() {
+        if (Peek('"')) {
+            CodePoints ignored;
+            return ParseString(&ignored);
+        }
+        if (Peek('{')) {
+            return ParseObject([this](const std::string &) { return SkipValue(); });
+        }
+        if (Peek('[')) {
+            return ParseArray([this]() { return SkipValue(); });
+        }
+        // Number, true, false or null.
+        const char *start = p_;
+        while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' && *p_ != '\n' && *p_ != '\r' &&
+               *p_ != '\t') {
+            ++p_;
+        }
+        return p_ > start;
+    }
+
+    bool ParseInt(int64_t *value) {
+        char *num_end = nullptr;
+        const long long parsed = std::strtoll(p_, &num_end, 10);
+        if (num_end == p_) {
+            return false;
+        }
+        p_ = num_end;
+        *value = parsed;
+        return true;
+    }
+
+    void SkipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+            ++p_;
+        }
+    }
+
+    bool Peek(char c) const {
+        return p_ < end_ && *p_ == c;
+    }
+
+    bool Consume(char c) {
+        if (p_ < end_ && *p_ == c) {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseHex4(uint32_t *value) {
+        if (end_ - p_ < 4) {
+            return false;
+        }
+        *value = 0;
+        for (int i = 0; i < 4; ++i, ++p_) {
+            const char c = *p_;
+            *value <<= 4;
+            if (c >= '0' && c <= '9') {
+                *value |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                *value |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                *value |= c - 'A' + 10;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char *p_;
+    const char *end_;
+    CodePoints key_;
+};
+
+// merges.txt: an optional "#version" line, then "left right" per line.
+bool ParseMergesText(const char *p, const char *end, std::vector<std::pair<CodePoints, CodePoints>> *merges) {
+    // Only the "#version" header is a comment: "#" is also a token, so "# #"
+    // and "## #" are merges.
+    static constexpr char kHeader[] = "#version";
+    if (static_cast<size_t>(end - p) >= sizeof(kHeader) - 1 && std::memcmp(p, kHeader, sizeof(kHeader) - 1) == 0) {
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+    }
+    while (p < end) {
+        const char *line_end = p;
+        while (line_end < end && *line_end != '\n') {
+            ++line_end;
+        }
+        const char *content_end = line_end > p && line_end[-1] == '\r' ? line_end - 1 : line_end;
+        if (content_end > p) {
+            // Reuse the JSON string reader by quoting the line.
+            std::string quoted;
+            quoted.reserve(static_cast<size_t>(content_end - p) + 2);
+            quoted.push_back('"');
+            for (const char *c = p; c < content_end; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    quoted.push_back('\\');
+                }
+                quoted.push_back(*c);
+            }
+            quoted.push_back('"');
+            CodePoints pair;
+            CodePoints left;
+            CodePoints right;
+            if (!JsonReader(quoted.data(), quoted.data() + quoted.size()).ParseString(&pair) ||
+                !JsonReader::SplitMerge(pair, &left, &right)) {
+                return false;
+            }
+            merges->emplace_back(std::move(left), std::move(right));
+        }
+        p = line_end + 1;
+    }
+    return true;
+}
+
+enum class CharClass {
+    kSpace,
+    kLetter,
+    kDigit,
+    kOther,
+};
+
+// Classifies the UTF-8 character at |p| and returns its length in bytes.
+size_t ClassifyChar(const char *p, const char *end, CharClass *char_class) {
+    const uint8_t c = static_cast<uint8_t>(*p);
+    if (c < 0x80) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            *char_class = CharClass::kSpace;
+        } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            *char_class = CharClass::kLetter;
+        } else if (c >= '0' && c <= '9') {
+            *char_class = CharClass::kDigit;
+        } else {
+            *char_class = CharClass::kOther;
+        }
+        return 1;
+    }
+    const size_t length = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 1));
+    if (length == 1 || static_cast<size_t>(end - p) < length) {
+        *char_class = CharClass::kOther;  // stray continuation or truncated
+        return 1;
+    }
+    uint32_t cp = c & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        cp = (cp << 6) | (static_cast<uint8_t>(p[i]) & 0x3F);
+    }
+    const bool space = cp == 0x85 || cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 ||
+                       cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000;
+    *char_class = space ? CharClass::kSpace : CharClass::kLetter;
+    return length;
+}
+
+// Length of GPT-2's contraction suffixes ('s 't 're 've 'm 'll 'd) at |p|, or 0.
+size_t ContractionLength(const char *p, const char *end) {
+    if (*p != '\'' || end - p < 2) {
+        return 0;
+    }
+    const char a = p[1];
+    if (a == 's' || a == 't' || a == 'm' || a == 'd') {
+        return 2;
+    }
+    const char b = end - p >= 3 ? p[2] : '\0';
+    if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) {
+        return 3;
+    }
+    return 0;
+}
+
+// Length of the next word of GPT-2's pre-tokenizer pattern
+//   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+// starting at |p|.
+size_t NextWord(const char *p, const char *end) {
+    const size_t contraction = ContractionLength(p, end);
+    if (contraction > 0) {
+        return contraction;
+    }
+    CharClass first;
+    size_t first_length = ClassifyChar(p, end, &first);
+    const char *run = p;
+    CharClass run_class = first;
+    if (*p == ' ' && p + 1 < end) {
+        CharClass next;
+        ClassifyChar(p + 1, end, &next);
+        if (next != CharClass::kSpace) {
+            run = p + 1;
+            run_class = next;
+        }
+    }
+    if (run_class != CharClass::kSpace) {
+        const char *q = run;
+        CharClass c = run_class;
+        while (q < end) {
+            const size_t length = ClassifyChar(q, end, &c);
+            if (c != run_class) {
+                break;
+            }
+            q += length;
+        }
+        return static_cast<size_t>(q - p);
+    }
+    // A run of spaces. Unless it ends the text, the last space is left to
+    // lead the next word.
+    const char *q = p + first_length;
+    const char *last = p;
+    CharClass c = first;
+    while (q < end) {
+        const size_t length = ClassifyChar(q, end, &c);
+        if (c != CharClass::kSpace) {
+            break;
+        }
+        last = q;
+        q += length;
+    }
+    if (q == end || last == p) {
+        return static_cast<size_t>(q - p);
+    }
+    return static_cast<size_t>(last - p);
+}
+
+// Bytes at the end of |text| that start a UTF-8 character not yet complete.
+size_t IncompleteUtf8Tail(const std::string &text, size_t from) {
+    const size_t size = text.size();
+    for (size_t back = 1; back <= 3 && back <= size - from; ++back) {
+        const uint8_t c = static_cast<uint8_t>(text[size - back]);
+        if ((c & 0xC0) == 0x80) {
+            continue;  // continuation byte, keep looking for the lead
+        }
+        const size_t length = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 1));
+        return length > back ? back : 0;
+    }
+    return 0;
+}
+
+}  // namespace
+
+struct Tokenizer::Source {
+    std::vector<std::pair<CodePoints, int64_t>> vocab;
+    std::vector<std::pair<CodePoints, CodePoints>> merges;
+};
+
+bool Tokenizer::Load(const std::string &path, std::string *error) {
+    std::vector<uint8_t> bytes;
+    if (!ReadFile(path, &bytes, error)) {
+        return false;
+    }
+    const char *begin = reinterpret_cast<const char *>(bytes.data());
+    const char *end = begin + bytes.size();
+    const size_t slash = path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    const std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    Source source;
+    if (name.find("tokenizer") != std::string::npos) {
+        std::string reason;
+        if (!JsonReader(begin, end).ParseTokenizerJson(&source.vocab, &source.merges, &reason)) {
+            *error = "Failed to parse tokenizer " + path + ": " + reason;
+            return false;
+        }
+    } else {
+        if (!JsonReader(begin, end).ParseVocab(&source.vocab)) {
+            *error = "Failed to parse vocabulary " + path;
+            return false;
+        }
+        const std::string merges_path = dir + "merges.txt";
+        if (FileExists(merges_path)) {
+            if (!ReadFile(merges_path, &bytes, error)) {
+                return false;
+            }
+            begin = reinterpret_cast<const char *>(bytes.data());
+            if (!ParseMergesText(begin, begin + bytes.size(), &source.merges)) {
+                *error = "Failed to parse merges " + merges_path;
+                return false;
+            }
+        } else {
+            VLM_LOGI("No %s, the tokenizer can only decode", merges_path.c_str());
+        }
+    }
+    return Build(source, error);
+}
+
+bool Tokenizer::Build(const Source &source, std::string *error) {
+    int byte_for_codepoint[324];
+    BuildByteDecoder(byte_for_codepoint);
+
+    int64_t max_id = -1;
+    for (const auto &entry : source.vocab) {
+        max_id = entry.second > max_id ? entry.second : max_id;
+    }
+    if (max_id < 0 || max_id >= INT32_MAX) {
+        *error = "Vocabulary is empty or has out-of-range ids";
+        return false;
+    }
+    std::vector<std::string> pieces(static_cast<size_t>(max_id + 1));
+    std::unordered_map<std::string, uint32_t> ids;  // byte-level token string -> id, for the merges
+    ids.reserve(source.vocab.size());
+    for (int32_t &token : byte_tokens_) {
+        token = -1;
+    }
+    for (const auto &entry : source.vocab) {
+        if (entry.second < 0) {
+            continue;
+        }
+        std::string &piece = pieces[static_cast<size_t>(entry.second)];
+        piece.clear();
+        bool byte_level = true;
+        for (uint32_t cp : entry.first) {
+            if (cp < 324 && byte_for_codepoint[cp] >= 0) {
+                piece.push_back(static_cast<char>(byte_for_codepoint[cp]));
+            } else {
+                // Not a byte-level vocab entry (e.g. a special token); keep as is.
+                AppendUtf8(cp, &piece);
+                byte_level = false;
+            }
+        }
+        if (byte_level && piece.size() == 1) {
+            byte_tokens_[static_cast<uint8_t>(piece[0])] = static_cast<int32_t>(entry.second);
+        }
+        ids.emplace(ToUtf8(entry.first), static_cast<uint32_t>(entry.second));
+    }
+
+    size_t arena_size = 0;
+    for (const std::string &piece : pieces) {
+        arena_size += piece.size();
+    }
+    arena_.clear();
+    arena_.reserve(arena_size);
+    offsets_.assign(1, 0);
+    offsets_.reserve(pieces.size() + 1);
+    for (const std::string &piece : pieces) {
+        arena_ += piece;
+        offsets_.push_back(static_cast<uint32_t>(arena_.size()));
+    }
+
+    merges_.clear();
+    merge_count_ = 0;
+    if (!source.merges.empty()) {
+        size_t slots = 16;
+        while (slots < source.merges.size() * 2) {
+            slots <<= 1;
+        }
+        merges_.assign(slots, MergeSlot());
+    }
+    size_t skipped = 0;
+    for (size_t rank = 0; rank < source.merges.size(); ++rank) {
+        const std::string left = ToUtf8(source.merges[rank].first);
+        const std::string right = ToUtf8(source.merges[rank].second);
+        const auto left_id = ids.find(left);
+        const auto right_id = ids.find(right);
+        const auto merged_id = ids.find(left + right);
+        if (left_id == ids.end() || right_id == ids.end() || merged_id == ids.end()) {
+            ++skipped;
+            continue;
+        }
+        AddMerge(left_id->second, right_id->second, merged_id->second, static_cast<uint32_t>(rank));
+    }
+    if (skipped > 0) {
+        VLM_LOGW("Tokenizer: %zu merges refer to tokens missing from the vocabulary", skipped);
+    }
+    VLM_LOGI("Tokenizer: %zu tokens, %zu merges, %zu bytes of tables", VocabSize(), merge_count_, MemoryBytes());
+    return true;
+}
+
+size_t Tokenizer::MemoryBytes() const {
+    return arena_.capacity() + offsets_.capacity() * sizeof(uint32_t) + merges_.capacity() * sizeof(MergeSlot);
+}
+
+void Tokenizer::AddMerge(uint32_t left, uint32_t right, uint32_t merged, uint32_t rank) {
+    const uint64_t pair = static_cast<uint64_t>(left) << 32 | right;
+    const size_t mask = merges_.size() - 1;
+    for (size_t i = static_cast<size_t>((pair * 0x9E3779B97F4A7C15ull) >> 32) & mask;; i = (i + 1) & mask) {
+        MergeSlot &slot = merges_[i];
+        if (slot.pair == pair) {
+            return;  // the first, lowest-ranked, rule wins
+        }
+        if (slot.pair == kEmptyPair) {
+            slot.pair = pair;
+            slot.rank = rank;
+            slot.merged = merged;
+            ++merge_count_;
+            return;
+        }
+    }
+}
+
+const Tokenizer::MergeSlot *Tokenizer::FindMerge(uint32_t left, uint32_t right) const {
+    const uint64_t pair = static_cast<uint64_t>(left) << 32 | right;
+    const size_t mask = merges_.size() - 1;
+    for (size_t i = static_cast<size_t>((pair * 0x9E3779B97F4A7C15ull) >> 32) & mask;; i = (i + 1) & mask) {
+        const MergeSlot &slot = merges_[i];
+        if (slot.pair == pair) {
+            return &slot;
+        }
+        if (slot.pair == kEmptyPair) {
+            return nullptr;
+        }
+    }
+}
+
+void Tokenizer::Encode(std::string_view text, std::vector<int64_t> *ids) const {
+    if (!CanEncode()) {
+        return;
+    }
+    std::vector<uint32_t> symbols;
+    std::vector<uint32_t> ranks;
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while (p < end) {
+        const size_t length = NextWord(p, end);
+        EncodeWord(p, length, &symbols, &ranks, ids);
+        p += length;
+    }
+}
+
+// Repeatedly joins the adjacent pair with the lowest merge rank, the same
+// result as GPT-2's bpe(). |ranks|[i] caches the rank of symbols i and i + 1
+// so only the neighbours of a merge are looked up again.
+void Tokenizer::EncodeWord(const char *word, size_t size, std::vector<uint32_t> *symbols,
+                           std::vector<uint32_t> *ranks, std::vector<int64_t> *ids) const {
+    symbols->clear();
+    for (size_t i = 0; i < size; ++i) {
+        const int32_t token = byte_tokens_[static_cast<uint8_t>(word[i])];
+        if (token >= 0) {
+            symbols->push_back(static_cast<uint32_t>(token));
+        }
+    }
+    std::vector<uint32_t> &s = *symbols;
+    std::vector<uint32_t> &r = *ranks;
+    r.clear();
+    for (size_t i = 0; i + 1 < s.size(); ++i) {
+        const MergeSlot *merge = FindMerge(s[i], s[i + 1]);
+        r.push_back(merge ? merge->rank : kNoRank);
+    }
+    while (!r.empty()) {
+        size_t best = 0;
+        for (size_t i = 1; i < r.size(); ++i) {
+            if (r[i] < r[best]) {
+                best = i;
+            }
+        }
+        if (r[best] == kNoRank) {
+            break;
+        }
+        s[best] = FindMerge(s[best], s[best + 1])->merged;
+        s.erase(s.begin() + static_cast<std::ptrdiff_t>(best) + 1);
+        r.erase(r.begin() + static_cast<std::ptrdiff_t>(best));
+        if (best > 0) {
+            const MergeSlot *merge = FindMerge(s[best - 1], s[best]);
+            r[best - 1] = merge ? merge->rank : kNoRank;
+        }
+        if (best < r.size()) {
+            const MergeSlot *merge = FindMerge(s[best], s[best + 1]);
+            r[best] = merge ? merge->rank : kNoRank;
+        }
+    }
+    ids->insert(ids->end(), s.begin(), s.end());
+}
+
+std::string Tokenizer::Decode(const int64_t *ids, size_t count) const {
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size += Piece(ids[i]).size();
+    }
+    std::string text;
+    text.reserve(size);
+    for (size_t i = 0; i < count; ++i) {
+        text += Piece(ids[i]);
+    }
+    return text;
+}
+
+StreamDetokenizer::StreamDetokenizer(const Tokenizer *tokenizer, size_t reserve_bytes) : tokenizer_(tokenizer) {
+    text_.reserve(reserve_bytes);
+}
+
+void StreamDetokenizer::Reset() {
+    text_.clear();
+    emitted_ = 0;
+}
+
+std::string_view StreamDetokenizer::Push(int64_t id) {
+    text_ += tokenizer_->Piece(id);
+    const size_t complete = text_.size() - IncompleteUtf8Tail(text_, emitted_);
+    const std::string_view chunk(text_.data() + emitted_, complete - emitted_);
+    emitted_ = complete;
+    return chunk;
+}
+
+std::string_view StreamDetokenizer::Flush() {
+    const std::string_view chunk(text_.data() + emitted_, text_.size() - emitted_);
+    emitted_ = text_.size();
+    return chunk;
+}
+
+}  // namespace vlm
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vlm {
+
+// Byte-level BPE tokenizer for GPT-2 style vocabularies (the OPT language
+// model used by BLIP-2 shares GPT-2's vocab.json and merges.txt).
+//
+// Everything is loaded once into flat tables: the bytes of every token back
+// to back in one arena indexed by id, and the merges in an open-addressing
+// hash table keyed by the pair of token ids they join, so neither encoding
+// nor decoding touches a node-based container.
+class Tokenizer {
+public:
+    // Loads a Hugging Face tokenizer.json, or a vocab.json mapping token
+    // strings to ids together with the merges.txt next to it. Without merges
+    // the tokenizer can only decode.
+    bool Load(const std::string &path, std::string *error);
+
+    bool IsLoaded() const {
+        return offsets_.size() > 1;
+    }
+    bool CanEncode() const {
+        return merge_count_ > 0;
+    }
+
+    size_t VocabSize() const {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+    size_t MergeCount() const {
+        return merge_count_;
+    }
+    // Bytes held by the vocabulary and merge tables.
+    size_t MemoryBytes() const;
+
+    // Appends the ids of |text| to |ids|. Text is split into words the way
+    // GPT-2's pre-tokenizer does, with every code point outside ASCII counted
+    // as a letter apart from Unicode spaces; bytes without a token are
+    // dropped. Added special tokens are not matched in the text.
+    void Encode(std::string_view text, std::vector<int64_t> *ids) const;
+
+    // Concatenates the decoded bytes of |ids|. Ids outside the vocabulary are
+    // skipped.
+    std::string Decode(const int64_t *ids, size_t count) const;
+
+    // Raw bytes of one token, empty for ids outside the vocabulary.
+    std::string_view Piece(int64_t id) const {
+        if (id < 0 || static_cast<size_t>(id) >= VocabSize()) {
+            return std::string_view();
+        }
+        const size_t index = static_cast<size_t>(id);
+        return std::string_view(arena_.data() + offsets_[index], offsets_[index + 1] - offsets_[index]);
+    }
+
+private:
+    struct MergeSlot {
+        uint64_t pair = kEmptyPair;  // left id << 32 | right id
+        uint32_t rank = 0;
+        uint32_t merged = 0;
+    };
+    static constexpr uint64_t kEmptyPair = ~0ull;
+
+    struct Source;  // parsed vocabulary and merges, see tokenizer.cpp
+
+    bool Build(const Source &source, std::string *error);
+    void AddMerge(uint32_t left, uint32_t right, uint32_t merged, uint32_t rank);
+    const MergeSlot *FindMerge(uint32_t left, uint32_t right) const;
+    // Applies the merges to one pre-tokenized word.
+    void EncodeWord(const char *word, size_t size, std::vector<uint32_t> *symbols, std::vector<uint32_t> *ranks,
+                    std::vector<int64_t> *ids) const;
+
+    // Token id -> raw bytes, with the byte-level unicode mapping undone:
+    // arena_[offsets_[id], offsets_[id + 1]).
+    std::string arena_;
+    std::vector<uint32_t> offsets_;
+    // Token of each single byte, -1 where the vocabulary has none.
+    int32_t byte_tokens_[256];
+    std::vector<MergeSlot> merges_;  // power-of-two size, at most half full
+    size_t merge_count_ = 0;
+};
+
+// Turns token ids into text as they are generated. Bytes of a UTF-8
+// character split across tokens are held back until it is complete, so each
+// chunk returned is whole characters. The text buffer is kept across
+// Reset(), so once it has grown to the longest caption pushing a token no
+// longer allocates.
+class StreamDetokenizer {
+public:
+    explicit StreamDetokenizer(const Tokenizer *tokenizer, size_t reserve_bytes = 256);
+
+    void Reset();
+    // Appends the bytes of |id| and returns the characters completed by it,
+    // valid until the next call.
+    std::string_view Push(int64_t id);
+    // Returns whatever is still held back, complete or not.
+    std::string_view Flush();
+
+    // Everything returned so far.
+    std::string_view Text() const {
+        return std::string_view(text_.data(), emitted_);
+    }
+
+private:
+    const Tokenizer *tokenizer_;
+    std::string text_;
+    size_t emitted_ = 0;
+};
+
+}  // namespace vlm
@@ -0,0 +1,64 @@
+#pragma once
+
+// Helpers shared by the host tools.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace vlm_tools {
+
+inline std::string JsonEscape(const std::string &text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+// *.jpg / *.jpeg files directly in |dir|, sorted by name so runs replay them
+// in the same order. Empty when there are none or |dir| cannot be read.
+inline std::vector<std::string> ListJpegFiles(const std::string &dir) {
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (entry.is_regular_file() && (ext == ".jpg" || ext == ".jpeg")) {
+            paths.push_back(entry.path().string());
+        }
+    }
+    if (ec) {
+        paths.clear();
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+}  // namespace vlm_tools
@@ -0,0 +1,235 @@
+// Beam search scaling benchmark: captions the same images at several beam
+// widths, all beams of a width decoded as one batch per step, and writes a
+// JSON report of how decoder latency per caption and per step grows with the
+// width against greedy decoding (width 1). Batching is worth it while that
+// growth stays well below the width itself.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caption_pipeline.h"
+#include "file_utils.h"
+#include "latency_stats.h"
+#include "tool_utils.h"
+#include "vlm_engine.h"
+
+namespace {
+
+using vlm_tools::JsonEscape;
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s --models DIR --images DIR [options]\n"
+                 "  --models DIR       directory with encoder/decoder models and vocab.json\n"
+                 "  --images DIR       *.jpg files to caption\n"
+                 "  --decoder FILE     decoder file name inside the models dir (default decoder_model.onnx)\n"
+                 "  --widths LIST      beam widths to compare, e.g. 1,2,4,8 (default); 1 is greedy decoding\n"
+                 "  --length-penalty X  beam search favors longer captions above 0 (default 1)\n"
+                 "  --early-stopping   end beam search once N captions are finished\n"
+                 "  --threads N        intra-op threads, calling thread included (default 1)\n"
+                 "  --precision P      model variant: fp32 (default), int8, q4 or fp16\n"
+                 "  --max-tokens N     maximum caption length (default 30)\n"
+                 "  --bos ID --eos ID  special token ids (default 50256)\n"
+                 "  --prompt TEXT      text the captions continue, e.g. \"a photo of\"\n"
+                 "  --warmup N         untimed captions per width (default 1)\n"
+                 "  --iterations N     timed passes over the image set per width (default 3)\n"
+                 "  --output FILE      write the JSON report to FILE instead of stdout\n",
+                 argv0);
+}
+
+struct WidthResult {
+    int beams = 1;
+    vlm::LatencySamples decoder;
+    vlm::LatencySamples per_step;  // batched steps, the prompt step excluded
+    uint64_t steps = 0;
+    uint64_t tokens = 0;
+    std::vector<std::string> captions;  // first pass
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    vlm::VlmEngineConfig engine_config;
+    vlm::CaptionConfig caption_config;
+    std::string images_dir;
+    std::string output_path;
+    std::string widths_list = "1,2,4,8";
+    int warmup = 1;
+    int iterations = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--models") == 0 && has_value) {
+            engine_config.models_dir = argv[++i];
+            if (engine_config.models_dir.back() != '/') {
+                engine_config.models_dir += '/';
+            }
+        } else if (std::strcmp(arg, "--images") == 0 && has_value) {
+            images_dir = argv[++i];
+        } else if (std::strcmp(arg, "--decoder") == 0 && has_value) {
+            engine_config.decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--widths") == 0 && has_value) {
+            widths_list = argv[++i];
+        } else if (std::strcmp(arg, "--length-penalty") == 0 && has_value) {
+            caption_config.beam_search.length_penalty = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--early-stopping") == 0) {
+            caption_config.beam_search.early_stopping = true;
+        } else if (std::strcmp(arg, "--threads") == 0 && has_value) {
+            engine_config.intra_op_num_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--precision") == 0 && has_value) {
+            if (!vlm::ParseModelPrecision(argv[++i], &engine_config.precision)) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--max-tokens") == 0 && has_value) {
+            caption_config.max_new_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--bos") == 0 && has_value) {
+            caption_config.bos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--eos") == 0 && has_value) {
+            caption_config.eos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--prompt") == 0 && has_value) {
+            caption_config.prompt = argv[++i];
+        } else if (std::strcmp(arg, "--warmup") == 0 && has_value) {
+            warmup = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--iterations") == 0 && has_value) {
+            iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    std::vector<WidthResult> results;
+    std::stringstream widths(widths_list);
+    for (std::string item; std::getline(widths, item, ',');) {
+        results.emplace_back();
+        results.back().beams = std::atoi(item.c_str());
+        if (results.back().beams < 1) {
+            results.clear();
+            break;
+        }
+    }
+    if (engine_config.models_dir.empty() || images_dir.empty() || results.empty() || warmup < 0 ||
+        iterations < 1) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    if (caption_config.vocab_path.empty()) {
+        caption_config.vocab_path = engine_config.models_dir + "vocab.json";
+    }
+
+    const std::vector<std::string> image_paths = vlm_tools::ListJpegFiles(images_dir);
+    if (image_paths.empty()) {
+        std::fprintf(stderr, "No JPEG files found in %s\n", images_dir.c_str());
+        return 1;
+    }
+    std::vector<std::vector<uint8_t>> images(image_paths.size());
+    std::string error;
+    for (size_t i = 0; i < image_paths.size(); ++i) {
+        if (!vlm::ReadFile(image_paths[i], &images[i], &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    vlm::VlmEngine engine;
+    if (!engine.Initialize(engine_config)) {
+        std::fprintf(stderr, "%s\n", engine.StatusMessage().c_str());
+        return 1;
+    }
+
+    // Each width gets its own pipeline over the same sessions, sized for
+    // that many beams.
+    vlm::CaptionResult caption;
+    for (WidthResult &width : results) {
+        vlm::CaptionConfig config = caption_config;
+        config.beam_search.beams = width.beams;
+        vlm::CaptionPipeline pipeline;
+        if (!pipeline.Initialize(&engine, config, &error)) {
+            std::fprintf(stderr, "Caption pipeline failed for %d beams: %s\n", width.beams, error.c_str());
+            return 1;
+        }
+        for (int i = 0; i < warmup; ++i) {
+            const std::vector<uint8_t> &image = images[static_cast<size_t>(i) % images.size()];
+            if (!pipeline.CaptionJpeg(image.data(), image.size(), &caption, &error)) {
+                std::fprintf(stderr, "Warm-up caption failed: %s\n", error.c_str());
+                return 1;
+            }
+        }
+        for (int pass = 0; pass < iterations; ++pass) {
+            for (size_t i = 0; i < images.size(); ++i) {
+                if (!pipeline.CaptionJpeg(images[i].data(), images[i].size(), &caption, &error)) {
+                    std::fprintf(stderr, "%s: %s\n", image_paths[i].c_str(), error.c_str());
+                    return 1;
+                }
+                width.decoder.Add(caption.timings.decoder_ms);
+                for (size_t s = 1; s < caption.step_ms.size(); ++s) {
+                    width.per_step.Add(caption.step_ms[s]);
+                }
+                width.steps += caption.step_ms.size();
+                width.tokens += caption.token_ids.size();
+                if (pass == 0) {
+                    width.captions.push_back(caption.text);
+                }
+            }
+        }
+    }
+
+    FILE *out = stdout;
+    if (!output_path.empty()) {
+        out = std::fopen(output_path.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", output_path.c_str());
+            return 1;
+        }
+    }
+    const WidthResult *greedy = nullptr;
+    for (const WidthResult &width : results) {
+        greedy = width.beams == 1 ? &width : greedy;
+    }
+    const int captions = iterations * static_cast<int>(images.size());
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"benchmark\": \"vlm_beams\",\n  \"schema_version\": 1,\n");
+    std::fprintf(out, "  \"config\": {\"decoder\": \"%s\", \"precision\": \"%s\", \"threads\": %d, "
+                      "\"max_new_tokens\": %d, \"length_penalty\": %.3f, \"early_stopping\": %s, \"images\": %zu, "
+                      "\"iterations\": %d},\n",
+                 JsonEscape(engine_config.decoder_filename).c_str(), vlm::ModelPrecisionName(engine_config.precision),
+                 engine_config.intra_op_num_threads, caption_config.max_new_tokens,
+                 caption_config.beam_search.length_penalty,
+                 caption_config.beam_search.early_stopping ? "true" : "false", images.size(), iterations);
+    // Ratios are against width 1 when it was measured; sub-linear means
+    // below the width.
+    std::fprintf(out, "  \"widths\": [\n");
+    for (size_t w = 0; w < results.size(); ++w) {
+        WidthResult &width = results[w];
+        std::fprintf(out,
+                     "    {\"beams\": %d, \"decoder_ms\": {\"mean\": %.3f, \"p50\": %.3f}, "
+                     "\"per_step_ms\": {\"mean\": %.3f, \"p50\": %.3f}, \"steps_per_caption\": %.2f, "
+                     "\"tokens_per_caption\": %.2f",
+                     width.beams, width.decoder.Mean(), width.decoder.Percentile(50), width.per_step.Mean(),
+                     width.per_step.Percentile(50), static_cast<double>(width.steps) / captions,
+                     static_cast<double>(width.tokens) / captions);
+        if (greedy && width.beams > 1 && greedy->decoder.Mean() > 0.0 && greedy->per_step.Mean() > 0.0) {
+            const double decoder_ratio = width.decoder.Mean() / greedy->decoder.Mean();
+            const double step_ratio = width.per_step.Mean() / greedy->per_step.Mean();
+            std::fprintf(out, ", \"decoder_vs_greedy\": %.3f, \"per_step_vs_greedy\": %.3f, \"sublinear\": %s",
+                         decoder_ratio, step_ratio, decoder_ratio < width.beams ? "true" : "false");
+        }
+        std::fprintf(out, ", \"captions\": [");
+        for (size_t i = 0; i < width.captions.size(); ++i) {
+            std::fprintf(out, "%s\"%s\"", i > 0 ? ", " : "", JsonEscape(width.captions[i]).c_str());
+        }
+        std::fprintf(out, "]}%s\n", w + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,621 @@
+// Host benchmark for the VLM pipeline. Replays a directory of captured JPEGs
+// through the same engine and pipeline the headset app uses and writes
+// latency percentiles and memory use as JSON.
+//
+// The image set is processed in file name order after a fixed number of
+// warm-up captions, so runs with the same arguments on the same machine are
+// comparable across commits.
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caption_pipeline.h"
+#include "cpu_features.h"
+#include "file_frame_source.h"
+#include "file_utils.h"
+#include "frame_pool.h"
+#include "inference_worker.h"
+#include "latency_stats.h"
+#include "live_captioner.h"
+#include "ort_utils.h"
+#include "tool_utils.h"
+#include "vlm_engine.h"
+
+namespace {
+
+using vlm_tools::JsonEscape;
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s --models DIR --images DIR [options]\n"
+                 "  --models DIR       directory with encoder/decoder models and vocab.json\n"
+                 "  --images DIR       captured *.jpg files to replay (for example the app's captures/)\n"
+                 "  --encoder FILE     encoder file name inside the models dir (default encoder_model.onnx)\n"
+                 "  --decoder FILE     decoder file name inside the models dir (default decoder_model.onnx)\n"
+                 "  --vocab PATH       vocab.json + merges.txt, or tokenizer.json (default <models>/vocab.json)\n"
+                 "  --threads N        intra-op threads, calling thread included (default 1)\n"
+                 "  --per-session-threads  give each session its own pool instead of sharing one\n"
+                 "  --affinity SPEC    processors for the worker threads, e.g. \"1;2;3\" for --threads 4\n"
+                 "  --spin             let idle pool threads spin\n"
+                 "  --max-tokens N     maximum caption length (default 30)\n"
+                 "  --bos ID --eos ID  special token ids (default 50256)\n"
+                 "  --prompt TEXT      text the captions continue, e.g. \"a photo of\"\n"
+                 "  --temperature T    sample at temperature T instead of picking the most likely token\n"
+                 "  --top-k N          sample among the N most likely tokens only\n"
+                 "  --top-p P          sample among the most likely tokens holding P of the probability\n"
+                 "  --repetition-penalty X  penalize tokens already in the caption (default 1, off)\n"
+                 "  --seed N           sampling seed (default 0)\n"
+                 "  --beams N          beam search over N captions decoded as one batch (default 1, off)\n"
+                 "  --length-penalty X  beam search favors longer captions above 0 (default 1)\n"
+                 "  --early-stopping   end beam search once N captions are finished\n"
+                 "  --draft FILE       draft decoder inside the models dir for speculative decoding\n"
+                 "  --draft-tokens N   tokens the draft decoder proposes per decoder run (default 4)\n"
+                 "  --warmup N         untimed captions before measuring (default 2)\n"
+                 "  --iterations N     timed passes over the image set (default 3)\n"
+                 "  --precision P      model variant: fp32 (default), int8, q4 or fp16, e.g. encoder_model_int8.onnx\n"
+                 "  --no-mmap          load models by path instead of mapping them\n"
+                 "  --no-ort-format    ignore pre-converted .ort models next to the .onnx files\n"
+                 "  --cache-dir DIR    optimized-model cache; run twice to compare cold and warm start\n"
+                 "  --pipelined        submit captures back to back to an InferenceWorker that encodes the\n"
+                 "                     next image while the previous one is decoded\n"
+                 "  --live FPS         replay the images as a FPS video stream and caption it the way the\n"
+                 "                     app's live mode does; combine with --pipelined for the two-stage worker\n"
+                 "  --gate             skip the models for images matching the last one encoded and reuse its\n"
+                 "                     caption; --gate-hash N and --gate-diff X set the thresholds\n"
+                 "  --cache            return the caption of an earlier image whose embeddings are similar\n"
+                 "                     enough; --cache-similarity X and --cache-mb N set the threshold and size,\n"
+                 "                     --cache-fp16 stores the keys in float16\n"
+                 "  --label TEXT       free-form tag stored in the report, e.g. a commit id\n"
+                 "  --output FILE      write the JSON report to FILE instead of stdout\n",
+                 argv0);
+}
+
+// Resident set size in kB: current values from /proc, the peak from
+// getrusage (ru_maxrss is in kB on Linux). RssFile covers mapped model files,
+// which the kernel can drop and re-read under memory pressure.
+long ProcStatusKb(const char *field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const size_t length = std::strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, length, field) == 0) {
+            return std::strtol(line.c_str() + length, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+long CurrentRssKb() {
+    return ProcStatusKb("VmRSS:");
+}
+
+long PeakRssKb() {
+    rusage usage = {};
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+}
+
+// User plus system CPU time of all threads, to weigh latency against the
+// cores it takes.
+double CpuTimeMs() {
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+void WriteStats(FILE *out, const char *name, vlm::LatencySamples *samples, bool last) {
+    std::fprintf(out,
+                 "    \"%s\": {\"count\": %zu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+                 "\"min\": %.3f, \"max\": %.3f}%s\n",
+                 name, samples->Count(), samples->Mean(), samples->Percentile(50), samples->Percentile(90),
+                 samples->Percentile(99), samples->Min(), samples->Max(), last ? "" : ",");
+}
+
+void WriteModelLoad(FILE *out, const char *name, const vlm::ModelLoadInfo &info, bool last) {
+    const char *cache = info.cache == vlm::ModelLoadInfo::Cache::kSaved    ? "cold"
+                        : info.cache == vlm::ModelLoadInfo::Cache::kLoaded ? "warm"
+                                                                           : "off";
+    std::fprintf(out,
+                 "    \"%s\": {\"path\": \"%s\", \"precision\": \"%s\", \"format\": \"%s\", \"mapped\": %s, "
+                 "\"file_bytes\": %zu, \"optimized_cache\": \"%s\", \"load_ms\": %.3f",
+                 name, JsonEscape(info.path).c_str(), vlm::ModelPrecisionName(info.precision),
+                 info.ort_format ? "ort" : "onnx", info.mapped ? "true" : "false",
+                 info.file_bytes, cache, info.load_ms);
+    if (info.cold_start_ms >= 0.0) {
+        std::fprintf(out, ", \"cold_start_ms\": %.3f", info.cold_start_ms);
+    }
+    std::fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+struct CaptionRecord {
+    std::string image;
+    std::string text;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    vlm::VlmEngineConfig engine_config;
+    vlm::CaptionConfig caption_config;
+    std::string images_dir;
+    std::string output_path;
+    std::string label;
+    int warmup = 2;
+    int iterations = 3;
+    bool pipelined = false;
+    double live_fps = 0.0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--models") == 0 && has_value) {
+            engine_config.models_dir = argv[++i];
+            if (engine_config.models_dir.back() != '/') {
+                engine_config.models_dir += '/';
+            }
+        } else if (std::strcmp(arg, "--images") == 0 && has_value) {
+            images_dir = argv[++i];
+        } else if (std::strcmp(arg, "--encoder") == 0 && has_value) {
+            engine_config.encoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--decoder") == 0 && has_value) {
+            engine_config.decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--vocab") == 0 && has_value) {
+            caption_config.vocab_path = argv[++i];
+        } else if (std::strcmp(arg, "--threads") == 0 && has_value) {
+            engine_config.intra_op_num_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--per-session-threads") == 0) {
+            engine_config.share_thread_pools = false;
+        } else if (std::strcmp(arg, "--affinity") == 0 && has_value) {
+            engine_config.intra_op_thread_affinities = argv[++i];
+        } else if (std::strcmp(arg, "--spin") == 0) {
+            engine_config.allow_spinning = true;
+        } else if (std::strcmp(arg, "--max-tokens") == 0 && has_value) {
+            caption_config.max_new_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--prompt") == 0 && has_value) {
+            caption_config.prompt = argv[++i];
+        } else if (std::strcmp(arg, "--temperature") == 0 && has_value) {
+            caption_config.sampling.temperature = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--top-k") == 0 && has_value) {
+            caption_config.sampling.top_k = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--top-p") == 0 && has_value) {
+            caption_config.sampling.top_p = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--repetition-penalty") == 0 && has_value) {
+            caption_config.sampling.repetition_penalty = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--seed") == 0 && has_value) {
+            caption_config.sampling.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(arg, "--beams") == 0 && has_value) {
+            caption_config.beam_search.beams = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--length-penalty") == 0 && has_value) {
+            caption_config.beam_search.length_penalty = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--early-stopping") == 0) {
+            caption_config.beam_search.early_stopping = true;
+        } else if (std::strcmp(arg, "--draft") == 0 && has_value) {
+            engine_config.draft_decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--draft-tokens") == 0 && has_value) {
+            caption_config.draft_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--bos") == 0 && has_value) {
+            caption_config.bos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--eos") == 0 && has_value) {
+            caption_config.eos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--warmup") == 0 && has_value) {
+            warmup = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--iterations") == 0 && has_value) {
+            iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--precision") == 0 && has_value) {
+            if (!vlm::ParseModelPrecision(argv[++i], &engine_config.precision)) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--no-mmap") == 0) {
+            engine_config.map_model_files = false;
+        } else if (std::strcmp(arg, "--no-ort-format") == 0) {
+            engine_config.prefer_ort_format = false;
+        } else if (std::strcmp(arg, "--cache-dir") == 0 && has_value) {
+            engine_config.optimized_model_cache_dir = argv[++i];
+            if (engine_config.optimized_model_cache_dir.back() != '/') {
+                engine_config.optimized_model_cache_dir += '/';
+            }
+        } else if (std::strcmp(arg, "--live") == 0 && has_value) {
+            live_fps = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--gate") == 0) {
+            caption_config.gate.enabled = true;
+        } else if (std::strcmp(arg, "--gate-hash") == 0 && has_value) {
+            caption_config.gate.enabled = true;
+            caption_config.gate.max_hash_distance = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--gate-diff") == 0 && has_value) {
+            caption_config.gate.enabled = true;
+            caption_config.gate.max_mean_difference = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--cache") == 0) {
+            caption_config.cache.enabled = true;
+        } else if (std::strcmp(arg, "--cache-similarity") == 0 && has_value) {
+            caption_config.cache.enabled = true;
+            caption_config.cache.min_similarity = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--cache-mb") == 0 && has_value) {
+            caption_config.cache.enabled = true;
+            caption_config.cache.max_bytes = static_cast<size_t>(std::atof(argv[++i]) * (1 << 20));
+        } else if (std::strcmp(arg, "--cache-fp16") == 0) {
+            caption_config.cache.enabled = true;
+            caption_config.cache.half_keys = true;
+        } else if (std::strcmp(arg, "--pipelined") == 0) {
+            pipelined = true;
+        } else if (std::strcmp(arg, "--label") == 0 && has_value) {
+            label = argv[++i];
+        } else if (std::strcmp(arg, "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (engine_config.models_dir.empty() || images_dir.empty() || warmup < 0 || iterations < 1) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    if (!engine_config.draft_decoder_filename.empty() && caption_config.draft_tokens == 0) {
+        caption_config.draft_tokens = 4;
+    }
+    if (caption_config.vocab_path.empty()) {
+        caption_config.vocab_path = engine_config.models_dir + "vocab.json";
+    }
+
+    const std::vector<std::string> image_paths = vlm_tools::ListJpegFiles(images_dir);
+    if (image_paths.empty()) {
+        std::fprintf(stderr, "No JPEG files found in %s\n", images_dir.c_str());
+        return 1;
+    }
+
+    // Images are read up front so file I/O stays out of the measurements.
+    std::vector<std::vector<uint8_t>> images(image_paths.size());
+    std::string error;
+    for (size_t i = 0; i < image_paths.size(); ++i) {
+        if (!vlm::ReadFile(image_paths[i], &images[i], &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    const long rss_before_load_kb = CurrentRssKb();
+    vlm::Stopwatch load_time;
+    vlm::VlmEngine engine;
+    if (!engine.Initialize(engine_config)) {
+        std::fprintf(stderr, "%s\n", engine.StatusMessage().c_str());
+        return 1;
+    }
+    vlm::CaptionPipeline pipeline;
+    if (!pipeline.Initialize(&engine, caption_config, &error)) {
+        std::fprintf(stderr, "Caption pipeline failed: %s\n", error.c_str());
+        return 1;
+    }
+    const double load_ms = load_time.ElapsedMs();
+    const long rss_after_load_kb = CurrentRssKb();
+    const long rss_file_after_load_kb = ProcStatusKb("RssFile:");
+    const long peak_rss_after_load_kb = PeakRssKb();
+
+    vlm::CaptionResult result;
+    for (int i = 0; i < warmup; ++i) {
+        const std::vector<uint8_t> &image = images[static_cast<size_t>(i) % images.size()];
+        if (!pipeline.CaptionJpeg(image.data(), image.size(), &result, &error)) {
+            std::fprintf(stderr, "Warm-up caption failed: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    const uint64_t encoded_before = pipeline.EncodedFrames();
+    const uint64_t gated_before = pipeline.GatedFrames();
+    const uint64_t hits_before = pipeline.Cache().Hits();
+    const uint64_t misses_before = pipeline.Cache().Misses();
+    vlm::LatencySamples image_decode;
+    vlm::LatencySamples preprocess;
+    vlm::LatencySamples gate;
+    vlm::LatencySamples encoder;
+    vlm::LatencySamples cache_lookup;
+    vlm::LatencySamples queue;
+    vlm::LatencySamples first_token;
+    vlm::LatencySamples per_token;
+    vlm::LatencySamples inter_token;  // per caption, mean and longest gap
+    vlm::LatencySamples max_inter_token;
+    vlm::LatencySamples decoder;
+    vlm::LatencySamples total;
+    uint64_t tokens = 0;
+    double decode_ms_sum = 0.0;
+    double decoder_ms_sum = 0.0;
+    double select_ms_sum = 0.0;
+    double draft_ms_sum = 0.0;
+    uint64_t steps = 0;
+    uint64_t draft_tokens = 0;
+    uint64_t accepted_tokens = 0;
+    int failures = 0;
+    int reused = 0;
+    std::vector<CaptionRecord> captions(images.size());
+    auto record = [&](size_t i, const vlm::CaptionResult &caption) {
+        const vlm::CaptionTimings &t = caption.timings;
+        image_decode.Add(t.image_decode_ms);
+        preprocess.Add(t.preprocess_ms);
+        if (caption_config.gate.enabled) {
+            gate.Add(t.gate_ms);
+        }
+        queue.Add(t.queue_ms);
+        total.Add(t.total_ms);
+        captions[i].image = std::filesystem::path(image_paths[i]).filename().string();
+        captions[i].text = caption.text;
+        // Gated captions ran neither model.
+        if (caption.reused) {
+            ++reused;
+            return;
+        }
+        encoder.Add(t.encoder_ms);
+        if (caption_config.cache.enabled) {
+            cache_lookup.Add(t.cache_ms);
+        }
+        // Cache hits skipped the decoder.
+        if (caption.cache_hit) {
+            return;
+        }
+        first_token.Add(t.first_token_ms);
+        if (t.inter_token_ms > 0.0) {
+            inter_token.Add(t.inter_token_ms);
+            max_inter_token.Add(t.max_inter_token_ms);
+        }
+        decoder.Add(t.decoder_ms);
+        decoder_ms_sum += t.decoder_ms;
+        select_ms_sum += t.select_ms;
+        draft_ms_sum += t.draft_ms;
+        steps += caption.step_ms.size();
+        draft_tokens += static_cast<uint64_t>(t.draft_tokens);
+        accepted_tokens += static_cast<uint64_t>(t.accepted_tokens);
+        for (size_t s = 1; s < caption.step_ms.size(); ++s) {
+            per_token.Add(caption.step_ms[s]);
+            decode_ms_sum += caption.step_ms[s];
+        }
+        tokens += static_cast<uint64_t>(t.generated_tokens);
+    };
+
+    const vlm::Stopwatch wall;
+    const double cpu_start_ms = CpuTimeMs();
+    uint64_t live_offered = 0;
+    uint64_t live_skipped = 0;
+    uint64_t live_dropped = 0;
+    double live_interval_ms = 0.0;
+    if (live_fps > 0.0) {
+        // Every image once per iteration at |live_fps|; the captioner decides
+        // which of those frames get captioned.
+        vlm::InferenceWorker worker;
+        vlm::FramePool pool(4, 0);
+        vlm::FileFrameSource source(&pool, image_paths, live_fps, iterations);
+        vlm::LiveCaptioner captioner(&worker);
+        worker.Start(&pipeline, pipelined ? vlm::InferenceMode::kPipelined : vlm::InferenceMode::kSerial);
+        if (!captioner.Start(&source, &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        vlm::CaptionCompletion completion;
+        while (true) {
+            const bool finished = source.Finished() && !worker.IsBusy();
+            while (worker.PollCompletion(&completion)) {
+                captioner.OnCompletion(completion);
+                const size_t i = static_cast<size_t>(completion.frame_id % images.size());
+                if (completion.ok) {
+                    record(i, completion.caption);
+                } else {
+                    std::fprintf(stderr, "%s: %s\n", image_paths[i].c_str(), completion.error.c_str());
+                    ++failures;
+                }
+            }
+            if (finished) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        live_interval_ms = captioner.IntervalMs();
+        captioner.Stop();
+        worker.Stop();
+        live_offered = source.FramesOffered();
+        live_skipped = captioner.SkippedFrames();
+        live_dropped = source.FramesDropped();
+    } else if (pipelined) {
+        // Frames are submitted as soon as the worker has room for them, like
+        // a camera producing faster than captions complete, but never so fast
+        // that the worker has to drop one.
+        vlm::InferenceWorker worker;
+        vlm::FramePool pool(4, 0);
+        worker.Start(&pipeline, vlm::InferenceMode::kPipelined);
+        const uint64_t submissions = static_cast<uint64_t>(iterations) * images.size();
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        vlm::CaptionCompletion completion;
+        while (completed < submissions) {
+            bool idle = true;
+            while (worker.PollCompletion(&completion)) {
+                const size_t i = static_cast<size_t>(completion.frame_id % images.size());
+                if (completion.ok) {
+                    record(i, completion.caption);
+                } else {
+                    std::fprintf(stderr, "%s: %s\n", image_paths[i].c_str(), completion.error.c_str());
+                    ++failures;
+                }
+                ++completed;
+                idle = false;
+            }
+            if (submitted < submissions && worker.QueuedJobs() == 0) {
+                std::shared_ptr<vlm::Frame> frame = pool.Acquire();
+                if (frame) {
+                    const std::vector<uint8_t> &image = images[submitted % images.size()];
+                    frame->Assign(image.data(), image.size());
+                    frame->frame_id = submitted;
+                    vlm::FrameJob job;
+                    job.frame_id = submitted++;
+                    job.frame = std::move(frame);
+                    worker.Submit(std::move(job));
+                    idle = false;
+                }
+            }
+            if (idle) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        worker.Stop();
+    } else {
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            for (size_t i = 0; i < images.size(); ++i) {
+                if (!pipeline.CaptionJpeg(images[i].data(), images[i].size(), &result, &error)) {
+                    std::fprintf(stderr, "%s: %s\n", image_paths[i].c_str(), error.c_str());
+                    ++failures;
+                    continue;
+                }
+                record(i, result);
+            }
+        }
+    }
+    const double wall_ms = wall.ElapsedMs();
+    const double cpu_ms = CpuTimeMs() - cpu_start_ms;
+
+    FILE *out = stdout;
+    if (!output_path.empty()) {
+        out = std::fopen(output_path.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", output_path.c_str());
+            return 1;
+        }
+    }
+    const int captioned = static_cast<int>(total.Count());
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"benchmark\": \"vlm_bench\",\n  \"schema_version\": 1,\n");
+    std::fprintf(out, "  \"label\": \"%s\",\n", JsonEscape(label).c_str());
+    std::fprintf(out, "  \"config\": {\n");
+    std::fprintf(out, "    \"encoder\": \"%s\",\n", JsonEscape(engine_config.encoder_filename).c_str());
+    std::fprintf(out, "    \"decoder\": \"%s\",\n", JsonEscape(engine_config.decoder_filename).c_str());
+    std::fprintf(out, "    \"precision\": \"%s\",\n", vlm::ModelPrecisionName(engine_config.precision));
+    std::fprintf(out, "    \"onnxruntime\": \"%s\",\n", OrtGetApiBase()->GetVersionString());
+    std::fprintf(out, "    \"simd\": \"%s\",\n", vlm::SimdLevelName(vlm::DetectSimdLevel()));
+    std::fprintf(out, "    \"kv_cache\": %s,\n", pipeline.UsesKvCache() ? "true" : "false");
+    std::fprintf(out, "    \"input_size\": [%d, %d],\n", pipeline.InputWidth(), pipeline.InputHeight());
+    std::fprintf(out,
+                 "    \"tensors\": {\"pixels\": \"%s\", \"embeddings\": \"%s\", \"embeddings_bytes\": %zu, "
+                 "\"logits\": \"%s\"},\n",
+                 vlm::FloatTypeName(pipeline.PixelType()), vlm::FloatTypeName(pipeline.EmbeddingsType()),
+                 pipeline.EmbeddingsBytes(), vlm::FloatTypeName(pipeline.LogitsType()));
+    std::fprintf(out, "    \"threads\": %d,\n", engine_config.intra_op_num_threads);
+    std::fprintf(out, "    \"thread_pools\": \"%s\",\n", engine_config.share_thread_pools ? "shared" : "per_session");
+    std::fprintf(out, "    \"thread_affinities\": \"%s\",\n",
+                 JsonEscape(engine_config.intra_op_thread_affinities).c_str());
+    std::fprintf(out, "    \"allow_spinning\": %s,\n", engine_config.allow_spinning ? "true" : "false");
+    std::fprintf(out, "    \"max_new_tokens\": %d,\n", caption_config.max_new_tokens);
+    std::fprintf(out, "    \"prompt\": \"%s\",\n", JsonEscape(caption_config.prompt).c_str());
+    const vlm::SamplingConfig &sampling = caption_config.sampling;
+    std::fprintf(out,
+                 "    \"sampling\": {\"greedy\": %s, \"temperature\": %.3f, \"top_k\": %d, \"top_p\": %.3f, "
+                 "\"repetition_penalty\": %.3f, \"seed\": %llu},\n",
+                 sampling.Greedy() ? "true" : "false", sampling.temperature, sampling.top_k, sampling.top_p,
+                 sampling.repetition_penalty, static_cast<unsigned long long>(sampling.seed));
+    std::fprintf(out, "    \"beam_search\": {\"beams\": %d, \"length_penalty\": %.3f, "
+                      "\"early_stopping\": %s},\n",
+                 caption_config.beam_search.beams, caption_config.beam_search.length_penalty,
+                 caption_config.beam_search.early_stopping ? "true" : "false");
+    std::fprintf(out, "    \"speculative\": {\"draft_decoder\": \"%s\", \"draft_tokens\": %d},\n",
+                 JsonEscape(engine_config.draft_decoder_filename).c_str(), caption_config.draft_tokens);
+    std::fprintf(out, "    \"images\": %zu,\n", images.size());
+    std::fprintf(out, "    \"warmup\": %d,\n", warmup);
+    std::fprintf(out, "    \"pipelined\": %s,\n", pipelined ? "true" : "false");
+    std::fprintf(out, "    \"live_fps\": %.3f,\n", live_fps);
+    std::fprintf(out, "    \"frame_gate\": {\"enabled\": %s, \"max_hash_distance\": %d, \"max_mean_difference\": %.4f},\n",
+                 caption_config.gate.enabled ? "true" : "false", caption_config.gate.max_hash_distance,
+                 caption_config.gate.max_mean_difference);
+    std::fprintf(out,
+                 "    \"caption_cache\": {\"enabled\": %s, \"min_similarity\": %.4f, \"max_bytes\": %zu, "
+                 "\"half_keys\": %s},\n",
+                 caption_config.cache.enabled ? "true" : "false", caption_config.cache.min_similarity,
+                 caption_config.cache.max_bytes, caption_config.cache.half_keys ? "true" : "false");
+    std::fprintf(out, "    \"iterations\": %d\n", iterations);
+    std::fprintf(out, "  },\n");
+    std::fprintf(out, "  \"captions\": %d,\n  \"failures\": %d,\n  \"generated_tokens\": %llu,\n", captioned,
+                 failures, static_cast<unsigned long long>(tokens));
+    std::fprintf(out, "  \"load_ms\": %.3f,\n", load_ms);
+    std::fprintf(out, "  \"model_load\": {\n");
+    WriteModelLoad(out, "encoder", engine.EncoderLoadInfo(), false);
+    const bool draft = engine.DraftDecoderSession() != nullptr;
+    WriteModelLoad(out, "decoder", engine.DecoderLoadInfo(), !draft);
+    if (draft) {
+        WriteModelLoad(out, "draft_decoder", engine.DraftDecoderLoadInfo(), true);
+    }
+    std::fprintf(out, "  },\n");
+    std::fprintf(out, "  \"latency_ms\": {\n");
+    WriteStats(out, "image_decode", &image_decode, false);
+    WriteStats(out, "preprocess", &preprocess, false);
+    WriteStats(out, "frame_gate", &gate, false);
+    WriteStats(out, "encoder", &encoder, false);
+    WriteStats(out, "cache_lookup", &cache_lookup, false);
+    WriteStats(out, "queue_wait", &queue, false);
+    WriteStats(out, "time_to_first_token", &first_token, false);
+    WriteStats(out, "inter_token", &inter_token, false);
+    WriteStats(out, "max_inter_token", &max_inter_token, false);
+    WriteStats(out, "per_token", &per_token, false);
+    WriteStats(out, "decoder", &decoder, false);
+    WriteStats(out, "total", &total, true);
+    std::fprintf(out, "  },\n");
+    std::fprintf(out,
+                 "  \"throughput\": {\"captions_per_s\": %.3f, \"decode_tokens_per_s\": %.3f, "
+                 "\"effective_tokens_per_s\": %.3f, \"cpu_ms_per_caption\": %.3f},\n",
+                 wall_ms > 0.0 ? captioned * 1000.0 / wall_ms : 0.0,
+                 decode_ms_sum > 0.0 ? per_token.Count() * 1000.0 / decode_ms_sum : 0.0,
+                 decoder_ms_sum > 0.0 ? tokens * 1000.0 / decoder_ms_sum : 0.0,
+                 captioned > 0 ? cpu_ms / captioned : 0.0);
+    // Picking tokens from the logits against the decoder runs it follows.
+    std::fprintf(out, "  \"token_selection\": {\"steps\": %llu, \"us_per_step\": %.3f, \"share_of_decoder\": %.5f},\n",
+                 static_cast<unsigned long long>(steps), steps > 0 ? select_ms_sum * 1000.0 / steps : 0.0,
+                 decoder_ms_sum > 0.0 ? select_ms_sum / decoder_ms_sum : 0.0);
+    if (caption_config.draft_tokens > 0) {
+        // Tokens per decoder step, prompt step included, against 1 without
+        // a draft decoder; effective_tokens_per_s above counts the draft runs.
+        std::fprintf(out,
+                     "  \"speculative\": {\"proposed\": %llu, \"accepted\": %llu, \"acceptance_rate\": %.4f, "
+                     "\"tokens_per_step\": %.3f, \"draft_share_of_decoder\": %.5f},\n",
+                     static_cast<unsigned long long>(draft_tokens), static_cast<unsigned long long>(accepted_tokens),
+                     draft_tokens > 0 ? static_cast<double>(accepted_tokens) / draft_tokens : 0.0,
+                     steps > 0 ? static_cast<double>(tokens) / steps : 0.0,
+                     decoder_ms_sum > 0.0 ? draft_ms_sum / decoder_ms_sum : 0.0);
+    }
+    std::fprintf(out, "  \"frame_gate\": {\"encoded\": %llu, \"gated\": %llu, \"reused_captions\": %d},\n",
+                 static_cast<unsigned long long>(pipeline.EncodedFrames() - encoded_before),
+                 static_cast<unsigned long long>(pipeline.GatedFrames() - gated_before), reused);
+    const vlm::CaptionCache &cache = pipeline.Cache();
+    const uint64_t hits = cache.Hits() - hits_before;
+    const uint64_t lookups = hits + cache.Misses() - misses_before;
+    std::fprintf(out,
+                 "  \"caption_cache\": {\"hits\": %llu, \"lookups\": %llu, \"hit_rate\": %.3f, \"entries\": %zu, "
+                 "\"capacity\": %zu, \"memory_bytes\": %zu},\n",
+                 static_cast<unsigned long long>(hits), static_cast<unsigned long long>(lookups),
+                 lookups > 0 ? static_cast<double>(hits) / lookups : 0.0, cache.Entries(), cache.Capacity(),
+                 cache.MemoryBytes());
+    if (live_fps > 0.0) {
+        std::fprintf(out,
+                     "  \"live\": {\"frames\": %llu, \"skipped\": %llu, \"dropped\": %llu, "
+                     "\"final_interval_ms\": %.3f},\n",
+                     static_cast<unsigned long long>(live_offered), static_cast<unsigned long long>(live_skipped),
+                     static_cast<unsigned long long>(live_dropped), live_interval_ms);
+    }
+    std::fprintf(out,
+                 "  \"memory_kb\": {\"rss_before_load\": %ld, \"rss_after_load\": %ld, \"rss_file_after_load\": %ld, "
+                 "\"peak_rss_after_load\": %ld, \"peak_rss\": %ld},\n",
+                 rss_before_load_kb, rss_after_load_kb, rss_file_after_load_kb, peak_rss_after_load_kb, PeakRssKb());
+    std::fprintf(out, "  \"outputs\": [\n");
+    for (size_t i = 0; i < captions.size(); ++i) {
+        std::fprintf(out, "    {\"image\": \"%s\", \"caption\": \"%s\"}%s\n", JsonEscape(captions[i].image).c_str(),
+                     JsonEscape(captions[i].text).c_str(), i + 1 < captions.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+// Host command line front end for the VLM pipeline: captions JPEG files with
+// the same engine and pipeline the headset app uses and prints per-stage
+// timings.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caption_pipeline.h"
+#include "file_utils.h"
+#include "frame_quality.h"
+#include "vlm_engine.h"
+
+namespace {
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s --models DIR [options] IMAGE.jpg...\n"
+                 "  --models DIR       directory with encoder/decoder models and vocab.json\n"
+                 "  --encoder FILE     encoder file name inside DIR (default encoder_model.onnx)\n"
+                 "  --decoder FILE     decoder file name inside DIR (default decoder_model.onnx)\n"
+                 "  --vocab PATH       vocab.json + merges.txt, or tokenizer.json (default DIR/vocab.json)\n"
+                 "  --precision P      model variant: fp32 (default), int8, q4 or fp16\n"
+                 "  --threads N        intra-op threads, calling thread included (default 1)\n"
+                 "  --max-tokens N     maximum caption length (default 30)\n"
+                 "  --bos ID --eos ID  special token ids (default 50256)\n"
+                 "  --prompt TEXT      text the captions continue, e.g. \"a photo of\"\n"
+                 "  --temperature T    sample at temperature T instead of picking the most likely token\n"
+                 "  --top-k N          sample among the N most likely tokens only\n"
+                 "  --top-p P          sample among the most likely tokens holding P of the probability\n"
+                 "  --repetition-penalty X  penalize tokens already in the caption (default 1, off)\n"
+                 "  --seed N           sampling seed (default 0)\n"
+                 "  --beams N          beam search over N captions decoded as one batch (default 1, off)\n"
+                 "  --length-penalty X  beam search favors longer captions above 0 (default 1)\n"
+                 "  --early-stopping   end beam search once N captions are finished\n"
+                 "  --draft FILE       draft decoder inside the models dir for speculative decoding\n"
+                 "  --draft-tokens N   tokens the draft decoder proposes per decoder run (default 4)\n"
+                 "  --stream           print each caption to stderr as it grows, read from another thread\n"
+                 "                     the way the headset app's render loop reads it\n"
+                 "  --burst N          take the images N at a time as camera bursts and caption only the\n"
+                 "                     sharpest, well exposed one of each, the way the headset app does\n"
+                 "  --min-sharpness X  skip bursts whose best image is blurrier than this (Laplacian variance)\n"
+                 "  --max-clipped F    skip bursts whose best image has more than this fraction clipped\n"
+                 "  --repeat N         caption every image N times (default 1)\n",
+                 argv0);
+}
+
+void PrintStage(const char *name, const vlm::StageCounter &counter) {
+    std::printf("  %-13s mean %8.2f ms  max %8.2f ms\n", name, counter.MeanMs(), counter.max_ms);
+}
+
+// Polls the streamed caption until stopped and prints every change, the
+// final caption included.
+void PrintStream(vlm::CaptionPipeline *pipeline, const std::atomic<bool> *stop) {
+    uint64_t caption = 0;
+    int tokens = -1;
+    bool done = false;
+    for (bool last = false; !last;) {
+        last = stop->load(std::memory_order_acquire);
+        const vlm::CaptionSnapshot &snapshot = pipeline->StreamSnapshot();
+        if (snapshot.caption != caption || snapshot.tokens != tokens || snapshot.done != done) {
+            caption = snapshot.caption;
+            tokens = snapshot.tokens;
+            done = snapshot.done;
+            std::fprintf(stderr, "  [%llu] %8.2f ms %3d tokens%s: %s\n", static_cast<unsigned long long>(caption),
+                         snapshot.last_token_ms, tokens, done ? ", done" : "", snapshot.text.c_str());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    vlm::VlmEngineConfig engine_config;
+    vlm::CaptionConfig caption_config;
+    int repeat = 1;
+    bool stream = false;
+    vlm::FrameQualityConfig quality_config;
+    bool score_frames = false;
+    std::vector<std::string> images;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--models") == 0 && has_value) {
+            engine_config.models_dir = argv[++i];
+            if (engine_config.models_dir.back() != '/') {
+                engine_config.models_dir += '/';
+            }
+        } else if (std::strcmp(arg, "--encoder") == 0 && has_value) {
+            engine_config.encoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--decoder") == 0 && has_value) {
+            engine_config.decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--vocab") == 0 && has_value) {
+            caption_config.vocab_path = argv[++i];
+        } else if (std::strcmp(arg, "--precision") == 0 && has_value) {
+            if (!vlm::ParseModelPrecision(argv[++i], &engine_config.precision)) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--threads") == 0 && has_value) {
+            engine_config.intra_op_num_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--max-tokens") == 0 && has_value) {
+            caption_config.max_new_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--prompt") == 0 && has_value) {
+            caption_config.prompt = argv[++i];
+        } else if (std::strcmp(arg, "--temperature") == 0 && has_value) {
+            caption_config.sampling.temperature = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--top-k") == 0 && has_value) {
+            caption_config.sampling.top_k = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--top-p") == 0 && has_value) {
+            caption_config.sampling.top_p = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--repetition-penalty") == 0 && has_value) {
+            caption_config.sampling.repetition_penalty = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--seed") == 0 && has_value) {
+            caption_config.sampling.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(arg, "--beams") == 0 && has_value) {
+            caption_config.beam_search.beams = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--length-penalty") == 0 && has_value) {
+            caption_config.beam_search.length_penalty = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(arg, "--early-stopping") == 0) {
+            caption_config.beam_search.early_stopping = true;
+        } else if (std::strcmp(arg, "--draft") == 0 && has_value) {
+            engine_config.draft_decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--draft-tokens") == 0 && has_value) {
+            caption_config.draft_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--bos") == 0 && has_value) {
+            caption_config.bos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--eos") == 0 && has_value) {
+            caption_config.eos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--stream") == 0) {
+            stream = true;
+        } else if (std::strcmp(arg, "--burst") == 0 && has_value) {
+            quality_config.burst_frames = std::atoi(argv[++i]);
+            score_frames = true;
+        } else if (std::strcmp(arg, "--min-sharpness") == 0 && has_value) {
+            quality_config.min_sharpness = static_cast<float>(std::atof(argv[++i]));
+            score_frames = true;
+        } else if (std::strcmp(arg, "--max-clipped") == 0 && has_value) {
+            quality_config.max_clipped = static_cast<float>(std::atof(argv[++i]));
+            score_frames = true;
+        } else if (std::strcmp(arg, "--repeat") == 0 && has_value) {
+            repeat = std::atoi(argv[++i]);
+        } else if (arg[0] == '-') {
+            PrintUsage(argv[0]);
+            return 2;
+        } else {
+            images.push_back(arg);
+        }
+    }
+    if (engine_config.models_dir.empty() || images.empty() || repeat < 1 || quality_config.burst_frames < 1) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    if (!engine_config.draft_decoder_filename.empty() && caption_config.draft_tokens == 0) {
+        caption_config.draft_tokens = 4;
+    }
+    if (caption_config.vocab_path.empty()) {
+        caption_config.vocab_path = engine_config.models_dir + "vocab.json";
+    }
+    caption_config.stream = stream;
+
+    vlm::VlmEngine engine;
+    if (!engine.Initialize(engine_config)) {
+        std::fprintf(stderr, "%s\n", engine.StatusMessage().c_str());
+        return 1;
+    }
+    vlm::CaptionPipeline pipeline;
+    std::string error;
+    if (!pipeline.Initialize(&engine, caption_config, &error)) {
+        std::fprintf(stderr, "Caption pipeline failed: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::atomic<bool> stop_stream{false};
+    std::thread stream_reader;
+    if (stream) {
+        stream_reader = std::thread(PrintStream, &pipeline, &stop_stream);
+    }
+    vlm::BurstSelector burst_selector;
+    burst_selector.Configure(quality_config);
+    std::vector<std::string> burst_images;
+    int failures = 0;
+    for (int r = 0; r < repeat; ++r) {
+        for (const std::string &path : images) {
+            std::string image = path;
+            vlm::CaptionResult result;
+            if (score_frames) {
+                // Files stand in for camera frames: every burst_frames of them
+                // are scored and only the best one is captioned.
+                if (burst_images.empty()) {
+                    burst_selector.Begin();
+                }
+                burst_images.push_back(path);
+                std::shared_ptr<vlm::Frame> frame = std::make_shared<vlm::Frame>();
+                if (!vlm::ReadFile(path, &frame->data, &error)) {
+                    std::fprintf(stderr, "%s\n", error.c_str());
+                    frame.reset();
+                }
+                vlm::FrameRef best;
+                vlm::BurstOutcome outcome;
+                if (!burst_selector.Add(std::move(frame), &best, &outcome)) {
+                    continue;
+                }
+                if (outcome.best_index >= 0) {
+                    image = burst_images[outcome.best_index];
+                    const vlm::FrameQuality &q = outcome.best;
+                    std::printf("%s: best of %d, sharpness %.1f, mean luma %.0f, %.1f%% clipped%s\n",
+                                image.c_str(), outcome.frames, q.sharpness, q.mean_luma, 100.0f * q.clipped,
+                                outcome.accepted ? "" : ", below the quality floor");
+                }
+                burst_images.clear();
+                if (!best) {
+                    continue;
+                }
+                if (!pipeline.CaptionJpeg(best->data.data(), best->data.size(), &result, &error)) {
+                    std::fprintf(stderr, "%s: %s\n", image.c_str(), error.c_str());
+                    ++failures;
+                    continue;
+                }
+            } else if (!pipeline.CaptionFile(image, &result, &error)) {
+                std::fprintf(stderr, "%s: %s\n", image.c_str(), error.c_str());
+                ++failures;
+                continue;
+            }
+            const vlm::CaptionTimings &t = result.timings;
+            std::printf("%s: %s\n  decode %.2f ms, preprocess %.2f ms, encoder %.2f ms, decoder %.2f ms "
+                        "(%d tokens), total %.2f ms\n",
+                        image.c_str(), result.text.c_str(), t.image_decode_ms, t.preprocess_ms, t.encoder_ms,
+                        t.decoder_ms, t.generated_tokens, t.total_ms);
+        }
+    }
+    if (!burst_images.empty()) {
+        std::fprintf(stderr, "%zu images left over after the last full burst were not captioned\n",
+                     burst_images.size());
+    }
+    if (stream) {
+        stop_stream.store(true, std::memory_order_release);
+        stream_reader.join();
+    }
+
+    const vlm::PipelineCounters &counters = pipeline.Counters();
+    if (counters.total.count > 0) {
+        std::printf("%llu captions, %llu tokens\n", static_cast<unsigned long long>(counters.total.count),
+                    static_cast<unsigned long long>(counters.generated_tokens));
+        PrintStage("image decode", counters.image_decode);
+        PrintStage("preprocess", counters.preprocess);
+        PrintStage("encoder", counters.encoder);
+        PrintStage("decoder", counters.decoder);
+        PrintStage("token select", counters.select);
+        if (counters.draft_tokens > 0) {
+            PrintStage("draft", counters.draft);
+            std::printf("  %llu of %llu draft tokens accepted (%.1f%%)\n",
+                        static_cast<unsigned long long>(counters.accepted_tokens),
+                        static_cast<unsigned long long>(counters.draft_tokens),
+                        100.0 * counters.accepted_tokens / counters.draft_tokens);
+        }
+        PrintStage("detokenize", counters.detokenize);
+        PrintStage("first token", counters.first_token);
+        PrintStage("inter-token", counters.inter_token);
+        PrintStage("total", counters.total);
+    }
+    return failures == 0 ? 0 : 1;
+}
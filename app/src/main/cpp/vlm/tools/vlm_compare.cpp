@@ -0,0 +1,371 @@
+// Accuracy regression check for model variants. Captions a fixed image set
+// with reference models (fp32 by default) and with a candidate variant, then
+// compares the captions and, by teacher forcing the reference tokens through
+// both decoders, the logits at every position. The result is a JSON report;
+// --min-top1 and --max-kl turn it into a pass/fail check.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "caption_pipeline.h"
+#include "file_utils.h"
+#include "tool_utils.h"
+#include "vlm_engine.h"
+
+namespace {
+
+using vlm_tools::JsonEscape;
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s --models DIR --images DIR --precision P [options]\n"
+                 "  --models DIR       directory with the model variants and vocab.json\n"
+                 "  --images DIR       fixed set of *.jpg files to caption\n"
+                 "  --precision P      candidate variant: int8, q4 or fp16 (or fp32)\n"
+                 "  --reference P      reference variant (default fp32)\n"
+                 "  --encoder FILE     fp32 encoder file name inside DIR (default encoder_model.onnx)\n"
+                 "  --decoder FILE     fp32 decoder file name inside DIR (default decoder_model.onnx)\n"
+                 "  --vocab PATH       vocab.json + merges.txt, or tokenizer.json (default DIR/vocab.json)\n"
+                 "  --threads N        intra-op threads, calling thread included (default 1)\n"
+                 "  --max-tokens N     maximum caption length (default 30)\n"
+                 "  --bos ID --eos ID  special token ids (default 50256)\n"
+                 "  --prompt TEXT      text the captions continue, e.g. \"a photo of\"\n"
+                 "  --min-top1 X       fail when fewer than X of the teacher-forced argmaxes agree\n"
+                 "  --max-kl X         fail when the mean KL divergence exceeds X\n"
+                 "  --output FILE      write the JSON report to FILE instead of stdout\n",
+                 argv0);
+}
+
+struct ImageComparison {
+    std::string image;
+    std::string reference_text;
+    std::string candidate_text;
+    std::vector<int64_t> reference_tokens;
+    std::vector<int64_t> candidate_tokens;
+    // Teacher-forced logits of the reference, released once compared.
+    std::vector<float> reference_logits;
+    double reference_ms = 0.0;
+    double candidate_ms = 0.0;
+    // Teacher-forced comparison over every position.
+    int positions = 0;
+    int top1_agreements = 0;
+    double kl_sum = 0.0;
+    double min_cosine = 1.0;
+    double max_abs_diff = 0.0;
+};
+
+struct VariantRun {
+    vlm::ModelLoadInfo encoder;
+    vlm::ModelLoadInfo decoder;
+    double encoder_ms = 0.0;
+    double decoder_ms = 0.0;
+    double total_ms = 0.0;
+    int captions = 0;
+};
+
+size_t EditDistance(const std::vector<int64_t> &a, const std::vector<int64_t> &b) {
+    std::vector<size_t> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        size_t diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); ++j) {
+            const size_t above = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+// 1 for identical token sequences, 0 for nothing in common.
+double TokenSimilarity(const std::vector<int64_t> &a, const std::vector<int64_t> &b) {
+    const size_t longest = std::max(a.size(), b.size());
+    return longest == 0 ? 1.0 : 1.0 - static_cast<double>(EditDistance(a, b)) / longest;
+}
+
+// log(sum(exp(row))) without overflow.
+double LogSumExp(const float *row, size_t count) {
+    const float peak = *std::max_element(row, row + count);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += std::exp(static_cast<double>(row[i]) - peak);
+    }
+    return peak + std::log(sum);
+}
+
+void CompareLogits(const float *reference, const float *candidate, size_t vocab, ImageComparison *comparison) {
+    const double ref_lse = LogSumExp(reference, vocab);
+    const double cand_lse = LogSumExp(candidate, vocab);
+    double kl = 0.0;
+    double dot = 0.0;
+    double ref_norm = 0.0;
+    double cand_norm = 0.0;
+    for (size_t i = 0; i < vocab; ++i) {
+        const double p_log = reference[i] - ref_lse;
+        const double q_log = candidate[i] - cand_lse;
+        kl += std::exp(p_log) * (p_log - q_log);
+        dot += static_cast<double>(reference[i]) * candidate[i];
+        ref_norm += static_cast<double>(reference[i]) * reference[i];
+        cand_norm += static_cast<double>(candidate[i]) * candidate[i];
+        comparison->max_abs_diff =
+            std::max(comparison->max_abs_diff, std::fabs(static_cast<double>(reference[i]) - candidate[i]));
+    }
+    const double cosine = ref_norm > 0.0 && cand_norm > 0.0 ? dot / std::sqrt(ref_norm * cand_norm) : 1.0;
+    ++comparison->positions;
+    comparison->kl_sum += std::max(kl, 0.0);
+    comparison->min_cosine = std::min(comparison->min_cosine, cosine);
+    if (std::max_element(reference, reference + vocab) - reference ==
+        std::max_element(candidate, candidate + vocab) - candidate) {
+        ++comparison->top1_agreements;
+    }
+}
+
+// Captions every image with one variant. The reference run records its
+// tokens and teacher-forced logits; the candidate run compares against them.
+bool RunVariant(vlm::VlmEngineConfig engine_config, const vlm::CaptionConfig &caption_config,
+                vlm::ModelPrecision precision, bool reference, const std::vector<std::vector<uint8_t>> &images,
+                std::vector<ImageComparison> *comparisons, VariantRun *run, std::string *error) {
+    engine_config.precision = precision;
+    vlm::VlmEngine engine;
+    if (!engine.Initialize(engine_config)) {
+        *error = engine.StatusMessage();
+        return false;
+    }
+    run->encoder = engine.EncoderLoadInfo();
+    run->decoder = engine.DecoderLoadInfo();
+    vlm::CaptionPipeline pipeline;
+    if (!pipeline.Initialize(&engine, caption_config, error)) {
+        return false;
+    }
+    vlm::EncodedFrame frame;
+    if (!pipeline.PrepareEncodedFrame(&frame, error)) {
+        return false;
+    }
+
+    vlm::CaptionResult result;
+    std::vector<float> logits;
+    for (size_t i = 0; i < images.size(); ++i) {
+        ImageComparison &comparison = (*comparisons)[i];
+        const std::vector<uint8_t> &image = images[i];
+        if (!pipeline.CaptionJpeg(image.data(), image.size(), &result, error)) {
+            *error = comparison.image + ": " + *error;
+            return false;
+        }
+        run->encoder_ms += result.timings.encoder_ms;
+        run->decoder_ms += result.timings.decoder_ms;
+        run->total_ms += result.timings.total_ms;
+        ++run->captions;
+        (reference ? comparison.reference_text : comparison.candidate_text) = result.text;
+        (reference ? comparison.reference_tokens : comparison.candidate_tokens) = result.token_ids;
+        (reference ? comparison.reference_ms : comparison.candidate_ms) = result.timings.total_ms;
+
+        if (!pipeline.EncodeJpeg(image.data(), image.size(), &frame, error) ||
+            !pipeline.TokenLogits(&frame, comparison.reference_tokens, &logits, error)) {
+            *error = comparison.image + ": " + *error;
+            return false;
+        }
+        if (reference) {
+            comparison.reference_logits.swap(logits);
+            continue;
+        }
+        if (logits.size() != comparison.reference_logits.size()) {
+            *error = "Reference and candidate decoders disagree on the vocabulary size";
+            return false;
+        }
+        const size_t vocab = static_cast<size_t>(pipeline.VocabSize());
+        for (size_t offset = 0; offset < logits.size(); offset += vocab) {
+            CompareLogits(comparison.reference_logits.data() + offset, logits.data() + offset, vocab, &comparison);
+        }
+        std::vector<float>().swap(comparison.reference_logits);
+    }
+    return true;
+}
+
+void WriteRun(FILE *out, const char *name, vlm::ModelPrecision precision, const VariantRun &run) {
+    const double count = run.captions > 0 ? run.captions : 1;
+    std::fprintf(out,
+                 "  \"%s\": {\"precision\": \"%s\", \"encoder\": \"%s\", \"encoder_precision\": \"%s\", "
+                 "\"encoder_bytes\": %zu, \"decoder\": \"%s\", \"decoder_precision\": \"%s\", \"decoder_bytes\": %zu, "
+                 "\"mean_encoder_ms\": %.3f, \"mean_decoder_ms\": %.3f, \"mean_total_ms\": %.3f},\n",
+                 name, vlm::ModelPrecisionName(precision), JsonEscape(run.encoder.path).c_str(),
+                 vlm::ModelPrecisionName(run.encoder.precision), run.encoder.file_bytes,
+                 JsonEscape(run.decoder.path).c_str(), vlm::ModelPrecisionName(run.decoder.precision),
+                 run.decoder.file_bytes, run.encoder_ms / count, run.decoder_ms / count, run.total_ms / count);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    vlm::VlmEngineConfig engine_config;
+    vlm::CaptionConfig caption_config;
+    vlm::ModelPrecision reference_precision = vlm::ModelPrecision::kFp32;
+    vlm::ModelPrecision candidate_precision = vlm::ModelPrecision::kFp32;
+    bool has_candidate = false;
+    std::string images_dir;
+    std::string output_path;
+    double min_top1 = -1.0;
+    double max_kl = -1.0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--models") == 0 && has_value) {
+            engine_config.models_dir = argv[++i];
+            if (engine_config.models_dir.back() != '/') {
+                engine_config.models_dir += '/';
+            }
+        } else if (std::strcmp(arg, "--images") == 0 && has_value) {
+            images_dir = argv[++i];
+        } else if (std::strcmp(arg, "--precision") == 0 && has_value) {
+            has_candidate = vlm::ParseModelPrecision(argv[++i], &candidate_precision);
+            if (!has_candidate) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--reference") == 0 && has_value) {
+            if (!vlm::ParseModelPrecision(argv[++i], &reference_precision)) {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--encoder") == 0 && has_value) {
+            engine_config.encoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--decoder") == 0 && has_value) {
+            engine_config.decoder_filename = argv[++i];
+        } else if (std::strcmp(arg, "--vocab") == 0 && has_value) {
+            caption_config.vocab_path = argv[++i];
+        } else if (std::strcmp(arg, "--threads") == 0 && has_value) {
+            engine_config.intra_op_num_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--max-tokens") == 0 && has_value) {
+            caption_config.max_new_tokens = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--prompt") == 0 && has_value) {
+            caption_config.prompt = argv[++i];
+        } else if (std::strcmp(arg, "--bos") == 0 && has_value) {
+            caption_config.bos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--eos") == 0 && has_value) {
+            caption_config.eos_token_id = std::atoll(argv[++i]);
+        } else if (std::strcmp(arg, "--min-top1") == 0 && has_value) {
+            min_top1 = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--max-kl") == 0 && has_value) {
+            max_kl = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (engine_config.models_dir.empty() || images_dir.empty() || !has_candidate) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    if (caption_config.vocab_path.empty()) {
+        caption_config.vocab_path = engine_config.models_dir + "vocab.json";
+    }
+
+    const std::vector<std::string> image_paths = vlm_tools::ListJpegFiles(images_dir);
+    if (image_paths.empty()) {
+        std::fprintf(stderr, "No JPEG files found in %s\n", images_dir.c_str());
+        return 1;
+    }
+    std::vector<std::vector<uint8_t>> images(image_paths.size());
+    std::vector<ImageComparison> comparisons(image_paths.size());
+    std::string error;
+    for (size_t i = 0; i < image_paths.size(); ++i) {
+        comparisons[i].image = std::filesystem::path(image_paths[i]).filename().string();
+        if (!vlm::ReadFile(image_paths[i], &images[i], &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // One variant at a time, so only one set of weights is resident.
+    VariantRun reference;
+    VariantRun candidate;
+    if (!RunVariant(engine_config, caption_config, reference_precision, true, images, &comparisons, &reference,
+                    &error) ||
+        !RunVariant(engine_config, caption_config, candidate_precision, false, images, &comparisons, &candidate,
+                    &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (candidate.encoder.precision != candidate_precision && candidate.decoder.precision != candidate_precision) {
+        std::fprintf(stderr, "warning: no %s variant found, the candidate ran the fp32 models\n",
+                     vlm::ModelPrecisionName(candidate_precision));
+    }
+
+    int exact = 0;
+    int positions = 0;
+    int top1 = 0;
+    double kl_sum = 0.0;
+    double token_similarity_sum = 0.0;
+    double min_cosine = 1.0;
+    double max_abs_diff = 0.0;
+    for (const ImageComparison &c : comparisons) {
+        exact += c.reference_text == c.candidate_text ? 1 : 0;
+        token_similarity_sum += TokenSimilarity(c.reference_tokens, c.candidate_tokens);
+        positions += c.positions;
+        top1 += c.top1_agreements;
+        kl_sum += c.kl_sum;
+        min_cosine = std::min(min_cosine, c.min_cosine);
+        max_abs_diff = std::max(max_abs_diff, c.max_abs_diff);
+    }
+    const double count = static_cast<double>(comparisons.size());
+    const double top1_rate = positions > 0 ? static_cast<double>(top1) / positions : 1.0;
+    const double mean_kl = positions > 0 ? kl_sum / positions : 0.0;
+
+    FILE *out = stdout;
+    if (!output_path.empty()) {
+        out = std::fopen(output_path.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", output_path.c_str());
+            return 1;
+        }
+    }
+    std::fprintf(out, "{\n  \"benchmark\": \"vlm_compare\",\n  \"schema_version\": 1,\n");
+    std::fprintf(out, "  \"onnxruntime\": \"%s\",\n", OrtGetApiBase()->GetVersionString());
+    WriteRun(out, "reference", reference_precision, reference);
+    WriteRun(out, "candidate", candidate_precision, candidate);
+    std::fprintf(out,
+                 "  \"summary\": {\"images\": %zu, \"exact_caption_rate\": %.4f, \"mean_token_similarity\": %.4f, "
+                 "\"teacher_forced_positions\": %d, \"top1_agreement\": %.4f, \"mean_kl\": %.6f, "
+                 "\"min_logit_cosine\": %.6f, \"max_logit_abs_diff\": %.4f},\n",
+                 comparisons.size(), exact / count, token_similarity_sum / count, positions, top1_rate, mean_kl,
+                 min_cosine, max_abs_diff);
+    std::fprintf(out, "  \"images\": [\n");
+    for (size_t i = 0; i < comparisons.size(); ++i) {
+        const ImageComparison &c = comparisons[i];
+        std::fprintf(out,
+                     "    {\"image\": \"%s\", \"reference\": \"%s\", \"candidate\": \"%s\", "
+                     "\"token_similarity\": %.4f, \"top1_agreement\": %.4f, \"mean_kl\": %.6f, "
+                     "\"reference_ms\": %.3f, \"candidate_ms\": %.3f}%s\n",
+                     JsonEscape(c.image).c_str(), JsonEscape(c.reference_text).c_str(),
+                     JsonEscape(c.candidate_text).c_str(), TokenSimilarity(c.reference_tokens, c.candidate_tokens),
+                     c.positions > 0 ? static_cast<double>(c.top1_agreements) / c.positions : 1.0,
+                     c.positions > 0 ? c.kl_sum / c.positions : 0.0, c.reference_ms, c.candidate_ms,
+                     i + 1 < comparisons.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    bool pass = true;
+    if (min_top1 >= 0.0 && top1_rate < min_top1) {
+        std::fprintf(stderr, "FAIL: top-1 agreement %.4f below %.4f\n", top1_rate, min_top1);
+        pass = false;
+    }
+    if (max_kl >= 0.0 && mean_kl > max_kl) {
+        std::fprintf(stderr, "FAIL: mean KL divergence %.6f above %.6f\n", mean_kl, max_kl);
+        pass = false;
+    }
+    return pass ? 0 : 1;
+}
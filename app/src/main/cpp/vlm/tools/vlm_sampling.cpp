@@ -0,0 +1,161 @@
+// Microbenchmark for the logits processor: times picking one token from a
+// row of synthetic logits the size of the BLIP-2 OPT vocabulary, for each
+// sampling mode and kernel, and writes a JSON report. Compare the per-step
+// cost with vlm_bench's per_token decoder latency.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+#include "latency_stats.h"
+#include "logits_processor.h"
+
+namespace {
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s [options]\n"
+                 "  --vocab-size N     logits per row (default 50272, the OPT vocabulary)\n"
+                 "  --iterations N     timed rows per mode and kernel (default 2000)\n"
+                 "  --output FILE      write the JSON report to FILE instead of stdout\n",
+                 argv0);
+}
+
+struct Mode {
+    const char *name;
+    vlm::SamplingConfig config;
+};
+
+// Language model logits are mostly noise with a few tokens far above it.
+std::vector<float> SyntheticLogits(size_t vocab, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(-2.0f, 2.0f);
+    std::vector<float> row(vocab);
+    for (float &logit : row) {
+        logit = noise(rng);
+    }
+    for (int i = 0; i < 20; ++i) {
+        row[rng() % vocab] = 8.0f + static_cast<float>(i) * 0.4f;
+    }
+    return row;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t vocab = 50272;
+    int iterations = 2000;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--vocab-size") == 0 && has_value) {
+            vocab = static_cast<size_t>(std::atoll(argv[++i]));
+        } else if (std::strcmp(arg, "--iterations") == 0 && has_value) {
+            iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (vocab < 2 || iterations < 1) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Mode> modes(6);
+    modes[0].name = "greedy";
+    modes[1].name = "greedy_penalty";
+    modes[1].config.repetition_penalty = 1.3f;
+    modes[2].name = "temperature";
+    modes[2].config.temperature = 0.8f;
+    modes[3].name = "top_k";
+    modes[3].config.temperature = 0.8f;
+    modes[3].config.top_k = 50;
+    modes[4].name = "top_p";
+    modes[4].config.temperature = 0.8f;
+    modes[4].config.top_p = 0.9f;
+    modes[5].name = "top_k_top_p_penalty";
+    modes[5].config.temperature = 0.8f;
+    modes[5].config.top_k = 50;
+    modes[5].config.top_p = 0.9f;
+    modes[5].config.repetition_penalty = 1.3f;
+
+    std::vector<vlm::SimdLevel> levels = {vlm::SimdLevel::kScalar};
+    if (vlm::DetectSimdLevel() != vlm::SimdLevel::kScalar) {
+        levels.push_back(vlm::DetectSimdLevel());
+    }
+
+    // A few different rows, and a caption's worth of history for the penalty.
+    std::vector<std::vector<float>> rows;
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        rows.push_back(SyntheticLogits(vocab, seed));
+    }
+    std::vector<int64_t> history;
+    for (int64_t t = 0; t < 30; ++t) {
+        history.push_back((t * 7919) % static_cast<int64_t>(vocab));
+    }
+
+    FILE *out = stdout;
+    if (!output_path.empty()) {
+        out = std::fopen(output_path.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", output_path.c_str());
+            return 1;
+        }
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"benchmark\": \"vlm_sampling\",\n  \"schema_version\": 1,\n");
+    std::fprintf(out, "  \"vocab_size\": %zu,\n  \"iterations\": %d,\n", vocab, iterations);
+    std::fprintf(out, "  \"simd\": \"%s\",\n", vlm::SimdLevelName(vlm::DetectSimdLevel()));
+    std::fprintf(out, "  \"modes\": {\n");
+    std::vector<float> logits(vocab);
+    bool all_agree = true;
+    for (size_t m = 0; m < modes.size(); ++m) {
+        std::fprintf(out, "    \"%s\": {", modes[m].name);
+        std::vector<int64_t> picks[2];
+        for (size_t l = 0; l < levels.size(); ++l) {
+            vlm::LogitsProcessor processor;
+            processor.Configure(modes[m].config, levels[l]);
+            processor.Reset(history.data(), history.size());
+            vlm::LatencySamples samples;
+            for (int i = 0; i < iterations; ++i) {
+                // The penalty changes the row, so every step starts from a
+                // fresh copy, as the decoder would have just written it.
+                const std::vector<float> &row = rows[static_cast<size_t>(i) % rows.size()];
+                std::copy(row.begin(), row.end(), logits.begin());
+                const vlm::Stopwatch step;
+                const int64_t token = processor.Select(logits.data(), vocab);
+                samples.Add(step.ElapsedMs());
+                picks[l].push_back(token);
+            }
+            std::fprintf(out, "%s\"%s\": {\"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f}",
+                         l > 0 ? ", " : "", vlm::SimdLevelName(levels[l]), samples.Mean() * 1000.0,
+                         samples.Percentile(50.0) * 1000.0, samples.Percentile(99.0) * 1000.0);
+        }
+        // Greedy picks must not depend on the kernel; sampled ones may differ
+        // where the vector exp() rounds a draw to the neighbouring token.
+        if (levels.size() > 1) {
+            size_t agree = 0;
+            for (size_t i = 0; i < picks[0].size(); ++i) {
+                agree += picks[0][i] == picks[1][i] ? 1 : 0;
+            }
+            const double rate = static_cast<double>(agree) / picks[0].size();
+            all_agree = all_agree && (modes[m].config.Greedy() ? rate == 1.0 : true);
+            std::fprintf(out, ", \"same_token_as_scalar\": %.4f", rate);
+        }
+        std::fprintf(out, "}%s\n", m + 1 < modes.size() ? "," : "");
+    }
+    std::fprintf(out, "  }\n}\n");
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return all_agree ? 0 : 1;
+}
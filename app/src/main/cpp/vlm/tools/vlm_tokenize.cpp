@@ -0,0 +1,175 @@
+// Host tool for the caption tokenizer: prints the ids of a text and its
+// round trip, or measures encode, decode and streaming detokenization
+// throughput on a text file and writes a JSON report.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "file_utils.h"
+#include "latency_stats.h"
+#include "tokenizer.h"
+#include "tool_utils.h"
+
+namespace {
+
+using vlm_tools::JsonEscape;
+
+void PrintUsage(const char *argv0) {
+    std::fprintf(stderr,
+                 "Usage: %s --vocab PATH [options] [TEXT...]\n"
+                 "  --vocab PATH       vocab.json + merges.txt, or tokenizer.json\n"
+                 "  --bench FILE       time encoding and decoding FILE instead of printing TEXT\n"
+                 "  --iterations N     timed passes over FILE (default 20)\n"
+                 "  --output FILE      write the JSON report to FILE instead of stdout\n",
+                 argv0);
+}
+
+struct Throughput {
+    double best_ms = 0.0;
+    double total_ms = 0.0;
+
+    void Add(double ms) {
+        best_ms = total_ms == 0.0 || ms < best_ms ? ms : best_ms;
+        total_ms += ms;
+    }
+};
+
+void WriteThroughput(FILE *out, const char *name, const Throughput &t, int iterations, size_t bytes, size_t tokens,
+                     bool last) {
+    const double mean_ms = t.total_ms / iterations;
+    std::fprintf(out,
+                 "    \"%s\": {\"mean_ms\": %.3f, \"best_ms\": %.3f, \"mb_per_s\": %.2f, \"tokens_per_s\": %.0f, "
+                 "\"ns_per_token\": %.1f}%s\n",
+                 name, mean_ms, t.best_ms, mean_ms > 0.0 ? bytes / (mean_ms * 1e3) : 0.0,
+                 mean_ms > 0.0 ? tokens * 1e3 / mean_ms : 0.0, tokens > 0 ? mean_ms * 1e6 / tokens : 0.0,
+                 last ? "" : ",");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string vocab_path;
+    std::string bench_path;
+    std::string output_path;
+    int iterations = 20;
+    std::vector<std::string> texts;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(arg, "--vocab") == 0 && has_value) {
+            vocab_path = argv[++i];
+        } else if (std::strcmp(arg, "--bench") == 0 && has_value) {
+            bench_path = argv[++i];
+        } else if (std::strcmp(arg, "--iterations") == 0 && has_value) {
+            iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            PrintUsage(argv[0]);
+            return 2;
+        } else {
+            texts.push_back(arg);
+        }
+    }
+    if (vocab_path.empty() || iterations < 1 || (bench_path.empty() && texts.empty())) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    vlm::Tokenizer tokenizer;
+    std::string error;
+    const vlm::Stopwatch load;
+    if (!tokenizer.Load(vocab_path, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    const double load_ms = load.ElapsedMs();
+    if (!tokenizer.CanEncode()) {
+        std::fprintf(stderr, "%s has no merges; only decoding is possible\n", vocab_path.c_str());
+        return 1;
+    }
+
+    if (bench_path.empty()) {
+        std::vector<int64_t> ids;
+        for (const std::string &text : texts) {
+            ids.clear();
+            tokenizer.Encode(text, &ids);
+            std::printf("%zu tokens:", ids.size());
+            for (int64_t id : ids) {
+                std::printf(" %lld", static_cast<long long>(id));
+            }
+            const std::string decoded = tokenizer.Decode(ids.data(), ids.size());
+            std::printf("\n  round trip %s: \"%s\"\n", decoded == text ? "ok" : "DIFFERS", decoded.c_str());
+        }
+        return 0;
+    }
+
+    std::vector<uint8_t> bytes;
+    if (!vlm::ReadFile(bench_path, &bytes, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    const std::string text(bytes.begin(), bytes.end());
+    std::vector<int64_t> ids;
+    tokenizer.Encode(text, &ids);  // warm-up, and sizes |ids|
+    const bool round_trip = tokenizer.Decode(ids.data(), ids.size()) == text;
+
+    Throughput encode;
+    Throughput decode;
+    Throughput stream;
+    vlm::StreamDetokenizer detokenizer(&tokenizer, text.size());
+    size_t streamed = 0;
+    for (int i = 0; i < iterations; ++i) {
+        vlm::Stopwatch stage;
+        ids.clear();
+        tokenizer.Encode(text, &ids);
+        encode.Add(stage.ElapsedMs());
+
+        stage.Restart();
+        const std::string decoded = tokenizer.Decode(ids.data(), ids.size());
+        decode.Add(stage.ElapsedMs());
+
+        stage.Restart();
+        detokenizer.Reset();
+        streamed = 0;
+        for (int64_t id : ids) {
+            streamed += detokenizer.Push(id).size();
+        }
+        streamed += detokenizer.Flush().size();
+        stream.Add(stage.ElapsedMs());
+    }
+
+    FILE *out = stdout;
+    if (!output_path.empty()) {
+        out = std::fopen(output_path.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", output_path.c_str());
+            return 1;
+        }
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"benchmark\": \"vlm_tokenize\",\n  \"schema_version\": 1,\n");
+    std::fprintf(out, "  \"tokenizer\": {\"path\": \"%s\", \"vocab\": %zu, \"merges\": %zu, \"memory_bytes\": %zu, "
+                      "\"load_ms\": %.3f},\n",
+                 JsonEscape(vocab_path).c_str(), tokenizer.VocabSize(), tokenizer.MergeCount(),
+                 tokenizer.MemoryBytes(), load_ms);
+    std::fprintf(out, "  \"text\": {\"path\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, \"bytes_per_token\": %.3f, "
+                      "\"round_trip\": %s, \"streamed_bytes\": %zu},\n",
+                 JsonEscape(bench_path).c_str(), text.size(), ids.size(),
+                 ids.empty() ? 0.0 : static_cast<double>(text.size()) / ids.size(), round_trip ? "true" : "false",
+                 streamed);
+    std::fprintf(out, "  \"iterations\": %d,\n", iterations);
+    std::fprintf(out, "  \"throughput\": {\n");
+    WriteThroughput(out, "encode", encode, iterations, text.size(), ids.size(), false);
+    WriteThroughput(out, "decode", decode, iterations, text.size(), ids.size(), false);
+    WriteThroughput(out, "stream_decode", stream, iterations, text.size(), ids.size(), true);
+    std::fprintf(out, "  }\n}\n");
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return round_trip ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+#include "vlm_engine.h"
+
+#include <cstdio>
+
+#include "cpu_features.h"
+#include "latency_stats.h"
+#include "model_cache.h"
+#include "onnxruntime/core/session/onnxruntime_session_options_config_keys.h"
+#include "vlm_log.h"
+
+namespace vlm {
+
+namespace {
+
+std::string OrtFormatPath(const std::string &onnx_path) {
+    static const std::string kOnnx = ".onnx";
+    if (onnx_path.size() > kOnnx.size() &&
+        onnx_path.compare(onnx_path.size() - kOnnx.size(), kOnnx.size(), kOnnx) == 0) {
+        return onnx_path.substr(0, onnx_path.size() - kOnnx.size()) + ".ort";
+    }
+    return onnx_path + ".ort";
+}
+
+const char *const kPrecisionSuffixes[] = {"", "_int8", "_q4", "_fp16"};
+
+bool IsQuantized(ModelPrecision precision) {
+    return precision == ModelPrecision::kInt8 || precision == ModelPrecision::kInt4;
+}
+
+const char *CacheName(ModelLoadInfo::Cache cache) {
+    switch (cache) {
+        case ModelLoadInfo::Cache::kSaved:
+            return ", optimized and cached";
+        case ModelLoadInfo::Cache::kLoaded:
+            return ", from optimized cache";
+        default:
+            return "";
+    }
+}
+
+}  // namespace
+
+const char *ModelPrecisionName(ModelPrecision precision) {
+    switch (precision) {
+        case ModelPrecision::kInt8:
+            return "int8";
+        case ModelPrecision::kInt4:
+            return "q4";
+        case ModelPrecision::kFp16:
+            return "fp16";
+        default:
+            return "fp32";
+    }
+}
+
+bool ParseModelPrecision(const std::string &name, ModelPrecision *precision) {
+    for (ModelPrecision candidate : {ModelPrecision::kFp32, ModelPrecision::kInt8, ModelPrecision::kInt4,
+                                     ModelPrecision::kFp16}) {
+        if (name == ModelPrecisionName(candidate)) {
+            *precision = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string ModelVariantPath(const std::string &onnx_path, ModelPrecision precision) {
+    static const std::string kOnnx = ".onnx";
+    const char *suffix = kPrecisionSuffixes[static_cast<int>(precision)];
+    if (onnx_path.size() > kOnnx.size() &&
+        onnx_path.compare(onnx_path.size() - kOnnx.size(), kOnnx.size(), kOnnx) == 0) {
+        return onnx_path.substr(0, onnx_path.size() - kOnnx.size()) + suffix + kOnnx;
+    }
+    return onnx_path + suffix;
+}
+
+bool ResolveModelFile(const std::string &onnx_path, ModelPrecision precision, bool prefer_ort_format,
+                      ModelLoadInfo *load_info) {
+    *load_info = ModelLoadInfo();
+    load_info->path = onnx_path;
+    bool found = true;
+    if (precision != ModelPrecision::kFp32) {
+        const std::string variant = ModelVariantPath(onnx_path, precision);
+        found = FileExists(variant) || (prefer_ort_format && FileExists(OrtFormatPath(variant)));
+        if (found) {
+            load_info->path = variant;
+            load_info->precision = precision;
+        }
+    }
+    // The .ort file of whichever model was picked, never the fp32 one in
+    // place of a variant.
+    const std::string ort = OrtFormatPath(load_info->path);
+    if (prefer_ort_format && FileExists(ort)) {
+        load_info->path = ort;
+        load_info->ort_format = true;
+    }
+    return found;
+}
+
+VlmEngine::~VlmEngine() {
+    Shutdown();
+}
+
+bool VlmEngine::Initialize(const VlmEngineConfig &config) {
+    if (env_ != nullptr) {
+        return IsReady();
+    }
+    config_ = config;
+    status_message_.clear();
+
+    ort_ = config_.api ? config_.api : OrtGetApiBase()->GetApi(ORT_API_VERSION);
+    if (!ort_) {
+        status_message_ = "ONNX init failed: API not available.";
+        VLM_LOGE("%s", status_message_.c_str());
+        return false;
+    }
+    const char *ort_version = OrtGetApiBase()->GetVersionString();
+    VLM_LOGI("ONNX Runtime version: %s", ort_version ? ort_version : "unknown");
+
+    std::string error;
+    if (!CreateEnv(&error)) {
+        status_message_ = error;
+        env_ = nullptr;
+        return false;
+    }
+    if (!CheckOrtStatus(ort_, ort_->CreateSessionOptions(&session_options_), "CreateSessionOptions failed", &error) ||
+        !ConfigureThreading(&error)) {
+        status_message_ = error;
+        Shutdown();
+        return false;
+    }
+    if (config_.map_model_files) {
+        // Only consulted for ORT-format models created from a buffer.
+        CheckOrtStatus(ort_,
+                       ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsConfigUseORTModelBytesDirectly,
+                                                   "1"),
+                       "AddSessionConfigEntry(use_ort_model_bytes_directly) failed");
+        CheckOrtStatus(ort_,
+                       ort_->AddSessionConfigEntry(session_options_,
+                                                   kOrtSessionOptionsConfigUseORTModelBytesForInitializers, "1"),
+                       "AddSessionConfigEntry(use_ort_model_bytes_for_initializers) failed");
+    }
+
+    if (IsQuantized(config_.precision)) {
+        // Signed int8 QDQ weights may use the int8 kernels on every CPU, and
+        // 4-bit QDQ MatMuls fuse into MatMulNBits at the configured accuracy.
+        const std::string accuracy_level = std::to_string(config_.matmul_nbits_accuracy_level);
+        CheckOrtStatus(ort_, ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsQDQIsInt8Allowed, "1"),
+                       "AddSessionConfigEntry(qdqisint8allowed) failed");
+        CheckOrtStatus(ort_,
+                       ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsQDQMatMulNBitsAccuracyLevel,
+                                                   accuracy_level.c_str()),
+                       "AddSessionConfigEntry(qdq_matmulnbits_accuracy_level) failed");
+    }
+
+    bool ok = LoadSession(config_.models_dir + config_.encoder_filename, "Encoder", &encoder_session_,
+                          &encoder_mapping_, &encoder_load_, &encoder_inputs_, &encoder_outputs_);
+    ok = LoadSession(config_.models_dir + config_.decoder_filename, "Decoder", &decoder_session_, &decoder_mapping_,
+                     &decoder_load_, &decoder_inputs_, &decoder_outputs_) &&
+         ok;
+    if (!config_.draft_decoder_filename.empty()) {
+        ok = LoadSession(config_.models_dir + config_.draft_decoder_filename, "Draft decoder", &draft_decoder_session_,
+                         &draft_decoder_mapping_, &draft_decoder_load_, &draft_decoder_inputs_,
+                         &draft_decoder_outputs_) &&
+             ok;
+    }
+    status_message_ += ok ? "\nONNX initialization complete" : "\nONNX initialization incomplete";
+    return ok;
+}
+
+bool VlmEngine::CreateEnv(std::string *error) {
+    if (!config_.share_thread_pools) {
+        return CheckOrtStatus(ort_, ort_->CreateEnv(config_.log_level, config_.log_id.c_str(), &env_),
+                              "ONNX env failed", error);
+    }
+    OrtThreadingOptions *threading = nullptr;
+    if (!CheckOrtStatus(ort_, ort_->CreateThreadingOptions(&threading), "CreateThreadingOptions failed", error)) {
+        return false;
+    }
+    bool ok =
+        CheckOrtStatus(ort_, ort_->SetGlobalIntraOpNumThreads(threading, config_.intra_op_num_threads),
+                       "SetGlobalIntraOpNumThreads failed", error) &&
+        CheckOrtStatus(ort_, ort_->SetGlobalInterOpNumThreads(threading, config_.inter_op_num_threads),
+                       "SetGlobalInterOpNumThreads failed", error) &&
+        CheckOrtStatus(ort_, ort_->SetGlobalSpinControl(threading, config_.allow_spinning ? 1 : 0),
+                       "SetGlobalSpinControl failed", error);
+    if (ok && !config_.intra_op_thread_affinities.empty()) {
+        ok = CheckOrtStatus(
+            ort_, ort_->SetGlobalIntraOpThreadAffinity(threading, config_.intra_op_thread_affinities.c_str()),
+            "Invalid intra-op thread affinities", error);
+    }
+    ok = ok && CheckOrtStatus(ort_,
+                              ort_->CreateEnvWithGlobalThreadPools(config_.log_level, config_.log_id.c_str(),
+                                                                   threading, &env_),
+                              "ONNX env failed", error);
+    ort_->ReleaseThreadingOptions(threading);
+    return ok;
+}
+
+bool VlmEngine::ConfigureThreading(std::string *error) {
+    if (config_.share_thread_pools) {
+        // Sessions fall back to the env's pools.
+        return CheckOrtStatus(ort_, ort_->DisablePerSessionThreads(session_options_), "DisablePerSessionThreads failed",
+                              error);
+    }
+    const char *spinning = config_.allow_spinning ? "1" : "0";
+    bool ok = CheckOrtStatus(ort_, ort_->SetIntraOpNumThreads(session_options_, config_.intra_op_num_threads),
+                             "SetIntraOpNumThreads failed", error) &&
+              CheckOrtStatus(ort_, ort_->SetInterOpNumThreads(session_options_, config_.inter_op_num_threads),
+                             "SetInterOpNumThreads failed", error) &&
+              CheckOrtStatus(ort_,
+                             ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsConfigAllowIntraOpSpinning,
+                                                         spinning),
+                             "AddSessionConfigEntry(intra_op.allow_spinning) failed", error) &&
+              CheckOrtStatus(ort_,
+                             ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsConfigAllowInterOpSpinning,
+                                                         spinning),
+                             "AddSessionConfigEntry(inter_op.allow_spinning) failed", error);
+    if (ok && !config_.intra_op_thread_affinities.empty()) {
+        ok = CheckOrtStatus(ort_,
+                            ort_->AddSessionConfigEntry(session_options_, kOrtSessionOptionsConfigIntraOpThreadAffinities,
+                                                        config_.intra_op_thread_affinities.c_str()),
+                            "Invalid intra-op thread affinities", error);
+    }
+    return ok;
+}
+
+bool VlmEngine::LoadSession(const std::string &path, const char *label, OrtSession **session, MappedFile *mapping,
+                            ModelLoadInfo *load_info, std::vector<TensorInfo> *inputs,
+                            std::vector<TensorInfo> *outputs) {
+    const Stopwatch load_time;
+    if (!ResolveModelFile(path, config_.precision, config_.prefer_ort_format, load_info)) {
+        VLM_LOGW("%s: no %s variant at %s, loading fp32", label, ModelPrecisionName(config_.precision),
+                 ModelVariantPath(path, config_.precision).c_str());
+    }
+
+    std::string error;
+    bool ok;
+    const std::string what = std::string(label) + " load failed";
+    if (load_info->ort_format && config_.map_model_files) {
+        ok = mapping->Open(load_info->path, &error);
+        if (ok) {
+            load_info->mapped = true;
+            load_info->file_bytes = mapping->Size();
+            ok = CheckOrtStatus(ort_,
+                                ort_->CreateSessionFromArray(env_, mapping->Data(), mapping->Size(),
+                                                             session_options_, session),
+                                what.c_str(), &error);
+            if (!ok) {
+                mapping->Close();
+            }
+        } else {
+            VLM_LOGE("%s: %s", what.c_str(), error.c_str());
+        }
+    } else if (!load_info->ort_format && !config_.optimized_model_cache_dir.empty()) {
+        load_info->file_bytes = FileSize(load_info->path);
+        ok = CreateSessionThroughCache(what, session, load_info, &error);
+    } else {
+        load_info->file_bytes = FileSize(load_info->path);
+        ok = CheckOrtStatus(ort_, ort_->CreateSession(env_, load_info->path.c_str(), session_options_, session),
+                            what.c_str(), &error);
+    }
+    if (!ok) {
+        *session = nullptr;
+        status_message_ += "\n" + error;
+        return false;
+    }
+    if (!DescribeSession(ort_, *session, inputs, outputs, &error)) {
+        ort_->ReleaseSession(*session);
+        *session = nullptr;
+        mapping->Close();
+        status_message_ += "\n" + std::string(label) + " introspection failed: " + error;
+        return false;
+    }
+    load_info->load_ms = load_time.ElapsedMs();
+    if (load_info->cache == ModelLoadInfo::Cache::kLoaded && load_info->cold_start_ms >= 0.0) {
+        VLM_LOGI("%s warm start %.1f ms, cold start was %.1f ms", label, load_info->load_ms,
+                 load_info->cold_start_ms);
+    }
+    VLM_LOGI("%s loaded from %s (%s %s%s%s) in %.1f ms", label, load_info->path.c_str(),
+             ModelPrecisionName(load_info->precision), load_info->ort_format ? "ORT format" : "ONNX",
+             load_info->mapped ? ", mmap" : "", CacheName(load_info->cache), load_info->load_ms);
+    char summary[128];
+    std::snprintf(summary, sizeof(summary), " loaded successfully (%s %s%s, %.0f ms)",
+                  ModelPrecisionName(load_info->precision), load_info->ort_format ? "ORT format" : "ONNX",
+                  CacheName(load_info->cache), load_info->load_ms);
+    status_message_ += "\n" + std::string(label) + summary;
+    return true;
+}
+
+bool VlmEngine::CreateSessionThroughCache(const std::string &what, OrtSession **session, ModelLoadInfo *load_info,
+                                          std::string *error) {
+    const std::string source = load_info->path;
+    // Everything besides the model bytes that shapes the optimized graph.
+    // Layout transforms depend on the CPU, so the cache is per device.
+    std::string signature = std::string("vlm-optimized-1 ort=") + OrtGetApiBase()->GetVersionString() +
+                            " simd=" + SimdLevelName(DetectSimdLevel()) + " level=all prepacked=1";
+    if (IsQuantized(config_.precision)) {
+        signature += " qdq_int8=1 nbits_accuracy=" + std::to_string(config_.matmul_nbits_accuracy_level);
+    }
+    OptimizedModelEntry entry;
+    std::string cache_error;
+    if (!FindOptimizedModel(config_.optimized_model_cache_dir, source, signature, &entry, &cache_error)) {
+        VLM_LOGW("Optimized model cache unavailable: %s", cache_error.c_str());
+        return CheckOrtStatus(ort_, ort_->CreateSession(env_, source.c_str(), session_options_, session), what.c_str(),
+                              error);
+    }
+
+    OrtSessionOptions *options = nullptr;
+    if (!CheckOrtStatus(ort_, ort_->CloneSessionOptions(session_options_, &options), "CloneSessionOptions failed",
+                        error)) {
+        return false;
+    }
+    bool ok = false;
+    if (OptimizedModelExists(entry)) {
+        // Already optimized; running the optimizers again would only cost time.
+        CheckOrtStatus(ort_, ort_->SetSessionGraphOptimizationLevel(options, ORT_DISABLE_ALL),
+                       "SetSessionGraphOptimizationLevel failed");
+        ok = CheckOrtStatus(ort_, ort_->CreateSession(env_, entry.model_path.c_str(), options, session),
+                            what.c_str(), &cache_error);
+        if (ok) {
+            load_info->path = entry.model_path;
+            load_info->cache = ModelLoadInfo::Cache::kLoaded;
+            load_info->cold_start_ms = LoadColdStartMs(entry);
+        } else {
+            VLM_LOGW("Discarding optimized model %s: %s", entry.model_path.c_str(), cache_error.c_str());
+            RemoveOptimizedModel(entry);
+        }
+        ort_->ReleaseSessionOptions(options);
+        options = nullptr;
+        if (ok) {
+            return true;
+        }
+        if (!CheckOrtStatus(ort_, ort_->CloneSessionOptions(session_options_, &options),
+                            "CloneSessionOptions failed", error)) {
+            return false;
+        }
+    }
+
+    // Cold start: optimize, and have ORT save the result to a temporary name
+    // that is renamed once complete.
+    const Stopwatch cold_start;
+    const std::string temporary = entry.model_path + ".tmp";
+    CheckOrtStatus(ort_, ort_->SetOptimizedModelFilePath(options, temporary.c_str()),
+                   "SetOptimizedModelFilePath failed");
+    CheckOrtStatus(ort_,
+                   ort_->AddSessionConfigEntry(options, kOrtSessionOptionsOptimizedModelExternalInitializersFileName,
+                                               entry.data_file_name.c_str()),
+                   "AddSessionConfigEntry(optimized_model_external_initializers_file_name) failed");
+    CheckOrtStatus(ort_,
+                   ort_->AddSessionConfigEntry(options, kOrtSessionOptionsSavePrePackedConstantInitializers, "1"),
+                   "AddSessionConfigEntry(save_external_prepacked_constant_initializers) failed");
+    ok = CheckOrtStatus(ort_, ort_->CreateSession(env_, source.c_str(), options, session), what.c_str(), error);
+    ort_->ReleaseSessionOptions(options);
+    if (!ok) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), entry.model_path.c_str()) == 0) {
+        load_info->cache = ModelLoadInfo::Cache::kSaved;
+        SaveColdStartMs(entry, cold_start.ElapsedMs());
+        RemoveStaleOptimizedModels(config_.optimized_model_cache_dir, entry);
+    } else {
+        VLM_LOGW("Could not save optimized model %s", entry.model_path.c_str());
+        std::remove(temporary.c_str());
+    }
+    return true;
+}
+
+void VlmEngine::Shutdown() {
+    if (!ort_) {
+        return;
+    }
+    if (encoder_session_) {
+        ort_->ReleaseSession(encoder_session_);
+        encoder_session_ = nullptr;
+    }
+    if (decoder_session_) {
+        ort_->ReleaseSession(decoder_session_);
+        decoder_session_ = nullptr;
+    }
+    if (draft_decoder_session_) {
+        ort_->ReleaseSession(draft_decoder_session_);
+        draft_decoder_session_ = nullptr;
+    }
+    encoder_mapping_.Close();
+    decoder_mapping_.Close();
+    draft_decoder_mapping_.Close();
+    if (session_options_) {
+        ort_->ReleaseSessionOptions(session_options_);
+        session_options_ = nullptr;
+    }
+    if (env_) {
+        ort_->ReleaseEnv(env_);
+        env_ = nullptr;
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "file_utils.h"
+#include "onnxruntime/core/session/onnxruntime_c_api.h"
+#include "ort_utils.h"
+
+namespace vlm {
+
+// Weight precision of an exported model variant. Quantized variants sit next
+// to the fp32 model with a suffix: "encoder_model_int8.onnx" (INT8, QDQ or
+// dynamically quantized), "encoder_model_q4.onnx" (4-bit MatMulNBits),
+// "encoder_model_fp16.onnx" (float16 weights, and usually float16 inputs and
+// outputs, which the caption pipeline converts to as needed).
+enum class ModelPrecision {
+    kFp32,
+    kInt8,
+    kInt4,
+    kFp16,
+};
+
+const char *ModelPrecisionName(ModelPrecision precision);
+// Accepts the names above ("fp32", "int8", "q4", "fp16").
+bool ParseModelPrecision(const std::string &name, ModelPrecision *precision);
+// |onnx_path| with the variant suffix inserted before the extension.
+std::string ModelVariantPath(const std::string &onnx_path, ModelPrecision precision);
+
+struct VlmEngineConfig {
+    // Directory holding the exported BLIP-2 models, with trailing separator.
+    std::string models_dir;
+    std::string encoder_filename = "encoder_model.onnx";
+    std::string decoder_filename = "decoder_model.onnx";
+    // Small decoder that proposes tokens for the decoder to verify
+    // (speculative decoding), e.g. "draft_decoder_model.onnx". It takes the
+    // same image embeddings and tokenizer as the decoder. Empty loads none.
+    std::string draft_decoder_filename;
+    // Variant to load; each model falls back to fp32 when its variant is
+    // missing.
+    ModelPrecision precision = ModelPrecision::kFp32;
+    // "session.qdq_matmulnbits_accuracy_level" for 4-bit QDQ weights fused
+    // into MatMulNBits: 4 quantizes activations to int8 (fastest on CPU), 0
+    // keeps the kernel default. Only set when a quantized variant is asked for.
+    int matmul_nbits_accuracy_level = 4;
+    // Load "<name>.ort" instead of "<name>.onnx" when it exists next to it.
+    bool prefer_ort_format = true;
+    // mmap .ort models and let the session use the mapped bytes and
+    // initializers in place instead of copying them. ONNX models are always
+    // loaded by path: they are parsed into new structures either way, and a
+    // mapping on top of that only raises peak memory.
+    bool map_model_files = true;
+    // Writable directory (with trailing separator) for ONNX models saved after
+    // graph optimization, with prepacked weights. The first start optimizes
+    // and saves, later ones load the saved model without optimizing again.
+    // Empty disables the cache. Not used for .ort models, which are
+    // optimized offline already.
+    std::string optimized_model_cache_dir;
+    // Threads per intra-op pool, the calling thread included, and per
+    // inter-op pool (only used by parallel graph execution).
+    int intra_op_num_threads = 1;
+    int inter_op_num_threads = 1;
+    // Run both sessions on one set of pools owned by the env instead of a set
+    // per session, so raising the thread count does not oversubscribe the
+    // cores the render loop needs.
+    bool share_thread_pools = true;
+    // Processors for the intra_op_num_threads - 1 worker threads, in ORT's
+    // "session.intra_op_thread_affinities" syntax: "2;3;4" pins one worker to
+    // each of processors 2-4, "2,3;4,5" lets each of two roam over a pair.
+    // Empty leaves placement to the OS.
+    std::string intra_op_thread_affinities;
+    // Idle pool threads spin waiting for work: lower latency between kernels
+    // at the cost of cores kept busy between captions.
+    bool allow_spinning = false;
+    OrtLoggingLevel log_level = ORT_LOGGING_LEVEL_WARNING;
+    std::string log_id = "ML2App";
+    // ORT entry points used by the engine and by everything that runs its
+    // sessions through Api(), e.g. an instrumented copy in tests. Null uses
+    // ONNX Runtime's own.
+    const OrtApi *api = nullptr;
+};
+
+// How one model was loaded, for logs and benchmarks.
+struct ModelLoadInfo {
+    std::string path;
+    ModelPrecision precision = ModelPrecision::kFp32;
+    bool ort_format = false;
+    bool mapped = false;
+    size_t file_bytes = 0;
+    double load_ms = 0.0;
+    // Optimized-model cache: kSaved on a cold start, kLoaded on a warm one,
+    // which also reports the session creation time of its cold start.
+    enum class Cache { kOff, kSaved, kLoaded } cache = Cache::kOff;
+    double cold_start_ms = -1.0;
+};
+
+// Picks the file to load for the fp32 model at |onnx_path|: its |precision|
+// variant if one exists, else the fp32 model, either one as ".ort" when
+// |prefer_ort_format| is set and that file exists. Sets the path, precision
+// and format of |load_info|. Returns false when the variant was asked for
+// but is missing.
+bool ResolveModelFile(const std::string &onnx_path, ModelPrecision precision, bool prefer_ort_format,
+                      ModelLoadInfo *load_info);
+
+// Owns the ONNX Runtime environment and the BLIP-2 encoder/decoder sessions,
+// plus the optional draft decoder. Meant to be created once for the lifetime
+// of the app: Initialize() loads the models, every caption request reuses the
+// sessions, Shutdown() releases them.
+class VlmEngine {
+public:
+    VlmEngine() = default;
+    ~VlmEngine();
+    VlmEngine(const VlmEngine &) = delete;
+    VlmEngine &operator=(const VlmEngine &) = delete;
+
+    // Loads the models. Calling it again while initialized is a no-op.
+    // Returns false if the env or any session could not be created; the
+    // reason is available from StatusMessage().
+    bool Initialize(const VlmEngineConfig &config);
+    void Shutdown();
+
+    bool IsReady() const {
+        return encoder_session_ != nullptr && decoder_session_ != nullptr;
+    }
+
+    // Human readable summary of the last Initialize() call, for the GUI.
+    const std::string &StatusMessage() const {
+        return status_message_;
+    }
+
+    const OrtApi *Api() const {
+        return ort_;
+    }
+    OrtSession *EncoderSession() const {
+        return encoder_session_;
+    }
+    OrtSession *DecoderSession() const {
+        return decoder_session_;
+    }
+    const std::vector<TensorInfo> &EncoderInputs() const {
+        return encoder_inputs_;
+    }
+    const std::vector<TensorInfo> &EncoderOutputs() const {
+        return encoder_outputs_;
+    }
+    const std::vector<TensorInfo> &DecoderInputs() const {
+        return decoder_inputs_;
+    }
+    const std::vector<TensorInfo> &DecoderOutputs() const {
+        return decoder_outputs_;
+    }
+    const ModelLoadInfo &EncoderLoadInfo() const {
+        return encoder_load_;
+    }
+    const ModelLoadInfo &DecoderLoadInfo() const {
+        return decoder_load_;
+    }
+    // Null unless a draft decoder was configured.
+    OrtSession *DraftDecoderSession() const {
+        return draft_decoder_session_;
+    }
+    const std::vector<TensorInfo> &DraftDecoderInputs() const {
+        return draft_decoder_inputs_;
+    }
+    const std::vector<TensorInfo> &DraftDecoderOutputs() const {
+        return draft_decoder_outputs_;
+    }
+    const ModelLoadInfo &DraftDecoderLoadInfo() const {
+        return draft_decoder_load_;
+    }
+
+private:
+    bool LoadSession(const std::string &path, const char *label, OrtSession **session, MappedFile *mapping,
+                     ModelLoadInfo *load_info, std::vector<TensorInfo> *inputs, std::vector<TensorInfo> *outputs);
+    bool CreateEnv(std::string *error);
+    bool ConfigureThreading(std::string *error);
+    bool CreateSessionThroughCache(const std::string &what, OrtSession **session, ModelLoadInfo *load_info,
+                                   std::string *error);
+
+    VlmEngineConfig config_;
+    const OrtApi *ort_ = nullptr;
+    OrtEnv *env_ = nullptr;
+    OrtSessionOptions *session_options_ = nullptr;
+    OrtSession *encoder_session_ = nullptr;
+    OrtSession *decoder_session_ = nullptr;
+    OrtSession *draft_decoder_session_ = nullptr;
+    std::vector<TensorInfo> encoder_inputs_;
+    std::vector<TensorInfo> encoder_outputs_;
+    std::vector<TensorInfo> decoder_inputs_;
+    std::vector<TensorInfo> decoder_outputs_;
+    std::vector<TensorInfo> draft_decoder_inputs_;
+    std::vector<TensorInfo> draft_decoder_outputs_;
+    // An ORT-format session reads its graph and weights from these mappings,
+    // so they live as long as the sessions.
+    MappedFile encoder_mapping_;
+    MappedFile decoder_mapping_;
+    MappedFile draft_decoder_mapping_;
+    ModelLoadInfo encoder_load_;
+    ModelLoadInfo decoder_load_;
+    ModelLoadInfo draft_decoder_load_;
+    std::string status_message_;
+};
+
+}  // namespace vlm
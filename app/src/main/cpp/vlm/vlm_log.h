@@ -0,0 +1,27 @@
+#pragma once
+
+// Logging for the platform-neutral VLM code. On device this goes to logcat
+// next to the app_framework ALOG* output; on a host build it goes to stderr.
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+
+#define VLM_LOG_TAG "com.magicleap.capi.sample.camera_mixed_reality.vlm"
+#define VLM_LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, VLM_LOG_TAG, __VA_ARGS__)
+#define VLM_LOGI(...) __android_log_print(ANDROID_LOG_INFO, VLM_LOG_TAG, __VA_ARGS__)
+#define VLM_LOGW(...) __android_log_print(ANDROID_LOG_WARN, VLM_LOG_TAG, __VA_ARGS__)
+#define VLM_LOGE(...) __android_log_print(ANDROID_LOG_ERROR, VLM_LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define VLM_LOG_PRINT(level, ...)                 \
+    do {                                          \
+        std::fprintf(stderr, "%s/vlm: ", level);  \
+        std::fprintf(stderr, __VA_ARGS__);        \
+        std::fputc('\n', stderr);                 \
+    } while (0)
+#define VLM_LOGD(...) VLM_LOG_PRINT("D", __VA_ARGS__)
+#define VLM_LOGI(...) VLM_LOG_PRINT("I", __VA_ARGS__)
+#define VLM_LOGW(...) VLM_LOG_PRINT("W", __VA_ARGS__)
+#define VLM_LOGE(...) VLM_LOG_PRINT("E", __VA_ARGS__)
+#endif
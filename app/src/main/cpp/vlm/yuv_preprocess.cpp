@@ -0,0 +1,280 @@
+#include "yuv_preprocess.h"
+
+#include <algorithm>
+
+#if VLM_HAVE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if VLM_HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace vlm {
+
+namespace {
+
+// Full-range BT.601 (JFIF), matching what the JPEG path produces.
+constexpr float kRFromV = 1.402f;
+constexpr float kGFromU = -0.344136f;
+constexpr float kGFromV = -0.714136f;
+constexpr float kBFromU = 1.772f;
+
+// Everything one output row needs. Horizontal taps are byte offsets into the
+// source rows; |lo|/|hi| and |frac| arrays are indexed by output column.
+struct RowArgs {
+    const uint8_t *y0;
+    const uint8_t *y1;
+    const uint8_t *u0;
+    const uint8_t *u1;
+    const uint8_t *v0;
+    const uint8_t *v1;
+    float fy;
+    float fcy;
+    const int32_t *lx_lo;
+    const int32_t *lx_hi;
+    const float *lx_frac;
+    const int32_t *cx_lo;
+    const int32_t *cx_hi;
+    const float *cx_frac;
+    const float *scale;
+    const float *bias;
+    float *r;
+    float *g;
+    float *b;
+};
+
+inline float Lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+inline float Sample(const uint8_t *row0, const uint8_t *row1, int32_t lo, int32_t hi, float fx, float fy) {
+    return Lerp(Lerp(row0[lo], row0[hi], fx), Lerp(row1[lo], row1[hi], fx), fy);
+}
+
+inline float Clamp255(float v) {
+    return std::min(std::max(v, 0.0f), 255.0f);
+}
+
+void ConvertRowScalar(const RowArgs &a, int begin, int end) {
+    for (int x = begin; x < end; ++x) {
+        const float y = Sample(a.y0, a.y1, a.lx_lo[x], a.lx_hi[x], a.lx_frac[x], a.fy);
+        const float u = Sample(a.u0, a.u1, a.cx_lo[x], a.cx_hi[x], a.cx_frac[x], a.fcy) - 128.0f;
+        const float v = Sample(a.v0, a.v1, a.cx_lo[x], a.cx_hi[x], a.cx_frac[x], a.fcy) - 128.0f;
+        const float r = Clamp255(y + kRFromV * v);
+        const float g = Clamp255(y + kGFromU * u + kGFromV * v);
+        const float b = Clamp255(y + kBFromU * u);
+        a.r[x] = r * a.scale[0] + a.bias[0];
+        a.g[x] = g * a.scale[1] + a.bias[1];
+        a.b[x] = b * a.scale[2] + a.bias[2];
+    }
+}
+
+#if VLM_HAVE_AVX2_KERNELS
+// Loads the bytes at row[offsets[i]] for 8 lanes as floats. Each gather reads
+// 4 bytes, so callers must guarantee 3 bytes of slack past the last offset.
+VLM_TARGET_AVX2 inline __m256 GatherBytes(const uint8_t *row, __m256i offsets) {
+    const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(row), offsets, 1);
+    return _mm256_cvtepi32_ps(_mm256_and_si256(words, _mm256_set1_epi32(0xFF)));
+}
+
+VLM_TARGET_AVX2 inline __m256 SampleAvx2(const uint8_t *row0, const uint8_t *row1, __m256i lo, __m256i hi,
+                                         __m256 fx, __m256 fy) {
+    const __m256 a0 = GatherBytes(row0, lo);
+    const __m256 a1 = GatherBytes(row0, hi);
+    const __m256 b0 = GatherBytes(row1, lo);
+    const __m256 b1 = GatherBytes(row1, hi);
+    const __m256 top = _mm256_fmadd_ps(_mm256_sub_ps(a1, a0), fx, a0);
+    const __m256 bottom = _mm256_fmadd_ps(_mm256_sub_ps(b1, b0), fx, b0);
+    return _mm256_fmadd_ps(_mm256_sub_ps(bottom, top), fy, top);
+}
+
+// Returns the number of columns converted (a multiple of 8).
+VLM_TARGET_AVX2 int ConvertRowAvx2(const RowArgs &a, int end) {
+    const __m256 fy = _mm256_set1_ps(a.fy);
+    const __m256 fcy = _mm256_set1_ps(a.fcy);
+    const __m256 c128 = _mm256_set1_ps(128.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 c255 = _mm256_set1_ps(255.0f);
+    const __m256 r_v = _mm256_set1_ps(kRFromV);
+    const __m256 g_u = _mm256_set1_ps(kGFromU);
+    const __m256 g_v = _mm256_set1_ps(kGFromV);
+    const __m256 b_u = _mm256_set1_ps(kBFromU);
+    const __m256 scale_r = _mm256_set1_ps(a.scale[0]);
+    const __m256 scale_g = _mm256_set1_ps(a.scale[1]);
+    const __m256 scale_b = _mm256_set1_ps(a.scale[2]);
+    const __m256 bias_r = _mm256_set1_ps(a.bias[0]);
+    const __m256 bias_g = _mm256_set1_ps(a.bias[1]);
+    const __m256 bias_b = _mm256_set1_ps(a.bias[2]);
+
+    int x = 0;
+    for (; x + 8 <= end; x += 8) {
+        const __m256i lx_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.lx_lo + x));
+        const __m256i lx_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.lx_hi + x));
+        const __m256i cx_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.cx_lo + x));
+        const __m256i cx_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.cx_hi + x));
+        const __m256 lfx = _mm256_loadu_ps(a.lx_frac + x);
+        const __m256 cfx = _mm256_loadu_ps(a.cx_frac + x);
+
+        const __m256 y = SampleAvx2(a.y0, a.y1, lx_lo, lx_hi, lfx, fy);
+        const __m256 u = _mm256_sub_ps(SampleAvx2(a.u0, a.u1, cx_lo, cx_hi, cfx, fcy), c128);
+        const __m256 v = _mm256_sub_ps(SampleAvx2(a.v0, a.v1, cx_lo, cx_hi, cfx, fcy), c128);
+
+        __m256 r = _mm256_fmadd_ps(r_v, v, y);
+        __m256 g = _mm256_fmadd_ps(g_v, v, _mm256_fmadd_ps(g_u, u, y));
+        __m256 b = _mm256_fmadd_ps(b_u, u, y);
+        r = _mm256_min_ps(_mm256_max_ps(r, zero), c255);
+        g = _mm256_min_ps(_mm256_max_ps(g, zero), c255);
+        b = _mm256_min_ps(_mm256_max_ps(b, zero), c255);
+        _mm256_storeu_ps(a.r + x, _mm256_fmadd_ps(r, scale_r, bias_r));
+        _mm256_storeu_ps(a.g + x, _mm256_fmadd_ps(g, scale_g, bias_g));
+        _mm256_storeu_ps(a.b + x, _mm256_fmadd_ps(b, scale_b, bias_b));
+    }
+    return x;
+}
+#endif
+
+#if VLM_HAVE_NEON_KERNELS
+// NEON has no gather, so the 4 lanes are loaded with scalar reads and the
+// interpolation, colour conversion and normalization run vectorized.
+inline float32x4_t SampleNeon(const uint8_t *row0, const uint8_t *row1, const int32_t *lo, const int32_t *hi,
+                              float32x4_t fx, float32x4_t fy) {
+    const float a0_lanes[4] = {row0[lo[0]], row0[lo[1]], row0[lo[2]], row0[lo[3]]};
+    const float a1_lanes[4] = {row0[hi[0]], row0[hi[1]], row0[hi[2]], row0[hi[3]]};
+    const float b0_lanes[4] = {row1[lo[0]], row1[lo[1]], row1[lo[2]], row1[lo[3]]};
+    const float b1_lanes[4] = {row1[hi[0]], row1[hi[1]], row1[hi[2]], row1[hi[3]]};
+    const float32x4_t a0 = vld1q_f32(a0_lanes);
+    const float32x4_t b0 = vld1q_f32(b0_lanes);
+    const float32x4_t top = vmlaq_f32(a0, vsubq_f32(vld1q_f32(a1_lanes), a0), fx);
+    const float32x4_t bottom = vmlaq_f32(b0, vsubq_f32(vld1q_f32(b1_lanes), b0), fx);
+    return vmlaq_f32(top, vsubq_f32(bottom, top), fy);
+}
+
+int ConvertRowNeon(const RowArgs &a, int end) {
+    const float32x4_t fy = vdupq_n_f32(a.fy);
+    const float32x4_t fcy = vdupq_n_f32(a.fcy);
+    const float32x4_t c128 = vdupq_n_f32(128.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t c255 = vdupq_n_f32(255.0f);
+    int x = 0;
+    for (; x + 4 <= end; x += 4) {
+        const float32x4_t lfx = vld1q_f32(a.lx_frac + x);
+        const float32x4_t cfx = vld1q_f32(a.cx_frac + x);
+        const float32x4_t y = SampleNeon(a.y0, a.y1, a.lx_lo + x, a.lx_hi + x, lfx, fy);
+        const float32x4_t u = vsubq_f32(SampleNeon(a.u0, a.u1, a.cx_lo + x, a.cx_hi + x, cfx, fcy), c128);
+        const float32x4_t v = vsubq_f32(SampleNeon(a.v0, a.v1, a.cx_lo + x, a.cx_hi + x, cfx, fcy), c128);
+        float32x4_t r = vmlaq_n_f32(y, v, kRFromV);
+        float32x4_t g = vmlaq_n_f32(vmlaq_n_f32(y, u, kGFromU), v, kGFromV);
+        float32x4_t b = vmlaq_n_f32(y, u, kBFromU);
+        r = vminq_f32(vmaxq_f32(r, zero), c255);
+        g = vminq_f32(vmaxq_f32(g, zero), c255);
+        b = vminq_f32(vmaxq_f32(b, zero), c255);
+        vst1q_f32(a.r + x, vmlaq_n_f32(vdupq_n_f32(a.bias[0]), r, a.scale[0]));
+        vst1q_f32(a.g + x, vmlaq_n_f32(vdupq_n_f32(a.bias[1]), g, a.scale[1]));
+        vst1q_f32(a.b + x, vmlaq_n_f32(vdupq_n_f32(a.bias[2]), b, a.scale[2]));
+    }
+    return x;
+}
+#endif
+
+// Pixel-center aligned bilinear taps for |dst| samples over |src| samples
+// spaced |step| bytes apart. |ratio| is the source pixels per output pixel
+// measured on the luma grid, so chroma taps land on the matching positions.
+void ComputeTaps(int src, int dst, float ratio, float grid_scale, int step, std::vector<int32_t> *lo,
+                 std::vector<int32_t> *hi, std::vector<float> *frac) {
+    lo->resize(dst);
+    hi->resize(dst);
+    frac->resize(dst);
+    for (int i = 0; i < dst; ++i) {
+        float pos = (static_cast<float>(i) + 0.5f) * ratio * grid_scale - 0.5f;
+        pos = std::max(pos, 0.0f);
+        const int l = std::min(static_cast<int>(pos), src - 1);
+        (*lo)[i] = l * step;
+        (*hi)[i] = std::min(l + 1, src - 1) * step;
+        (*frac)[i] = pos - static_cast<float>(l);
+    }
+}
+
+}  // namespace
+
+void YuvPreprocessor::Prepare(const YuvImage &image, const PreprocessConfig &config) {
+    if (image.width == src_width_ && image.height == src_height_ && config.width == dst_width_ &&
+        config.height == dst_height_ && image.uv_pixel_stride == uv_pixel_stride_) {
+        return;
+    }
+    src_width_ = image.width;
+    src_height_ = image.height;
+    dst_width_ = config.width;
+    dst_height_ = config.height;
+    uv_pixel_stride_ = image.uv_pixel_stride;
+
+    const float ratio_x = static_cast<float>(src_width_) / static_cast<float>(dst_width_);
+    const float ratio_y = static_cast<float>(src_height_) / static_cast<float>(dst_height_);
+    const int chroma_w = (src_width_ + 1) / 2;
+    const int chroma_h = (src_height_ + 1) / 2;
+    ComputeTaps(src_width_, dst_width_, ratio_x, 1.0f, 1, &luma_x_.lo, &luma_x_.hi, &luma_x_.frac);
+    ComputeTaps(src_height_, dst_height_, ratio_y, 1.0f, 1, &luma_y_.lo, &luma_y_.hi, &luma_y_.frac);
+    ComputeTaps(chroma_w, dst_width_, ratio_x, 0.5f, uv_pixel_stride_, &chroma_x_.lo, &chroma_x_.hi,
+                &chroma_x_.frac);
+    ComputeTaps(chroma_h, dst_height_, ratio_y, 0.5f, 1, &chroma_y_.lo, &chroma_y_.hi, &chroma_y_.frac);
+}
+
+void YuvPreprocessor::Run(const YuvImage &image, const PreprocessConfig &config, float *out, SimdLevel level) {
+    Prepare(image, config);
+
+    float scale[3];
+    float bias[3];
+    for (int c = 0; c < 3; ++c) {
+        scale[c] = 1.0f / (255.0f * config.std[c]);
+        bias[c] = -config.mean[c] / config.std[c];
+    }
+
+    const size_t plane = static_cast<size_t>(dst_width_) * dst_height_;
+    // The AVX2 gathers read 4 bytes at the furthest horizontal tap; rows too
+    // close to the end of their plane fall back to the scalar kernel.
+    const size_t luma_reach = static_cast<size_t>(luma_x_.hi.back()) + 4;
+    const size_t chroma_reach = static_cast<size_t>(chroma_x_.hi.back()) + 4;
+
+    RowArgs args;
+    args.lx_lo = luma_x_.lo.data();
+    args.lx_hi = luma_x_.hi.data();
+    args.lx_frac = luma_x_.frac.data();
+    args.cx_lo = chroma_x_.lo.data();
+    args.cx_hi = chroma_x_.hi.data();
+    args.cx_frac = chroma_x_.frac.data();
+    args.scale = scale;
+    args.bias = bias;
+
+    for (int y = 0; y < dst_height_; ++y) {
+        const size_t y0 = static_cast<size_t>(luma_y_.lo[y]) * image.y_stride;
+        const size_t y1 = static_cast<size_t>(luma_y_.hi[y]) * image.y_stride;
+        const size_t c0 = static_cast<size_t>(chroma_y_.lo[y]) * image.uv_stride;
+        const size_t c1 = static_cast<size_t>(chroma_y_.hi[y]) * image.uv_stride;
+        args.y0 = image.y + y0;
+        args.y1 = image.y + y1;
+        args.u0 = image.u + c0;
+        args.u1 = image.u + c1;
+        args.v0 = image.v + c0;
+        args.v1 = image.v + c1;
+        args.fy = luma_y_.frac[y];
+        args.fcy = chroma_y_.frac[y];
+        args.r = out + static_cast<size_t>(y) * dst_width_;
+        args.g = args.r + plane;
+        args.b = args.g + plane;
+
+        int done = 0;
+#if VLM_HAVE_AVX2_KERNELS
+        if (level == SimdLevel::kAvx2 && y1 + luma_reach <= image.y_size && c1 + chroma_reach <= image.u_size &&
+            c1 + chroma_reach <= image.v_size) {
+            done = ConvertRowAvx2(args, dst_width_);
+        }
+#endif
+#if VLM_HAVE_NEON_KERNELS
+        if (level == SimdLevel::kNeon) {
+            done = ConvertRowNeon(args, dst_width_);
+        }
+#endif
+        ConvertRowScalar(args, done, dst_width_);
+    }
+}
+
+}  // namespace vlm
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+#include "image_preprocess.h"
+
+namespace vlm {
+
+// View of a YUV_420_888 image: full resolution Y plane and 2x2 subsampled
+// U/V planes. |uv_pixel_stride| is 1 for planar (I420) and 2 for
+// semi-planar (NV12/NV21) layouts. The *_size fields are the number of
+// readable bytes starting at each plane pointer.
+struct YuvImage {
+    int width = 0;
+    int height = 0;
+    const uint8_t *y = nullptr;
+    const uint8_t *u = nullptr;
+    const uint8_t *v = nullptr;
+    int y_stride = 0;
+    int uv_stride = 0;
+    int uv_pixel_stride = 1;
+    size_t y_size = 0;
+    size_t u_size = 0;
+    size_t v_size = 0;
+};
+
+// Converts camera YUV straight into the encoder's normalized planar float
+// tensor in one pass: bilinear resize, full-range BT.601 YUV -> RGB, clamp
+// and mean/std normalization are fused per output pixel, so no intermediate
+// RGB image is ever materialized. Resize taps are cached between calls with
+// the same geometry.
+class YuvPreprocessor {
+public:
+    // |out| must hold 3 * config.width * config.height floats.
+    void Run(const YuvImage &image, const PreprocessConfig &config, float *out) {
+        Run(image, config, out, DetectSimdLevel());
+    }
+
+    // Same, with an explicit kernel; SimdLevel::kScalar is the reference.
+    void Run(const YuvImage &image, const PreprocessConfig &config, float *out, SimdLevel level);
+
+private:
+    struct Taps {
+        std::vector<int32_t> lo;  // byte offsets of the left/top sample
+        std::vector<int32_t> hi;  // byte offsets of the right/bottom sample
+        std::vector<float> frac;
+    };
+
+    void Prepare(const YuvImage &image, const PreprocessConfig &config);
+
+    int src_width_ = 0;
+    int src_height_ = 0;
+    int dst_width_ = 0;
+    int dst_height_ = 0;
+    int uv_pixel_stride_ = 0;
+    Taps luma_x_;
+    Taps luma_y_;
+    Taps chroma_x_;
+    Taps chroma_y_;
+};
+
+}  // namespace vlm